@@ -0,0 +1,215 @@
+#include "AudioRecorder.hpp"
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "ThreadPolicy.hpp"
+
+namespace {
+
+constexpr size_t kBatchSize = 64;
+
+// RIFF + JUNK (room for a ds64 chunk) + fmt + data chunk header
+constexpr size_t kHeaderSize = 12 + 36 + 24 + 8;
+
+void put16(uint8_t*& p, uint16_t v) {
+    *p++ = v & 0xFF;
+    *p++ = v >> 8;
+}
+
+void put32(uint8_t*& p, uint32_t v) {
+    for(int i = 0; i < 4; i++) *p++ = (v >> (8 * i)) & 0xFF;
+}
+
+void put64(uint8_t*& p, uint64_t v) {
+    for(int i = 0; i < 8; i++) *p++ = (v >> (8 * i)) & 0xFF;
+}
+
+uint16_t get16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t get32(const uint8_t* p) {
+    return get16(p) | (uint32_t(get16(p + 2)) << 16);
+}
+
+void putTag(uint8_t*& p, const char* tag) {
+    std::memcpy(p, tag, 4);
+    p += 4;
+}
+
+// WAV header for `dataBytes` of PCM; uses the RF64 layout when 32-bit sizes overflow
+void buildHeader(uint8_t* header, int sampleRate, int channels, int sampleBytes, uint64_t dataBytes) {
+    uint64_t riffBytes = kHeaderSize - 8 + dataBytes;
+    bool rf64 = riffBytes > 0xFFFFFFFFull;
+    uint32_t blockAlign = channels * sampleBytes;
+    uint8_t* p = header;
+
+    putTag(p, rf64 ? "RF64" : "RIFF");
+    put32(p, rf64 ? 0xFFFFFFFF : static_cast<uint32_t>(riffBytes));
+    putTag(p, "WAVE");
+
+    putTag(p, rf64 ? "ds64" : "JUNK");
+    put32(p, 28);
+    put64(p, rf64 ? riffBytes : 0);
+    put64(p, rf64 ? dataBytes : 0);
+    put64(p, rf64 ? dataBytes / blockAlign : 0);
+    put32(p, 0);  // no extra table entries
+
+    putTag(p, "fmt ");
+    put32(p, 16);
+    put16(p, 1);  // PCM
+    put16(p, channels);
+    put32(p, sampleRate);
+    put32(p, sampleRate * blockAlign);
+    put16(p, blockAlign);
+    put16(p, sampleBytes * 8);
+
+    putTag(p, "data");
+    put32(p, rf64 ? 0xFFFFFFFF : static_cast<uint32_t>(dataBytes));
+}
+
+}  // namespace
+
+AudioRecorder::AudioRecorder(size_t queueCapacity, const RecordingOptions& options) : _options(options), _queue(queueCapacity, MailboxPolicy::Block) {}
+
+AudioRecorder::~AudioRecorder() {
+    stop();
+}
+
+int AudioRecorder::addTrack(const std::string& path, int sampleRate, int channels, int sampleBytes) {
+    if(_running) return -1;
+    // Sizes are filled in at every checkpoint and on close
+    std::vector<uint8_t> header(kHeaderSize);
+    buildHeader(header.data(), sampleRate, channels, sampleBytes, 0);
+    Track track;
+    track.path = path;
+    // Segments end on whole sample frames, so each one is a playable file
+    RecordingOptions options = _options;
+    uint64_t blockAlign = uint64_t(channels) * sampleBytes;
+    if(options.segmentBytes && blockAlign) options.segmentBytes = std::max(options.segmentBytes / blockAlign, uint64_t(1)) * blockAlign;
+    track.file.reset(new SegmentedFile(path, "wav", options, std::move(header), &AudioRecorder::updateWavHeader));
+    if(!track.file->open()) return -1;
+    _tracks.push_back(std::move(track));
+    return static_cast<int>(_tracks.size() - 1);
+}
+
+void AudioRecorder::start() {
+    if(_running.exchange(true)) return;
+    _writer = std::thread(&AudioRecorder::writerLoop, this);
+}
+
+void AudioRecorder::stop() {
+    if(_running.exchange(false)) {
+        _queue.close();
+        _writer.join();
+    }
+    for(auto& track : _tracks) finalize(track);
+}
+
+bool AudioRecorder::push(int track, AudioChunk chunk) {
+    if(!_running.load(std::memory_order_relaxed) || track < 0 || track >= static_cast<int>(_tracks.size())) return false;
+    Item item;
+    item.track = track;
+    item.chunk = std::move(chunk);
+    return _queue.push(std::move(item));
+}
+
+void AudioRecorder::writerLoop() {
+    ThreadPolicy::global().enter(ThreadRole::Audio, "audio-writer");
+    std::vector<Item> batch;
+    batch.reserve(kBatchSize);
+    while(true) {
+        Item item;
+        if(!_queue.waitPop(item, std::chrono::milliseconds(100))) {
+            if(!_running && _queue.size() == 0) break;
+        } else {
+            batch.push_back(std::move(item));
+            while(batch.size() < kBatchSize && _queue.tryPop(item)) batch.push_back(std::move(item));
+            writeBatch(batch);
+            batch.clear();
+        }
+        // Between batches, so a checkpoint only delays packets that are queued anyway
+        for(auto& track : _tracks) track.file->poll();
+    }
+}
+
+void AudioRecorder::writeBatch(std::vector<Item>& batch) {
+    // Group per track, keeping arrival order within each track
+    std::stable_sort(batch.begin(), batch.end(), [](const Item& a, const Item& b) { return a.track < b.track; });
+    size_t begin = 0;
+    while(begin < batch.size()) {
+        size_t end = begin;
+        while(end < batch.size() && batch[end].track == batch[begin].track) end++;
+        writeTrack(_tracks[batch[begin].track], &batch[begin], end - begin);
+        begin = end;
+    }
+}
+
+void AudioRecorder::writeTrack(Track& track, const Item* items, size_t count) {
+    std::vector<iovec> iov;
+    iov.reserve(count);
+    for(size_t i = 0; i < count; i++) {
+        if(items[i].chunk.size == 0) continue;
+        iov.push_back({const_cast<uint8_t*>(items[i].chunk.data), items[i].chunk.size});
+    }
+    if(!iov.empty()) track.file->write(iov.data(), iov.size());
+    _chunksWritten += count;
+}
+
+void AudioRecorder::finalize(Track& track) {
+    track.file->close();
+}
+
+void AudioRecorder::updateWavHeader(std::vector<uint8_t>& header, uint64_t dataBytes) {
+    if(header.size() < kHeaderSize) return;
+    // fmt chunk fields, see buildHeader()
+    int channels = get16(&header[58]);
+    int sampleRate = static_cast<int>(get32(&header[60]));
+    int sampleBytes = get16(&header[70]) / 8;
+    if(channels == 0 || sampleBytes == 0) return;
+    buildHeader(header.data(), sampleRate, channels, sampleBytes, dataBytes);
+}
+
+AudioRecorderStats AudioRecorder::getStats() const {
+    AudioRecorderStats stats;
+    auto queueStats = _queue.getStats();
+    stats.chunksWritten = _chunksWritten.load();
+    stats.queueDepth = queueStats.occupancy;
+    stats.maxQueueDepth = queueStats.maxOccupancy;
+    LatencyHistogram writes;
+    for(const auto& track : _tracks) {
+        auto file = track.file->getStats();
+        stats.bytesWritten += file.bytes;
+        stats.writeErrors += file.errors;
+        stats.maxWriteStallUs = std::max(stats.maxWriteStallUs, file.maxWriteNs / 1000);
+        stats.segments += file.segments;
+        stats.checkpoints += file.checkpoints;
+        stats.maxCheckpointUs = std::max(stats.maxCheckpointUs, file.maxCheckpointNs / 1000);
+        writes.merge(file.writeLatency);
+    }
+    stats.p99WriteUs = writes.percentile(0.99) / 1000;
+    stats.p999WriteUs = writes.percentile(0.999) / 1000;
+    return stats;
+}
+
+void AudioRecorder::printStats() const {
+    auto stats = getStats();
+    printf("Audio recorder: %.2f MB in %lu chunks, queue depth %zu (max %zu), write p99 %.3f ms, p99.9 %.3f ms, max %.3f ms; "
+           "%lu segments, %lu checkpoints (max %.3f ms), %lu errors\n",
+           stats.bytesWritten / 1048576.0,
+           (unsigned long)stats.chunksWritten,
+           stats.queueDepth,
+           stats.maxQueueDepth,
+           stats.p99WriteUs / 1000.0,
+           stats.p999WriteUs / 1000.0,
+           stats.maxWriteStallUs / 1000.0,
+           (unsigned long)stats.segments,
+           (unsigned long)stats.checkpoints,
+           stats.maxCheckpointUs / 1000.0,
+           (unsigned long)stats.writeErrors);
+}
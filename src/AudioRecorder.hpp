@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameMailbox.hpp"
+#include "SegmentedFile.hpp"
+
+// Audio payload handed to the recorder without copying; `owner` keeps the packet alive
+// until the writer thread has written it
+struct AudioChunk {
+    std::shared_ptr<void> owner;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+struct AudioRecorderStats {
+    uint64_t bytesWritten = 0;
+    uint64_t chunksWritten = 0;
+    uint64_t writeErrors = 0;
+    size_t queueDepth = 0;
+    size_t maxQueueDepth = 0;
+    uint64_t maxWriteStallUs = 0;  // longest single track write
+    uint64_t p99WriteUs = 0;       // per track write, all tracks
+    uint64_t p999WriteUs = 0;
+    uint64_t segments = 0;
+    uint64_t checkpoints = 0;
+    uint64_t maxCheckpointUs = 0;
+};
+
+// Writes audio streams to WAV files from a dedicated thread.
+//
+// push() only enqueues the chunk on a lock-free mailbox, so a slow disk never stalls the
+// caller unless `queueCapacity` chunks are already waiting. The writer drains the queue in
+// batches and writes each track with one vectored write per batch through a SegmentedFile, which
+// preallocates ahead of the write position, checkpoints the data, header and index every
+// `options.checkpointMs` and, with segment limits, splits a track into complete WAV files that
+// rec-join puts back together. Headers are WAV, promoted to RF64 if a track outgrew 4 GB.
+class AudioRecorder {
+   public:
+    explicit AudioRecorder(size_t queueCapacity = 512, const RecordingOptions& options = RecordingOptions());
+    ~AudioRecorder();
+
+    AudioRecorder(const AudioRecorder&) = delete;
+    AudioRecorder& operator=(const AudioRecorder&) = delete;
+
+    // Opens a WAV file for one stream; returns the track id or -1 on error.
+    // Must be called before start().
+    int addTrack(const std::string& path, int sampleRate, int channels, int sampleBytes);
+
+    void start();
+    // Flushes everything queued, finalizes the headers and closes the files
+    void stop();
+
+    // Returns false if the recorder is stopped or the track is invalid
+    bool push(int track, AudioChunk chunk);
+
+    AudioRecorderStats getStats() const;
+    void printStats() const;
+
+    // Rewrites the sizes of a header this recorder wrote for `dataBytes` of PCM
+    static void updateWavHeader(std::vector<uint8_t>& header, uint64_t dataBytes);
+
+   private:
+    struct Track {
+        std::string path;
+        std::unique_ptr<SegmentedFile> file;
+    };
+    struct Item {
+        int track = -1;
+        AudioChunk chunk;
+    };
+
+    void writerLoop();
+    void writeBatch(std::vector<Item>& batch);
+    void writeTrack(Track& track, const Item* items, size_t count);
+    void finalize(Track& track);
+
+    const RecordingOptions _options;
+    std::vector<Track> _tracks;
+    FrameMailbox<Item> _queue;
+    std::thread _writer;
+    std::atomic<bool> _running{false};
+
+    std::atomic<uint64_t> _chunksWritten{0};
+};
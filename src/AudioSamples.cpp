@@ -0,0 +1,131 @@
+#include "AudioSamples.hpp"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define AUDIO_SAMPLES_X86 1
+    #include <immintrin.h>
+#endif
+
+namespace {
+
+constexpr float kInt32Scale = 1.0f / 2147483648.0f;
+
+#ifdef AUDIO_SAMPLES_X86
+
+bool haveSse41() {
+    static const bool have = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse4.1") != 0;
+    }();
+    return have;
+}
+
+// 8 samples of s16 -> 2x4 left-justified int32
+__attribute__((target("sse4.1"))) inline void s16x8(const uint8_t* src, __m128i& lo, __m128i& hi) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+    lo = _mm_slli_epi32(_mm_cvtepi16_epi32(v), 16);
+    hi = _mm_slli_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(v, 8)), 16);
+}
+
+// 4 samples of packed s24 from the low 12 of 16 loaded bytes -> left-justified int32
+__attribute__((target("sse4.1"))) inline __m128i s24x4(const uint8_t* src) {
+    const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), shuffle);
+}
+
+__attribute__((target("sse4.1"))) size_t s16ToInt32Sse(const uint8_t* src, int32_t* dst, size_t count) {
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m128i lo, hi;
+        s16x8(src + 2 * i, lo, hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), hi);
+    }
+    return i;
+}
+
+__attribute__((target("sse4.1"))) size_t s16ToFloatSse(const uint8_t* src, float* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(kInt32Scale);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m128i lo, hi;
+        s16x8(src + 2 * i, lo, hi);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    return i;
+}
+
+// The 16-byte loads read 4 bytes past the 12 consumed, so stop while that stays in bounds
+__attribute__((target("sse4.1"))) size_t s24ToInt32Sse(const uint8_t* src, int32_t* dst, size_t count) {
+    size_t i = 0;
+    for(; 3 * i + 16 <= 3 * count; i += 4) _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), s24x4(src + 3 * i));
+    return i;
+}
+
+__attribute__((target("sse4.1"))) size_t s24ToFloatSse(const uint8_t* src, float* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(kInt32Scale);
+    size_t i = 0;
+    for(; 3 * i + 16 <= 3 * count; i += 4) _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(s24x4(src + 3 * i)), scale));
+    return i;
+}
+
+__attribute__((target("sse4.1"))) size_t s32ToFloatSse(const uint8_t* src, float* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(kInt32Scale);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 4 * i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    return i;
+}
+
+#endif  // AUDIO_SAMPLES_X86
+
+}  // namespace
+
+void convertS16ToInt32(const uint8_t* src, int32_t* dst, size_t count) {
+    size_t i = 0;
+#ifdef AUDIO_SAMPLES_X86
+    if(haveSse41()) i = s16ToInt32Sse(src, dst, count);
+#endif
+    for(; i < count; i++) dst[i] = SampleCodec<2>::sample(src + 2 * i);
+}
+
+void convertS24ToInt32(const uint8_t* src, int32_t* dst, size_t count) {
+    size_t i = 0;
+#ifdef AUDIO_SAMPLES_X86
+    if(haveSse41()) i = s24ToInt32Sse(src, dst, count);
+#endif
+    for(; i < count; i++) dst[i] = SampleCodec<3>::sample(src + 3 * i);
+}
+
+void convertS32ToInt32(const uint8_t* src, int32_t* dst, size_t count) {
+    // Already the target layout on little-endian hosts
+    std::memcpy(dst, src, count * sizeof(int32_t));
+}
+
+void convertS16ToFloat(const uint8_t* src, float* dst, size_t count) {
+    size_t i = 0;
+#ifdef AUDIO_SAMPLES_X86
+    if(haveSse41()) i = s16ToFloatSse(src, dst, count);
+#endif
+    for(; i < count; i++) dst[i] = SampleCodec<2>::sample(src + 2 * i) * kInt32Scale;
+}
+
+void convertS24ToFloat(const uint8_t* src, float* dst, size_t count) {
+    size_t i = 0;
+#ifdef AUDIO_SAMPLES_X86
+    if(haveSse41()) i = s24ToFloatSse(src, dst, count);
+#endif
+    for(; i < count; i++) dst[i] = SampleCodec<3>::sample(src + 3 * i) * kInt32Scale;
+}
+
+void convertS32ToFloat(const uint8_t* src, float* dst, size_t count) {
+    size_t i = 0;
+#ifdef AUDIO_SAMPLES_X86
+    if(haveSse41()) i = s32ToFloatSse(src, dst, count);
+#endif
+    for(; i < count; i++) dst[i] = SampleCodec<4>::sample(src + 4 * i) * kInt32Scale;
+}
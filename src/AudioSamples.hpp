@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversion of packed little-endian PCM (as sent by AudioMic over XLink) to int32 / float.
+//
+// int32 output is left-justified: every sample size maps to the full int32 range, so a 16-bit
+// 0x7FFF and a 24-bit 0x7FFFFF both become 0x7FFF0000-ish values. Float output is in [-1, 1], 1
+// only for a full-scale 32-bit sample, which float rounds up.
+// SSE4.1 kernels are used when the CPU supports them, with scalar fallbacks elsewhere.
+
+void convertS16ToInt32(const uint8_t* src, int32_t* dst, size_t count);
+void convertS24ToInt32(const uint8_t* src, int32_t* dst, size_t count);
+void convertS32ToInt32(const uint8_t* src, int32_t* dst, size_t count);
+
+void convertS16ToFloat(const uint8_t* src, float* dst, size_t count);
+void convertS24ToFloat(const uint8_t* src, float* dst, size_t count);
+void convertS32ToFloat(const uint8_t* src, float* dst, size_t count);
+
+// Compile-time selection of the kernels for a sample size
+template <int SampleBytes>
+struct SampleCodec;
+
+template <>
+struct SampleCodec<2> {
+    static void toInt32(const uint8_t* src, int32_t* dst, size_t count) {
+        convertS16ToInt32(src, dst, count);
+    }
+    static void toFloat(const uint8_t* src, float* dst, size_t count) {
+        convertS16ToFloat(src, dst, count);
+    }
+    static int32_t sample(const uint8_t* p) {
+        return static_cast<int32_t>(static_cast<uint32_t>(p[0]) << 16 | static_cast<uint32_t>(p[1]) << 24);
+    }
+};
+
+template <>
+struct SampleCodec<3> {
+    static void toInt32(const uint8_t* src, int32_t* dst, size_t count) {
+        convertS24ToInt32(src, dst, count);
+    }
+    static void toFloat(const uint8_t* src, float* dst, size_t count) {
+        convertS24ToFloat(src, dst, count);
+    }
+    static int32_t sample(const uint8_t* p) {
+        return static_cast<int32_t>(static_cast<uint32_t>(p[0]) << 8 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 24);
+    }
+};
+
+template <>
+struct SampleCodec<4> {
+    static void toInt32(const uint8_t* src, int32_t* dst, size_t count) {
+        convertS32ToInt32(src, dst, count);
+    }
+    static void toFloat(const uint8_t* src, float* dst, size_t count) {
+        convertS32ToFloat(src, dst, count);
+    }
+    static int32_t sample(const uint8_t* p) {
+        return static_cast<int32_t>(static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 | static_cast<uint32_t>(p[2]) << 16
+                                    | static_cast<uint32_t>(p[3]) << 24);
+    }
+};
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "AudioSamples.hpp"
+
+// Non-owning view over the interleaved samples of one audio packet
+template <int SampleBytes, int Channels>
+class AudioSpan {
+   public:
+    static constexpr int sampleBytes = SampleBytes;
+    static constexpr int channels = Channels;
+    static constexpr int frameBytes = SampleBytes * Channels;
+
+    AudioSpan(const uint8_t* data, size_t frames) : _data(data), _frames(frames) {}
+
+    const uint8_t* data() const {
+        return _data;
+    }
+    size_t frames() const {
+        return _frames;
+    }
+    size_t samples() const {
+        return _frames * Channels;
+    }
+    size_t bytes() const {
+        return _frames * frameBytes;
+    }
+
+    // Left-justified int32, see AudioSamples.hpp
+    int32_t sample(size_t frame, int channel) const {
+        return SampleCodec<SampleBytes>::sample(_data + frame * frameBytes + channel * SampleBytes);
+    }
+
+    // `dst` must hold samples() values
+    void toInt32(int32_t* dst) const {
+        SampleCodec<SampleBytes>::toInt32(_data, dst, samples());
+    }
+    void toFloat(float* dst) const {
+        SampleCodec<SampleBytes>::toFloat(_data, dst, samples());
+    }
+
+   private:
+    const uint8_t* _data;
+    size_t _frames;
+};
+
+// Per-packet entry point for one audio stream, independent of the sample format.
+//
+// `Packet` is an ImgFrame-like message: getHeight() samples of getWidth() channels, with the
+// payload at `packet->data` (the zero-copy XLink buffer). `packet->length` only bounds the
+// payload, since for depthai messages it also covers the metadata; setPayloadBytes() gives the
+// exact size. Packets whose samples don't fit in it are rejected. The sample size and channel
+// count are fixed when the tap is created, so nothing in process() branches on the format.
+template <typename Packet>
+class AudioTapBase {
+   public:
+    using RawSink = std::function<void(const std::shared_ptr<Packet>& packet, const uint8_t* data, size_t bytes)>;
+    using FloatSink = std::function<void(const std::shared_ptr<Packet>& packet, const float* samples, size_t frames, int channels)>;
+    using PayloadBytes = std::function<size_t(const Packet& packet)>;
+
+    virtual ~AudioTapBase() = default;
+
+    // Returns false (and counts it) if the packet shape doesn't match the tap
+    virtual bool process(const std::shared_ptr<Packet>& packet) = 0;
+
+    virtual int sampleBytes() const = 0;
+    virtual int channels() const = 0;
+
+    // Raw payload bytes, e.g. for recording
+    void addRawSink(RawSink sink) {
+        _rawSinks.push_back(std::move(sink));
+    }
+    // Samples converted to interleaved float; the conversion runs once per packet for all float sinks
+    void addFloatSink(FloatSink sink) {
+        _floatSinks.push_back(std::move(sink));
+    }
+    // Payload size of a packet, e.g. payloadSize() from CaptureDai.hpp; default `packet->length`
+    void setPayloadBytes(PayloadBytes payloadBytes) {
+        _payloadBytes = std::move(payloadBytes);
+    }
+
+    uint64_t packets() const {
+        return _packets.load(std::memory_order_relaxed);
+    }
+    uint64_t rejected() const {
+        return _rejected.load(std::memory_order_relaxed);
+    }
+
+   protected:
+    size_t payloadBytes(const Packet& packet) const {
+        return _payloadBytes ? _payloadBytes(packet) : packet.packet->length;
+    }
+
+    PayloadBytes _payloadBytes;
+    std::vector<RawSink> _rawSinks;
+    std::vector<FloatSink> _floatSinks;
+    std::vector<float> _floatBuffer;
+    std::atomic<uint64_t> _packets{0};
+    std::atomic<uint64_t> _rejected{0};
+};
+
+template <int SampleBytes, int Channels, typename Packet>
+class AudioTap : public AudioTapBase<Packet> {
+   public:
+    using Span = AudioSpan<SampleBytes, Channels>;
+    using Sink = std::function<void(const std::shared_ptr<Packet>& packet, Span span)>;
+
+    // Typed sinks get the span directly and can use its specialized conversions
+    void addSink(Sink sink) {
+        _sinks.push_back(std::move(sink));
+    }
+
+    bool process(const std::shared_ptr<Packet>& packet) override {
+        if(!packet || !packet->packet || packet->getWidth() != Channels || packet->getHeight() <= 0) {
+            this->_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        Span span(packet->packet->data, static_cast<size_t>(packet->getHeight()));
+        // A short or malformed packet would be read past its payload
+        if(span.bytes() > this->payloadBytes(*packet)) {
+            this->_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        this->_packets.fetch_add(1, std::memory_order_relaxed);
+        for(auto& sink : _sinks) sink(packet, span);
+        for(auto& sink : this->_rawSinks) sink(packet, span.data(), span.bytes());
+        if(!this->_floatSinks.empty()) {
+            this->_floatBuffer.resize(span.samples());
+            span.toFloat(this->_floatBuffer.data());
+            for(auto& sink : this->_floatSinks) sink(packet, this->_floatBuffer.data(), span.frames(), Channels);
+        }
+        return true;
+    }
+
+    int sampleBytes() const override {
+        return SampleBytes;
+    }
+    int channels() const override {
+        return Channels;
+    }
+
+   private:
+    std::vector<Sink> _sinks;
+};
+
+// Picks the specialization once, when the stream is set up; nullptr for unsupported formats
+template <typename Packet>
+std::unique_ptr<AudioTapBase<Packet>> makeAudioTap(int sampleBytes, int channels) {
+    std::unique_ptr<AudioTapBase<Packet>> tap;
+    switch(sampleBytes * 10 + channels) {
+        case 21:
+            tap.reset(new AudioTap<2, 1, Packet>());
+            break;
+        case 22:
+            tap.reset(new AudioTap<2, 2, Packet>());
+            break;
+        case 31:
+            tap.reset(new AudioTap<3, 1, Packet>());
+            break;
+        case 32:
+            tap.reset(new AudioTap<3, 2, Packet>());
+            break;
+        case 41:
+            tap.reset(new AudioTap<4, 1, Packet>());
+            break;
+        case 42:
+            tap.reset(new AudioTap<4, 2, Packet>());
+            break;
+        default:
+            break;
+    }
+    return tap;
+}
@@ -0,0 +1,130 @@
+#include "AudioTimeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+// Shared source of silence, written out in pieces of at most this size
+constexpr size_t kZeroBytes = 64 << 10;
+const uint8_t* zeros() {
+    static const std::vector<uint8_t> block(kZeroBytes, 0);
+    return block.data();
+}
+
+}  // namespace
+
+AudioTimeline::AudioTimeline(int sampleRate, int frameBytes, size_t depth, Output output)
+    : _sampleRate(sampleRate), _frameBytes(frameBytes), _output(std::move(output)), _slots(std::max<size_t>(depth, 1)) {
+    _stats.sampleRate = sampleRate;
+}
+
+void AudioTimeline::push(int64_t sequence, int64_t deviceTimestampNs, size_t frames, AudioChunk chunk) {
+    const int64_t depth = static_cast<int64_t>(_slots.size());
+    _stats.packets++;
+    if(_next >= 0 && sequence + 4 * depth < _next) {
+        // Far behind what was played out: the stream restarted on the device
+        flush();
+        _next = -1;
+        _highest = -1;
+    }
+    if(_next < 0) _next = sequence;
+    if(sequence < _next) {
+        _stats.late++;
+        return;
+    }
+    Slot& existing = _slots[sequence % depth];
+    if(existing.used && existing.sequence == sequence) {
+        _stats.duplicates++;
+        return;
+    }
+    if(sequence < _highest) _stats.reordered++;
+    _highest = std::max(_highest, sequence);
+
+    // Give up on whatever is more than `depth` packets overdue. Held packets all lie within
+    // `depth` of _next, so a longer jump skips the rest without visiting it.
+    int64_t keepFrom = sequence - depth + 1;
+    if(_next < keepFrom) {
+        int64_t scanTo = std::min(keepFrom, _next + depth);
+        while(_next < scanTo) emitNext();
+        _missing += keepFrom - _next;
+        _next = keepFrom;
+    }
+
+    Slot& slot = _slots[sequence % depth];
+    slot.used = true;
+    slot.sequence = sequence;
+    slot.timestampNs = deviceTimestampNs;
+    slot.frames = frames;
+    slot.chunk = std::move(chunk);
+
+    while(_slots[_next % depth].used && _slots[_next % depth].sequence == _next) emitNext();
+}
+
+void AudioTimeline::flush() {
+    if(_next < 0) return;
+    while(_next <= _highest) emitNext();
+    // Missing packets at the very end have nothing after them to place; no silence for those
+    _missing = 0;
+}
+
+void AudioTimeline::emitNext() {
+    Slot& slot = _slots[_next % static_cast<int64_t>(_slots.size())];
+    if(slot.used && slot.sequence == _next) {
+        emitPacket(slot);
+    } else {
+        _missing++;
+    }
+    _next++;
+}
+
+void AudioTimeline::emitPacket(Slot& slot) {
+    if(_missing > 0) {
+        // Silence as long as the device clock says the missing packets were, unless the
+        // timestamps disagree with their count by more than 2x
+        uint64_t expected = uint64_t(_missing) * _lastFrames;
+        uint64_t frames = expected;
+        if(_stats.endTimestampNs >= 0 && slot.timestampNs > _stats.endTimestampNs) {
+            uint64_t fromClock = static_cast<uint64_t>(std::llround((slot.timestampNs - _stats.endTimestampNs) * 1e-9 * _sampleRate));
+            if(expected == 0 || (fromClock * 2 >= expected && fromClock <= expected * 2)) frames = fromClock;
+        }
+        _stats.gaps++;
+        emitSilence(frames);
+        _missing = 0;
+    }
+    if(_stats.firstTimestampNs < 0) _stats.firstTimestampNs = slot.timestampNs;
+    _stats.endTimestampNs = slot.timestampNs + static_cast<int64_t>(slot.frames * 1e9 / _sampleRate);
+    _stats.frames += slot.frames;
+    _lastFrames = slot.frames;
+    _output(std::move(slot.chunk));
+    slot.chunk = AudioChunk();
+    slot.used = false;
+}
+
+void AudioTimeline::emitSilence(uint64_t frames) {
+    _stats.silenceFrames += frames;
+    _stats.frames += frames;
+    const uint64_t maxFrames = kZeroBytes / _frameBytes;
+    while(frames > 0) {
+        uint64_t n = std::min(frames, maxFrames);
+        AudioChunk chunk;
+        chunk.data = zeros();
+        chunk.size = n * _frameBytes;
+        _output(std::move(chunk));
+        frames -= n;
+    }
+}
+
+void AudioTimeline::printStats(const char* name) const {
+    printf("%s: %lu packets, %lu reordered, %lu late, %lu duplicate; %lu gaps filled with %.1f ms of silence; %.1f s, %+.2f ms vs device clock\n",
+           name,
+           (unsigned long)_stats.packets,
+           (unsigned long)_stats.reordered,
+           (unsigned long)_stats.late,
+           (unsigned long)_stats.duplicates,
+           (unsigned long)_stats.gaps,
+           _stats.silenceFrames * 1e3 / _sampleRate,
+           double(_stats.frames) / _sampleRate,
+           _stats.offsetMs());
+}
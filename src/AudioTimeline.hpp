@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "AudioRecorder.hpp"
+
+struct AudioTimelineStats {
+    uint64_t packets = 0;
+    uint64_t reordered = 0;   // arrived after a later packet, put back in place
+    uint64_t late = 0;        // arrived after their place was already played out, dropped
+    uint64_t duplicates = 0;
+    uint64_t gaps = 0;        // runs of missing packets filled with silence
+    uint64_t silenceFrames = 0;
+    uint64_t frames = 0;      // emitted, audio and silence
+    int64_t firstTimestampNs = -1;
+    int64_t endTimestampNs = -1;  // device time at the end of the last emitted packet
+    int sampleRate = 0;
+
+    // How far the emitted sample count runs ahead of the device clock (negative: behind)
+    double offsetMs() const {
+        if(firstTimestampNs < 0 || sampleRate <= 0) return 0.0;
+        return (double(frames) / sampleRate - (endTimestampNs - firstTimestampNs) / 1e9) * 1e3;
+    }
+};
+
+// Puts the packets of one audio stream back on a continuous timeline before they are written.
+//
+// Packets are ordered by sequence number in a jitter buffer of `depth` slots: a packet that
+// arrives out of order waits for the ones before it, and once a missing packet is `depth`
+// packets overdue it is given up and replaced by silence as long as the device timestamps say
+// it was (falling back to the previous packet's length). A packet arriving after its place was
+// played out is dropped, so the output never goes back in time. Everything emitted is audio or
+// silence in sample order, so the file stays aligned with the device clock however many packets
+// the queues lose. The buffer holds at most `depth` packets and silence comes from one shared
+// block of zeros, so memory stays constant however long the recording runs.
+class AudioTimeline {
+   public:
+    using Output = std::function<void(AudioChunk chunk)>;
+
+    AudioTimeline(int sampleRate, int frameBytes, size_t depth, Output output);
+
+    // `frames` sample frames of `frameBytes` each at chunk.data; timestamp of the first frame
+    void push(int64_t sequence, int64_t deviceTimestampNs, size_t frames, AudioChunk chunk);
+    // Emits everything still held, e.g. at the end of a recording
+    void flush();
+
+    const AudioTimelineStats& stats() const {
+        return _stats;
+    }
+    void printStats(const char* name) const;
+
+    // Drift of `a` against `b` in ms: how much further a's samples have moved away from the
+    // shared device clock than b's. Streams from one clock should stay within a packet.
+    static double driftMs(const AudioTimeline& a, const AudioTimeline& b) {
+        return a._stats.offsetMs() - b._stats.offsetMs();
+    }
+
+   private:
+    struct Slot {
+        bool used = false;
+        int64_t sequence = 0;
+        int64_t timestampNs = 0;
+        size_t frames = 0;
+        AudioChunk chunk;
+    };
+
+    void emitNext();
+    void emitPacket(Slot& slot);
+    void emitSilence(uint64_t frames);
+
+    const int _sampleRate;
+    const int _frameBytes;
+    Output _output;
+    std::vector<Slot> _slots;
+    int64_t _next = -1;       // sequence number to emit next
+    int64_t _highest = -1;    // highest sequence number seen
+    int64_t _missing = 0;     // packets given up on since the last emitted one
+    size_t _lastFrames = 0;   // length of the last emitted packet, for gaps without timestamps
+    AudioTimelineStats _stats;
+};
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "depthai/depthai.hpp"
+#include "CaptureFile.hpp"
+#include "ControlScheduler.hpp"
+#include "DetectionTracker.hpp"
+#include "FrameSink.hpp"
+#include "PipelineCache.hpp"
+#include "RoiController.hpp"
+#include "StreamLoss.hpp"
+#include "VideoMuxer.hpp"
+
+// Recording and sink helpers for depthai messages
+
+// Payload bytes of a zero-copy frame. XLink packets carry the serialized metadata after the
+// payload, followed by its 4-byte type and 4-byte size, and `packet->length` covers all of it.
+inline size_t payloadSize(const dai::ImgFrame& frame) {
+    const uint8_t* data = frame.packet->data;
+    size_t length = frame.packet->length;
+    if(length < 8) return 0;
+    uint32_t metadataSize;
+    std::memcpy(&metadataSize, data + length - 4, sizeof(metadataSize));
+    return metadataSize + 8 <= length ? length - 8 - metadataSize : 0;
+}
+
+inline dai::VideoEncoderProperties::Profile encoderProfile(VideoCodec codec) {
+    switch(codec) {
+        case VideoCodec::H264:
+            return dai::VideoEncoderProperties::Profile::H264_MAIN;
+        case VideoCodec::MJPEG:
+            return dai::VideoEncoderProperties::Profile::MJPEG;
+        default:
+            return dai::VideoEncoderProperties::Profile::H265_MAIN;
+    }
+}
+
+// ImageManip config for a crop from RoiController; NV12 like the pipeline's initial config
+inline dai::ImageManipConfig manipConfig(const Roi& roi) {
+    dai::ImageManipConfig cfg;
+    cfg.setCropRect(roi.x, roi.y, roi.x + roi.width, roi.y + roi.height);
+    cfg.setResize(roi.outWidth, roi.outHeight);
+    cfg.setFrameType(dai::ImgFrame::Type::NV12);
+    return cfg;
+}
+
+// CameraControl message for a scheduled command; fields left unset are not touched
+inline dai::CameraControl cameraControl(const CameraCommand& cmd) {
+    dai::CameraControl ctrl;
+    if(cmd.streaming == CameraCommand::Streaming::Start) ctrl.setStartStreaming();
+    if(cmd.streaming == CameraCommand::Streaming::Stop) ctrl.setStopStreaming();
+    if(cmd.lensPosition >= 0) ctrl.setManualFocus(static_cast<uint8_t>(cmd.lensPosition));
+    if(cmd.autoFocusMode >= 0) ctrl.setAutoFocusMode(static_cast<dai::CameraControl::AutoFocusMode>(cmd.autoFocusMode));
+    if(cmd.autoFocusTrigger) ctrl.setAutoFocusTrigger();
+    if(cmd.exposureUs >= 0) ctrl.setManualExposure(static_cast<uint32_t>(cmd.exposureUs), static_cast<uint32_t>(std::max(cmd.iso, 100)));
+    if(cmd.whiteBalanceK >= 0) ctrl.setManualWhiteBalance(cmd.whiteBalanceK);
+    return ctrl;
+}
+
+// Sends the next scheduled command if the rate limit allows it
+inline bool sendCameraControl(ControlScheduler& scheduler, dai::DataInputQueue& queue) {
+    CameraCommand cmd;
+    if(!scheduler.takeNext(cmd)) return false;
+    queue.send(cameraControl(cmd));
+    return true;
+}
+
+// Camera settings a frame was captured with, to time when sent commands took effect
+inline void trackCameraControl(ControlScheduler& scheduler, const dai::ImgFrame& frame) {
+    scheduler.onFrame(frame.getLensPosition(), static_cast<int>(frame.getExposureTime().count()), frame.getTimestamp());
+}
+
+// Encoded frame (VideoEncoder `bitstream` output) into the muxer, zero-copy
+inline bool muxFrame(VideoMuxer& muxer, const std::shared_ptr<dai::ImgFrame>& frame) {
+    int64_t ts = std::chrono::duration_cast<std::chrono::nanoseconds>(frame->getTimestampDevice().time_since_epoch()).count();
+    return muxer.write(frame, frame->packet->data, payloadSize(*frame), ts);
+}
+
+template <typename Msg>
+inline CaptureInfo captureInfo(const Msg& msg) {
+    CaptureInfo info;
+    info.sequence = msg.getSequenceNum();
+    info.deviceTimestampNs = std::chrono::duration_cast<std::chrono::nanoseconds>(msg.getTimestampDevice().time_since_epoch()).count();
+    return info;
+}
+
+inline CaptureInfo captureInfo(const dai::ImgFrame& frame) {
+    CaptureInfo info = captureInfo<dai::ImgFrame>(frame);
+    info.width = frame.getWidth();
+    info.height = frame.getHeight();
+    info.frameType = static_cast<uint32_t>(frame.getType());
+    return info;
+}
+
+// Zero-copy: the writer holds `frame` until the payload is on disk
+inline bool captureFrame(CaptureWriter& writer, int stream, const std::shared_ptr<dai::ImgFrame>& frame, const void* data, size_t size) {
+    return writer.append(stream, captureInfo(*frame), frame, data, size);
+}
+
+// Image payload as returned by getFrame() (NV12 / YUV420p include the chroma planes)
+inline bool captureFrame(CaptureWriter& writer, int stream, const std::shared_ptr<dai::ImgFrame>& frame) {
+    cv::Mat mat = frame->getFrame();
+    return captureFrame(writer, stream, frame, mat.data, mat.total() * mat.elemSize());
+}
+
+inline bool captureDetections(CaptureWriter& writer, int stream, const std::shared_ptr<dai::ImgDetections>& msg) {
+    auto payload = std::make_shared<std::vector<CaptureDetection>>();
+    payload->reserve(msg->detections.size());
+    for(const auto& d : msg->detections) payload->push_back({d.label, d.confidence, d.xmin, d.ymin, d.xmax, d.ymax});
+    CaptureInfo info = captureInfo(*msg);
+    info.width = static_cast<uint32_t>(payload->size());
+    info.height = 1;
+    const void* data = payload->data();
+    size_t size = payload->size() * sizeof(CaptureDetection);
+    return writer.append(stream, info, std::move(payload), data, size);
+}
+
+// Appends the message as the next frame of a DetectionTracker batch
+inline void addDetections(DetectionBatch& batch, const dai::ImgDetections& msg) {
+    batch.beginFrame(msg.getSequenceNum());
+    for(const auto& d : msg.detections) batch.add(d.label, d.confidence, d.xmin, d.ymin, d.xmax, d.ymax);
+}
+
+// Frame for a FrameSink, zero-copy like captureFrame()
+inline SinkFrame sinkFrame(const char* stream, const std::shared_ptr<dai::ImgFrame>& frame, const void* data, size_t size) {
+    SinkFrame out;
+    out.stream = stream;
+    out.info = captureInfo(*frame);
+    out.data = static_cast<const uint8_t*>(data);
+    out.size = size;
+    out.owner = frame;
+    return out;
+}
+
+inline SinkFrame sinkFrame(const char* stream, const std::shared_ptr<dai::ImgFrame>& frame) {
+    cv::Mat mat = frame->getFrame();
+    return sinkFrame(stream, frame, mat.data, mat.total() * mat.elemSize());
+}
+
+// Sequence number of the message types the pipelines output, -1 for others
+inline int64_t sequenceNum(const std::shared_ptr<dai::ADatatype>& msg) {
+    if(auto frame = std::dynamic_pointer_cast<dai::ImgFrame>(msg)) return frame->getSequenceNum();
+    if(auto detections = std::dynamic_pointer_cast<dai::ImgDetections>(msg)) return detections->getSequenceNum();
+    return -1;
+}
+
+// Feeds every message the host receives on `queue` to the loss monitor. Queue callbacks run
+// after the push, so messages later overwritten in a full non-blocking queue are seen too.
+inline void watchLoss(LossMonitor& monitor, int stream, const std::shared_ptr<dai::DataOutputQueue>& queue) {
+    if(!queue || stream < 0) return;
+    queue->addCallback([&monitor, stream](std::shared_ptr<dai::ADatatype> msg) {
+        auto frame = std::dynamic_pointer_cast<dai::ImgFrame>(msg);
+        monitor.arrived(stream, sequenceNum(msg), frame ? frame->packet->length : 0);
+    });
+}
+
+// Applies the monitor's adaptive depth to the host queue
+inline void adaptQueue(LossMonitor& monitor, int stream, const std::shared_ptr<dai::DataOutputQueue>& queue) {
+    int depth;
+    if(queue && monitor.adapt(stream, depth)) queue->setMaxSize(depth);
+}
+
+// Serialized pipeline (node graph, properties and asset metadata as JSON)
+inline std::vector<uint8_t> serializePipeline(const dai::Pipeline& pipeline) {
+    std::string json = pipeline.serializeToJson().dump();
+    return std::vector<uint8_t>(json.begin(), json.end());
+}
+
+// Compares the serialized pipeline with the one cached for the same configuration and library
+// version, and caches it if it differs. Returns true if the device gets the same pipeline as
+// the last launch with this configuration.
+inline bool cachePipeline(PipelineCache& cache, const std::string& config, const dai::Pipeline& pipeline) {
+    std::string key = std::string("depthai ") + dai::build::VERSION + "\n" + config;
+    std::vector<uint8_t> serialized = serializePipeline(pipeline), cached;
+    bool unchanged = cache.load(key, cached) && cached == serialized;
+    if(!unchanged) cache.store(key, serialized);
+    printf("Pipeline: %lu bytes serialized, %s (%s)\n",
+           (unsigned long)serialized.size(),
+           unchanged ? "same as the last launch" : "new or changed",
+           cache.pathFor(key).c_str());
+    return unchanged;
+}
@@ -0,0 +1,366 @@
+#include "CaptureFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include "ThreadPolicy.hpp"
+
+using namespace capture;
+
+namespace {
+
+constexpr size_t kBatchSize = 64;
+constexpr char kFileMagic[8] = {'D', 'A', 'I', 'C', 'A', 'P', 0, 1};
+constexpr char kFooterMagic[8] = {'D', 'A', 'I', 'I', 'D', 'X', 0, 1};
+constexpr uint32_t kRecordMagic = 0x44524352;  // "RCRD" little-endian
+constexpr uint32_t kVersion = 1;
+
+const uint8_t kZeros[kAlignment] = {};
+
+inline uint64_t alignUp(uint64_t v) {
+    return (v + kAlignment - 1) & ~uint64_t(kAlignment - 1);
+}
+
+inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// writev() until everything is written; returns false on error
+bool writeAll(int fd, std::vector<iovec>& iov) {
+    size_t done = 0;
+    while(done < iov.size()) {
+        int n = static_cast<int>(std::min<size_t>(iov.size() - done, IOV_MAX));
+        ssize_t written = ::writev(fd, &iov[done], n);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        while(done < iov.size() && static_cast<size_t>(written) >= iov[done].iov_len) {
+            written -= iov[done].iov_len;
+            done++;
+        }
+        if(done < iov.size()) {
+            iov[done].iov_base = static_cast<uint8_t*>(iov[done].iov_base) + written;
+            iov[done].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+CaptureWriter::CaptureWriter(size_t queueCapacity) : _queue(queueCapacity, MailboxPolicy::Block) {}
+
+CaptureWriter::~CaptureWriter() {
+    close();
+}
+
+bool CaptureWriter::open(const std::string& path) {
+    if(_running) return false;
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(_fd < 0) {
+        printf("CaptureWriter: cannot open %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    FileHeader header{};
+    std::memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.version = kVersion;
+    header.headerSize = sizeof(FileHeader);
+    header.createdUnixNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    if(::write(_fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header))) {
+        printf("CaptureWriter: cannot write %s: %s\n", path.c_str(), strerror(errno));
+        ::close(_fd);
+        _fd = -1;
+        return false;
+    }
+    _offset = sizeof(header);
+    _index.clear();
+    _streams.clear();
+    _streamCount = 0;
+    _running = true;
+    _writer = std::thread(&CaptureWriter::writerLoop, this);
+    return true;
+}
+
+void CaptureWriter::close() {
+    if(_running.exchange(false)) {
+        _queue.close();
+        _writer.join();
+    }
+    if(_fd < 0) return;
+
+    Footer footer{};
+    std::memcpy(footer.magic, kFooterMagic, sizeof(kFooterMagic));
+    footer.indexOffset = _offset;
+    footer.messageCount = _index.size();
+    footer.streamCount = _streams.size();
+    std::vector<iovec> iov;
+    if(!_index.empty()) iov.push_back({_index.data(), _index.size() * sizeof(IndexEntry)});
+    if(!_streams.empty()) iov.push_back({_streams.data(), _streams.size() * sizeof(StreamEntry)});
+    iov.push_back({&footer, sizeof(footer)});
+    if(!writeAll(_fd, iov)) _writeErrors++;
+    ::close(_fd);
+    _fd = -1;
+}
+
+int CaptureWriter::addStream(const std::string& name) {
+    if(!_running) return -1;
+    int stream = _streamCount.fetch_add(1);
+    // The definition record goes through the queue, so it lands before the stream's messages
+    auto owner = std::make_shared<std::string>(name);
+    Item item;
+    std::memset(&item.header, 0, sizeof(item.header));
+    item.header.magic = kRecordMagic;
+    item.header.type = RECORD_STREAM;
+    item.header.stream = static_cast<uint16_t>(stream);
+    item.header.payloadSize = owner->size();
+    item.header.hostTimestampNs = nowNs();
+    item.data = owner->data();
+    item.owner = std::move(owner);
+    return _queue.push(std::move(item)) ? stream : -1;
+}
+
+bool CaptureWriter::append(int stream, const CaptureInfo& info, std::shared_ptr<const void> owner, const void* data, size_t size) {
+    if(!_running.load(std::memory_order_relaxed) || stream < 0 || stream >= _streamCount.load(std::memory_order_relaxed)) return false;
+    Item item;
+    std::memset(&item.header, 0, sizeof(item.header));
+    item.header.magic = kRecordMagic;
+    item.header.type = RECORD_MESSAGE;
+    item.header.stream = static_cast<uint16_t>(stream);
+    item.header.payloadSize = size;
+    item.header.sequence = info.sequence;
+    item.header.deviceTimestampNs = info.deviceTimestampNs;
+    item.header.hostTimestampNs = nowNs();
+    item.header.width = info.width;
+    item.header.height = info.height;
+    item.header.frameType = info.frameType;
+    item.owner = std::move(owner);
+    item.data = data;
+    return _queue.push(std::move(item));
+}
+
+void CaptureWriter::writerLoop() {
+    ThreadPolicy::global().enter(ThreadRole::Writer, "capture-writer");
+    std::vector<Item> batch;
+    std::vector<iovec> iov;
+    batch.reserve(kBatchSize);
+    iov.reserve(3 * kBatchSize);
+    while(true) {
+        Item item;
+        if(!_queue.waitPop(item, std::chrono::milliseconds(100))) {
+            if(!_running && _queue.size() == 0) break;
+            continue;
+        }
+        batch.push_back(std::move(item));
+        while(batch.size() < kBatchSize && _queue.tryPop(item)) batch.push_back(std::move(item));
+
+        // Header, payload and padding of the whole batch in one writev()
+        uint64_t offset = _offset;
+        for(auto& it : batch) {
+            const RecordHeader& h = it.header;
+            if(h.type == RECORD_STREAM) {
+                _streams.push_back({offset});
+            } else {
+                IndexEntry entry{};
+                entry.offset = offset;
+                entry.sequence = h.sequence;
+                entry.deviceTimestampNs = h.deviceTimestampNs;
+                entry.stream = h.stream;
+                _index.push_back(entry);
+            }
+            iov.push_back({const_cast<RecordHeader*>(&h), sizeof(h)});
+            if(h.payloadSize) iov.push_back({const_cast<void*>(it.data), h.payloadSize});
+            uint64_t end = offset + sizeof(h) + h.payloadSize;
+            uint64_t padding = alignUp(end) - end;
+            if(padding) iov.push_back({const_cast<uint8_t*>(kZeros), padding});
+            offset = end + padding;
+        }
+        if(writeAll(_fd, iov)) {
+            _bytes += offset - _offset;
+            _records += batch.size();
+            _offset = offset;
+        } else {
+            // Keep the index consistent with what is known to be on disk
+            _writeErrors++;
+            while(!_index.empty() && _index.back().offset >= _offset) _index.pop_back();
+            while(!_streams.empty() && _streams.back().offset >= _offset) _streams.pop_back();
+            if(::ftruncate(_fd, _offset) != 0 || ::lseek(_fd, _offset, SEEK_SET) < 0) _writeErrors++;
+        }
+        iov.clear();
+        batch.clear();
+    }
+}
+
+CaptureWriterStats CaptureWriter::getStats() const {
+    CaptureWriterStats stats;
+    auto queueStats = _queue.getStats();
+    stats.records = _records.load();
+    stats.bytes = _bytes.load();
+    stats.writeErrors = _writeErrors.load();
+    stats.queueDepth = queueStats.occupancy;
+    stats.maxQueueDepth = queueStats.maxOccupancy;
+    return stats;
+}
+
+void CaptureWriter::printStats() const {
+    auto stats = getStats();
+    printf("Capture writer: %.2f MB in %lu records, queue depth %zu (max %zu), %lu errors\n",
+           stats.bytes / 1048576.0,
+           (unsigned long)stats.records,
+           stats.queueDepth,
+           stats.maxQueueDepth,
+           (unsigned long)stats.writeErrors);
+}
+
+CaptureReader::~CaptureReader() {
+    close();
+}
+
+bool CaptureReader::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        printf("CaptureReader: cannot open %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+        printf("CaptureReader: %s is not a capture file\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void* base = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);  // the mapping stays valid
+    if(base == MAP_FAILED) {
+        printf("CaptureReader: cannot map %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    // Replay walks the file front to back
+    madvise(base, size, MADV_SEQUENTIAL);
+    _mapping = std::shared_ptr<const uint8_t>(static_cast<const uint8_t*>(base), [size](const uint8_t* p) { munmap(const_cast<uint8_t*>(p), size); });
+    _fileSize = size;
+
+    auto header = reinterpret_cast<const FileHeader*>(_mapping.get());
+    if(std::memcmp(header->magic, kFileMagic, sizeof(kFileMagic)) != 0 || header->version != kVersion) {
+        printf("CaptureReader: %s is not a capture file\n", path.c_str());
+        close();
+        return false;
+    }
+    _recovered = !loadIndex();
+    if(_recovered) {
+        scanRecords();
+        printf("CaptureReader: %s has no valid index, recovered %zu messages\n", path.c_str(), _index.size());
+    }
+    return true;
+}
+
+void CaptureReader::close() {
+    _mapping.reset();
+    _fileSize = 0;
+    _index.clear();
+    _streamNames.clear();
+    _recovered = false;
+}
+
+bool CaptureReader::loadIndex() {
+    if(_fileSize < sizeof(FileHeader) + sizeof(Footer)) return false;
+    const uint8_t* base = _mapping.get();
+    Footer footer;
+    std::memcpy(&footer, base + _fileSize - sizeof(Footer), sizeof(footer));
+    if(std::memcmp(footer.magic, kFooterMagic, sizeof(kFooterMagic)) != 0) return false;
+    // The counts are checked against the space they occupy, so nothing below can overflow
+    uint64_t indexEnd = _fileSize - sizeof(Footer);
+    if(footer.indexOffset < sizeof(FileHeader) || footer.indexOffset > indexEnd) return false;
+    uint64_t tableBytes = indexEnd - footer.indexOffset;
+    if(footer.messageCount > tableBytes / sizeof(IndexEntry)) return false;
+    uint64_t streamBytes = tableBytes - footer.messageCount * sizeof(IndexEntry);
+    if(footer.streamCount > streamBytes / sizeof(StreamEntry) || footer.streamCount * sizeof(StreamEntry) != streamBytes) return false;
+
+    std::vector<IndexEntry> index(footer.messageCount);
+    std::memcpy(index.data(), base + footer.indexOffset, footer.messageCount * sizeof(IndexEntry));
+    std::vector<StreamEntry> streams(footer.streamCount);
+    std::memcpy(streams.data(), base + footer.indexOffset + footer.messageCount * sizeof(IndexEntry), footer.streamCount * sizeof(StreamEntry));
+
+    // Same bounds as scanRecords(), but against the start of the index: a record must lie
+    // entirely before it
+    auto record = [&](uint64_t offset, uint16_t type) -> const RecordHeader* {
+        if(offset < sizeof(FileHeader) || offset % kAlignment != 0 || offset > footer.indexOffset - sizeof(RecordHeader)) return nullptr;
+        auto h = reinterpret_cast<const RecordHeader*>(base + offset);
+        if(h->magic != kRecordMagic || h->type != type || h->payloadSize > footer.indexOffset - offset - sizeof(RecordHeader)) return nullptr;
+        return h;
+    };
+
+    std::vector<std::string> names(streams.size());
+    for(const auto& s : streams) {
+        auto h = record(s.offset, RECORD_STREAM);
+        if(!h || h->stream >= names.size()) return false;
+        names[h->stream].assign(reinterpret_cast<const char*>(h + 1), h->payloadSize);
+    }
+    for(const auto& e : index) {
+        auto h = record(e.offset, RECORD_MESSAGE);
+        if(!h || h->stream != e.stream || e.stream >= names.size()) return false;
+    }
+    _index = std::move(index);
+    _streamNames = std::move(names);
+    return true;
+}
+
+void CaptureReader::scanRecords() {
+    const uint8_t* base = _mapping.get();
+    uint64_t offset = sizeof(FileHeader);
+    // Stops at the first torn or missing record, i.e. where the writer was interrupted
+    while(offset + sizeof(RecordHeader) <= _fileSize) {
+        auto h = reinterpret_cast<const RecordHeader*>(base + offset);
+        if(h->magic != kRecordMagic || h->payloadSize > _fileSize - offset - sizeof(RecordHeader)) break;
+        if(h->type == RECORD_STREAM) {
+            if(h->stream >= _streamNames.size()) _streamNames.resize(h->stream + 1);
+            _streamNames[h->stream].assign(reinterpret_cast<const char*>(h + 1), h->payloadSize);
+        } else if(h->type == RECORD_MESSAGE && h->stream < _streamNames.size()) {
+            IndexEntry entry{};
+            entry.offset = offset;
+            entry.sequence = h->sequence;
+            entry.deviceTimestampNs = h->deviceTimestampNs;
+            entry.stream = h->stream;
+            _index.push_back(entry);
+        }
+        offset = alignUp(offset + sizeof(RecordHeader) + h->payloadSize);
+    }
+}
+
+CaptureMessage CaptureReader::message(size_t i) const {
+    auto h = reinterpret_cast<const RecordHeader*>(_mapping.get() + _index[i].offset);
+    CaptureMessage msg;
+    msg.stream = h->stream;
+    msg.sequence = h->sequence;
+    msg.deviceTimestampNs = h->deviceTimestampNs;
+    msg.hostTimestampNs = h->hostTimestampNs;
+    msg.width = h->width;
+    msg.height = h->height;
+    msg.frameType = h->frameType;
+    msg.data = reinterpret_cast<const uint8_t*>(h + 1);
+    msg.size = h->payloadSize;
+    return msg;
+}
+
+size_t CaptureReader::lowerBound(int64_t deviceTimestampNs) const {
+    auto it = std::lower_bound(_index.begin(), _index.end(), deviceTimestampNs, [](const IndexEntry& e, int64_t ts) { return e.deviceTimestampNs < ts; });
+    return it - _index.begin();
+}
+
+int CaptureReader::streamId(const std::string& name) const {
+    for(size_t i = 0; i < _streamNames.size(); i++) {
+        if(_streamNames[i] == name) return static_cast<int>(i);
+    }
+    return -1;
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameMailbox.hpp"
+
+// Multi-stream capture file: append-only records plus a trailing index.
+//
+//   FileHeader                          64 bytes
+//   { RecordHeader, payload, padding }  every record starts on a 64-byte boundary
+//   IndexEntry[messageCount]            written on close
+//   StreamEntry[streamCount]
+//   Footer                              64 bytes, points back at the index
+//
+// Payloads are 64-byte aligned in the file, so a mapped file hands out SIMD-friendly
+// pointers. A file without footer (crash, power loss) is still readable: the reader rebuilds
+// the index by scanning records and stops at the first incomplete one.
+
+namespace capture {
+
+constexpr size_t kAlignment = 64;
+
+enum RecordType : uint16_t { RECORD_STREAM = 0, RECORD_MESSAGE = 1 };
+
+struct FileHeader {
+    char magic[8];  // "DAICAP\0\1"
+    uint32_t version;
+    uint32_t headerSize;
+    int64_t createdUnixNs;
+    uint8_t reserved[40];
+};
+
+struct RecordHeader {
+    uint32_t magic;  // 'RCRD'
+    uint16_t type;
+    uint16_t stream;
+    uint64_t payloadSize;
+    int64_t sequence;
+    int64_t deviceTimestampNs;
+    int64_t hostTimestampNs;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frameType;  // dai::ImgFrame::Type for frames, stream specific otherwise
+    uint32_t reserved[3];
+};
+
+struct IndexEntry {
+    uint64_t offset;  // of the RecordHeader
+    int64_t sequence;
+    int64_t deviceTimestampNs;
+    uint16_t stream;
+    uint16_t reserved[3];
+};
+
+struct StreamEntry {
+    uint64_t offset;  // of the stream's definition record
+};
+
+struct Footer {
+    char magic[8];  // "DAIIDX\0\1"
+    uint64_t indexOffset;
+    uint64_t messageCount;
+    uint64_t streamCount;
+    uint8_t reserved[32];
+};
+
+static_assert(sizeof(FileHeader) == 64, "FileHeader layout");
+static_assert(sizeof(RecordHeader) == 64, "RecordHeader layout");
+static_assert(sizeof(IndexEntry) == 32, "IndexEntry layout");
+static_assert(sizeof(Footer) == 64, "Footer layout");
+
+}  // namespace capture
+
+// Message metadata stored with each record
+struct CaptureInfo {
+    int64_t sequence = 0;
+    int64_t deviceTimestampNs = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t frameType = 0;
+};
+
+// Payload layout of the `nn` stream: one entry per detection, normalized coordinates
+struct CaptureDetection {
+    uint32_t label;
+    float confidence;
+    float xmin, ymin, xmax, ymax;
+};
+
+struct CaptureWriterStats {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    uint64_t writeErrors = 0;
+    size_t queueDepth = 0;
+    size_t maxQueueDepth = 0;
+};
+
+// Writes capture files from a background thread. append() takes a reference on the payload
+// owner instead of copying; the writer thread writes header + payload with one writev().
+class CaptureWriter {
+   public:
+    explicit CaptureWriter(size_t queueCapacity = 256);
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    bool open(const std::string& path);
+    // Writes the index and footer; the file is complete afterwards
+    void close();
+
+    // Stream ids are small integers in registration order; call before appending to the stream
+    int addStream(const std::string& name);
+
+    // Thread-safe. `owner` keeps `data` alive until it is written.
+    bool append(int stream, const CaptureInfo& info, std::shared_ptr<const void> owner, const void* data, size_t size);
+
+    CaptureWriterStats getStats() const;
+    void printStats() const;
+
+   private:
+    struct Item {
+        capture::RecordHeader header;
+        std::shared_ptr<const void> owner;
+        const void* data = nullptr;
+    };
+
+    void writerLoop();
+    void writeRecord(Item& item);
+
+    int _fd = -1;
+    uint64_t _offset = 0;
+    std::vector<capture::IndexEntry> _index;
+    std::vector<capture::StreamEntry> _streams;
+    std::atomic<int> _streamCount{0};
+
+    FrameMailbox<Item> _queue;
+    std::thread _writer;
+    std::atomic<bool> _running{false};
+
+    std::atomic<uint64_t> _records{0};
+    std::atomic<uint64_t> _bytes{0};
+    std::atomic<uint64_t> _writeErrors{0};
+};
+
+// One message of a mapped capture file, payload points into the mapping
+struct CaptureMessage {
+    int stream = -1;
+    int64_t sequence = 0;
+    int64_t deviceTimestampNs = 0;
+    int64_t hostTimestampNs = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t frameType = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+// Read-only, memory-mapped view of a capture file
+class CaptureReader {
+   public:
+    CaptureReader() = default;
+    ~CaptureReader();
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    // Number of messages, over all streams, in file order
+    size_t size() const {
+        return _index.size();
+    }
+    // O(1) access to message i
+    CaptureMessage message(size_t i) const;
+    const capture::IndexEntry& entry(size_t i) const {
+        return _index[i];
+    }
+
+    // First message with a device timestamp >= ts (binary search, timestamps per file are
+    // assumed to be roughly monotonic as they come from one device clock)
+    size_t lowerBound(int64_t deviceTimestampNs) const;
+
+    int streamCount() const {
+        return static_cast<int>(_streamNames.size());
+    }
+    const std::string& streamName(int stream) const {
+        return _streamNames[stream];
+    }
+    // -1 if the file has no such stream
+    int streamId(const std::string& name) const;
+
+    // True if the file had no valid footer or index and the index was rebuilt by scanning
+    bool indexRecovered() const {
+        return _recovered;
+    }
+
+    // Keeps the mapping alive, for handing out payload pointers that outlive the reader
+    std::shared_ptr<const uint8_t> mapping() const {
+        return _mapping;
+    }
+
+   private:
+    bool loadIndex();
+    void scanRecords();
+
+    std::shared_ptr<const uint8_t> _mapping;
+    size_t _fileSize = 0;
+    std::vector<capture::IndexEntry> _index;
+    std::vector<std::string> _streamNames;
+    bool _recovered = false;
+};
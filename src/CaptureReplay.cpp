@@ -0,0 +1,53 @@
+#include "CaptureReplay.hpp"
+
+#include <algorithm>
+#include <thread>
+
+CaptureReplay::CaptureReplay(std::shared_ptr<const CaptureReader> reader) : _reader(std::move(reader)), _callbacks(_reader->streamCount()) {}
+
+bool CaptureReplay::onStream(const std::string& name, Callback callback) {
+    int stream = _reader->streamId(name);
+    if(stream < 0) return false;
+    _callbacks[stream] = std::move(callback);
+    return true;
+}
+
+uint64_t CaptureReplay::run(double speed, size_t begin, size_t end) {
+    using namespace std::chrono;
+    _stop = false;
+    end = std::min(end, _reader->size());
+    auto mapping = _reader->mapping();
+    uint64_t delivered = 0;
+
+    auto start = steady_clock::now();
+    int64_t firstTs = begin < end ? _reader->entry(begin).deviceTimestampNs : 0;
+    for(size_t i = begin; i < end && !_stop.load(std::memory_order_relaxed); i++) {
+        const auto& entry = _reader->entry(i);
+        const Callback& callback = _callbacks[entry.stream];
+        if(!callback) {
+            _stats.skipped++;
+            continue;
+        }
+        if(speed > 0) {
+            auto due = start + duration_cast<steady_clock::duration>(nanoseconds(static_cast<int64_t>((entry.deviceTimestampNs - firstTs) / speed)));
+            auto now = steady_clock::now();
+            if(now < due) {
+                std::this_thread::sleep_until(due);
+            } else {
+                uint64_t lateUs = duration_cast<microseconds>(now - due).count();
+                _stats.maxLateUs = std::max(_stats.maxLateUs, lateUs);
+            }
+        }
+
+        auto frame = std::make_shared<ReplayFrame>();
+        frame->_msg = _reader->message(i);
+        frame->packet = std::make_shared<ReplayPacket>();
+        frame->packet->data = const_cast<uint8_t*>(frame->_msg.data);
+        frame->packet->length = static_cast<uint32_t>(frame->_msg.size);
+        frame->packet->mapping = mapping;
+        callback(frame);
+        delivered++;
+    }
+    _stats.delivered += delivered;
+    return delivered;
+}
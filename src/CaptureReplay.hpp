@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CaptureFile.hpp"
+
+// Payload of a replayed message, shaped like the XLink packet of a zero-copy ImgFrame
+struct ReplayPacket {
+    uint8_t* data = nullptr;  // points into the read-only mapping, don't write through it
+    uint32_t length = 0;
+    std::shared_ptr<const uint8_t> mapping;
+};
+
+// ImgFrame-like view of one message of a capture file. Exposes the accessors the host-side
+// consumers use (`packet->data`, getWidth(), getHeight(), ...), so templated stages such as
+// AudioTap<..., ReplayFrame> run unchanged on replayed data. Nothing is copied: the packet
+// references the file mapping and keeps it alive.
+class ReplayFrame {
+   public:
+    std::shared_ptr<ReplayPacket> packet;
+
+    int getWidth() const {
+        return static_cast<int>(_msg.width);
+    }
+    int getHeight() const {
+        return static_cast<int>(_msg.height);
+    }
+    int64_t getSequenceNum() const {
+        return _msg.sequence;
+    }
+    std::chrono::steady_clock::time_point getTimestampDevice() const {
+        return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(_msg.deviceTimestampNs)));
+    }
+    // dai::ImgFrame::Type as recorded, or stream specific
+    uint32_t getFrameType() const {
+        return _msg.frameType;
+    }
+    int getStream() const {
+        return _msg.stream;
+    }
+    const CaptureMessage& message() const {
+        return _msg;
+    }
+
+   private:
+    friend class CaptureReplay;
+    CaptureMessage _msg;
+};
+
+struct ReplayStats {
+    uint64_t delivered = 0;
+    uint64_t skipped = 0;    // messages of streams without a consumer
+    uint64_t maxLateUs = 0;  // worst delivery lag behind the recorded schedule
+};
+
+// Feeds the messages of a capture file to per-stream callbacks, in file order.
+//
+// speed 1.0 reproduces the recorded pacing from the device timestamps (2.0 plays twice as
+// fast); speed 0 delivers as fast as the consumers take it, which makes runs over the same
+// file deterministic benchmarks of the host pipeline.
+class CaptureReplay {
+   public:
+    using Callback = std::function<void(const std::shared_ptr<ReplayFrame>& frame)>;
+
+    explicit CaptureReplay(std::shared_ptr<const CaptureReader> reader);
+
+    // Returns false if the file has no such stream
+    bool onStream(const std::string& name, Callback callback);
+
+    // Replays messages [begin, end) on the calling thread; returns the number delivered
+    uint64_t run(double speed = 1.0, size_t begin = 0, size_t end = SIZE_MAX);
+    // Makes run() return after the current message, callable from any thread
+    void stop() {
+        _stop = true;
+    }
+
+    ReplayStats getStats() const {
+        return _stats;
+    }
+
+   private:
+    std::shared_ptr<const CaptureReader> _reader;
+    std::vector<Callback> _callbacks;  // by stream id
+    std::atomic<bool> _stop{false};
+    ReplayStats _stats;
+};
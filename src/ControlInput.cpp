@@ -0,0 +1,143 @@
+#include "ControlInput.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "ThreadPolicy.hpp"
+
+namespace {
+
+constexpr size_t kMaxLine = 256;
+
+// Splits complete lines off `buffer`
+template <typename Fn>
+void takeLines(std::string& buffer, Fn&& onLine) {
+    size_t begin = 0, end;
+    while((end = buffer.find('\n', begin)) != std::string::npos) {
+        std::string line = buffer.substr(begin, end - begin);
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+        onLine(std::move(line));
+        begin = end + 1;
+    }
+    buffer.erase(0, begin);
+    // A client that never sends a newline doesn't get to grow the buffer forever
+    if(buffer.size() > kMaxLine) buffer.clear();
+}
+
+}  // namespace
+
+ControlInput::~ControlInput() {
+    stop();
+}
+
+bool ControlInput::start(bool readStdin, const std::string& socketPath) {
+    if(_reader.joinable()) return false;
+    if(pipe(_wakeFd) != 0) return false;
+    if(!socketPath.empty()) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if(socketPath.size() >= sizeof(addr.sun_path)) {
+            printf("ControlInput: socket path too long: %s\n", socketPath.c_str());
+            return false;
+        }
+        std::strcpy(addr.sun_path, socketPath.c_str());
+        _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(socketPath.c_str());
+        if(_listenFd < 0 || bind(_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(_listenFd, 4) != 0) {
+            printf("ControlInput: cannot listen on %s: %s\n", socketPath.c_str(), strerror(errno));
+            if(_listenFd >= 0) ::close(_listenFd);
+            _listenFd = -1;
+            return false;
+        }
+        _socketPath = socketPath;
+        printf("Control socket: %s\n", socketPath.c_str());
+    }
+    _reader = std::thread(&ControlInput::readerLoop, this, readStdin);
+    return true;
+}
+
+void ControlInput::stop() {
+    if(_reader.joinable()) {
+        char c = 0;
+        if(write(_wakeFd[1], &c, 1) != 1) perror("ControlInput");
+        _reader.join();
+    }
+    if(_listenFd >= 0) {
+        ::close(_listenFd);
+        unlink(_socketPath.c_str());
+        _listenFd = -1;
+    }
+    for(int& fd : _wakeFd) {
+        if(fd >= 0) ::close(fd);
+        fd = -1;
+    }
+}
+
+int ControlInput::pollKey() {
+    std::string command;
+    while(poll(command)) {
+        if(!command.empty()) return static_cast<unsigned char>(command[0]);
+    }
+    return -1;
+}
+
+void ControlInput::readerLoop(bool readStdin) {
+    ThreadPolicy::global().enter(ThreadRole::Control);
+    // fds[0]: wake pipe, then stdin and the listening socket if used, then clients
+    std::vector<pollfd> fds;
+    std::vector<std::string> buffers;
+    auto add = [&](int fd) {
+        fds.push_back({fd, POLLIN, 0});
+        buffers.emplace_back();
+    };
+    add(_wakeFd[0]);
+    if(readStdin) add(STDIN_FILENO);
+    if(_listenFd >= 0) add(_listenFd);
+
+    auto onLine = [this](std::string line) {
+        if(line.empty()) return;
+        _commands.push(std::move(line));
+        if(_onCommand) _onCommand();
+    };
+
+    while(true) {
+        if(::poll(fds.data(), fds.size(), -1) < 0) {
+            if(errno == EINTR) continue;
+            break;
+        }
+        if(fds[0].revents) break;
+        for(size_t i = 1; i < fds.size(); i++) {
+            if(!fds[i].revents) continue;
+            if(fds[i].fd == _listenFd) {
+                int client = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if(client >= 0) add(client);
+                continue;
+            }
+            char chunk[kMaxLine];
+            ssize_t n = read(fds[i].fd, chunk, sizeof(chunk));
+            if(n > 0) {
+                buffers[i].append(chunk, n);
+                takeLines(buffers[i], onLine);
+                continue;
+            }
+            if(n < 0 && errno == EINTR) continue;
+            // EOF or error: a trailing line without newline still counts
+            if(!buffers[i].empty()) onLine(std::move(buffers[i]));
+            if(fds[i].fd != STDIN_FILENO) ::close(fds[i].fd);
+            fds.erase(fds.begin() + i);
+            buffers.erase(buffers.begin() + i);
+            i--;
+        }
+    }
+    for(size_t i = 1; i < fds.size(); i++) {
+        if(fds[i].fd != STDIN_FILENO && fds[i].fd != _listenFd) ::close(fds[i].fd);
+    }
+}
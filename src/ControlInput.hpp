@@ -0,0 +1,47 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "FrameMailbox.hpp"
+
+// Line-based control commands from stdin and/or a UNIX domain socket, for running without a
+// window to take key presses.
+//
+// Each line is one command; pollKey() returns its first character, so the existing single-key
+// bindings work unchanged (`echo q | nc -U /tmp/cam.sock` quits). Input is read on a background
+// thread, polling never blocks.
+class ControlInput {
+   public:
+    ControlInput() : _commands(64, MailboxPolicy::DropOldest) {}
+    ~ControlInput();
+
+    ControlInput(const ControlInput&) = delete;
+    ControlInput& operator=(const ControlInput&) = delete;
+
+    // `socketPath` empty for no socket; an existing socket file at that path is replaced
+    bool start(bool readStdin, const std::string& socketPath = "");
+    void stop();
+
+    // Called on the reader thread after each command, e.g. to wake a waiting loop
+    void setOnCommand(std::function<void()> onCommand) {
+        _onCommand = std::move(onCommand);
+    }
+
+    bool poll(std::string& command) {
+        return _commands.tryPop(command);
+    }
+    // First character of the next non-empty command, -1 if there is none (like cv::waitKey)
+    int pollKey();
+
+   private:
+    void readerLoop(bool readStdin);
+
+    FrameMailbox<std::string> _commands;
+    std::function<void()> _onCommand;
+    std::string _socketPath;
+    int _listenFd = -1;
+    int _wakeFd[2] = {-1, -1};
+    std::thread _reader;
+};
@@ -0,0 +1,148 @@
+#include "ControlScheduler.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using std::chrono::steady_clock;
+
+void CameraCommand::merge(const CameraCommand& newer) {
+    if(newer.lensPosition >= 0) {
+        lensPosition = newer.lensPosition;
+        // Manual focus turns autofocus off
+        autoFocusMode = -1;
+        autoFocusTrigger = false;
+    }
+    if(newer.autoFocusMode >= 0) {
+        autoFocusMode = newer.autoFocusMode;
+        lensPosition = -1;
+    }
+    if(newer.autoFocusTrigger) {
+        autoFocusTrigger = true;
+        lensPosition = -1;
+    }
+    if(newer.exposureUs >= 0) {
+        exposureUs = newer.exposureUs;
+        iso = newer.iso;
+    }
+    if(newer.whiteBalanceK >= 0) whiteBalanceK = newer.whiteBalanceK;
+}
+
+ControlScheduler::ControlScheduler(std::chrono::microseconds minInterval, std::chrono::milliseconds effectTimeout)
+    : _minInterval(minInterval), _effectTimeout(effectTimeout) {}
+
+void ControlScheduler::setMinInterval(std::chrono::microseconds minInterval) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _minInterval = minInterval;
+}
+
+void ControlScheduler::submit(const CameraCommand& command) {
+    if(command.empty()) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.submitted++;
+    bool mergedAny = false;
+    if(command.hasSettings()) {
+        // Settings join the last pending command unless a streaming change closed it
+        if(!_queue.empty() && _queue.back().streaming == CameraCommand::Streaming::None) {
+            _queue.back().merge(command);
+            mergedAny = true;
+        } else {
+            CameraCommand settings;
+            settings.merge(command);
+            _queue.push_back(settings);
+        }
+    }
+    if(command.streaming != CameraCommand::Streaming::None) {
+        // Start / stop go on their own after everything before them; a repeat of the last
+        // pending one adds nothing
+        if(!_queue.empty() && _queue.back().streaming == command.streaming) {
+            mergedAny = true;
+        } else {
+            CameraCommand streaming;
+            streaming.streaming = command.streaming;
+            _queue.push_back(streaming);
+        }
+    }
+    if(mergedAny) _stats.merged++;
+}
+
+bool ControlScheduler::pending() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_queue.empty();
+}
+
+steady_clock::duration ControlScheduler::nextDue(steady_clock::time_point now) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_queue.empty()) return steady_clock::duration::max();
+    auto due = _lastSent + _minInterval;
+    return due > now ? due - now : steady_clock::duration::zero();
+}
+
+bool ControlScheduler::takeNext(CameraCommand& command, steady_clock::time_point now) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_queue.empty() || now < _lastSent + _minInterval) return false;
+    command = _queue.front();
+    _queue.pop_front();
+    _lastSent = now;
+    _stats.sent++;
+    if(command.lensPosition >= 0) expect(_lens, command.lensPosition, now);
+    if(command.exposureUs >= 0) expect(_exposure, command.exposureUs, now);
+    if(command.streaming == CameraCommand::Streaming::Start) expect(_start, 0, now);
+    // Frames after a stop can't confirm an earlier start
+    if(command.streaming == CameraCommand::Streaming::Stop && _start.active) {
+        _start.active = false;
+        _stats.unobserved++;
+    }
+    return true;
+}
+
+void ControlScheduler::expect(Expectation& e, int value, steady_clock::time_point now) {
+    // A newer command to the same field supersedes the one still in flight
+    if(e.active) _stats.unobserved++;
+    e.active = true;
+    e.value = value;
+    e.sentAt = now;
+}
+
+void ControlScheduler::observed(Expectation& e, steady_clock::time_point captured) {
+    e.active = false;
+    _stats.observed++;
+    uint64_t us = captured > e.sentAt ? std::chrono::duration_cast<std::chrono::microseconds>(captured - e.sentAt).count() : 0;
+    _stats.latency.add(LatencyHistogram::bucketOf(us * 1000), 1);
+    if(us > _stats.maxLatencyUs) _stats.maxLatencyUs = us;
+}
+
+void ControlScheduler::onFrame(int lensPosition, int exposureUs, steady_clock::time_point captured) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(Expectation* e : {&_lens, &_exposure, &_start}) {
+        if(e->active && captured - e->sentAt > _effectTimeout) {
+            e->active = false;
+            _stats.unobserved++;
+        }
+    }
+    // Only frames captured after the send can show its effect
+    if(_start.active && captured >= _start.sentAt) observed(_start, captured);
+    if(_lens.active && captured >= _lens.sentAt && lensPosition == _lens.value) observed(_lens, captured);
+    // Exposure is quantized to sensor lines, accept 5%
+    if(_exposure.active && captured >= _exposure.sentAt && exposureUs >= 0 && std::abs(exposureUs - _exposure.value) * 20 <= _exposure.value) {
+        observed(_exposure, captured);
+    }
+}
+
+ControlSchedulerStats ControlScheduler::getStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void ControlScheduler::printStats(const char* name) const {
+    auto stats = getStats();
+    printf("%s: %lu submitted, %lu sent, %lu merged; effect seen for %lu (p50 %.1f ms, p99 %.1f ms, max %.1f ms), %lu not seen\n",
+           name,
+           (unsigned long)stats.submitted,
+           (unsigned long)stats.sent,
+           (unsigned long)stats.merged,
+           (unsigned long)stats.observed,
+           stats.latency.percentile(0.5) / 1e6,
+           stats.latency.percentile(0.99) / 1e6,
+           stats.maxLatencyUs / 1e3,
+           (unsigned long)stats.unobserved);
+}
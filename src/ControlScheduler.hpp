@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+#include "PipelineMetrics.hpp"
+
+// Camera settings to change; fields left at -1 / false stay as they are on the device.
+// Kept free of depthai types so the merge rules can be exercised without a device.
+struct CameraCommand {
+    enum class Streaming { None, Start, Stop };
+
+    int lensPosition = -1;   // manual focus, 0..255
+    int autoFocusMode = -1;  // dai::CameraControl::AutoFocusMode
+    bool autoFocusTrigger = false;
+    int exposureUs = -1;     // manual exposure, with iso
+    int iso = -1;
+    int whiteBalanceK = -1;  // manual white balance
+    Streaming streaming = Streaming::None;
+
+    bool empty() const {
+        return lensPosition < 0 && autoFocusMode < 0 && !autoFocusTrigger && exposureUs < 0 && whiteBalanceK < 0 && streaming == Streaming::None;
+    }
+    bool hasSettings() const {
+        return lensPosition >= 0 || autoFocusMode >= 0 || autoFocusTrigger || exposureUs >= 0 || whiteBalanceK >= 0;
+    }
+
+    // Folds a newer command's settings into this one: per field the newer value wins, and
+    // manual focus and autofocus replace each other. Streaming is not merged, see ControlScheduler.
+    void merge(const CameraCommand& newer);
+};
+
+struct ControlSchedulerStats {
+    uint64_t submitted = 0;
+    uint64_t sent = 0;
+    uint64_t merged = 0;    // submissions folded into a command still waiting to be sent
+    uint64_t observed = 0;  // sent changes later seen in frame metadata
+    uint64_t unobserved = 0;  // superseded or not seen within the effect timeout
+    LatencyHistogram latency;  // send -> first frame captured with the change
+    uint64_t maxLatencyUs = 0;
+};
+
+// Latest-wins scheduler between input handling and the control XLinkIn.
+//
+// submit() can be called at any rate; settings merge into the pending command, so a burst of
+// focus steps becomes one lens move to the final position. Start / stop streaming are never
+// merged or reordered: they end the pending command, and settings submitted after them go
+// into a new command behind them (a repeated start or stop collapses into one). takeNext()
+// hands out at most one command per `minInterval`, typically the frame period.
+//
+// Sent lens positions, exposures and stream starts are matched against the metadata of the
+// frames that follow (onFrame()), giving the command-to-effect latency. A change the device
+// clamps or never applies counts as unobserved after `effectTimeout`.
+class ControlScheduler {
+   public:
+    explicit ControlScheduler(std::chrono::microseconds minInterval = std::chrono::microseconds(33333),
+                              std::chrono::milliseconds effectTimeout = std::chrono::seconds(2));
+
+    void setMinInterval(std::chrono::microseconds minInterval);
+
+    void submit(const CameraCommand& command);
+    bool pending() const;
+    // Next command to send if one is pending and the rate limit allows it
+    bool takeNext(CameraCommand& command, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+    // Time until takeNext() may return something, zero if it would now (or nothing is pending: max)
+    std::chrono::steady_clock::duration nextDue(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) const;
+
+    // Frame metadata: lens position, exposure (-1 if unknown) and capture time on the host clock
+    void onFrame(int lensPosition, int exposureUs, std::chrono::steady_clock::time_point captured);
+
+    ControlSchedulerStats getStats() const;
+    void printStats(const char* name) const;
+
+   private:
+    struct Expectation {
+        bool active = false;
+        int value = 0;
+        std::chrono::steady_clock::time_point sentAt;
+    };
+
+    void expect(Expectation& e, int value, std::chrono::steady_clock::time_point now);
+    void observed(Expectation& e, std::chrono::steady_clock::time_point captured);
+
+    std::chrono::microseconds _minInterval;
+    const std::chrono::milliseconds _effectTimeout;
+
+    mutable std::mutex _mutex;
+    std::deque<CameraCommand> _queue;
+    std::chrono::steady_clock::time_point _lastSent;
+    Expectation _lens, _exposure, _start;
+    ControlSchedulerStats _stats;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "FrameMailbox.hpp"
+#include "ThreadPolicy.hpp"
+
+struct ConversionStats {
+    uint64_t submitted = 0;
+    uint64_t converted = 0;
+    uint64_t skipped = 0;  // superseded before any worker picked them up, never converted
+    uint64_t stale = 0;    // converted, but superseded by a newer result before the consumer took it
+};
+
+// Moves expensive per-frame conversion (e.g. NV12 -> BGR) off the thread that receives frames.
+//
+// submit() only hands the input over to a latest-wins mailbox. Workers convert on demand:
+// a worker takes new input only while fewer than `maxReady` results are waiting for the
+// consumer or in flight, so frames the consumer would never look at are dropped unconverted.
+// With zero workers, submit() converts inline, which is the old behaviour and is kept for
+// comparison.
+template <typename In, typename Out>
+class ConversionPool {
+   public:
+    using ConvertFn = std::function<Out(const In&)>;
+
+    ConversionPool(ConvertFn convert, unsigned numWorkers, size_t maxReady = 0)
+        : _convert(std::move(convert)),
+          _maxReady(maxReady ? maxReady : std::max<size_t>(1, numWorkers)),
+          _input(2, MailboxPolicy::LatestWins),
+          _output(_maxReady, MailboxPolicy::LatestWins),
+          _numWorkers(numWorkers) {
+        for(unsigned i = 0; i < numWorkers; i++) _workers.emplace_back(&ConversionPool::workerLoop, this);
+    }
+
+    ~ConversionPool() {
+        stop();
+    }
+
+    ConversionPool(const ConversionPool&) = delete;
+    ConversionPool& operator=(const ConversionPool&) = delete;
+
+    void submit(In item) {
+        uint64_t seq = _submitted.fetch_add(1, std::memory_order_relaxed) + 1;
+        if(_numWorkers == 0) {
+            publish(seq, _convert(item));
+        } else {
+            _input.push(std::make_pair(seq, std::move(item)));
+        }
+    }
+
+    bool tryGet(Out& out) {
+        if(!_output.tryPop(out)) return false;
+        signalDemand();
+        return true;
+    }
+
+    template <typename Rep, typename Period>
+    bool waitGet(Out& out, std::chrono::duration<Rep, Period> timeout) {
+        if(!_output.waitPop(out, timeout)) return false;
+        signalDemand();
+        return true;
+    }
+
+    // Drops pending input, e.g. when streaming is stopped
+    void clear() {
+        _input.clear();
+        _output.clear();
+        signalDemand();
+    }
+
+    void stop() {
+        if(!_running.exchange(false)) return;
+        _input.close();
+        signalDemand();
+        for(auto& t : _workers) t.join();
+        _workers.clear();
+    }
+
+    ConversionStats getStats() const {
+        ConversionStats stats;
+        stats.submitted = _submitted.load(std::memory_order_relaxed);
+        stats.converted = _converted.load(std::memory_order_relaxed);
+        stats.skipped = _input.getStats().dropped;
+        stats.stale = _stale.load(std::memory_order_relaxed) + _output.getStats().dropped;
+        return stats;
+    }
+
+   private:
+    // Reserve one of the maxReady output slots; blocks until the consumer makes room
+    bool reserve() {
+        std::unique_lock<std::mutex> lock(_demandMtx);
+        while(_running.load()) {
+            size_t inFlight = _inFlight.load();
+            if(_output.size() + inFlight < _maxReady) {
+                if(_inFlight.compare_exchange_weak(inFlight, inFlight + 1)) return true;
+                continue;
+            }
+            _demandCv.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    void workerLoop() {
+        ThreadPolicy::global().enter(ThreadRole::Worker, "convert");
+        while(reserve()) {
+            std::pair<uint64_t, In> item;
+            if(_input.waitPop(item, std::chrono::milliseconds(50))) {
+                publish(item.first, _convert(item.second));
+            }
+            _inFlight.fetch_sub(1);
+        }
+    }
+
+    void publish(uint64_t seq, Out result) {
+        _converted.fetch_add(1, std::memory_order_relaxed);
+        // With several workers a slow conversion may finish after a newer one
+        uint64_t last = _lastPublished.load();
+        while(true) {
+            if(seq <= last) {
+                _stale.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if(_lastPublished.compare_exchange_weak(last, seq)) break;
+        }
+        _output.push(std::move(result));
+    }
+
+    void signalDemand() {
+        std::lock_guard<std::mutex> lock(_demandMtx);
+        _demandCv.notify_all();
+    }
+
+    ConvertFn _convert;
+    const size_t _maxReady;
+    FrameMailbox<std::pair<uint64_t, In>> _input;
+    FrameMailbox<Out> _output;
+    const unsigned _numWorkers;
+    std::vector<std::thread> _workers;
+    std::atomic<bool> _running{true};
+
+    std::mutex _demandMtx;
+    std::condition_variable _demandCv;
+    std::atomic<size_t> _inFlight{0};
+    std::atomic<uint64_t> _lastPublished{0};
+
+    std::atomic<uint64_t> _submitted{0};
+    std::atomic<uint64_t> _converted{0};
+    std::atomic<uint64_t> _stale{0};
+};
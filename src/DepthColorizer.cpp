@@ -0,0 +1,103 @@
+#include "DepthColorizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// Same shape as OpenCV's COLORMAP_JET: dark blue -> cyan -> yellow -> dark red
+inline uint32_t jet(float x) {
+    auto channel = [](float v) { return static_cast<uint32_t>(std::lround(255.0f * std::min(1.0f, std::max(0.0f, v)))); };
+    uint32_t r = channel(1.5f - std::fabs(4.0f * x - 3.0f));
+    uint32_t g = channel(1.5f - std::fabs(4.0f * x - 2.0f));
+    uint32_t b = channel(1.5f - std::fabs(4.0f * x - 1.0f));
+    return b | g << 8 | r << 16;
+}
+
+}  // namespace
+
+DepthColorizer::DepthColorizer(float smoothing) : _smoothing(smoothing), _lut(65536) {
+    rebuildLut(0, 65535);
+}
+
+void DepthColorizer::setFixedRange(uint16_t minDepth, uint16_t maxDepth) {
+    _autoRange = false;
+    rebuildLut(minDepth, std::max<uint16_t>(maxDepth, minDepth + 1));
+}
+
+void DepthColorizer::setAutoRange(float smoothing) {
+    _autoRange = true;
+    _smoothing = smoothing;
+    _haveRange = false;
+}
+
+void DepthColorizer::rebuildLut(uint16_t minDepth, uint16_t maxDepth) {
+    _lutMin = minDepth;
+    _lutMax = maxDepth;
+    float scale = 1.0f / std::max(1, maxDepth - minDepth);
+    for(int d = 0; d < 65536; d++) {
+        float x = (std::min<int>(std::max<int>(d, minDepth), maxDepth) - minDepth) * scale;
+        _lut[d] = jet(x);
+    }
+    _lut[0] = 0;  // invalid
+    _lutRebuilds++;
+}
+
+void DepthColorizer::updateAutoRange(uint16_t frameMin, uint16_t frameMax) {
+    if(frameMin > frameMax) return;  // no valid pixels
+    if(!_haveRange) {
+        _smoothMin = frameMin;
+        _smoothMax = frameMax;
+        _haveRange = true;
+    } else {
+        _smoothMin += _smoothing * (frameMin - _smoothMin);
+        _smoothMax += _smoothing * (frameMax - _smoothMax);
+    }
+    // Rebuild only when the range moved by more than 1% of its span
+    float span = std::max(1.0f, _smoothMax - _smoothMin);
+    if(std::fabs(_smoothMin - _lutMin) > 0.01f * span || std::fabs(_smoothMax - _lutMax) > 0.01f * span) {
+        auto lo = static_cast<uint16_t>(std::lround(_smoothMin));
+        auto hi = static_cast<uint16_t>(std::lround(_smoothMax));
+        rebuildLut(lo, std::max<uint16_t>(hi, lo + 1));
+    }
+}
+
+void DepthColorizer::colorize(const uint16_t* depth, int width, int height, size_t depthStride, uint8_t* bgr, size_t bgrStride) {
+    const uint32_t* lut = _lut.data();
+    uint16_t frameMin = 0xFFFF, frameMax = 0;
+    for(int r = 0; r < height; r++) {
+        const uint16_t* in = reinterpret_cast<const uint16_t*>(reinterpret_cast<const uint8_t*>(depth) + r * depthStride);
+        uint8_t* out = bgr + r * bgrStride;
+        uint16_t rowMin = 0xFFFF, rowMax = 0;
+        int c = 0;
+        // 4-byte stores overlap the next pixel, which is overwritten right after
+        for(; c + 1 < width; c++) {
+            uint16_t d = in[c];
+            std::memcpy(out + 3 * c, &lut[d], 4);
+            // Zero is invalid, keep it out of the minimum
+            rowMin = std::min<uint16_t>(rowMin, d ? d : 0xFFFF);
+            rowMax = std::max(rowMax, d);
+        }
+        for(; c < width; c++) {
+            uint16_t d = in[c];
+            uint32_t color = lut[d];
+            out[3 * c] = color & 0xFF;
+            out[3 * c + 1] = (color >> 8) & 0xFF;
+            out[3 * c + 2] = (color >> 16) & 0xFF;
+            rowMin = std::min<uint16_t>(rowMin, d ? d : 0xFFFF);
+            rowMax = std::max(rowMax, d);
+        }
+        frameMin = std::min(frameMin, rowMin);
+        frameMax = std::max(frameMax, rowMax);
+    }
+    // The new range applies from the next frame on
+    if(_autoRange) updateAutoRange(frameMin, frameMax);
+}
+
+const cv::Mat& DepthColorizer::colorize(const cv::Mat& depth16) {
+    CV_Assert(depth16.type() == CV_16UC1);
+    _output.create(depth16.size(), CV_8UC3);
+    colorize(depth16.ptr<uint16_t>(), depth16.cols, depth16.rows, depth16.step, _output.data, _output.step);
+    return _output;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Maps 16-bit depth straight to BGR through a 64K-entry lookup table, in one pass.
+//
+// Replaces cv::normalize(NORM_MINMAX) + cv::applyColorMap(COLORMAP_JET): no intermediate
+// 8-bit image, no per-frame allocation, and no flicker from a min/max that jumps every
+// frame. The range is either fixed, or follows the scene: min/max of valid pixels are
+// gathered during the colorizing pass, smoothed over frames and applied to the next frame.
+// The table is only rebuilt when the smoothed range moved noticeably. Depth 0 (no return)
+// is drawn black.
+class DepthColorizer {
+   public:
+    // Auto range, `smoothing` is the EMA weight of the newest frame's min/max
+    explicit DepthColorizer(float smoothing = 0.1f);
+
+    // Fixed range in depth units; values outside are clamped
+    void setFixedRange(uint16_t minDepth, uint16_t maxDepth);
+    void setAutoRange(float smoothing);
+
+    // Writes width x height BGR pixels into `bgr`
+    void colorize(const uint16_t* depth, int width, int height, size_t depthStride, uint8_t* bgr, size_t bgrStride);
+
+    // Colorizes into an internal buffer that is reused across frames
+    const cv::Mat& colorize(const cv::Mat& depth16);
+
+    uint16_t rangeMin() const {
+        return _lutMin;
+    }
+    uint16_t rangeMax() const {
+        return _lutMax;
+    }
+    uint64_t lutRebuilds() const {
+        return _lutRebuilds;
+    }
+
+   private:
+    void rebuildLut(uint16_t minDepth, uint16_t maxDepth);
+    void updateAutoRange(uint16_t frameMin, uint16_t frameMax);
+
+    bool _autoRange = true;
+    float _smoothing;
+    bool _haveRange = false;
+    float _smoothMin = 0, _smoothMax = 0;
+
+    uint16_t _lutMin = 0, _lutMax = 0;
+    std::vector<uint32_t> _lut;  // packed B | G << 8 | R << 16, 65536 entries
+    uint64_t _lutRebuilds = 0;
+
+    cv::Mat _output;
+};
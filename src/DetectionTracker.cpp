@@ -0,0 +1,215 @@
+#include "DetectionTracker.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace {
+
+inline float boxArea(float x0, float y0, float x1, float y1) {
+    return std::max(0.0f, x1 - x0) * std::max(0.0f, y1 - y0);
+}
+
+inline float boxIou(float ax0, float ay0, float ax1, float ay1, float areaA, float bx0, float by0, float bx1, float by1, float areaB) {
+    float w = std::min(ax1, bx1) - std::max(ax0, bx0);
+    float h = std::min(ay1, by1) - std::max(ay0, by0);
+    if(w <= 0 || h <= 0) return 0.0f;
+    float inter = w * h;
+    return inter / (areaA + areaB - inter);
+}
+
+}  // namespace
+
+void DetectionBatch::clear() {
+    frameSequence.clear();
+    frameStart.assign(1, 0);
+    resize(0);
+}
+
+void DetectionBatch::resize(size_t n) {
+    label.resize(n);
+    confidence.resize(n);
+    xmin.resize(n);
+    ymin.resize(n);
+    xmax.resize(n);
+    ymax.resize(n);
+    trackId.resize(n, -1);
+}
+
+DetectionTracker::DetectionTracker(const DetectionConfig& config) : _config(config), _history(std::max<size_t>(config.history, 1)) {}
+
+void DetectionTracker::reset() {
+    _tracks.clear();
+    for(auto& frame : _history) frame.sequence = -1;
+}
+
+void DetectionTracker::process(DetectionBatch& batch) {
+    auto t0 = std::chrono::steady_clock::now();
+    _stats.batches++;
+    size_t out = 0;
+    for(size_t f = 0; f < batch.frames(); f++) {
+        size_t begin = batch.frameStart[f];
+        size_t end = batch.frameStart[f + 1];
+        _stats.frames++;
+        _stats.detections += end - begin;
+        size_t kept = filter(batch, begin, end, out);
+        batch.frameStart[f] = static_cast<uint32_t>(out);
+        track(batch, out, out + kept);
+        record(batch, batch.frameSequence[f], out, out + kept);
+        out += kept;
+    }
+    batch.frameStart[batch.frames()] = static_cast<uint32_t>(out);
+    batch.resize(out);
+    _stats.activeTracks = _tracks.size();
+    _stats.processNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+}
+
+size_t DetectionTracker::filter(DetectionBatch& b, size_t begin, size_t end, size_t out) {
+    _order.clear();
+    for(size_t i = begin; i < end; i++) {
+        if(b.confidence[i] >= _config.minConfidence) _order.push_back(static_cast<uint32_t>(i));
+    }
+    _stats.confident += _order.size();
+    std::sort(_order.begin(), _order.end(), [&b](uint32_t x, uint32_t y) { return b.confidence[x] > b.confidence[y] || (b.confidence[x] == b.confidence[y] && x < y); });
+
+    // Greedy NMS: a box survives unless a more confident kept box of its label overlaps it
+    _kept.clear();
+    _area.clear();
+    for(uint32_t i : _order) {
+        if(_kept.size() >= _config.maxPerFrame) break;
+        float area = boxArea(b.xmin[i], b.ymin[i], b.xmax[i], b.ymax[i]);
+        bool suppressed = false;
+        for(size_t k = 0; k < _kept.size() && !suppressed; k++) {
+            uint32_t j = _kept[k];
+            suppressed = b.label[j] == b.label[i] &&
+                         boxIou(b.xmin[i], b.ymin[i], b.xmax[i], b.ymax[i], area, b.xmin[j], b.ymin[j], b.xmax[j], b.ymax[j], _area[k]) > _config.nmsIou;
+        }
+        if(!suppressed) {
+            _kept.push_back(i);
+            _area.push_back(area);
+        }
+    }
+    _stats.kept += _kept.size();
+
+    // In index order every source lies at or after its destination, so compacting in place is safe
+    std::sort(_kept.begin(), _kept.end());
+    for(size_t k = 0; k < _kept.size(); k++) {
+        size_t i = _kept[k], o = out + k;
+        b.label[o] = b.label[i];
+        b.confidence[o] = b.confidence[i];
+        b.xmin[o] = b.xmin[i];
+        b.ymin[o] = b.ymin[i];
+        b.xmax[o] = b.xmax[i];
+        b.ymax[o] = b.ymax[i];
+        b.trackId[o] = -1;
+    }
+    return _kept.size();
+}
+
+void DetectionTracker::track(DetectionBatch& b, size_t begin, size_t end) {
+    size_t n = end - begin;
+    _matches.clear();
+    for(size_t t = 0; t < _tracks.size(); t++) {
+        const Track& tr = _tracks[t];
+        float trackArea = boxArea(tr.xmin, tr.ymin, tr.xmax, tr.ymax);
+        for(size_t d = begin; d < end; d++) {
+            if(b.label[d] != tr.label) continue;
+            float iou = boxIou(tr.xmin, tr.ymin, tr.xmax, tr.ymax, trackArea, b.xmin[d], b.ymin[d], b.xmax[d], b.ymax[d], boxArea(b.xmin[d], b.ymin[d], b.xmax[d], b.ymax[d]));
+            if(iou >= _config.trackIou) _matches.push_back({iou, static_cast<uint32_t>(t), static_cast<uint32_t>(d - begin)});
+        }
+    }
+    std::sort(_matches.begin(), _matches.end(), [](const Match& x, const Match& y) { return x.iou > y.iou; });
+
+    _trackMatched.assign(_tracks.size(), 0);
+    _detectionMatched.assign(n, 0);
+    for(const auto& m : _matches) {
+        if(_trackMatched[m.track] || _detectionMatched[m.detection]) continue;
+        _trackMatched[m.track] = 1;
+        _detectionMatched[m.detection] = 1;
+        Track& tr = _tracks[m.track];
+        size_t d = begin + m.detection;
+        tr.xmin = b.xmin[d];
+        tr.ymin = b.ymin[d];
+        tr.xmax = b.xmax[d];
+        tr.ymax = b.ymax[d];
+        tr.hits++;
+        tr.missed = 0;
+        if(tr.id < 0 && tr.hits >= _config.minHits) {
+            tr.id = _nextId++;
+            _stats.tracks++;
+        }
+        b.trackId[d] = tr.id;
+    }
+
+    // Unmatched tracks age, the ones missed too long end
+    size_t alive = 0;
+    for(size_t t = 0; t < _tracks.size(); t++) {
+        if(!_trackMatched[t] && ++_tracks[t].missed > _config.maxMissed) continue;
+        _tracks[alive++] = _tracks[t];
+    }
+    _tracks.resize(alive);
+
+    // Unmatched detections start tracks
+    for(size_t k = 0; k < n; k++) {
+        if(_detectionMatched[k]) continue;
+        size_t d = begin + k;
+        Track tr{b.label[d], b.xmin[d], b.ymin[d], b.xmax[d], b.ymax[d], -1, 1, 0};
+        if(_config.minHits <= 1) {
+            tr.id = _nextId++;
+            _stats.tracks++;
+        }
+        b.trackId[d] = tr.id;
+        _tracks.push_back(tr);
+    }
+}
+
+void DetectionTracker::record(const DetectionBatch& b, int64_t sequence, size_t begin, size_t end) {
+    FrameDetections& frame = _history[_recorded++ % _history.size()];
+    frame.sequence = sequence;
+    frame.detections.clear();
+    for(size_t i = begin; i < end; i++) {
+        TrackedDetection d;
+        d.label = b.label[i];
+        d.confidence = b.confidence[i];
+        d.xmin = b.xmin[i];
+        d.ymin = b.ymin[i];
+        d.xmax = b.xmax[i];
+        d.ymax = b.ymax[i];
+        d.trackId = b.trackId[i];
+        frame.detections.push_back(d);
+    }
+}
+
+const FrameDetections* DetectionTracker::attach(int64_t sequence, int64_t maxAge) {
+    const FrameDetections* best = nullptr;
+    for(const auto& frame : _history) {
+        if(frame.sequence < 0 || frame.sequence > sequence || sequence - frame.sequence > maxAge) continue;
+        if(!best || frame.sequence > best->sequence) best = &frame;
+    }
+    if(!best) {
+        _stats.unattached++;
+    } else if(best->sequence == sequence) {
+        _stats.attachedExact++;
+    } else {
+        _stats.attachedEarlier++;
+    }
+    return best;
+}
+
+void DetectionTracker::printStats(const char* name) const {
+    double frames = _stats.frames ? double(_stats.frames) : 1.0;
+    printf("%s: %lu frames in %lu batches, per frame %.1f detections, %.1f confident, %.1f kept, %.1f us; %lu tracks, %lu active; "
+           "video frames with detections: %lu same frame, %lu earlier, %lu none\n",
+           name,
+           (unsigned long)_stats.frames,
+           (unsigned long)_stats.batches,
+           _stats.detections / frames,
+           _stats.confident / frames,
+           _stats.kept / frames,
+           _stats.processNs / 1e3 / frames,
+           (unsigned long)_stats.tracks,
+           (unsigned long)_stats.activeTracks,
+           (unsigned long)_stats.attachedExact,
+           (unsigned long)_stats.attachedEarlier,
+           (unsigned long)_stats.unattached);
+}
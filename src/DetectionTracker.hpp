@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Detections of consecutive frames in structure-of-arrays layout, normalized coordinates.
+// Frame f owns detections [frameStart[f], frameStart[f + 1]).
+struct DetectionBatch {
+    std::vector<int64_t> frameSequence;
+    std::vector<uint32_t> frameStart{0};
+    std::vector<uint32_t> label;
+    std::vector<float> confidence;
+    std::vector<float> xmin, ymin, xmax, ymax;
+    std::vector<int32_t> trackId;  // set by DetectionTracker::process(), -1 if not tracked (yet)
+
+    size_t frames() const {
+        return frameSequence.size();
+    }
+    size_t size() const {
+        return label.size();
+    }
+
+    void beginFrame(int64_t sequence) {
+        frameSequence.push_back(sequence);
+        frameStart.push_back(frameStart.back());
+    }
+    // To the frame begun last
+    void add(uint32_t l, float c, float x0, float y0, float x1, float y1) {
+        label.push_back(l);
+        confidence.push_back(c);
+        xmin.push_back(x0);
+        ymin.push_back(y0);
+        xmax.push_back(x1);
+        ymax.push_back(y1);
+        trackId.push_back(-1);
+        frameStart.back()++;
+    }
+    // Keeps the storage
+    void clear();
+    void resize(size_t n);
+};
+
+struct TrackedDetection {
+    uint32_t label = 0;
+    float confidence = 0;
+    float xmin = 0, ymin = 0, xmax = 0, ymax = 0;
+    int32_t trackId = -1;
+};
+
+// What was kept of one frame's detections
+struct FrameDetections {
+    int64_t sequence = -1;
+    std::vector<TrackedDetection> detections;
+};
+
+struct DetectionConfig {
+    float minConfidence = 0.5f;
+    float nmsIou = 0.45f;      // a box overlapping a more confident one of its label by more is dropped
+    size_t maxPerFrame = 200;  // most confident first
+    float trackIou = 0.3f;     // least overlap with a track's last box to continue it
+    int minHits = 2;           // matched frames before a track gets its id
+    int maxMissed = 5;         // frames a track survives unmatched
+    size_t history = 32;       // frames of results kept for attaching to video frames
+};
+
+struct DetectionStats {
+    uint64_t frames = 0;
+    uint64_t batches = 0;
+    uint64_t detections = 0;  // as received
+    uint64_t confident = 0;   // above minConfidence
+    uint64_t kept = 0;        // after NMS and maxPerFrame
+    uint64_t tracks = 0;      // given an id
+    size_t activeTracks = 0;
+    uint64_t processNs = 0;
+    uint64_t attachedExact = 0;    // video frames with detections of the same sequence number
+    uint64_t attachedEarlier = 0;  // with the newest earlier detections instead
+    uint64_t unattached = 0;
+};
+
+// Host-side post-processing of detection network output: confidence threshold, per-label
+// non-maximum suppression and an IoU tracker that gives objects ids stable across frames.
+//
+// Detections are handled in batches of however many frames arrived since the last call, in
+// the SoA layout above, so the loop touches contiguous arrays instead of a message per frame
+// and a struct per box, and all scratch storage is reused. Tracking matches each frame's boxes
+// greedily by IoU against the tracks' last boxes of the same label; a track is reported once it
+// was matched minHits times and ends after maxMissed frames without a match.
+//
+// The results of the last `history` frames are kept by sequence number, which the network
+// output shares with the camera frames it ran on, so attach() finds the detections that belong
+// to a video frame. Not thread-safe; one thread feeds and attaches.
+class DetectionTracker {
+   public:
+    explicit DetectionTracker(const DetectionConfig& config = DetectionConfig());
+
+    // Filters `batch` in place (kept boxes keep their order within a frame), fills trackId and
+    // records each frame's results. Frames must come in sequence order.
+    void process(DetectionBatch& batch);
+
+    // Detections of frame `sequence`, or failing that of the newest frame at most `maxAge`
+    // frames before it; nullptr if there are none
+    const FrameDetections* attach(int64_t sequence, int64_t maxAge = 0);
+
+    void reset();
+    DetectionStats getStats() const {
+        return _stats;
+    }
+    void printStats(const char* name) const;
+
+   private:
+    struct Track {
+        uint32_t label;
+        float xmin, ymin, xmax, ymax;
+        int32_t id;
+        int hits;
+        int missed;
+    };
+    struct Match {
+        float iou;
+        uint32_t track;
+        uint32_t detection;
+    };
+
+    // Returns how many of [begin, end) were kept, moved down to `out`
+    size_t filter(DetectionBatch& batch, size_t begin, size_t end, size_t out);
+    void track(DetectionBatch& batch, size_t begin, size_t end);
+    void record(const DetectionBatch& batch, int64_t sequence, size_t begin, size_t end);
+
+    DetectionConfig _config;
+    std::vector<Track> _tracks;
+    int32_t _nextId = 0;
+    std::vector<FrameDetections> _history;
+    uint64_t _recorded = 0;
+    // Scratch, reused across frames
+    std::vector<uint32_t> _order;
+    std::vector<uint32_t> _kept;
+    std::vector<float> _area;
+    std::vector<Match> _matches;
+    std::vector<uint8_t> _trackMatched;
+    std::vector<uint8_t> _detectionMatched;
+    DetectionStats _stats;
+};
@@ -0,0 +1,146 @@
+#include "DeviceOrchestrator.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "ThreadPolicy.hpp"
+
+namespace {
+
+uint64_t threadCpuNs() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t processCpuNs() {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    auto ns = [](const timeval& tv) { return uint64_t(tv.tv_sec) * 1000000000 + uint64_t(tv.tv_usec) * 1000; };
+    return ns(usage.ru_utime) + ns(usage.ru_stime);
+}
+
+}  // namespace
+
+DeviceOrchestrator::DeviceOrchestrator(FrameSink* sink, size_t mailboxCapacity) : _sink(sink), _mailboxCapacity(mailboxCapacity) {}
+
+DeviceOrchestrator::~DeviceOrchestrator() {
+    stop();
+}
+
+int DeviceOrchestrator::addDevice(const std::string& name, int cpu) {
+    _devices.emplace_back(new Device(name, cpu, _mailboxCapacity));
+    return static_cast<int>(_devices.size()) - 1;
+}
+
+void DeviceOrchestrator::setProcess(Process process) {
+    _process = std::move(process);
+}
+
+void DeviceOrchestrator::start() {
+    if(_running.exchange(true)) return;
+    _started = std::chrono::steady_clock::now();
+    _startCpuNs = processCpuNs();
+    for(size_t i = 0; i < _devices.size(); i++) {
+        Device& device = *_devices[i];
+        device.worker = std::thread(&DeviceOrchestrator::run, this, std::ref(device), static_cast<int>(i));
+    }
+}
+
+void DeviceOrchestrator::stop() {
+    if(!_running.load()) return;
+    for(auto& device : _devices) device->mailbox.close();
+    _running = false;
+    for(auto& device : _devices) {
+        if(device->worker.joinable()) device->worker.join();
+    }
+}
+
+bool DeviceOrchestrator::submit(int device, SinkFrame frame) {
+    if(device < 0 || device >= numDevices()) return false;
+    return _devices[device]->mailbox.push(std::move(frame));
+}
+
+void DeviceOrchestrator::run(Device& device, int id) {
+    ThreadPolicy::global().enter(ThreadRole::Worker, device.name.c_str());
+    // The device's own CPU wins over the worker role's set
+    if(device.cpu >= 0 && !pinThread(pthread_self(), device.cpu)) {
+        printf("%s: can't pin worker to CPU %d\n", device.name.c_str(), device.cpu.load());
+        device.cpu = -1;
+    }
+    SinkFrame frame;
+    // After close() the mailbox still hands out what was queued, then waitPop() fails
+    while(device.mailbox.waitPop(frame, std::chrono::milliseconds(100)) || _running.load()) {
+        if(!frame.data) continue;
+        bool toSink = !_process || _process(id, frame);
+        if(toSink && _sink) {
+            auto it = device.streamNames.find(frame.stream);
+            if(it == device.streamNames.end()) it = device.streamNames.emplace(frame.stream, device.name + "." + frame.stream).first;
+            SinkFrame named = frame;
+            named.stream = it->second.c_str();
+            _sink->consume(named);
+        }
+        device.frames.fetch_add(1, std::memory_order_relaxed);
+        device.bytes.fetch_add(frame.size, std::memory_order_relaxed);
+        device.workerCpuNs.store(threadCpuNs(), std::memory_order_relaxed);
+        frame = SinkFrame();
+    }
+    device.workerCpuNs.store(threadCpuNs(), std::memory_order_relaxed);
+}
+
+DeviceStats DeviceOrchestrator::getStats(int id) const {
+    const Device& device = *_devices[id];
+    auto mailbox = device.mailbox.getStats();
+    DeviceStats stats;
+    stats.name = device.name;
+    stats.cpu = device.cpu;
+    stats.frames = device.frames.load(std::memory_order_relaxed);
+    stats.bytes = device.bytes.load(std::memory_order_relaxed);
+    stats.dropped = mailbox.dropped;
+    stats.workerCpuNs = device.workerCpuNs.load(std::memory_order_relaxed);
+    stats.maxQueued = mailbox.maxOccupancy;
+    return stats;
+}
+
+void DeviceOrchestrator::printStats() const {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _started).count();
+    if(seconds <= 0) return;
+    for(int i = 0; i < numDevices(); i++) {
+        auto stats = getStats(i);
+        char pinned[32] = "";
+        if(stats.cpu >= 0) snprintf(pinned, sizeof(pinned), " on CPU %d", stats.cpu);
+        printf("%-8s %7lu frames (%5.1f fps, %6.1f MB/s), %lu dropped, max %lu queued; worker %5.1f%% CPU%s\n",
+               stats.name.c_str(),
+               (unsigned long)stats.frames,
+               stats.frames / seconds,
+               stats.bytes / seconds / 1e6,
+               (unsigned long)stats.dropped,
+               (unsigned long)stats.maxQueued,
+               stats.workerCpuNs / 1e9 / seconds * 100.0,
+               pinned);
+    }
+    double processCpu = (processCpuNs() - _startCpuNs) / 1e9 / seconds * 100.0;
+    printf("Host CPU %.1f%% for %d devices, %.1f%% per device\n", processCpu, numDevices(), numDevices() ? processCpu / numDevices() : 0.0);
+}
+
+int DeviceOrchestrator::cpuCount() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? static_cast<int>(n) : 1;
+}
+
+int DeviceOrchestrator::spreadCpu(int n) {
+    int cpus = cpuCount();
+    return cpus > 1 ? 1 + n % (cpus - 1) : 0;
+}
+
+bool DeviceOrchestrator::pinThread(std::thread::native_handle_type thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
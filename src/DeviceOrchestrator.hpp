@@ -0,0 +1,96 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "FrameMailbox.hpp"
+#include "FrameSink.hpp"
+
+struct DeviceStats {
+    std::string name;
+    int cpu = -1;             // CPU the worker is pinned to, -1 if not pinned
+    uint64_t frames = 0;      // processed by the worker
+    uint64_t bytes = 0;
+    uint64_t dropped = 0;     // replaced in the mailbox before the worker got to them
+    uint64_t workerCpuNs = 0; // CPU time of the worker thread
+    size_t maxQueued = 0;
+};
+
+// Runs the host side of several devices in one process.
+//
+// Each device gets a mailbox and a worker thread, optionally pinned to a CPU: the device's
+// callback thread only submit()s, and the worker runs the per-frame processing and feeds the
+// sink shared by all devices (sinks are thread-safe). Stream names are prefixed with the
+// device name on the way, "video" from device "cam1" becomes "cam1.video", so one capture
+// file or shared-memory ring holds all devices apart. Frame buffers come from the process-wide
+// FramePool, shared the same way.
+//
+// Devices are anything that calls submit(): depthai queue callbacks in multi-cam, synthetic or
+// replayed stand-ins in host-bench, which is how scaling is measured without N cameras.
+class DeviceOrchestrator {
+   public:
+    // Per-frame work on the device's worker, before the sink; false skips the sink
+    using Process = std::function<bool(int device, const SinkFrame& frame)>;
+
+    explicit DeviceOrchestrator(FrameSink* sink, size_t mailboxCapacity = 4);
+    ~DeviceOrchestrator();
+
+    DeviceOrchestrator(const DeviceOrchestrator&) = delete;
+    DeviceOrchestrator& operator=(const DeviceOrchestrator&) = delete;
+
+    // Before start(); returns the device id. `cpu` -1 leaves the worker unpinned.
+    int addDevice(const std::string& name, int cpu = -1);
+    void setProcess(Process process);
+
+    void start();
+    // Drains the mailboxes and joins the workers
+    void stop();
+
+    // From the device's callback thread; oldest queued frames are dropped when the worker lags
+    bool submit(int device, SinkFrame frame);
+
+    int numDevices() const {
+        return static_cast<int>(_devices.size());
+    }
+    DeviceStats getStats(int device) const;
+    // One line per device plus the process CPU time per device since start()
+    void printStats() const;
+
+    // Online CPUs, and the CPU for the n-th worker when spreading them over all but CPU 0,
+    // which is left to the XLink and UI threads
+    static int cpuCount();
+    static int spreadCpu(int n);
+    static bool pinThread(std::thread::native_handle_type thread, int cpu);
+
+   private:
+    struct Device {
+        std::string name;
+        std::atomic<int> cpu{-1};
+        FrameMailbox<SinkFrame> mailbox;
+        std::thread worker;
+        std::unordered_map<std::string, std::string> streamNames;  // worker thread only
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> workerCpuNs{0};
+
+        Device(const std::string& name, int cpu, size_t capacity)
+            : name(name), cpu{cpu}, mailbox(capacity, MailboxPolicy::DropOldest) {}
+    };
+
+    void run(Device& device, int id);
+
+    FrameSink* _sink;
+    const size_t _mailboxCapacity;
+    Process _process;
+    std::deque<std::unique_ptr<Device>> _devices;
+    std::atomic<bool> _running{false};
+    std::chrono::steady_clock::time_point _started;
+    uint64_t _startCpuNs = 0;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// What happens when the producer outruns the consumer
+enum class MailboxPolicy {
+    LatestWins,  // consumer always takes the newest item, anything older is dropped
+    DropOldest,  // when full, the oldest queued item is evicted to make room
+    Block,       // when full, the producer waits for the consumer
+};
+
+struct MailboxStats {
+    uint64_t pushed = 0;
+    uint64_t popped = 0;
+    uint64_t dropped = 0;
+    size_t occupancy = 0;
+    size_t maxOccupancy = 0;
+};
+
+// Bounded mailbox for handing frames from a device callback thread to a consumer.
+//
+// The ring uses a sequence number per slot, so push/pop never take a lock. It is meant
+// for one producer and one consumer; DropOldest/LatestWins eviction makes the producer
+// act as a second consumer, which the per-slot sequence numbers handle safely.
+// The mutex/condition variable pair is only touched when a thread actually has to sleep
+// (Block policy or waitPop), and notifications are skipped when nobody waits.
+template <typename T>
+class FrameMailbox {
+   public:
+    explicit FrameMailbox(size_t capacity, MailboxPolicy policy = MailboxPolicy::LatestWins)
+        : _policy(policy) {
+        // At least two slots, with one the per-slot sequence can't tell full from empty
+        size_t size = 2;
+        while(size < capacity) size <<= 1;
+        _mask = size - 1;
+        _slots.reset(new Slot[size]);
+        for(size_t i = 0; i < size; i++) _slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    FrameMailbox(const FrameMailbox&) = delete;
+    FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+    // Returns false if the mailbox was closed (the item is discarded)
+    bool push(T item) {
+        if(_closed.load(std::memory_order_acquire)) return false;
+        if(_policy == MailboxPolicy::Block) {
+            while(!tryEnqueue(item)) {
+                std::unique_lock<std::mutex> lock(_waitMtx);
+                _waiters.fetch_add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                _waitCv.wait(lock, [&] { return _closed.load() || size() <= _mask; });
+                _waiters.fetch_sub(1);
+                if(_closed.load()) return false;
+            }
+        } else {
+            while(!tryEnqueue(item)) {
+                T victim;
+                if(tryDequeue(victim)) _dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        _pushed.fetch_add(1, std::memory_order_relaxed);
+        size_t occ = size();
+        size_t prevMax = _maxOccupancy.load(std::memory_order_relaxed);
+        while(occ > prevMax && !_maxOccupancy.compare_exchange_weak(prevMax, occ, std::memory_order_relaxed)) {
+        }
+        wakeWaiters();
+        return true;
+    }
+
+    // Non-blocking; with LatestWins any older queued items are dropped
+    bool tryPop(T& out) {
+        if(!tryDequeue(out)) return false;
+        if(_policy == MailboxPolicy::LatestWins) {
+            T newer;
+            while(tryDequeue(newer)) {
+                out = std::move(newer);
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        _popped.fetch_add(1, std::memory_order_relaxed);
+        wakeWaiters();
+        return true;
+    }
+
+    // Returns false on timeout or when closed and drained
+    template <typename Rep, typename Period>
+    bool waitPop(T& out, std::chrono::duration<Rep, Period> timeout) {
+        if(tryPop(out)) return true;
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        std::unique_lock<std::mutex> lock(_waitMtx);
+        _waiters.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool ready = _waitCv.wait_until(lock, deadline, [&] { return _closed.load() || size() > 0; });
+        _waiters.fetch_sub(1);
+        lock.unlock();
+        return ready && tryPop(out);
+    }
+
+    // Wakes all waiters; further pushes are rejected, queued items can still be popped
+    void close() {
+        _closed.store(true);
+        std::lock_guard<std::mutex> lock(_waitMtx);
+        _waitCv.notify_all();
+    }
+
+    // Drops everything currently queued, without counting it as loss
+    void clear() {
+        T victim;
+        while(tryDequeue(victim)) {
+        }
+        wakeWaiters();
+    }
+
+    size_t size() const {
+        size_t head = _head.load(std::memory_order_acquire);
+        size_t tail = _tail.load(std::memory_order_acquire);
+        return head >= tail ? head - tail : 0;
+    }
+
+    size_t capacity() const {
+        return _mask + 1;
+    }
+
+    MailboxPolicy policy() const {
+        return _policy;
+    }
+
+    MailboxStats getStats() const {
+        MailboxStats stats;
+        stats.pushed = _pushed.load(std::memory_order_relaxed);
+        stats.popped = _popped.load(std::memory_order_relaxed);
+        stats.dropped = _dropped.load(std::memory_order_relaxed);
+        stats.occupancy = size();
+        stats.maxOccupancy = _maxOccupancy.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+   private:
+    struct Slot {
+        std::atomic<size_t> seq{0};
+        T value;
+    };
+
+    bool tryEnqueue(T& item) {
+        size_t pos = _head.load(std::memory_order_relaxed);
+        while(true) {
+            Slot& slot = _slots[pos & _mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(diff == 0) {
+                if(_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(item);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;  // full
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryDequeue(T& out) {
+        size_t pos = _tail.load(std::memory_order_relaxed);
+        while(true) {
+            Slot& slot = _slots[pos & _mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(diff == 0) {
+                if(_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(slot.value);
+                    slot.value = T();  // release the payload now, not when the slot is reused
+                    slot.seq.store(pos + _mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(diff < 0) {
+                return false;  // empty
+            } else {
+                pos = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void wakeWaiters() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(_waiters.load() == 0) return;
+        { std::lock_guard<std::mutex> lock(_waitMtx); }
+        _waitCv.notify_all();
+    }
+
+    const MailboxPolicy _policy;
+    size_t _mask = 0;
+    std::unique_ptr<Slot[]> _slots;
+
+    // Keep the producer and consumer indices on separate cache lines
+    char _pad0[64];
+    std::atomic<size_t> _head{0};
+    char _pad1[64];
+    std::atomic<size_t> _tail{0};
+    char _pad2[64];
+
+    std::atomic<uint64_t> _pushed{0};
+    std::atomic<uint64_t> _popped{0};
+    std::atomic<uint64_t> _dropped{0};
+    std::atomic<size_t> _maxOccupancy{0};
+
+    std::atomic<bool> _closed{false};
+    std::atomic<int> _waiters{0};
+    std::mutex _waitMtx;
+    std::condition_variable _waitCv;
+};
@@ -0,0 +1,141 @@
+#include "FramePool.hpp"
+
+#include <cstdio>
+
+FramePool::FramePool(size_t maxCachedBytes, size_t minPooledBytes) : _maxCachedBytes(maxCachedBytes), _minPooledBytes(minPooledBytes) {}
+
+FramePool::~FramePool() {
+    trim();
+}
+
+FramePool& FramePool::installAsDefault(size_t maxCachedBytes) {
+    static FramePool* pool = new FramePool(maxCachedBytes);
+    cv::Mat::setDefaultAllocator(pool);
+    return *pool;
+}
+
+// Same layout rules as OpenCV's StdMatAllocator, only the buffer source differs
+cv::UMatData* FramePool::allocate(int dims, const int* sizes, int type, void* data0, size_t* step, cv::AccessFlag, cv::UMatUsageFlags) const {
+    size_t total = CV_ELEM_SIZE(type);
+    for(int i = dims - 1; i >= 0; i--) {
+        if(step) {
+            if(data0 && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+    uint8_t* data = data0 ? static_cast<uint8_t*>(data0) : acquire(total);
+    auto* u = new cv::UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if(data0) u->flags |= cv::UMatData::USER_ALLOCATED;
+    return u;
+}
+
+bool FramePool::allocate(cv::UMatData* u, cv::AccessFlag, cv::UMatUsageFlags) const {
+    return u != nullptr;
+}
+
+void FramePool::deallocate(cv::UMatData* u) const {
+    if(!u) return;
+    CV_Assert(u->urefcount == 0);
+    CV_Assert(u->refcount == 0);
+    if(!(u->flags & cv::UMatData::USER_ALLOCATED)) {
+        release(u->origdata, u->size);
+        u->origdata = nullptr;
+    }
+    delete u;
+}
+
+uint8_t* FramePool::acquire(size_t size) const {
+    if(size >= _minPooledBytes) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _free.find(size);
+        if(it != _free.end()) it->second.lastUsed = ++_clock;
+        if(it != _free.end() && !it->second.buffers.empty()) {
+            uint8_t* data = it->second.buffers.back();
+            it->second.buffers.pop_back();
+            _stats.hits++;
+            _stats.cachedBytes -= size;
+            _stats.cachedBuffers--;
+            return data;
+        }
+        _stats.misses++;
+    }
+    return static_cast<uint8_t*>(cv::fastMalloc(size));
+}
+
+void FramePool::release(uint8_t* data, size_t size) const {
+    if(size >= _minPooledBytes) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if(size <= _maxCachedBytes && _stats.cachedBytes + size > _maxCachedBytes) evictFor(size);
+        if(_stats.cachedBytes + size <= _maxCachedBytes) {
+            auto& sizeClass = _free[size];
+            sizeClass.buffers.push_back(data);
+            sizeClass.lastUsed = ++_clock;
+            _stats.cachedBytes += size;
+            _stats.cachedBuffers++;
+            return;
+        }
+        _stats.evictions++;
+    }
+    cv::fastFree(data);
+}
+
+void FramePool::evictFor(size_t size) const {
+    while(_stats.cachedBytes + size > _maxCachedBytes) {
+        // A handful of size classes at most, a scan is cheap
+        auto oldest = _free.end();
+        for(auto it = _free.begin(); it != _free.end();) {
+            if(it->first != size && it->second.buffers.empty()) {
+                it = _free.erase(it);
+                continue;
+            }
+            if(it->first != size && (oldest == _free.end() || it->second.lastUsed < oldest->second.lastUsed)) oldest = it;
+            ++it;
+        }
+        // Nothing but this size is cached; the caller frees the new buffer instead
+        if(oldest == _free.end()) return;
+        auto& buffers = oldest->second.buffers;
+        while(!buffers.empty() && _stats.cachedBytes + size > _maxCachedBytes) {
+            cv::fastFree(buffers.back());
+            buffers.pop_back();
+            _stats.cachedBytes -= oldest->first;
+            _stats.cachedBuffers--;
+            _stats.evictions++;
+        }
+        if(buffers.empty()) _free.erase(oldest);
+    }
+}
+
+void FramePool::trim() {
+    std::lock_guard<std::mutex> lock(_mtx);
+    for(auto& entry : _free) {
+        for(auto* data : entry.second.buffers) cv::fastFree(data);
+    }
+    _free.clear();
+    _stats.cachedBytes = 0;
+    _stats.cachedBuffers = 0;
+}
+
+FramePoolStats FramePool::getStats() const {
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _stats;
+}
+
+void FramePool::printStats(const char* name) const {
+    auto stats = getStats();
+    uint64_t total = stats.hits + stats.misses;
+    printf("%s: %lu hits, %lu misses (%.1f%% hit rate), %lu evictions, %zu buffers / %.1f MB cached\n",
+           name,
+           (unsigned long)stats.hits,
+           (unsigned long)stats.misses,
+           total ? 100.0 * stats.hits / total : 0.0,
+           (unsigned long)stats.evictions,
+           stats.cachedBuffers,
+           stats.cachedBytes / 1048576.0);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+struct FramePoolStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;  // buffers freed because the cache was at its cap, older sizes first
+    size_t cachedBytes = 0;
+    size_t cachedBuffers = 0;
+};
+
+// cv::MatAllocator that recycles frame-sized buffers instead of returning them to malloc.
+//
+// Freed buffers are kept in free lists keyed by their exact byte size, so a stream that keeps
+// producing the same frame size reuses the same few buffers. Buffers smaller than
+// `minPooledBytes` are not worth pooling and go straight to cv::fastMalloc/fastFree. The
+// cache never holds more than `maxCachedBytes`; when a freed buffer would exceed it, the size
+// classes used least recently are released first, so a stream that changes its frame size
+// (e.g. a runtime crop) gets the cache back for the new size.
+class FramePool : public cv::MatAllocator {
+   public:
+    explicit FramePool(size_t maxCachedBytes = 64 << 20, size_t minPooledBytes = 64 << 10);
+    ~FramePool() override;
+
+    // Makes a process-wide pool the default allocator for all cv::Mat, so every stream shares it.
+    // The pool is intentionally never destroyed, Mats may outlive main().
+    static FramePool& installAsDefault(size_t maxCachedBytes = 64 << 20);
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags)
+        const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+    // Frees all cached buffers
+    void trim();
+
+    FramePoolStats getStats() const;
+    void printStats(const char* name) const;
+
+   private:
+    struct SizeClass {
+        std::vector<uint8_t*> buffers;
+        uint64_t lastUsed = 0;
+    };
+
+    uint8_t* acquire(size_t size) const;
+    void release(uint8_t* data, size_t size) const;
+    // Frees cached buffers of other sizes, least recently used first, until `size` more fit
+    void evictFor(size_t size) const;
+
+    const size_t _maxCachedBytes;
+    const size_t _minPooledBytes;
+
+    mutable std::mutex _mtx;
+    mutable std::unordered_map<size_t, SizeClass> _free;
+    mutable uint64_t _clock = 0;
+    mutable FramePoolStats _stats;
+};
@@ -0,0 +1,75 @@
+#include "FrameSink.hpp"
+
+#include <cstdio>
+
+void FrameSink::printStats(const char* name) const {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _created).count();
+    printf("%s: %lu frames, %.2f MB, %.2f frames/s, %.2f MB/s\n",
+           name,
+           (unsigned long)frames(),
+           bytes() / 1048576.0,
+           seconds > 0 ? frames() / seconds : 0.0,
+           seconds > 0 ? bytes() / 1048576.0 / seconds : 0.0);
+}
+
+bool FileSink::open(const std::string& path) {
+    return _writer.open(path);
+}
+
+bool FileSink::consume(const SinkFrame& frame) {
+    int stream;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _streams.find(frame.stream);
+        if(it == _streams.end()) it = _streams.emplace(frame.stream, _writer.addStream(frame.stream)).first;
+        stream = it->second;
+    }
+    if(!_writer.append(stream, frame.info, frame.owner, frame.data, frame.size)) return false;
+    count(frame);
+    return true;
+}
+
+void FileSink::close() {
+    _writer.close();
+}
+
+bool ShmSink::open(const std::string& name, uint32_t slots, size_t slotCapacity) {
+    if(!_publisher.open(name, slots, slotCapacity)) return false;
+    printf("Publishing frames to shared memory %s, %u slots of %.1f MB\n", name.c_str(), slots, slotCapacity / 1048576.0);
+    return true;
+}
+
+bool ShmSink::consume(const SinkFrame& frame) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(!_publisher.publish(frame.stream, frame.info, frame.data, frame.size)) return false;
+    count(frame);
+    return true;
+}
+
+void ShmSink::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto stats = _publisher.getStats();
+    if(stats.tooLarge) printf("Shared memory: %lu frames too large for a slot\n", (unsigned long)stats.tooLarge);
+    _publisher.close();
+}
+
+ShmPublisherStats ShmSink::getStats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _publisher.getStats();
+}
+
+std::unique_ptr<FrameSink> makeFrameSink(const std::string& spec) {
+    if(spec == "null") return std::unique_ptr<FrameSink>(new NullSink());
+    if(spec.compare(0, 5, "file:") == 0 && spec.size() > 5) {
+        std::unique_ptr<FileSink> sink(new FileSink());
+        if(!sink->open(spec.substr(5))) return nullptr;
+        return std::unique_ptr<FrameSink>(std::move(sink));
+    }
+    if(spec.compare(0, 4, "shm:") == 0 && spec.size() > 4) {
+        std::unique_ptr<ShmSink> sink(new ShmSink());
+        if(!sink->open(spec.substr(4))) return nullptr;
+        return std::unique_ptr<FrameSink>(std::move(sink));
+    }
+    printf("Unknown sink '%s', expected null, file:<path> or shm:<name>\n", spec.c_str());
+    return nullptr;
+}
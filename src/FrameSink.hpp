@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "CaptureFile.hpp"
+#include "ShmFrameRing.hpp"
+
+// One frame handed to a sink; `data` stays valid while `owner` is held
+struct SinkFrame {
+    const char* stream = "";
+    CaptureInfo info;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<const void> owner;
+};
+
+// Destination for frames in headless mode. consume() is called on the thread that received
+// the frame and must not block for long; sinks that do I/O hand the frame to their own thread.
+class FrameSink {
+   public:
+    virtual ~FrameSink() = default;
+
+    virtual bool consume(const SinkFrame& frame) = 0;
+    // Flushes and releases resources; consume() fails afterwards
+    virtual void close() {}
+
+    uint64_t frames() const {
+        return _frames.load(std::memory_order_relaxed);
+    }
+    uint64_t bytes() const {
+        return _bytes.load(std::memory_order_relaxed);
+    }
+    // Frames and throughput since the sink was created
+    void printStats(const char* name) const;
+
+   protected:
+    void count(const SinkFrame& frame) {
+        _frames.fetch_add(1, std::memory_order_relaxed);
+        _bytes.fetch_add(frame.size, std::memory_order_relaxed);
+    }
+
+   private:
+    std::atomic<uint64_t> _frames{0};
+    std::atomic<uint64_t> _bytes{0};
+    const std::chrono::steady_clock::time_point _created = std::chrono::steady_clock::now();
+};
+
+// Counts and drops, for measuring the maximum rate of everything upstream
+class NullSink : public FrameSink {
+   public:
+    bool consume(const SinkFrame& frame) override {
+        count(frame);
+        return true;
+    }
+};
+
+// Records into a capture file (see CaptureFile.hpp), one capture stream per frame stream
+class FileSink : public FrameSink {
+   public:
+    bool open(const std::string& path);
+    bool consume(const SinkFrame& frame) override;
+    void close() override;
+
+    const CaptureWriter& writer() const {
+        return _writer;
+    }
+
+   private:
+    CaptureWriter _writer;
+    std::mutex _mutex;
+    std::unordered_map<std::string, int> _streams;
+};
+
+// Publishes into a shared-memory ring (see ShmFrameRing.hpp) for other processes on the host
+class ShmSink : public FrameSink {
+   public:
+    // Default slots fit a 4K NV12 frame
+    static constexpr uint32_t kSlots = 8;
+    static constexpr size_t kSlotCapacity = 3840 * 2160 * 3 / 2;
+
+    bool open(const std::string& name, uint32_t slots = kSlots, size_t slotCapacity = kSlotCapacity);
+    bool consume(const SinkFrame& frame) override;
+    void close() override;
+
+    ShmPublisherStats getStats();
+
+   private:
+    ShmRingPublisher _publisher;
+    std::mutex _mutex;
+};
+
+class CallbackSink : public FrameSink {
+   public:
+    using Callback = std::function<void(const SinkFrame& frame)>;
+
+    explicit CallbackSink(Callback callback) : _callback(std::move(callback)) {}
+
+    bool consume(const SinkFrame& frame) override {
+        count(frame);
+        _callback(frame);
+        return true;
+    }
+
+   private:
+    Callback _callback;
+};
+
+// "null", "file:<path>" or "shm:<name>"; nullptr and a message for anything else
+std::unique_ptr<FrameSink> makeFrameSink(const std::string& spec);
@@ -0,0 +1,137 @@
+#include "PdafDecoder.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr int kHeaderBytes = 5;
+constexpr int kWindowBytes = 5;
+constexpr int kWindowsPerRow = 16;
+// Header plus the invalid first window
+constexpr int kFirstWindow = kHeaderBytes + kWindowBytes;
+
+inline void gridSize(PdafMode mode, int& width, int& height) {
+    width = mode == PdafMode::Grid8x6 ? 8 : 16;
+    height = mode == PdafMode::Grid8x6 ? 6 : 12;
+}
+
+// Branch-free decode of one window. With the 5 bytes read big-endian into w:
+//   confidence = w[39:32] w[29:27]
+//   phase      = sign w[26], then w[25:24] w[23:22] w[19:16] w[15:14]
+// (w[31:30] and w[21:20] are not part of either value)
+inline void decodeWindow(const uint8_t* p, uint16_t& conf, float& phase) {
+    uint64_t w = static_cast<uint64_t>(p[0]) << 32 | static_cast<uint64_t>(p[1]) << 24 | static_cast<uint64_t>(p[2]) << 16
+                 | static_cast<uint64_t>(p[3]) << 8 | p[4];
+    conf = static_cast<uint16_t>(((w >> 32) & 0xFF) << 3 | ((w >> 27) & 0x7));
+    uint32_t raw = static_cast<uint32_t>(((w >> 26) & 1) << 10 | ((w >> 24) & 0x3) << 8 | ((w >> 22) & 0x3) << 6 | ((w >> 16) & 0xF) << 2
+                                         | ((w >> 14) & 0x3));
+    // Sign-extend the 11-bit value, 4 subpixel bits
+    int32_t value = static_cast<int32_t>(raw << 21) >> 21;
+    phase = value * (1.0f / 16);
+}
+
+}  // namespace
+
+size_t pdafPayloadSize(PdafMode mode) {
+    int width, height;
+    gridSize(mode, width, height);
+    return kFirstWindow + static_cast<size_t>(height) * kWindowsPerRow * kWindowBytes;
+}
+
+bool decodePdaf(const uint8_t* data, size_t size, PdafMode mode, PdafGrid& grid) {
+    if(data == nullptr || size < pdafPayloadSize(mode)) return false;
+    gridSize(mode, grid.width, grid.height);
+    grid.flexMask = data[0];
+    grid.confidence.resize(grid.width * grid.height);
+    grid.phase.resize(grid.width * grid.height);
+
+    uint16_t* conf = grid.confidence.data();
+    float* phase = grid.phase.data();
+    const uint8_t* row = data + kFirstWindow;
+    for(int i = 0; i < grid.height; i++) {
+        // 16 windows per row in the packet, in 8x6 mode only the first 8 are valid
+        for(int j = 0; j < grid.width; j++) decodeWindow(row + j * kWindowBytes, conf[j], phase[j]);
+        conf += grid.width;
+        phase += grid.width;
+        row += kWindowsPerRow * kWindowBytes;
+    }
+    return true;
+}
+
+PdafFocusMetric::PdafFocusMetric(float smoothing, int minConfidence) : _smoothing(smoothing), _minConfidence(minConfidence) {}
+
+void PdafFocusMetric::setRoi(int col0, int row0, int col1, int row1) {
+    _roi[0] = col0;
+    _roi[1] = row0;
+    _roi[2] = col1;
+    _roi[3] = row1;
+}
+
+void PdafFocusMetric::reset() {
+    _valid = false;
+    _defocus = 0;
+    _confidence = 0;
+    _sw = _sx = _sy = _sxx = _sxy = 0;
+}
+
+bool PdafFocusMetric::update(const PdafGrid& grid, int lensPosition) {
+    int col0 = 0, row0 = 0, col1 = grid.width, row1 = grid.height;
+    if(_roi[2] > _roi[0] && _roi[3] > _roi[1]) {
+        col0 = std::max(0, _roi[0]);
+        row0 = std::max(0, _roi[1]);
+        col1 = std::min(grid.width, _roi[2]);
+        row1 = std::min(grid.height, _roi[3]);
+    }
+
+    double weightSum = 0, phaseSum = 0;
+    int count = 0;
+    for(int i = row0; i < row1; i++) {
+        for(int j = col0; j < col1; j++) {
+            int conf = grid.conf(i, j);
+            // Branch-free threshold: low-confidence windows get zero weight
+            double weight = conf >= _minConfidence ? conf : 0;
+            weightSum += weight;
+            phaseSum += weight * grid.pd(i, j);
+            count += conf >= _minConfidence;
+        }
+    }
+    if(count == 0) return false;
+
+    float defocus = static_cast<float>(phaseSum / weightSum);
+    float confidence = static_cast<float>(weightSum / count);
+    if(!_valid) {
+        _defocus = defocus;
+        _confidence = confidence;
+        _valid = true;
+    } else {
+        _defocus += _smoothing * (defocus - _defocus);
+        _confidence += _smoothing * (confidence - _confidence);
+    }
+
+    if(lensPosition >= 0) {
+        // Older samples decay, so the fit follows scene changes
+        double decay = 1.0 - _smoothing;
+        _sw = _sw * decay + 1;
+        _sx = _sx * decay + lensPosition;
+        _sy = _sy * decay + defocus;
+        _sxx = _sxx * decay + double(lensPosition) * lensPosition;
+        _sxy = _sxy * decay + double(lensPosition) * defocus;
+    }
+    return true;
+}
+
+float PdafFocusMetric::quality() const {
+    return _valid ? 1.0f / (1.0f + std::fabs(_defocus)) : 0.0f;
+}
+
+int PdafFocusMetric::estimateLensPosition(int lensMin, int lensMax) const {
+    double denom = _sw * _sxx - _sx * _sx;
+    // Needs some spread in lens positions for the slope to mean anything
+    if(_sw < 2 || denom <= 1e-6 * _sw * _sw) return -1;
+    double a = (_sw * _sxy - _sx * _sy) / denom;
+    double b = (_sy - a * _sx) / _sw;
+    if(std::fabs(a) < 1e-9) return -1;
+    double lens = -b / a;
+    return static_cast<int>(std::lround(std::min<double>(lensMax, std::max<double>(lensMin, lens))));
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decoder for the PDAF statistics the sensor sends with `setRawMetadataOnly(true)`.
+//
+// Layout: a 5-byte header (byte 0: flexible ROI bitmask), one always-invalid window, then
+// `height` rows of 16 windows of 5 bytes each; in 8x6 mode only the first 8 windows of a row
+// are valid. Each window holds an 11-bit confidence and an 11-bit signed phase difference
+// with 4 fractional bits.
+
+enum class PdafMode { Grid16x12, Grid8x6 };
+
+struct PdafGrid {
+    int width = 0;
+    int height = 0;
+    uint8_t flexMask = 0;
+    std::vector<uint16_t> confidence;  // row-major, width * height
+    std::vector<float> phase;          // pixels of phase shift, row-major
+
+    uint16_t conf(int row, int col) const {
+        return confidence[row * width + col];
+    }
+    float pd(int row, int col) const {
+        return phase[row * width + col];
+    }
+};
+
+// Bytes the decoder reads for `mode`
+size_t pdafPayloadSize(PdafMode mode);
+
+// Decodes into `grid`, reusing its storage. Returns false if `size` is too small.
+bool decodePdaf(const uint8_t* data, size_t size, PdafMode mode, PdafGrid& grid);
+
+// Focus quality from successive PDAF grids, for driving the lens from the host.
+//
+// Each update() reduces the grid (optionally a window ROI) to a confidence-weighted mean
+// phase: its magnitude is the defocus, its sign the direction. Values are smoothed with an
+// exponential moving average. When lens positions are passed, a decayed least-squares fit of
+// phase against lens position estimates where the phase crosses zero, i.e. the in-focus
+// lens position.
+class PdafFocusMetric {
+   public:
+    explicit PdafFocusMetric(float smoothing = 0.3f, int minConfidence = 64);
+
+    // ROI in window coordinates, [col0, col1) x [row0, row1); an empty ROI uses the whole grid
+    void setRoi(int col0, int row0, int col1, int row1);
+
+    // Returns false if no window in the ROI had enough confidence
+    bool update(const PdafGrid& grid, int lensPosition = -1);
+    void reset();
+
+    // Smoothed confidence-weighted phase (pixels); ~0 when in focus
+    float defocus() const {
+        return _defocus;
+    }
+    // Smoothed mean confidence of the windows that passed the threshold
+    float confidence() const {
+        return _confidence;
+    }
+    // 1 when in focus, falling towards 0 with increasing defocus
+    float quality() const;
+    bool valid() const {
+        return _valid;
+    }
+
+    // Estimated in-focus lens position, or -1 until enough distinct lens positions were seen
+    int estimateLensPosition(int lensMin = 0, int lensMax = 255) const;
+
+   private:
+    float _smoothing;
+    int _minConfidence;
+    int _roi[4] = {0, 0, 0, 0};
+
+    bool _valid = false;
+    float _defocus = 0;
+    float _confidence = 0;
+
+    // Decayed sums for the phase = a * lens + b fit
+    double _sw = 0, _sx = 0, _sy = 0, _sxx = 0, _sxy = 0;
+};
@@ -0,0 +1,124 @@
+#include "PipelineCache.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'A', 'I', 'P', 'I', 'P', 'E', '1'};
+
+struct EntryHeader {
+    char magic[8];
+    uint32_t keySize;
+    uint32_t reserved;
+    uint64_t payloadSize;
+    uint64_t payloadHash;
+};
+
+// mkdir -p
+bool makeDirs(const std::string& dir) {
+    for(size_t pos = 1; pos <= dir.size(); pos++) {
+        if(pos < dir.size() && dir[pos] != '/') continue;
+        std::string part = dir.substr(0, pos);
+        if(mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+PipelineCache::PipelineCache(const std::string& dir) : _dir(dir) {
+    if(!_dir.empty()) return;
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+    if(xdg && *xdg) {
+        _dir = std::string(xdg) + "/oak-pipelines";
+    } else {
+        _dir = std::string(home && *home ? home : "/tmp") + "/.cache/oak-pipelines";
+    }
+}
+
+uint64_t PipelineCache::hash(const void* data, size_t size, uint64_t seed) {
+    // FNV-1a
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint64_t h = seed;
+    for(size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::string PipelineCache::pathFor(const std::string& key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016" PRIx64 ".pipeline", hash(key.data(), key.size()));
+    return _dir + name;
+}
+
+bool PipelineCache::load(const std::string& key, std::vector<uint8_t>& payload) {
+    FILE* f = fopen(pathFor(key).c_str(), "rb");
+    if(!f) {
+        _stats.misses++;
+        return false;
+    }
+    // The sizes in the header are only trusted as far as the file backs them, so a corrupt
+    // entry can't make the payload allocation arbitrarily large
+    struct stat st;
+    EntryHeader header;
+    std::string storedKey;
+    bool ok = fstat(fileno(f), &st) == 0 && fread(&header, sizeof(header), 1, f) == 1 && std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+              header.keySize == key.size();
+    uint64_t remaining = ok && static_cast<uint64_t>(st.st_size) >= sizeof(header) + header.keySize ? st.st_size - sizeof(header) - header.keySize : 0;
+    if(ok) {
+        storedKey.resize(header.keySize);
+        ok = fread(&storedKey[0], 1, storedKey.size(), f) == storedKey.size() && storedKey == key;
+    }
+    if(ok) ok = header.payloadSize <= remaining;
+    if(ok) {
+        payload.resize(header.payloadSize);
+        ok = fread(payload.data(), 1, payload.size(), f) == payload.size() && hash(payload.data(), payload.size()) == header.payloadHash;
+    }
+    fclose(f);
+    if(!ok) {
+        payload.clear();
+        _stats.rejected++;
+        return false;
+    }
+    _stats.hits++;
+    return true;
+}
+
+bool PipelineCache::store(const std::string& key, const std::vector<uint8_t>& payload) {
+    if(!makeDirs(_dir)) {
+        printf("Pipeline cache: can't create %s: %s\n", _dir.c_str(), strerror(errno));
+        return false;
+    }
+    std::string path = pathFor(key);
+    std::string tmp = path + "." + std::to_string(getpid()) + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if(!f) {
+        printf("Pipeline cache: can't write %s: %s\n", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    EntryHeader header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.keySize = static_cast<uint32_t>(key.size());
+    header.reserved = 0;
+    header.payloadSize = payload.size();
+    header.payloadHash = hash(payload.data(), payload.size());
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(key.data(), 1, key.size(), f) == key.size() &&
+              fwrite(payload.data(), 1, payload.size(), f) == payload.size();
+    ok = fclose(f) == 0 && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return false;
+    }
+    _stats.stored++;
+    return true;
+}
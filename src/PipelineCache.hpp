@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PipelineCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t rejected = 0;  // present but truncated, corrupt or for another key
+    uint64_t stored = 0;
+};
+
+// On-disk cache of serialized pipelines keyed by the configuration that produced them.
+//
+// One file per key, named after the key's hash: a header with magic, sizes and the payload
+// checksum, then the key itself (so a hash collision is a miss, not a wrong pipeline) and the
+// payload. store() writes a temporary file and renames it over the old one, so a crash or a
+// concurrent launch never leaves a half-written entry behind. The key should include
+// everything the pipeline depends on, including the depthai version.
+class PipelineCache {
+   public:
+    // Empty `dir`: $XDG_CACHE_HOME/oak-pipelines, or ~/.cache/oak-pipelines
+    explicit PipelineCache(const std::string& dir = "");
+
+    bool load(const std::string& key, std::vector<uint8_t>& payload);
+    bool store(const std::string& key, const std::vector<uint8_t>& payload);
+    // File an entry for `key` lives in
+    std::string pathFor(const std::string& key) const;
+
+    const std::string& dir() const {
+        return _dir;
+    }
+    PipelineCacheStats getStats() const {
+        return _stats;
+    }
+
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+   private:
+    std::string _dir;
+    PipelineCacheStats _stats;
+};
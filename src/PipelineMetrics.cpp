@@ -0,0 +1,164 @@
+#include "PipelineMetrics.hpp"
+
+#include <algorithm>
+
+namespace {
+
+std::atomic<uint64_t> nextMetricsId{1};
+
+// Shard of the metrics instance this thread recorded to last
+struct ShardCache {
+    uint64_t owner = 0;
+    void* shard = nullptr;
+};
+thread_local ShardCache shardCache;
+
+}  // namespace
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for(int i = 0; i < kBuckets; i++) _counts[i] += other._counts[i];
+    _total += other._total;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+    if(_total == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::max(0.0, std::min(1.0, q)) * (_total - 1));
+    uint64_t seen = 0;
+    for(int i = 0; i < kBuckets; i++) {
+        seen += _counts[i];
+        if(seen > rank) {
+            uint64_t low = bucketLow(i);
+            uint64_t high = i + 1 < kBuckets ? bucketLow(i + 1) : low;
+            return low + (high - low) / 2;
+        }
+    }
+    return bucketLow(kBuckets - 1);
+}
+
+PipelineMetrics::Stage::Stage() {
+    for(auto& c : counts) c.store(0, std::memory_order_relaxed);
+}
+
+PipelineMetrics::Shard::Shard() {
+    for(auto& s : stages) s.store(nullptr, std::memory_order_relaxed);
+}
+
+PipelineMetrics::Shard::~Shard() {
+    for(auto& s : stages) delete s.load();
+}
+
+PipelineMetrics::PipelineMetrics() : _id(nextMetricsId++), _lastPrint(std::chrono::steady_clock::now()) {}
+
+PipelineMetrics::~PipelineMetrics() {
+    if(shardCache.owner == _id) shardCache = ShardCache();
+}
+
+int PipelineMetrics::addStage(const std::string& name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    int stage = _numStages.load();
+    if(stage >= kMaxStages) return -1;
+    _names[stage] = name;
+    _numStages = stage + 1;
+    return stage;
+}
+
+PipelineMetrics::Shard* PipelineMetrics::localShard() {
+    if(shardCache.owner == _id) return static_cast<Shard*>(shardCache.shard);
+    // First record from this thread, or it recorded to other metrics in between. Shards live as
+    // long as the metrics, threads may come and go.
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto self = std::this_thread::get_id();
+    auto it = std::find_if(_shards.begin(), _shards.end(), [self](const std::unique_ptr<Shard>& s) { return s->thread == self; });
+    if(it == _shards.end()) {
+        _shards.emplace_back(new Shard());
+        _shards.back()->thread = self;
+        it = _shards.end() - 1;
+    }
+    shardCache.owner = _id;
+    shardCache.shard = it->get();
+    return it->get();
+}
+
+void PipelineMetrics::record(int stage, uint64_t latencyNs) {
+    if(stage < 0 || stage >= kMaxStages) return;
+    Shard* shard = localShard();
+    Stage* s = shard->stages[stage].load(std::memory_order_relaxed);
+    if(s == nullptr) {
+        s = new Stage();
+        shard->stages[stage].store(s, std::memory_order_release);
+    }
+    bump(s->counts[LatencyHistogram::bucketOf(latencyNs)], 1);
+    bump(s->sumNs, latencyNs);
+    if(latencyNs > s->maxNs.load(std::memory_order_relaxed)) s->maxNs.store(latencyNs, std::memory_order_relaxed);
+    bump(s->count, 1);
+}
+
+std::vector<StageSnapshot> PipelineMetrics::snapshot() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    int numStages = _numStages.load();
+    std::vector<StageSnapshot> stages(numStages);
+    for(int i = 0; i < numStages; i++) stages[i].name = _names[i];
+    for(const auto& shard : _shards) {
+        for(int i = 0; i < numStages; i++) {
+            const Stage* s = shard->stages[i].load(std::memory_order_acquire);
+            if(s == nullptr) continue;
+            StageSnapshot& out = stages[i];
+            for(int b = 0; b < LatencyHistogram::kBuckets; b++) {
+                uint64_t n = s->counts[b].load(std::memory_order_relaxed);
+                if(n) out.histogram.add(b, n);
+            }
+            out.count += s->count.load(std::memory_order_relaxed);
+            out.sumNs += s->sumNs.load(std::memory_order_relaxed);
+            out.maxNs = std::max(out.maxNs, s->maxNs.load(std::memory_order_relaxed));
+        }
+    }
+    return stages;
+}
+
+void PipelineMetrics::printSummary() {
+    auto now = std::chrono::steady_clock::now();
+    auto stages = snapshot();
+    double seconds = std::chrono::duration<double>(now - _lastPrint).count();
+    _lastPrint = now;
+    for(size_t i = 0; i < stages.size(); i++) {
+        const auto& s = stages[i];
+        double rate = seconds > 0 ? (s.count - _lastCounts[i]) / seconds : 0.0;
+        _lastCounts[i] = s.count;
+        if(s.count == 0) continue;
+        printf("%-20s %7.2f /s  latency ms: mean %7.2f  p50 %7.2f  p90 %7.2f  p99 %7.2f  max %7.2f\n",
+               s.name.c_str(),
+               rate,
+               s.meanNs() / 1e6,
+               s.histogram.percentile(0.5) / 1e6,
+               s.histogram.percentile(0.9) / 1e6,
+               s.histogram.percentile(0.99) / 1e6,
+               s.maxNs / 1e6);
+    }
+}
+
+bool PipelineMetrics::printEvery(std::chrono::steady_clock::duration interval) {
+    if(std::chrono::steady_clock::now() - _lastPrint < interval) return false;
+    printSummary();
+    return true;
+}
+
+void PipelineMetrics::writeJson(FILE* out) const {
+    auto stages = snapshot();
+    fprintf(out, "{\"stages\": [");
+    for(size_t i = 0; i < stages.size(); i++) {
+        const auto& s = stages[i];
+        fprintf(out,
+                "%s\n  {\"name\": \"%s\", \"count\": %lu, \"mean_ns\": %.0f, \"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, "
+                "\"max_ns\": %lu}",
+                i ? "," : "",
+                s.name.c_str(),
+                (unsigned long)s.count,
+                s.meanNs(),
+                (unsigned long)s.histogram.percentile(0.5),
+                (unsigned long)s.histogram.percentile(0.9),
+                (unsigned long)s.histogram.percentile(0.99),
+                (unsigned long)s.histogram.percentile(0.999),
+                (unsigned long)s.maxNs);
+    }
+    fprintf(out, "\n]}\n");
+}
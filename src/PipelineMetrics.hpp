@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Log-linear latency histogram (HDR style): 16 linear sub-buckets per power of two, so every
+// value is kept to ~6% precision from 1 ns up to ~18 minutes in 592 buckets.
+class LatencyHistogram {
+   public:
+    static constexpr int kSubBits = 4;
+    static constexpr int kSubBuckets = 1 << kSubBits;
+    static constexpr int kMaxBits = 40;
+    static constexpr int kBuckets = (kMaxBits - kSubBits + 1) * kSubBuckets;
+
+    static int bucketOf(uint64_t ns) {
+        if(ns < kSubBuckets) return static_cast<int>(ns);
+        if(ns >> kMaxBits) return kBuckets - 1;
+        int exp = 63 - __builtin_clzll(ns);
+        return (exp - kSubBits + 1) * kSubBuckets + static_cast<int>((ns >> (exp - kSubBits)) & (kSubBuckets - 1));
+    }
+    // Smallest value that lands in `bucket`
+    static uint64_t bucketLow(int bucket) {
+        if(bucket < kSubBuckets) return bucket;
+        int exp = bucket / kSubBuckets + kSubBits - 1;
+        return uint64_t(kSubBuckets + bucket % kSubBuckets) << (exp - kSubBits);
+    }
+
+    void add(int bucket, uint64_t count) {
+        _counts[bucket] += count;
+        _total += count;
+    }
+    void merge(const LatencyHistogram& other);
+
+    uint64_t count() const {
+        return _total;
+    }
+    // Value at quantile q in [0, 1], as the midpoint of its bucket
+    uint64_t percentile(double q) const;
+
+   private:
+    std::array<uint64_t, kBuckets> _counts{};
+    uint64_t _total = 0;
+};
+
+struct StageSnapshot {
+    std::string name;
+    LatencyHistogram histogram;
+    uint64_t count = 0;
+    uint64_t sumNs = 0;
+    uint64_t maxNs = 0;
+
+    double meanNs() const {
+        return count ? double(sumNs) / count : 0.0;
+    }
+};
+
+// Per-stage latency and rate instrumentation for the host pipeline.
+//
+// A stage is a point a frame passes, e.g. "video.callback" or "video.displayed"; stamp()
+// records how long after capture (the frame's device timestamp, on the host clock) the frame
+// got there. Every thread records into its own counters, with plain relaxed stores and no
+// shared cache lines, so the hot path is a clock read and a few increments. Readers merge all
+// threads' counters; they may see a record half applied, which only shifts a count between
+// two consecutive snapshots.
+class PipelineMetrics {
+   public:
+    static constexpr int kMaxStages = 32;
+
+    PipelineMetrics();
+    ~PipelineMetrics();
+
+    PipelineMetrics(const PipelineMetrics&) = delete;
+    PipelineMetrics& operator=(const PipelineMetrics&) = delete;
+
+    // Returns the stage id, -1 when all kMaxStages are used. Register stages before recording.
+    int addStage(const std::string& name);
+
+    void record(int stage, uint64_t latencyNs);
+    void stamp(int stage, std::chrono::steady_clock::time_point captured) {
+        auto latency = std::chrono::steady_clock::now() - captured;
+        record(stage, latency.count() > 0 ? std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count() : 0);
+    }
+
+    std::vector<StageSnapshot> snapshot() const;
+
+    // One line per stage with the rate since the previous summary and latency percentiles
+    void printSummary();
+    // Prints a summary if `interval` passed since the last one; cheap enough to call every loop
+    bool printEvery(std::chrono::steady_clock::duration interval);
+    // Machine-readable snapshot: {"stages": [{"name", "count", "mean_ns", "p50_ns", ...}]}
+    void writeJson(FILE* out) const;
+
+   private:
+    struct Stage {
+        std::array<std::atomic<uint64_t>, LatencyHistogram::kBuckets> counts;
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sumNs{0};
+        std::atomic<uint64_t> maxNs{0};
+        Stage();
+    };
+    // One per recording thread, only that thread writes to it
+    struct Shard {
+        std::thread::id thread;
+        std::array<std::atomic<Stage*>, kMaxStages> stages;
+        Shard();
+        ~Shard();
+    };
+
+    Shard* localShard();
+    static void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    const uint64_t _id;
+    std::atomic<int> _numStages{0};
+    std::array<std::string, kMaxStages> _names;
+
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<Shard>> _shards;
+
+    std::chrono::steady_clock::time_point _lastPrint;
+    std::array<uint64_t, kMaxStages> _lastCounts{};
+};
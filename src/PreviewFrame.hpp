@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "depthai/depthai.hpp"
+#include "DetectionTracker.hpp"
+#include "YuvToBgr.hpp"
+
+// Largest size with the frame's aspect ratio that fits in maxSize, never upscaled
+inline cv::Size fitPreviewSize(cv::Size frameSize, cv::Size maxSize) {
+    double scale = std::min(1.0, std::min(double(maxSize.width) / frameSize.width, double(maxSize.height) / frameSize.height));
+    return cv::Size(std::max(1, int(frameSize.width * scale + 0.5)), std::max(1, int(frameSize.height * scale + 0.5)));
+}
+
+// BGR image of `frame` for display, no larger than maxSize.
+// NV12 / YUV420p frames are converted and downscaled in one pass, so no full-resolution
+// BGR image is ever built; other frame types fall back to getCvFrame() + cv::resize.
+inline cv::Mat getPreviewFrame(const std::shared_ptr<dai::ImgFrame>& frame, cv::Size maxSize) {
+    cv::Size srcSize(frame->getWidth(), frame->getHeight());
+    cv::Size dstSize = fitPreviewSize(srcSize, maxSize);
+    auto type = frame->getType();
+    if(type == dai::ImgFrame::Type::NV12 || type == dai::ImgFrame::Type::YUV420p) {
+        const uint8_t* data = frame->getFrame().data;
+        Yuv420Image src = type == dai::ImgFrame::Type::NV12 ? Yuv420Image::nv12(data, srcSize.width, srcSize.height)
+                                                            : Yuv420Image::i420(data, srcSize.width, srcSize.height);
+        cv::Mat bgr(dstSize, CV_8UC3);
+        yuv420ToBgrResized(src, bgr.data, bgr.step, dstSize.width, dstSize.height);
+        return bgr;
+    }
+    cv::Mat bgr = frame->getCvFrame();
+    if(bgr.size() != dstSize) cv::resize(bgr, bgr, dstSize, 0, 0, cv::INTER_AREA);
+    return bgr;
+}
+
+// Draws tracked detections onto a preview. The network input is the camera preview, a square
+// cropped from the middle of the full-width frame, so x is mapped back through that crop.
+inline void drawDetections(cv::Mat& bgr, const FrameDetections& frame) {
+    float crop = bgr.cols > bgr.rows ? float(bgr.rows) / bgr.cols : 1.0f;
+    float x0 = (1.0f - crop) / 2;
+    for(const auto& d : frame.detections) {
+        cv::Point p0(int((x0 + d.xmin * crop) * bgr.cols), int(d.ymin * bgr.rows));
+        cv::Point p1(int((x0 + d.xmax * crop) * bgr.cols), int(d.ymax * bgr.rows));
+        // Not yet confirmed tracks are drawn dim
+        cv::Scalar color = d.trackId >= 0 ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 128, 0);
+        cv::rectangle(bgr, p0, p1, color, 2);
+        std::string text = std::to_string(d.label) + (d.trackId >= 0 ? " #" + std::to_string(d.trackId) : "");
+        cv::putText(bgr, text, cv::Point(p0.x + 2, p0.y + 14), cv::FONT_HERSHEY_SIMPLEX, 0.45, color, 1);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Wakes one waiting thread as soon as any of up to 64 sources has data.
+//
+// Producers call notify(source) (typically from a queue callback); wait() returns the mask of
+// sources notified since the previous wait(), or 0 on timeout. A notification is one atomic OR
+// when the waiter is already awake, the mutex is only taken to wake a sleeping waiter.
+class QueueNotifier {
+   public:
+    static constexpr int kMaxSources = 64;
+
+    // Returns -1 once all kMaxSources are taken
+    int addSource() {
+        int source = _numSources.load();
+        do {
+            if(source >= kMaxSources) return -1;
+        } while(!_numSources.compare_exchange_weak(source, source + 1));
+        return source;
+    }
+
+    // Registers a depthai output queue: its callbacks run after the message was added to the
+    // queue, so a woken loop always finds it with tryGet()
+    template <typename Queue>
+    int watch(const std::shared_ptr<Queue>& queue) {
+        int source = addSource();
+        if(queue && source >= 0) queue->addCallback(std::function<void()>([this, source]() { notify(source); }));
+        return source;
+    }
+
+    // Ignores sources outside [0, kMaxSources)
+    void notify(int source) {
+        if(source < 0 || source >= kMaxSources) return;
+        uint64_t bit = uint64_t(1) << source;
+        uint64_t prev = _pending.fetch_or(bit, std::memory_order_seq_cst);
+        if(prev == 0 && _sleeping.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _cv.notify_one();
+        }
+    }
+
+    // Mask of ready sources, 0 after `timeout` without any
+    template <typename Rep, typename Period>
+    uint64_t wait(std::chrono::duration<Rep, Period> timeout) {
+        uint64_t ready = _pending.exchange(0, std::memory_order_acquire);
+        if(ready || timeout <= timeout.zero()) return ready;
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sleeping.store(true, std::memory_order_seq_cst);
+        _cv.wait_for(lock, timeout, [this] { return _pending.load(std::memory_order_seq_cst) != 0; });
+        _sleeping.store(false, std::memory_order_relaxed);
+        return _pending.exchange(0, std::memory_order_acquire);
+    }
+
+   private:
+    std::atomic<int> _numSources{0};
+    std::atomic<uint64_t> _pending{0};
+    std::atomic<bool> _sleeping{false};
+    std::mutex _mutex;
+    std::condition_variable _cv;
+};
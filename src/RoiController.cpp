@@ -0,0 +1,116 @@
+#include "RoiController.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+
+constexpr float kMinCropPixels = 32;
+
+}  // namespace
+
+RoiController::RoiController(int sourceWidth, int sourceHeight, int maxOutWidth, int maxOutHeight)
+    : _sourceWidth(sourceWidth), _sourceHeight(sourceHeight), _maxOutWidth(maxOutWidth), _maxOutHeight(maxOutHeight) {
+    // The pipeline starts with the full frame at the maximum output size
+    _pending = normalize(0, 0, 1, 1, 0, 0);
+    _sent = _pending;
+    _stats.fullFrameBytes = uint64_t(_maxOutWidth) * _maxOutHeight * 3 / 2;
+}
+
+Roi RoiController::normalize(float x, float y, float width, float height, int outWidth, int outHeight) const {
+    Roi roi;
+    roi.width = std::min(1.0f, std::max(width, kMinCropPixels / _sourceWidth));
+    roi.height = std::min(1.0f, std::max(height, kMinCropPixels / _sourceHeight));
+    // A crop below the minimum grows around its center, so zooming in at the limit does not drift
+    x -= (roi.width - width) / 2;
+    y -= (roi.height - height) / 2;
+    roi.x = std::min(std::max(x, 0.0f), 1.0f - roi.width);
+    roi.y = std::min(std::max(y, 0.0f), 1.0f - roi.height);
+
+    float w = outWidth > 0 ? outWidth : roi.width * _sourceWidth;
+    float h = outHeight > 0 ? outHeight : roi.height * _sourceHeight;
+    float scale = std::min({1.0f, _maxOutWidth / w, _maxOutHeight / h});
+    roi.outWidth = std::max(16, static_cast<int>(w * scale) / 16 * 16);
+    roi.outHeight = std::max(2, static_cast<int>(h * scale) / 2 * 2);
+    return roi;
+}
+
+void RoiController::setRoi(float x, float y, float width, float height, int outWidth, int outHeight) {
+    request(normalize(x, y, width, height, outWidth, outHeight));
+}
+
+void RoiController::zoom(float factor) {
+    if(factor <= 0) return;
+    Roi roi = current();
+    float cx = roi.x + roi.width / 2, cy = roi.y + roi.height / 2;
+    float w = roi.width / factor, h = roi.height / factor;
+    request(normalize(cx - w / 2, cy - h / 2, w, h, 0, 0));
+}
+
+void RoiController::pan(float dx, float dy) {
+    Roi roi = current();
+    request(normalize(roi.x + dx * roi.width, roi.y + dy * roi.height, roi.width, roi.height, 0, 0));
+}
+
+void RoiController::reset() {
+    request(normalize(0, 0, 1, 1, 0, 0));
+}
+
+Roi RoiController::current() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending;
+}
+
+void RoiController::request(const Roi& roi) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.requests++;
+    if(_dirty) _stats.coalesced++;
+    _pending = roi;
+    _dirty = true;
+}
+
+bool RoiController::takePending(Roi& roi) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(!_dirty) return false;
+    _dirty = false;
+    // Requests that ended where they started cost nothing
+    if(_pending == _sent) {
+        _stats.coalesced++;
+        return false;
+    }
+    _sent = _pending;
+    _stats.sent++;
+    roi = _sent;
+    return true;
+}
+
+void RoiController::onFrame(size_t bytes) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.frames++;
+    _stats.bytes += bytes;
+    _stats.lastFrameBytes = bytes;
+}
+
+RoiStats RoiController::getStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void RoiController::printStats(const char* name) const {
+    auto stats = getStats();
+    Roi roi = current();
+    printf("%s: %lu requests, %lu configs sent, %lu coalesced; %.0f KB/frame (%.0f%% of full frame), ROI %.3f,%.3f %.3fx%.3f -> %dx%d\n",
+           name,
+           (unsigned long)stats.requests,
+           (unsigned long)stats.sent,
+           (unsigned long)stats.coalesced,
+           stats.bytesPerFrame() / 1024.0,
+           stats.bandwidthRatio() * 100.0,
+           roi.x,
+           roi.y,
+           roi.width,
+           roi.height,
+           roi.outWidth,
+           roi.outHeight);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+// Crop rectangle in normalized source coordinates plus the output size it is scaled to
+struct Roi {
+    float x = 0, y = 0, width = 1, height = 1;
+    int outWidth = 0;
+    int outHeight = 0;
+
+    bool operator==(const Roi& o) const {
+        return x == o.x && y == o.y && width == o.width && height == o.height && outWidth == o.outWidth && outHeight == o.outHeight;
+    }
+    bool operator!=(const Roi& o) const {
+        return !(*this == o);
+    }
+};
+
+struct RoiStats {
+    uint64_t requests = 0;   // setRoi() / zoom() / pan() calls
+    uint64_t sent = 0;       // configs handed out by takePending()
+    uint64_t coalesced = 0;  // requests replaced by a newer one before they were sent
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t lastFrameBytes = 0;
+    uint64_t fullFrameBytes = 0;  // NV12 at the maximum output size, for comparison
+
+    double bytesPerFrame() const {
+        return frames ? double(bytes) / frames : 0.0;
+    }
+    // Link bandwidth relative to always sending full-size output
+    double bandwidthRatio() const {
+        return frames && fullFrameBytes ? bytesPerFrame() / fullFrameBytes : 0.0;
+    }
+};
+
+// Host side of a runtime crop / digital zoom on the device's ImageManip.
+//
+// Requests may come from any thread at any rate (keys, control commands, a tracker); they only
+// replace the pending ROI. The frame callback calls takePending() once per received frame and
+// sends the config it returns, so at most one config goes to the device per frame and bursts
+// collapse into their latest state. A ROI equal to the last one sent is not sent again.
+//
+// ROIs are clamped to the source, and the output size follows the crop: the crop's pixel size
+// when it fits in the maximum output size, scaled down with the same aspect otherwise, so a
+// small region costs proportionally fewer bytes on the link. Output sizes are rounded to what
+// ImageManip accepts for NV12 (width a multiple of 16, height even).
+class RoiController {
+   public:
+    RoiController(int sourceWidth, int sourceHeight, int maxOutWidth, int maxOutHeight);
+
+    // Normalized crop; output size 0 = derived from the crop
+    void setRoi(float x, float y, float width, float height, int outWidth = 0, int outHeight = 0);
+    // Zooms by `factor` (> 1 zooms in) around the current ROI center
+    void zoom(float factor);
+    // Moves the ROI by a fraction of its own size
+    void pan(float dx, float dy);
+    void reset();
+
+    // Latest requested ROI, for display
+    Roi current() const;
+
+    // Called once per frame; true and the ROI to send if it changed since the last send
+    bool takePending(Roi& roi);
+    // Bytes of a received frame, for the bandwidth accounting
+    void onFrame(size_t bytes);
+
+    RoiStats getStats() const;
+    void printStats(const char* name) const;
+
+    // Clamping and output sizing as applied to every request
+    Roi normalize(float x, float y, float width, float height, int outWidth, int outHeight) const;
+
+   private:
+    void request(const Roi& roi);
+
+    const int _sourceWidth, _sourceHeight;
+    const int _maxOutWidth, _maxOutHeight;
+
+    mutable std::mutex _mutex;
+    Roi _pending;
+    Roi _sent;
+    bool _dirty = false;
+    bool _everSent = false;
+    RoiStats _stats;
+};
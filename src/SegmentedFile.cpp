@@ -0,0 +1,471 @@
+#include "SegmentedFile.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Writeback of the page cache is started every this many bytes, and waited for one window later
+constexpr uint64_t kWritebackBytes = 8 << 20;
+constexpr size_t kCopyBytes = 1 << 20;
+
+uint64_t elapsedNs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - since).count();
+}
+
+std::string dirOf(const std::string& path) {
+    size_t slash = path.rfind('/');
+    if(slash == std::string::npos) return ".";
+    return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+std::string baseName(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+bool writeAll(int fd, const void* data, size_t size, uint64_t offset) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    while(size > 0) {
+        ssize_t written = ::pwrite(fd, p, size, offset);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        p += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+}
+
+// A new or renamed directory entry is durable once the directory itself is synced
+bool syncDir(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+}  // namespace
+
+SegmentedFile::SegmentedFile(const std::string& path, const std::string& format, const RecordingOptions& options, std::vector<uint8_t> header, HeaderUpdate update)
+    : _path(path), _format(format), _options(options), _header(std::move(header)), _update(std::move(update)), _direct(options.direct) {
+    _index.format = format;
+    _index.headerBytes = _header.size();
+}
+
+SegmentedFile::~SegmentedFile() {
+    close();
+    free(_stage);
+}
+
+std::string SegmentedFile::segmentPath(size_t n) const {
+    if(!_options.segmented()) return _path;
+    // audio.wav -> audio.00003.wav
+    size_t slash = _path.rfind('/');
+    size_t dot = _path.rfind('.');
+    if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = _path.size();
+    char number[16];
+    snprintf(number, sizeof(number), ".%05u", static_cast<unsigned>(n));
+    return _path.substr(0, dot) + number + _path.substr(dot);
+}
+
+bool SegmentedFile::open() {
+    if(_fd >= 0) return true;
+    if(_direct && !_stage) {
+        void* stage = nullptr;
+        if(_header.size() >= kStageBytes || posix_memalign(&stage, kBlockSize, kStageBytes) != 0) {
+            printf("SegmentedFile: no staging buffer for O_DIRECT, using the page cache\n");
+            _direct = false;
+        }
+        _stage = static_cast<uint8_t*>(stage);
+    }
+    _lastCheckpoint = std::chrono::steady_clock::now();
+    return openSegment() && writeIndex();
+}
+
+bool SegmentedFile::openSegment() {
+    std::string path = segmentPath(_index.segments.size());
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    if(_direct) {
+        _fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        if(_fd < 0 && errno == EINVAL) {
+            // tmpfs and some FUSE filesystems don't do O_DIRECT
+            printf("SegmentedFile: no O_DIRECT for %s, using the page cache\n", path.c_str());
+            _direct = false;
+        } else if(_fd >= 0) {
+            _headerFd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        }
+    }
+    if(!_direct && _fd < 0) _fd = ::open(path.c_str(), flags, 0644);
+    if(_fd < 0 || (_direct && _headerFd < 0)) {
+        printf("SegmentedFile: cannot open %s: %s\n", path.c_str(), strerror(errno));
+        if(_fd >= 0) ::close(_fd);
+        _fd = -1;
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats.errors++;
+        return false;
+    }
+
+    SegmentIndex::Segment segment;
+    segment.path = baseName(path);
+    _index.segments.push_back(segment);
+    _segmentData = 0;
+    _allocated = 0;
+    _segmentStart = std::chrono::steady_clock::now();
+    _writebackStart = _writebackDone = _header.size();
+    _stageUsed = 0;
+    _stageOffset = 0;
+
+    reserve(_header.size());
+    bool ok = true;
+    if(!_header.empty()) {
+        if(_update) _update(_header, 0);
+        if(_direct) {
+            // Goes out with the first block of data
+            std::memcpy(_stage, _header.data(), _header.size());
+            _stageUsed = _header.size();
+        } else {
+            ok = writeAll(_fd, _header.data(), _header.size(), 0);
+        }
+    }
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    _stats.segments++;
+    if(!ok) _stats.errors++;
+    return ok;
+}
+
+bool SegmentedFile::finishSegment() {
+    bool ok = (!_direct || flushStage(true)) && writeHeader();
+    // Give back the reserved tail and the padding of the last block
+    ok = ::ftruncate(_fd, _header.size() + _segmentData) == 0 && ok;
+    ok = ::fdatasync(_fd) == 0 && ok;
+    ::close(_fd);
+    _fd = -1;
+    if(_headerFd >= 0) ::close(_headerFd);
+    _headerFd = -1;
+    _index.segments.back().dataBytes = _segmentData;
+    _index.segments.back().complete = true;
+    if(!ok) {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats.errors++;
+    }
+    return ok;
+}
+
+void SegmentedFile::reserve(uint64_t end) {
+#ifdef __linux__
+    if(end <= _allocated) return;
+    uint64_t target = end + _options.preallocateBytes;
+    // Not past where the segment will end anyway
+    if(_options.segmentBytes) target = std::min(target, std::max(end, _header.size() + _options.segmentBytes));
+    // KEEP_SIZE: reserve blocks without changing the visible file length
+    if(::fallocate(_fd, FALLOC_FL_KEEP_SIZE, _allocated, target - _allocated) == 0) {
+        _allocated = target;
+    } else {
+        _allocated = UINT64_MAX;  // not supported by the filesystem, don't retry for this segment
+    }
+#else
+    (void)end;
+#endif
+}
+
+bool SegmentedFile::write(const iovec* iov, size_t count) {
+    if(_fd < 0) return false;
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t total = 0;
+    for(size_t i = 0; i < count; i++) total += iov[i].iov_len;
+
+    bool ok = true;
+    bool old = _options.segmentMs && elapsedNs(_segmentStart) >= static_cast<uint64_t>(_options.segmentMs) * 1000000;
+    if(_segmentData > 0 && old) {
+        finishSegment();
+        ok = openSegment() && writeIndex();
+    }
+    // The batch is split where a segment fills up, so every segment but the last holds exactly
+    // segmentBytes
+    size_t first = 0, skip = 0;
+    uint64_t left = total;
+    while(ok && left > 0) {
+        if(_options.segmentBytes && _segmentData == _options.segmentBytes) {
+            finishSegment();
+            ok = openSegment() && writeIndex();
+            if(!ok) break;
+        }
+        uint64_t n = _options.segmentBytes ? std::min(left, _options.segmentBytes - _segmentData) : left;
+        const iovec* part = iov;
+        size_t parts = count;
+        if(n < total) {
+            // iovecs of bytes [total - left, total - left + n)
+            _split.clear();
+            uint64_t want = n;
+            while(want > 0) {
+                size_t len = static_cast<size_t>(std::min<uint64_t>(iov[first].iov_len - skip, want));
+                if(len > 0) _split.push_back({static_cast<uint8_t*>(iov[first].iov_base) + skip, len});
+                want -= len;
+                skip += len;
+                if(skip == iov[first].iov_len) {
+                    first++;
+                    skip = 0;
+                }
+            }
+            part = _split.data();
+            parts = _split.size();
+        }
+        reserve(_header.size() + _segmentData + n);
+        ok = _direct ? writeDirect(part, parts) : writeBuffered(part, parts);
+        if(ok) {
+            _segmentData += n;
+            left -= n;
+            if(!_direct) startWriteback();
+        }
+    }
+
+    uint64_t ns = elapsedNs(t0);
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    _stats.writes++;
+    if(ok) {
+        _stats.bytes += total;
+    } else {
+        _stats.errors++;
+    }
+    _stats.writeLatency.add(LatencyHistogram::bucketOf(ns), 1);
+    _stats.maxWriteNs = std::max(_stats.maxWriteNs, ns);
+    return ok;
+}
+
+bool SegmentedFile::writeBuffered(const iovec* iov, size_t count) {
+    _iov.assign(iov, iov + count);
+    uint64_t offset = _header.size() + _segmentData;
+    size_t done = 0;
+    while(done < _iov.size()) {
+        int n = static_cast<int>(std::min<size_t>(_iov.size() - done, IOV_MAX));
+        ssize_t written = ::pwritev(_fd, &_iov[done], n, offset);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        offset += written;
+        // Skip fully written buffers, adjust a partially written one
+        while(done < _iov.size() && static_cast<size_t>(written) >= _iov[done].iov_len) {
+            written -= _iov[done].iov_len;
+            done++;
+        }
+        if(done < _iov.size()) {
+            _iov[done].iov_base = static_cast<uint8_t*>(_iov[done].iov_base) + written;
+            _iov[done].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+void SegmentedFile::startWriteback() {
+#ifdef __linux__
+    uint64_t end = _header.size() + _segmentData;
+    if(end - _writebackStart < kWritebackBytes) return;
+    ::sync_file_range(_fd, _writebackStart, end - _writebackStart, SYNC_FILE_RANGE_WRITE);
+    // The previous window had a whole window's worth of writes to reach the disk; wait for what is
+    // left of it and drop it from the cache, nobody reads it back
+    if(_writebackStart > _writebackDone) {
+        ::sync_file_range(_fd, _writebackDone, _writebackStart - _writebackDone, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        ::posix_fadvise(_fd, _writebackDone, _writebackStart - _writebackDone, POSIX_FADV_DONTNEED);
+        _writebackDone = _writebackStart;
+    }
+    _writebackStart = end;
+#endif
+}
+
+bool SegmentedFile::writeDirect(const iovec* iov, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        const uint8_t* p = static_cast<const uint8_t*>(iov[i].iov_base);
+        size_t left = iov[i].iov_len;
+        while(left > 0) {
+            size_t n = std::min(left, kStageBytes - _stageUsed);
+            std::memcpy(_stage + _stageUsed, p, n);
+            _stageUsed += n;
+            p += n;
+            left -= n;
+            if(_stageUsed == kStageBytes && !flushStage(false)) return false;
+        }
+    }
+    return true;
+}
+
+bool SegmentedFile::flushStage(bool padTail) {
+    size_t whole = _stageUsed / kBlockSize * kBlockSize;
+    size_t length = padTail ? (_stageUsed + kBlockSize - 1) / kBlockSize * kBlockSize : whole;
+    if(length == 0) return true;
+    // Zero padding up to the block; a later flush overwrites it, close truncates it away
+    if(length > _stageUsed) std::memset(_stage + _stageUsed, 0, length - _stageUsed);
+    if(!writeAll(_fd, _stage, length, _stageOffset)) return false;
+    // The partial last block stays staged and is written again once it fills up
+    if(whole < _stageUsed) std::memmove(_stage, _stage + whole, _stageUsed - whole);
+    _stageOffset += whole;
+    _stageUsed -= whole;
+    return true;
+}
+
+bool SegmentedFile::writeHeader() {
+    if(_header.empty()) return true;
+    if(_update) _update(_header, _segmentData);
+    if(!_direct) return writeAll(_fd, _header.data(), _header.size(), 0);
+    // Still staged if the first block wasn't written yet, and a later flush would write it again
+    if(_stageOffset == 0) std::memcpy(_stage, _header.data(), _header.size());
+    return writeAll(_headerFd, _header.data(), _header.size(), 0);
+}
+
+void SegmentedFile::poll() {
+    if(_fd < 0 || _options.checkpointMs <= 0) return;
+    if(elapsedNs(_lastCheckpoint) >= static_cast<uint64_t>(_options.checkpointMs) * 1000000) checkpoint();
+}
+
+bool SegmentedFile::checkpoint() {
+    if(_fd < 0) return false;
+    auto t0 = std::chrono::steady_clock::now();
+    // One fdatasync covers both descriptors, it syncs the file
+    bool ok = (!_direct || flushStage(true)) && writeHeader() && ::fdatasync(_fd) == 0;
+    if(ok) {
+        _index.segments.back().dataBytes = _segmentData;
+        ok = writeIndex();
+    }
+    _lastCheckpoint = std::chrono::steady_clock::now();
+
+    uint64_t ns = elapsedNs(t0);
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    _stats.checkpoints++;
+    _stats.maxCheckpointNs = std::max(_stats.maxCheckpointNs, ns);
+    if(!ok) _stats.errors++;
+    return ok;
+}
+
+void SegmentedFile::close() {
+    if(_fd < 0) return;
+    finishSegment();
+    if(!writeIndex()) {
+        std::lock_guard<std::mutex> lock(_statsMutex);
+        _stats.errors++;
+    }
+}
+
+bool SegmentedFile::writeIndex() {
+    std::string text = "oak-segments 1 " + _index.format + " " + std::to_string(_index.headerBytes) + "\n";
+    for(const auto& segment : _index.segments) {
+        text += segment.path + " " + std::to_string(segment.dataBytes) + (segment.complete ? " complete\n" : " open\n");
+    }
+    // Written aside and renamed over the old one, so a crash leaves one or the other
+    std::string index = indexPath();
+    std::string tmp = index + ".tmp";
+    int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0) return false;
+    bool ok = writeAll(fd, text.data(), text.size(), 0) && ::fdatasync(fd) == 0;
+    ::close(fd);
+    return ok && ::rename(tmp.c_str(), index.c_str()) == 0 && syncDir(dirOf(index));
+}
+
+SegmentedFileStats SegmentedFile::getStats() const {
+    std::lock_guard<std::mutex> lock(_statsMutex);
+    return _stats;
+}
+
+bool SegmentedFile::readIndex(const std::string& indexPath, SegmentIndex& index) {
+    FILE* f = fopen(indexPath.c_str(), "r");
+    if(!f) return false;
+    char format[64] = {};
+    unsigned long headerBytes = 0;
+    int version = 0;
+    bool ok = fscanf(f, "oak-segments %d %63s %lu\n", &version, format, &headerBytes) == 3 && version == 1;
+    index = SegmentIndex();
+    if(!ok) {
+        // Empty, truncated or not an index at all
+        fclose(f);
+        return false;
+    }
+    index.format = format;
+    index.headerBytes = headerBytes;
+    std::string dir = dirOf(indexPath);
+    char line[4096];
+    while(ok && fgets(line, sizeof(line), f)) {
+        // "<name> <dataBytes> complete|open", the name may contain spaces
+        std::string text(line);
+        while(!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+        if(text.empty()) continue;
+        size_t state = text.rfind(' ');
+        size_t bytes = state == std::string::npos || state == 0 ? std::string::npos : text.rfind(' ', state - 1);
+        if(bytes == std::string::npos) {
+            ok = false;
+            break;
+        }
+        SegmentIndex::Segment segment;
+        segment.path = dir + "/" + text.substr(0, bytes);
+        segment.dataBytes = strtoull(text.c_str() + bytes + 1, nullptr, 10);
+        segment.complete = text.compare(state + 1, std::string::npos, "complete") == 0;
+        index.segments.push_back(segment);
+    }
+    fclose(f);
+    return ok;
+}
+
+bool SegmentedFile::concatenate(const std::string& indexPath, const std::string& outPath, HeaderUpdate update) {
+    SegmentIndex index;
+    if(!readIndex(indexPath, index) || index.segments.empty()) {
+        printf("SegmentedFile: no segments in %s\n", indexPath.c_str());
+        return false;
+    }
+    uint64_t total = 0;
+    for(const auto& segment : index.segments) total += segment.dataBytes;
+
+    int out = ::open(outPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(out < 0) {
+        printf("SegmentedFile: cannot open %s: %s\n", outPath.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = true;
+    uint64_t offset = 0;
+    std::vector<uint8_t> buffer(std::max(kCopyBytes, index.headerBytes));
+    for(size_t s = 0; ok && s < index.segments.size(); s++) {
+        const auto& segment = index.segments[s];
+        int in = ::open(segment.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(in < 0) {
+            printf("SegmentedFile: cannot open %s: %s\n", segment.path.c_str(), strerror(errno));
+            ok = false;
+            break;
+        }
+        if(s == 0 && index.headerBytes > 0) {
+            std::vector<uint8_t> header(index.headerBytes);
+            ok = ::pread(in, header.data(), header.size(), 0) == static_cast<ssize_t>(header.size());
+            if(ok && update) update(header, total);
+            ok = ok && writeAll(out, header.data(), header.size(), offset);
+            offset += header.size();
+        }
+        // Only what the index vouches for; an unfinished segment may hold more, not yet checkpointed
+        uint64_t position = index.headerBytes;
+        uint64_t left = segment.dataBytes;
+        while(ok && left > 0) {
+            ssize_t n = ::pread(in, buffer.data(), std::min<uint64_t>(left, buffer.size()), position);
+            if(n < 0 && errno == EINTR) continue;
+            if(n <= 0) {
+                printf("SegmentedFile: %s is shorter than its index says\n", segment.path.c_str());
+                ok = false;
+                break;
+            }
+            ok = writeAll(out, buffer.data(), n, offset);
+            position += n;
+            offset += n;
+            left -= n;
+        }
+        ::close(in);
+    }
+    ok = ::fsync(out) == 0 && ok;
+    ::close(out);
+    return ok;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "PipelineMetrics.hpp"
+
+struct RecordingOptions {
+    uint64_t segmentBytes = 0;              // payload per segment, 0: no limit
+    int64_t segmentMs = 0;                  // or once a segment is this old, 0: no limit
+    uint64_t preallocateBytes = 16 << 20;   // reserved ahead of the write position
+    int64_t checkpointMs = 1000;            // data, header and index made durable this often, 0: only on close
+    bool direct = false;                    // O_DIRECT, block-aligned writes from a staging buffer
+
+    bool segmented() const {
+        return segmentBytes > 0 || segmentMs > 0;
+    }
+};
+
+struct SegmentedFileStats {
+    uint64_t bytes = 0;  // payload, headers not included
+    uint64_t writes = 0;
+    uint64_t segments = 0;
+    uint64_t checkpoints = 0;
+    uint64_t errors = 0;
+    uint64_t maxWriteNs = 0;
+    uint64_t maxCheckpointNs = 0;
+    LatencyHistogram writeLatency;  // per write(), new segments and writeback included
+};
+
+// What the index of a recording lists
+struct SegmentIndex {
+    std::string format;  // e.g. "wav", "raw"
+    size_t headerBytes = 0;
+    struct Segment {
+        std::string path;
+        uint64_t dataBytes = 0;  // durable payload after the header
+        bool complete = false;
+    };
+    std::vector<Segment> segments;
+};
+
+// One recorded stream as a series of segment files plus an index, safe against crashes.
+//
+// "audio.wav" is written as audio.00000.wav, audio.00001.wav, ... (just audio.wav without
+// segment limits), each a complete file of the format: every segment starts with the header,
+// kept up to date through `update`. A segment ends once it holds segmentBytes of payload, so a
+// write() may be split across two segments, or at the first write() once it is segmentMs old.
+// Space is reserved with fallocate() ahead of the writes, so block allocation never happens
+// inside them.
+//
+// Writes go to the page cache by default, whose writeback is started every few MB and waited
+// for (and the pages dropped) one window later, so dirty data never piles up into a long
+// stall and a recording doesn't push everything else out of the cache. With `direct`, data is
+// copied into a block-aligned staging buffer and written with O_DIRECT in whole blocks.
+//
+// Every checkpointMs the data is synced, the header rewritten for the data so far and the
+// index (audio.wav.index, replaced atomically) updated. After a crash, each segment is a valid
+// file holding at least everything up to the last checkpoint, and concatenate() (or rec-join)
+// joins them into one file.
+//
+// Not thread-safe, except getStats(); all calls from the one writer thread.
+class SegmentedFile {
+   public:
+    // Rewrites the size fields of `header` for `dataBytes` of payload
+    using HeaderUpdate = std::function<void(std::vector<uint8_t>& header, uint64_t dataBytes)>;
+
+    SegmentedFile(const std::string& path,
+                  const std::string& format,
+                  const RecordingOptions& options,
+                  std::vector<uint8_t> header = std::vector<uint8_t>(),
+                  HeaderUpdate update = nullptr);
+    ~SegmentedFile();
+
+    SegmentedFile(const SegmentedFile&) = delete;
+    SegmentedFile& operator=(const SegmentedFile&) = delete;
+
+    // Creates the first segment and the index
+    bool open();
+    bool write(const iovec* iov, size_t count);
+    bool write(const void* data, size_t size) {
+        iovec iov{const_cast<void*>(data), size};
+        return write(&iov, 1);
+    }
+    // Checkpoints if one is due; for writers that go idle
+    void poll();
+    bool checkpoint();
+    // Completes the last segment; the index then lists every segment as complete
+    void close();
+
+    std::string indexPath() const {
+        return _path + ".index";
+    }
+    SegmentedFileStats getStats() const;
+
+    static bool readIndex(const std::string& indexPath, SegmentIndex& index);
+    // Joins the segments listed in the index into one file, with the first segment's header
+    // updated for the total size
+    static bool concatenate(const std::string& indexPath, const std::string& outPath, HeaderUpdate update);
+
+   private:
+    static constexpr size_t kBlockSize = 4096;
+    static constexpr size_t kStageBytes = 1 << 20;
+
+    bool openSegment();
+    bool finishSegment();
+    bool writeBuffered(const iovec* iov, size_t count);
+    bool writeDirect(const iovec* iov, size_t count);
+    bool flushStage(bool padTail);
+    bool writeHeader();
+    void reserve(uint64_t end);
+    void startWriteback();
+    bool writeIndex();
+    std::string segmentPath(size_t n) const;
+
+    const std::string _path;
+    const std::string _format;
+    const RecordingOptions _options;
+    std::vector<uint8_t> _header;
+    HeaderUpdate _update;
+
+    bool _direct;        // false after falling back to the page cache
+    int _fd = -1;
+    int _headerFd = -1;  // direct: a buffered descriptor for the header rewrites
+    SegmentIndex _index;  // segments so far, the last one open while _fd >= 0
+    uint64_t _segmentData = 0;
+    uint64_t _allocated = 0;
+    std::chrono::steady_clock::time_point _segmentStart;
+    std::chrono::steady_clock::time_point _lastCheckpoint;
+    std::vector<iovec> _iov;
+    std::vector<iovec> _split;  // the part of a write() that goes into the current segment
+    // Buffered: page cache writeback windows
+    uint64_t _writebackStart = 0;
+    uint64_t _writebackDone = 0;
+    // Direct: staging buffer holding the file from _stageOffset on
+    uint8_t* _stage = nullptr;
+    size_t _stageUsed = 0;
+    uint64_t _stageOffset = 0;
+
+    mutable std::mutex _statsMutex;
+    SegmentedFileStats _stats;
+};
@@ -0,0 +1,253 @@
+#include "ShmFrameRing.hpp"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+using namespace shmring;
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'A', 'I', 'S', 'H', 'M', 0, 1};
+constexpr uint32_t kVersion = 1;
+
+inline uint64_t alignUp(uint64_t v) {
+    return (v + kAlignment - 1) & ~uint64_t(kAlignment - 1);
+}
+
+inline int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Process-shared futex: no FUTEX_PRIVATE_FLAG, the word lives in a shared mapping
+inline uint32_t* futexAddr(const std::atomic<uint32_t>& word) {
+    return reinterpret_cast<uint32_t*>(const_cast<std::atomic<uint32_t>*>(&word));
+}
+
+void futexWakeAll(const std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, futexAddr(word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+// Returns false on timeout
+bool futexWait(const std::atomic<uint32_t>& word, uint32_t expected, int timeoutMs) {
+    timespec ts;
+    if(timeoutMs >= 0) {
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    }
+    long r = syscall(SYS_futex, futexAddr(word), FUTEX_WAIT, expected, timeoutMs >= 0 ? &ts : nullptr, nullptr, 0);
+    return r == 0 || errno != ETIMEDOUT;
+}
+
+}  // namespace
+
+ShmRingPublisher::~ShmRingPublisher() {
+    close();
+}
+
+bool ShmRingPublisher::open(const std::string& name, uint32_t slotCount, size_t slotCapacity) {
+    if(_base || slotCount == 0) return false;
+    uint64_t stride = sizeof(SlotHeader) + alignUp(slotCapacity);
+    size_t mapSize = sizeof(RingHeader) + slotCount * stride;
+
+    // A ring left behind by a crashed publisher is replaced, subscribers still on it see no new frames
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        printf("ShmRingPublisher: cannot create %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+    // Pages are allocated as the first lap touches them, a ring sized for 4K costs little at 1080p
+    if(ftruncate(fd, mapSize) != 0) {
+        printf("ShmRingPublisher: cannot size %s to %zu bytes: %s\n", name.c_str(), mapSize, strerror(errno));
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* base = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(base == MAP_FAILED) {
+        printf("ShmRingPublisher: cannot map %s: %s\n", name.c_str(), strerror(errno));
+        shm_unlink(name.c_str());
+        return false;
+    }
+    _base = static_cast<uint8_t*>(base);
+    _mapSize = mapSize;
+    _name = name;
+    _stats = ShmPublisherStats();
+
+    // The new object is zero-filled, which is also the initial state of all atomics
+    auto* header = reinterpret_cast<RingHeader*>(_base);
+    header->version = kVersion;
+    header->slotCount = slotCount;
+    header->slotStride = stride;
+    header->slotCapacity = slotCapacity;
+    header->publisherPid = getpid();
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, kMagic, sizeof(kMagic));
+    return true;
+}
+
+void ShmRingPublisher::close() {
+    if(!_base) return;
+    auto* header = reinterpret_cast<RingHeader*>(_base);
+    header->closed.store(1, std::memory_order_release);
+    header->futexWord.fetch_add(1, std::memory_order_release);
+    futexWakeAll(header->futexWord);
+    munmap(_base, _mapSize);
+    shm_unlink(_name.c_str());
+    _base = nullptr;
+}
+
+bool ShmRingPublisher::publish(const char* stream, const CaptureInfo& info, const void* data, size_t size) {
+    if(!_base) return false;
+    auto* header = reinterpret_cast<RingHeader*>(_base);
+    if(size > header->slotCapacity) {
+        _stats.tooLarge++;
+        return false;
+    }
+    uint64_t index = header->published.load(std::memory_order_relaxed);
+    auto* slot = reinterpret_cast<SlotHeader*>(_base + sizeof(RingHeader) + (index % header->slotCount) * header->slotStride);
+
+    // Odd while writing: readers of the previous frame in this slot see it change
+    slot->seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->sequence = info.sequence;
+    slot->deviceTimestampNs = info.deviceTimestampNs;
+    slot->size = size;
+    slot->width = info.width;
+    slot->height = info.height;
+    slot->frameType = info.frameType;
+    std::strncpy(slot->stream, stream, sizeof(slot->stream) - 1);
+    slot->stream[sizeof(slot->stream) - 1] = 0;
+    std::memcpy(reinterpret_cast<uint8_t*>(slot) + sizeof(SlotHeader), data, size);
+    slot->publishNs = nowNs();
+    slot->seq.store(2 * index + 2, std::memory_order_release);
+
+    header->published.store(index + 1, std::memory_order_release);
+    header->futexWord.fetch_add(1, std::memory_order_release);
+    futexWakeAll(header->futexWord);
+    _stats.published++;
+    return true;
+}
+
+ShmRingSubscriber::~ShmRingSubscriber() {
+    detach();
+}
+
+bool ShmRingSubscriber::attach(const std::string& name) {
+    if(_base) return false;
+    int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if(fd < 0) {
+        printf("ShmRingSubscriber: cannot open %s: %s\n", name.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    void* base = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(RingHeader)) {
+        // Read-only: a subscriber can't disturb the publisher or other subscribers
+        base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if(base == MAP_FAILED) {
+        printf("ShmRingSubscriber: cannot map %s\n", name.c_str());
+        return false;
+    }
+    const auto* ring = static_cast<const RingHeader*>(base);
+    bool ready = std::memcmp(ring->magic, kMagic, sizeof(kMagic)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(!ready || ring->version != kVersion || ring->slotCount == 0 || sizeof(RingHeader) + ring->slotCount * ring->slotStride > static_cast<size_t>(st.st_size)) {
+        printf("ShmRingSubscriber: %s is not a frame ring (or not ready yet)\n", name.c_str());
+        munmap(base, st.st_size);
+        return false;
+    }
+    _base = static_cast<const uint8_t*>(base);
+    _mapSize = st.st_size;
+    _next = ring->published.load(std::memory_order_acquire);
+    _stats = ShmSubscriberStats();
+    return true;
+}
+
+void ShmRingSubscriber::detach() {
+    if(!_base) return;
+    munmap(const_cast<uint8_t*>(_base), _mapSize);
+    _base = nullptr;
+}
+
+bool ShmRingSubscriber::acquire(ShmFrame& frame, int timeoutMs) {
+    if(!_base) return false;
+    const RingHeader* ring = header();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    while(true) {
+        // Read the futex word first: a frame published after this point changes it and the wait returns
+        uint32_t wakeups = ring->futexWord.load(std::memory_order_acquire);
+        uint64_t published = ring->published.load(std::memory_order_acquire);
+        if(_next < published) {
+            // Lapped: the publisher is already writing over the oldest slot, resume after it
+            if(published - _next >= ring->slotCount) {
+                uint64_t resume = published - ring->slotCount + 1;
+                _stats.dropped += resume - _next;
+                _next = resume;
+            }
+            const SlotHeader* s = slot(_next);
+            uint64_t expected = 2 * _next + 2;
+            if(s->seq.load(std::memory_order_acquire) == expected) {
+                frame.index = _next;
+                std::memcpy(frame.stream, s->stream, sizeof(frame.stream));
+                frame.stream[sizeof(frame.stream) - 1] = 0;
+                frame.info.sequence = s->sequence;
+                frame.info.deviceTimestampNs = s->deviceTimestampNs;
+                frame.info.width = s->width;
+                frame.info.height = s->height;
+                frame.info.frameType = s->frameType;
+                frame.publishNs = s->publishNs;
+                frame.size = std::min<uint64_t>(s->size, ring->slotCapacity);
+                frame.data = reinterpret_cast<const uint8_t*>(s) + sizeof(SlotHeader);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(s->seq.load(std::memory_order_relaxed) == expected) {
+                    _next++;
+                    _stats.received++;
+                    return true;
+                }
+            }
+            // Overwritten between the index check and reading its header
+            _stats.dropped++;
+            _next++;
+            continue;
+        }
+        if(ring->closed.load(std::memory_order_acquire)) return false;
+        int waitMs = -1;
+        if(timeoutMs >= 0) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if(left <= 0) return false;
+            waitMs = static_cast<int>(left);
+        }
+        if(!futexWait(ring->futexWord, wakeups, waitMs)) return false;
+    }
+}
+
+bool ShmRingSubscriber::valid(const ShmFrame& frame) const {
+    if(!_base) return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot(frame.index)->seq.load(std::memory_order_relaxed) == 2 * frame.index + 2;
+}
+
+bool ShmRingSubscriber::copy(const ShmFrame& frame, void* dst) const {
+    std::memcpy(dst, frame.data, frame.size);
+    return valid(frame);
+}
+
+bool ShmRingSubscriber::closed() const {
+    return !_base || header()->closed.load(std::memory_order_acquire);
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "CaptureFile.hpp"
+
+// Frame ring in POSIX shared memory, for fanning frames out to other processes on the host.
+//
+//   RingHeader                   128 bytes
+//   { SlotHeader, payload }      slotCount slots of slotStride bytes, payloads 64-byte aligned
+//
+// One publisher writes frames round-robin into the slots; any number of subscribers map the
+// ring read-only and read the payloads in place. Each slot is guarded by a sequence lock: the
+// publisher makes the slot's seq odd while writing and sets it to 2 * frameIndex + 2 when done,
+// so a reader can tell a complete frame from one being overwritten. The publisher never waits
+// for subscribers; one that falls more than slotCount frames behind skips ahead and counts the
+// lost frames.
+
+namespace shmring {
+
+constexpr size_t kAlignment = 64;
+
+struct RingHeader {
+    char magic[8];  // "DAISHM\0\1", written last when the ring is ready
+    uint32_t version;
+    uint32_t slotCount;
+    uint64_t slotStride;    // SlotHeader + payload capacity
+    uint64_t slotCapacity;  // max payload bytes
+    int32_t publisherPid;
+    uint8_t reserved0[28];
+    // Written by the publisher on every frame, kept off the read-mostly line above
+    std::atomic<uint64_t> published;  // frames completely written
+    std::atomic<uint32_t> futexWord;  // bumped per frame, subscribers sleep on it
+    std::atomic<uint32_t> closed;
+    uint8_t reserved1[48];
+};
+
+struct SlotHeader {
+    std::atomic<uint64_t> seq;
+    int64_t sequence;
+    int64_t deviceTimestampNs;
+    int64_t publishNs;  // steady_clock, comparable across processes
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frameType;
+    char stream[12];
+};
+
+static_assert(sizeof(RingHeader) == 128, "RingHeader layout");
+static_assert(sizeof(SlotHeader) == 64, "SlotHeader layout");
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared-memory atomics must be lock-free");
+
+}  // namespace shmring
+
+struct ShmPublisherStats {
+    uint64_t published = 0;
+    uint64_t tooLarge = 0;  // frames over the slot capacity, not published
+};
+
+// Creates the ring and writes frames into it. Not thread-safe: one publishing thread.
+class ShmRingPublisher {
+   public:
+    ShmRingPublisher() = default;
+    ~ShmRingPublisher();
+
+    ShmRingPublisher(const ShmRingPublisher&) = delete;
+    ShmRingPublisher& operator=(const ShmRingPublisher&) = delete;
+
+    // `name` as for shm_open ("/camera"); an existing ring of that name is replaced
+    bool open(const std::string& name, uint32_t slotCount, size_t slotCapacity);
+    // Marks the ring closed and unlinks it; attached subscribers keep their mapping
+    void close();
+
+    // One copy into the slot, then the frame is visible to all subscribers
+    bool publish(const char* stream, const CaptureInfo& info, const void* data, size_t size);
+
+    ShmPublisherStats getStats() const {
+        return _stats;
+    }
+
+   private:
+    std::string _name;
+    uint8_t* _base = nullptr;
+    size_t _mapSize = 0;
+    ShmPublisherStats _stats;
+};
+
+// A frame in the ring. `data` points into shared memory and may be overwritten at any time,
+// check ShmRingSubscriber::valid() after using it.
+struct ShmFrame {
+    uint64_t index = 0;  // position in the publisher's frame stream
+    char stream[12] = {};
+    CaptureInfo info;
+    int64_t publishNs = 0;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+};
+
+struct ShmSubscriberStats {
+    uint64_t received = 0;
+    uint64_t dropped = 0;  // overwritten before this subscriber got to them
+};
+
+class ShmRingSubscriber {
+   public:
+    ShmRingSubscriber() = default;
+    ~ShmRingSubscriber();
+
+    ShmRingSubscriber(const ShmRingSubscriber&) = delete;
+    ShmRingSubscriber& operator=(const ShmRingSubscriber&) = delete;
+
+    // Starts at the next frame published after attaching
+    bool attach(const std::string& name);
+    void detach();
+
+    // Next frame, waiting up to `timeoutMs` (-1 forever). False on timeout or once the
+    // publisher has closed the ring and everything is read.
+    bool acquire(ShmFrame& frame, int timeoutMs);
+    // True if `frame` was not overwritten since acquire(): whatever was read from its data is good
+    bool valid(const ShmFrame& frame) const;
+    // Copies the payload out; false if it was overwritten during the copy
+    bool copy(const ShmFrame& frame, void* dst) const;
+
+    bool closed() const;
+    ShmSubscriberStats getStats() const {
+        return _stats;
+    }
+
+   private:
+    const shmring::RingHeader* header() const {
+        return reinterpret_cast<const shmring::RingHeader*>(_base);
+    }
+    const shmring::SlotHeader* slot(uint64_t index) const {
+        return reinterpret_cast<const shmring::SlotHeader*>(_base + sizeof(shmring::RingHeader) + (index % header()->slotCount) * header()->slotStride);
+    }
+
+    const uint8_t* _base = nullptr;
+    size_t _mapSize = 0;
+    uint64_t _next = 0;
+    ShmSubscriberStats _stats;
+};
@@ -0,0 +1,94 @@
+#include "StartupProfiler.hpp"
+
+StartupProfiler::StartupProfiler() : _start(std::chrono::steady_clock::now()) {
+    for(auto& ns : _firstFrameNs) ns.store(-1, std::memory_order_relaxed);
+}
+
+int StartupProfiler::begin(const std::string& name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Phase phase;
+    phase.name = name;
+    phase.startNs = sinceStart();
+    _phases.push_back(phase);
+    return static_cast<int>(_phases.size()) - 1;
+}
+
+void StartupProfiler::end(int phase) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(phase >= 0 && phase < static_cast<int>(_phases.size())) _phases[phase].endNs = sinceStart();
+}
+
+int StartupProfiler::addStream(const std::string& name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    int stream = _numStreams.load();
+    if(stream >= kMaxStreams) return -1;
+    _streams.push_back(name);
+    _numStreams.store(stream + 1);
+    return stream;
+}
+
+void StartupProfiler::recordFirstFrame(int stream) {
+    int64_t expected = -1;
+    _firstFrameNs[stream].compare_exchange_strong(expected, sinceStart(), std::memory_order_relaxed);
+}
+
+bool StartupProfiler::allStreamsStarted() const {
+    int n = _numStreams.load();
+    for(int i = 0; i < n; i++) {
+        if(_firstFrameNs[i].load(std::memory_order_relaxed) < 0) return false;
+    }
+    return n > 0;
+}
+
+bool StartupProfiler::printWhenStarted() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_printed) return false;
+    }
+    if(!allStreamsStarted()) return false;
+    print();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _printed = true;
+    return true;
+}
+
+void StartupProfiler::print() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    printf("Startup:\n");
+    for(const auto& p : _phases) {
+        if(p.endNs >= 0) {
+            printf("  %-22s %8.1f ms  (at %8.1f ms)\n", p.name.c_str(), (p.endNs - p.startNs) / 1e6, p.startNs / 1e6);
+        } else {
+            printf("  %-22s  running  (at %8.1f ms)\n", p.name.c_str(), p.startNs / 1e6);
+        }
+    }
+    for(size_t i = 0; i < _streams.size(); i++) {
+        int64_t ns = _firstFrameNs[i].load(std::memory_order_relaxed);
+        std::string label = "first " + _streams[i];
+        if(ns >= 0) {
+            printf("  %-22s at %8.1f ms\n", label.c_str(), ns / 1e6);
+        } else {
+            printf("  %-22s none yet\n", label.c_str());
+        }
+    }
+}
+
+void StartupProfiler::writeJson(FILE* out) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    fprintf(out, "{\"phases\": [");
+    for(size_t i = 0; i < _phases.size(); i++) {
+        const auto& p = _phases[i];
+        fprintf(out,
+                "%s\n  {\"name\": \"%s\", \"start_ms\": %.3f, \"duration_ms\": %.3f}",
+                i ? "," : "",
+                p.name.c_str(),
+                p.startNs / 1e6,
+                p.endNs >= 0 ? (p.endNs - p.startNs) / 1e6 : -1.0);
+    }
+    fprintf(out, "\n], \"first_frames\": [");
+    for(size_t i = 0; i < _streams.size(); i++) {
+        int64_t ns = _firstFrameNs[i].load(std::memory_order_relaxed);
+        fprintf(out, "%s\n  {\"stream\": \"%s\", \"ms\": %.3f}", i ? "," : "", _streams[i].c_str(), ns >= 0 ? ns / 1e6 : -1.0);
+    }
+    fprintf(out, "\n]}\n");
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Breaks time-to-first-frame into phases.
+//
+// Phases (pipeline build, device boot, ...) are intervals measured from the profiler's
+// creation and may overlap, e.g. the pipeline is built while the device boots. firstFrame() is
+// called from the stream's callback or loop for every frame; only the first call per stream
+// records anything, later ones are a relaxed load. print() shows the timeline once every
+// registered stream delivered a frame (or whenever called).
+class StartupProfiler {
+   public:
+    static constexpr int kMaxStreams = 16;
+
+    StartupProfiler();
+
+    // Returns the phase id for end()
+    int begin(const std::string& name);
+    void end(int phase);
+
+    // Returns the stream id, -1 when all kMaxStreams are used
+    int addStream(const std::string& name);
+    void firstFrame(int stream) {
+        if(stream < 0 || _firstFrameNs[stream].load(std::memory_order_relaxed) >= 0) return;
+        recordFirstFrame(stream);
+    }
+    bool allStreamsStarted() const;
+
+    // Once all streams started, prints the breakdown (first call only); true if it printed
+    bool printWhenStarted();
+    void print() const;
+    // {"phases": [{"name", "start_ms", "duration_ms"}], "first_frames": [{"stream", "ms"}]}
+    void writeJson(FILE* out) const;
+
+   private:
+    struct Phase {
+        std::string name;
+        int64_t startNs = 0;
+        int64_t endNs = -1;
+    };
+
+    int64_t sinceStart() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+    }
+    void recordFirstFrame(int stream);
+
+    const std::chrono::steady_clock::time_point _start;
+    mutable std::mutex _mutex;
+    std::vector<Phase> _phases;
+    std::vector<std::string> _streams;
+    std::array<std::atomic<int64_t>, kMaxStreams> _firstFrameNs;
+    std::atomic<int> _numStreams{0};
+    bool _printed = false;
+};
+
+// Scoped phase
+class StartupPhase {
+   public:
+    StartupPhase(StartupProfiler& profiler, const std::string& name) : _profiler(profiler), _phase(profiler.begin(name)) {}
+    ~StartupPhase() {
+        _profiler.end(_phase);
+    }
+
+    StartupPhase(const StartupPhase&) = delete;
+    StartupPhase& operator=(const StartupPhase&) = delete;
+
+   private:
+    StartupProfiler& _profiler;
+    const int _phase;
+};
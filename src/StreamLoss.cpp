@@ -0,0 +1,104 @@
+#include "StreamLoss.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+int LossMonitor::addStream(const std::string& name, int depth, int minDepth, int maxDepth) {
+    _streams.emplace_back();
+    Stream& s = _streams.back();
+    s.name = name;
+    s.stats.name = name;
+    s.stats.depth = depth;
+    s.minDepth = minDepth > 0 ? minDepth : depth;
+    s.maxDepth = std::max(maxDepth, s.minDepth);
+    return static_cast<int>(_streams.size()) - 1;
+}
+
+void LossMonitor::arrived(int stream, int64_t sequence, size_t bytes) {
+    if(stream < 0 || sequence < 0) return;
+    Stream& s = _streams[stream];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.stats.arrived++;
+    s.stats.maxMessageBytes = std::max(s.stats.maxMessageBytes, bytes);
+    if(s.lastArrived >= 0 && sequence > s.lastArrived + 1) {
+        int64_t gap = sequence - s.lastArrived - 1;
+        s.stats.deviceDropped += gap;
+        // Forget whatever the skipped slots held kWindow messages ago
+        for(int64_t i = std::max(s.lastArrived + 1, sequence - kWindow); i < sequence; i++) s.mark(i, false);
+    } else if(s.lastArrived >= 0 && sequence <= s.lastArrived) {
+        // Stream restarted on the device
+        s.lastConsumed = -1;
+    }
+    s.lastArrived = sequence;
+    s.mark(sequence, true);
+    s.stats.maxOccupancy = std::max(s.stats.maxOccupancy, s.occupancy());
+    s.windowMaxOccupancy = std::max(s.windowMaxOccupancy, s.occupancy());
+}
+
+void LossMonitor::consumed(int stream, int64_t sequence) {
+    if(stream < 0 || sequence < 0) return;
+    Stream& s = _streams[stream];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.stats.consumed++;
+    if(s.lastConsumed >= 0 && sequence > s.lastConsumed + 1) {
+        uint64_t hostDropped = 0;
+        for(int64_t i = s.lastConsumed + 1; i < sequence; i++) {
+            // Older than the arrival window: the consumer fell that far behind, so it was the host
+            if(i <= s.lastArrived - kWindow || s.marked(i)) hostDropped++;
+        }
+        s.stats.hostDropped += hostDropped;
+        s.windowHostDropped += hostDropped;
+    }
+    s.lastConsumed = sequence;
+}
+
+bool LossMonitor::adapt(int stream, int& depth, std::chrono::steady_clock::time_point now) {
+    if(stream < 0) return false;
+    Stream& s = _streams[stream];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if(s.minDepth == s.maxDepth) return false;
+    if(s.windowStart == std::chrono::steady_clock::time_point()) s.windowStart = now;
+    if(now - s.windowStart < std::chrono::seconds(1)) return false;
+
+    int current = s.stats.depth;
+    int next = current;
+    if(s.windowHostDropped > 0) {
+        next = std::min(s.maxDepth, current * 2);
+        s.quietWindows = 0;
+    } else if(++s.quietWindows >= kQuietWindows) {
+        next = std::max(s.minDepth, std::max(2 * s.windowMaxOccupancy, current * 3 / 4));
+        next = std::min(next, current);
+        s.quietWindows = 0;
+    }
+    s.windowStart = now;
+    s.windowHostDropped = 0;
+    s.windowMaxOccupancy = s.occupancy();
+    if(next == current) return false;
+    s.stats.depth = next;
+    s.stats.resizes++;
+    depth = next;
+    return true;
+}
+
+StreamLossStats LossMonitor::getStats(int stream) const {
+    const Stream& s = _streams[stream];
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.stats;
+}
+
+void LossMonitor::printStats() const {
+    for(size_t i = 0; i < _streams.size(); i++) {
+        auto stats = getStats(static_cast<int>(i));
+        if(stats.arrived == 0) continue;
+        printf("%-10s %8lu received, %6lu dropped on device, %6lu on host (%.2f%%); queue depth %d (%d resizes, peak %d, up to %.1f MB)\n",
+               stats.name.c_str(),
+               (unsigned long)stats.arrived,
+               (unsigned long)stats.deviceDropped,
+               (unsigned long)stats.hostDropped,
+               stats.lossRatio() * 100.0,
+               stats.depth,
+               (int)stats.resizes,
+               stats.maxOccupancy,
+               stats.depth * stats.maxMessageBytes / 1e6);
+    }
+}
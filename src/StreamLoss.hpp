@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+struct StreamLossStats {
+    std::string name;
+    uint64_t arrived = 0;        // messages that reached the host queue
+    uint64_t consumed = 0;       // messages taken out of it
+    uint64_t deviceDropped = 0;  // sequence gaps already present on arrival
+    uint64_t hostDropped = 0;    // arrived but overwritten in a full non-blocking queue
+    int depth = 0;               // current host queue depth
+    int maxOccupancy = 0;        // estimated, since the start
+    uint64_t resizes = 0;
+    size_t maxMessageBytes = 0;
+
+    double lossRatio() const {
+        uint64_t total = consumed + deviceDropped + hostDropped;
+        return total ? double(deviceDropped + hostDropped) / total : 0.0;
+    }
+};
+
+// Per-stream loss accounting from message sequence numbers, plus optional adaptive sizing of
+// the host queue.
+//
+// arrived() is called for every message the host receives (from a queue callback, which runs
+// after the message was pushed) and consumed() for every message taken out of the queue.
+// A sequence gap at arrival means the device dropped the messages (e.g. its XLinkOut queue was
+// full); a message that arrived but is skipped at consumption was dropped by the host queue.
+//
+// With a depth range, adapt() resizes the host queue once per second: it doubles the depth
+// after a second with host drops (up to the maximum), and after several quiet seconds shrinks
+// it towards twice the peak occupancy seen, so bursty consumers keep their headroom and
+// steady ones give the memory back.
+class LossMonitor {
+   public:
+    // Returns the stream id. minDepth == maxDepth (or 0) keeps the queue at `depth`. Add every
+    // stream before the first arrived(): streams are not locked against being added.
+    int addStream(const std::string& name, int depth, int minDepth = 0, int maxDepth = 0);
+
+    void arrived(int stream, int64_t sequence, size_t bytes = 0);
+    void consumed(int stream, int64_t sequence);
+
+    // True and the new depth when the stream's queue should be resized
+    bool adapt(int stream, int& depth, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+    StreamLossStats getStats(int stream) const;
+    void printStats() const;
+
+   private:
+    static constexpr int kWindow = 1024;  // arrivals remembered to classify consumption gaps
+    static constexpr int kQuietWindows = 5;
+
+    struct Stream {
+        std::string name;
+        mutable std::mutex mutex;
+        std::array<uint64_t, kWindow / 64> arrivedBits{};
+        int64_t lastArrived = -1;
+        int64_t lastConsumed = -1;
+        StreamLossStats stats;
+        int minDepth = 0, maxDepth = 0;
+        // Current adaptation window
+        std::chrono::steady_clock::time_point windowStart;
+        uint64_t windowHostDropped = 0;
+        int windowMaxOccupancy = 0;
+        int quietWindows = 0;
+
+        void mark(int64_t sequence, bool value) {
+            uint64_t bit = uint64_t(1) << (sequence % 64);
+            auto& word = arrivedBits[(sequence / 64) % arrivedBits.size()];
+            word = value ? word | bit : word & ~bit;
+        }
+        bool marked(int64_t sequence) const {
+            return arrivedBits[(sequence / 64) % arrivedBits.size()] >> (sequence % 64) & 1;
+        }
+        int occupancy() const {
+            int64_t n = int64_t(stats.arrived) - int64_t(stats.consumed) - int64_t(stats.hostDropped);
+            return n > 0 ? static_cast<int>(n) : 0;
+        }
+    };
+
+    std::deque<Stream> _streams;
+};
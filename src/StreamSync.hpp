@@ -0,0 +1,225 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct StreamSyncStats {
+    uint64_t bundles = 0;   // led by a reference message; singles not included
+    uint64_t complete = 0;  // bundles with a match for every stream
+    uint64_t evicted = 0;   // left out of every bundle (too old, passed over, stream buffer full), emitted alone
+    uint64_t overflow = 0;  // dropped because the output was full
+    std::vector<uint64_t> matched;  // per stream, reference included
+    uint64_t totalLatencyUs = 0;    // sum over bundles of the time the reference message waited
+    uint64_t maxLatencyUs = 0;
+
+    // Fraction of bundles that have a message of `stream`
+    double matchRate(int stream) const {
+        return bundles ? double(matched[stream]) / bundles : 0.0;
+    }
+    double meanLatencyUs() const {
+        return bundles ? double(totalLatencyUs) / bundles : 0.0;
+    }
+};
+
+// Groups messages of several streams by device timestamp.
+//
+// Every message of the reference stream (e.g. video) opens a bundle; each other stream
+// contributes its message closest in time, if one lies within `tolerance`. A bundle is
+// emitted as soon as it is settled, i.e. every stream has delivered a message at or after the
+// reference timestamp (so no closer match can still arrive), or after the reference message
+// waited `maxWait` on the host, in which case streams without a match are left out. Device
+// timestamps must be monotonic per stream.
+//
+// Messages are never dropped for lack of a match: one that can no longer match (older than
+// the reference minus the tolerance, passed over by a closer one, pushed out of a full stream
+// buffer, or waiting `maxWait` with no reference message to wait for) is emitted on its own,
+// as a bundle holding just that stream. Streams that aren't hardware-synced, or run at another
+// rate, so still deliver every message; consumers that need the match check has().
+//
+// push() and tryPop() may be called from different threads.
+template <typename T>
+class StreamSync {
+   public:
+    struct Bundle {
+        int64_t timestampNs = 0;  // of the reference message
+        uint32_t mask = 0;        // bit s set if items[s] holds a message
+        std::vector<T> items;     // by stream
+
+        bool has(int stream) const {
+            return mask >> stream & 1;
+        }
+        // A message that matched no reference message, or a reference message that matched nothing
+        bool single() const {
+            return mask != 0 && (mask & (mask - 1)) == 0;
+        }
+    };
+
+    StreamSync(int numStreams,
+               std::chrono::nanoseconds tolerance,
+               int referenceStream = 0,
+               size_t capacity = 16,
+               std::chrono::microseconds maxWait = std::chrono::milliseconds(50))
+        : _tolerance(tolerance.count()), _reference(referenceStream), _capacity(std::max<size_t>(1, capacity)), _maxWait(maxWait), _queues(numStreams) {
+        _stats.matched.resize(numStreams);
+    }
+
+    StreamSync(const StreamSync&) = delete;
+    StreamSync& operator=(const StreamSync&) = delete;
+
+    void push(int stream, int64_t timestampNs, T item) {
+        auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& queue = _queues[stream];
+        if(queue.size() >= _capacity) {
+            emitSingle(stream, queue.front());
+            queue.pop_front();
+        }
+        queue.push_back(Entry{timestampNs, std::move(item), now});
+        settle(now);
+    }
+
+    // Also emits bundles whose reference message waited longer than maxWait
+    bool tryPop(Bundle& bundle) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        settle(Clock::now());
+        if(_ready.empty()) return false;
+        bundle = std::move(_ready.front());
+        _ready.pop_front();
+        return true;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for(auto& queue : _queues) queue.clear();
+        _ready.clear();
+    }
+
+    StreamSyncStats getStats() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _stats;
+    }
+
+    void printStats(const char* name) const {
+        auto stats = getStats();
+        printf("%s: %lu bundles, %lu complete, match rate", name, (unsigned long)stats.bundles, (unsigned long)stats.complete);
+        for(size_t s = 0; s < stats.matched.size(); s++) printf(" %.3f", stats.matchRate(static_cast<int>(s)));
+        printf(", added latency %.3f ms (max %.3f ms), %lu unmatched, %lu overflow\n",
+               stats.meanLatencyUs() / 1000.0,
+               stats.maxLatencyUs / 1000.0,
+               (unsigned long)stats.evicted,
+               (unsigned long)stats.overflow);
+    }
+
+   private:
+    using Clock = std::chrono::steady_clock;
+    struct Entry {
+        int64_t timestampNs;
+        T item;
+        Clock::time_point arrival;
+    };
+
+    // Emits bundles for reference messages that can't get any better matches
+    void settle(Clock::time_point now) {
+        auto& refQueue = _queues[_reference];
+        int numStreams = static_cast<int>(_queues.size());
+        while(!refQueue.empty()) {
+            Entry& ref = refQueue.front();
+            bool expired = now - ref.arrival >= _maxWait;
+            bool settled = true;
+            for(int s = 0; s < numStreams && settled; s++) {
+                if(s == _reference) continue;
+                auto& queue = _queues[s];
+                // Reference timestamps only grow, anything this old is useless from now on
+                while(!queue.empty() && queue.front().timestampNs < ref.timestampNs - _tolerance) {
+                    emitSingle(s, queue.front());
+                    queue.pop_front();
+                }
+                settled = expired || (!queue.empty() && queue.back().timestampNs >= ref.timestampNs);
+            }
+            if(!settled) break;
+
+            Bundle bundle;
+            bundle.timestampNs = ref.timestampNs;
+            bundle.items.resize(numStreams);
+            for(int s = 0; s < numStreams; s++) {
+                if(s == _reference) continue;
+                auto& queue = _queues[s];
+                size_t best = queue.size();
+                int64_t bestDiff = _tolerance + 1;
+                for(size_t i = 0; i < queue.size(); i++) {
+                    int64_t diff = std::abs(queue[i].timestampNs - ref.timestampNs);
+                    if(diff < bestDiff) {
+                        best = i;
+                        bestDiff = diff;
+                    } else if(queue[i].timestampNs > ref.timestampNs) {
+                        break;  // only getting further away
+                    }
+                }
+                if(best == queue.size()) continue;
+                bundle.items[s] = std::move(queue[best].item);
+                bundle.mask |= 1u << s;
+                _stats.matched[s]++;
+                // Older entries lost against the match, and would be further from later references
+                for(size_t i = 0; i < best; i++) emitSingle(s, queue[i]);
+                queue.erase(queue.begin(), queue.begin() + best + 1);
+            }
+            bundle.items[_reference] = std::move(ref.item);
+            bundle.mask |= 1u << _reference;
+            _stats.matched[_reference]++;
+
+            uint64_t latencyUs = std::chrono::duration_cast<std::chrono::microseconds>(now - ref.arrival).count();
+            _stats.totalLatencyUs += latencyUs;
+            _stats.maxLatencyUs = std::max(_stats.maxLatencyUs, latencyUs);
+            _stats.bundles++;
+            if(bundle.mask == (1u << numStreams) - 1) _stats.complete++;
+            refQueue.pop_front();
+            output(std::move(bundle));
+        }
+        // Nothing to wait for: don't hold the other streams back longer than maxWait
+        if(refQueue.empty()) {
+            for(int s = 0; s < numStreams; s++) {
+                auto& queue = _queues[s];
+                while(!queue.empty() && now - queue.front().arrival >= _maxWait) {
+                    emitSingle(s, queue.front());
+                    queue.pop_front();
+                }
+            }
+        }
+    }
+
+    // A message left out of every bundle, on its own
+    void emitSingle(int stream, Entry& entry) {
+        Bundle bundle;
+        bundle.timestampNs = entry.timestampNs;
+        bundle.items.resize(_queues.size());
+        bundle.items[stream] = std::move(entry.item);
+        bundle.mask = 1u << stream;
+        _stats.evicted++;
+        output(std::move(bundle));
+    }
+
+    void output(Bundle&& bundle) {
+        if(_ready.size() >= _capacity) {
+            _ready.pop_front();
+            _stats.overflow++;
+        }
+        _ready.push_back(std::move(bundle));
+    }
+
+    const int64_t _tolerance;
+    const int _reference;
+    const size_t _capacity;
+    const std::chrono::microseconds _maxWait;
+
+    mutable std::mutex _mutex;
+    std::vector<std::deque<Entry>> _queues;
+    std::deque<Bundle> _ready;
+    StreamSyncStats _stats;
+};
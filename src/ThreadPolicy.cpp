@@ -0,0 +1,327 @@
+#include "ThreadPolicy.hpp"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+constexpr int kRoles = static_cast<int>(ThreadRole::Count);
+const char* const kRoleNames[kRoles] = {"capture", "audio", "writer", "worker", "control", "ui"};
+// set_mempolicy() mode, from linux/mempolicy.h
+constexpr int kMpolPreferred = 1;
+
+pid_t currentTid() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while(true) {
+        size_t end = s.find(sep, start);
+        parts.push_back(s.substr(start, end - start));
+        if(end == std::string::npos) return parts;
+        start = end + 1;
+    }
+}
+
+bool parseInt(const std::string& s, int& value) {
+    char* end = nullptr;
+    long v = strtol(s.c_str(), &end, 10);
+    if(s.empty() || *end) return false;
+    value = static_cast<int>(v);
+    return true;
+}
+
+// "2-3,5"
+std::string cpuList(const std::vector<int>& cpus) {
+    std::string out;
+    for(size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while(j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+        if(!out.empty()) out += ",";
+        out += std::to_string(cpus[i]);
+        if(j > i) out += "-" + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return out;
+}
+
+void append(std::string& text, const std::string& part) {
+    if(!text.empty()) text += ", ";
+    text += part;
+}
+
+}  // namespace
+
+// Per-thread bookkeeping; its destructor runs as the thread exits
+struct ThreadRecord {
+    ThreadPolicy* policy = nullptr;
+    size_t index = 0;
+    int role = -1;
+
+    ~ThreadRecord() {
+        if(policy) policy->exited(index);
+    }
+};
+
+namespace {
+thread_local ThreadRecord _record;
+}  // namespace
+
+ThreadPolicy& ThreadPolicy::global() {
+    static ThreadPolicy* policy = new ThreadPolicy();
+    return *policy;
+}
+
+ThreadPolicy::ThreadPolicy() {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if(CPU_ISSET(cpu, &set)) _allowedCpus.push_back(cpu);
+        }
+    }
+}
+
+const char* ThreadPolicy::roleName(ThreadRole role) {
+    int i = static_cast<int>(role);
+    return i >= 0 && i < kRoles ? kRoleNames[i] : "?";
+}
+
+bool ThreadPolicy::parseRole(const std::string& name, ThreadRole& role) {
+    for(int i = 0; i < kRoles; i++) {
+        if(name == kRoleNames[i]) {
+            role = static_cast<ThreadRole>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPolicy::configure(const std::string& spec) {
+    for(const auto& entry : split(spec, ',')) {
+        if(entry.empty()) continue;
+        if(entry == "rt") {
+            _roles[static_cast<int>(ThreadRole::Capture)].fifoPriority = 20;
+            _roles[static_cast<int>(ThreadRole::Audio)].fifoPriority = 30;
+            _roles[static_cast<int>(ThreadRole::Writer)].nice = 5;
+            _roles[static_cast<int>(ThreadRole::Writer)].setNice = true;
+            _roles[static_cast<int>(ThreadRole::Worker)].nice = 2;
+            _roles[static_cast<int>(ThreadRole::Worker)].setNice = true;
+            continue;
+        }
+        auto options = split(entry, ':');
+        ThreadRole role;
+        if(!parseRole(options[0], role)) {
+            printf("Thread policy: unknown role '%s' in %s\n", options[0].c_str(), spec.c_str());
+            return false;
+        }
+        ThreadRolePolicy& policy = _roles[static_cast<int>(role)];
+        for(size_t i = 1; i < options.size(); i++) {
+            const std::string& option = options[i];
+            size_t eq = option.find('=');
+            std::string key = option.substr(0, eq);
+            std::string value = eq == std::string::npos ? "" : option.substr(eq + 1);
+            int a, b;
+            bool ok = true;
+            if(key == "fifo") {
+                ok = parseInt(value, policy.fifoPriority) && policy.fifoPriority > 0;
+            } else if(key == "nice") {
+                ok = parseInt(value, policy.nice);
+                policy.setNice = ok;
+            } else if(key == "numa" && value.empty()) {
+                policy.localMemory = true;
+            } else if(key == "cpus") {
+                size_t dash = value.find('-');
+                if(dash == std::string::npos) {
+                    ok = parseInt(value, a);
+                    b = a;
+                } else {
+                    ok = parseInt(value.substr(0, dash), a) && parseInt(value.substr(dash + 1), b);
+                }
+                ok = ok && a >= 0 && b >= a && b < CPU_SETSIZE;
+                for(int cpu = a; ok && cpu <= b; cpu++) {
+                    if(std::find(policy.cpus.begin(), policy.cpus.end(), cpu) == policy.cpus.end()) policy.cpus.push_back(cpu);
+                }
+                std::sort(policy.cpus.begin(), policy.cpus.end());
+            } else {
+                ok = false;
+            }
+            if(!ok) {
+                printf("Thread policy: bad option '%s' for %s, expected fifo=<1-99>, nice=<n>, cpus=<a>[-<b>] or numa\n", option.c_str(), options[0].c_str());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void ThreadPolicy::setRole(ThreadRole role, const ThreadRolePolicy& policy) {
+    _roles[static_cast<int>(role)] = policy;
+}
+
+void ThreadPolicy::enter(ThreadRole role, const char* name) {
+    if(_record.policy == this && _record.role == static_cast<int>(role)) return;
+
+    std::string threadName(name ? name : roleName(role));
+    pthread_setname_np(pthread_self(), threadName.substr(0, 15).c_str());
+    std::string applied = apply(_roles[static_cast<int>(role)]);
+    if(!applied.empty()) printf("Thread %s (%s): %s\n", threadName.c_str(), roleName(role), applied.c_str());
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_record.policy != this) {
+        ThreadStats stats;
+        stats.tid = currentTid();
+        _threads.push_back(stats);
+        _record.policy = this;
+        _record.index = _threads.size() - 1;
+    }
+    ThreadStats& stats = _threads[_record.index];
+    stats.name = threadName;
+    stats.role = role;
+    stats.applied = applied;
+    _record.role = static_cast<int>(role);
+}
+
+std::string ThreadPolicy::apply(const ThreadRolePolicy& policy) {
+    std::string applied;
+
+    std::vector<int> cpus;
+    for(int cpu : policy.cpus) {
+        if(std::find(_allowedCpus.begin(), _allowedCpus.end(), cpu) != _allowedCpus.end()) cpus.push_back(cpu);
+    }
+    if(cpus.size() < policy.cpus.size()) append(applied, "CPUs " + cpuList(policy.cpus) + " not all available");
+    if(!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(int cpu : cpus) CPU_SET(cpu, &set);
+        if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+            append(applied, "cpus " + cpuList(cpus));
+        } else {
+            append(applied, "can't set affinity");
+            cpus.clear();
+        }
+    }
+
+    if(policy.localMemory) {
+        // Preferred, not bound: allocations still succeed when the node is full
+        int node = cpus.empty() ? -1 : numaNode(cpus[0]);
+        bool oneNode = node >= 0;
+        for(int cpu : cpus) oneNode = oneNode && numaNode(cpu) == node;
+        bool multiNode = false;
+        for(int cpu : _allowedCpus) multiNode = multiNode || numaNode(cpu) != node;
+        if(!oneNode) {
+            append(applied, "numa needs cpus on one node");
+        } else if(!multiNode) {
+            append(applied, "numa: single node");
+        } else {
+            unsigned long mask[16] = {};
+            if(node < static_cast<int>(sizeof(mask) * 8)) mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+            if(syscall(SYS_set_mempolicy, kMpolPreferred, mask, sizeof(mask) * 8) == 0) {
+                append(applied, "memory on node " + std::to_string(node));
+            } else {
+                append(applied, std::string("can't prefer node ") + std::to_string(node) + ": " + strerror(errno));
+            }
+        }
+    }
+
+    int nice = policy.nice;
+    bool setNice = policy.setNice;
+    if(policy.fifoPriority > 0) {
+        sched_param param;
+        param.sched_priority = std::min(std::max(policy.fifoPriority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(err == 0) {
+            append(applied, "SCHED_FIFO " + std::to_string(param.sched_priority));
+            setNice = false;
+        } else {
+            // No CAP_SYS_NICE and no rtprio limit: the best an ordinary process gets is a nice level
+            append(applied, "SCHED_FIFO " + std::to_string(param.sched_priority) + " not permitted");
+            if(!setNice) nice = -10;
+            setNice = true;
+        }
+    }
+    if(setNice) {
+        if(setpriority(PRIO_PROCESS, static_cast<id_t>(currentTid()), nice) == 0) {
+            append(applied, "nice " + std::to_string(nice));
+        } else {
+            append(applied, "nice " + std::to_string(nice) + " not permitted");
+        }
+    }
+    return applied;
+}
+
+void ThreadPolicy::exited(size_t index) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(index >= _threads.size()) return;
+    ThreadStats& stats = _threads[index];
+    readSchedStat(stats.tid, stats.cpuNs, stats.waitNs, stats.timeslices);
+    stats.exited = true;
+}
+
+std::vector<ThreadStats> ThreadPolicy::getStats() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<ThreadStats> threads = _threads;
+    for(auto& stats : threads) {
+        if(!stats.exited) readSchedStat(stats.tid, stats.cpuNs, stats.waitNs, stats.timeslices);
+    }
+    return threads;
+}
+
+void ThreadPolicy::printStats() const {
+    auto threads = getStats();
+    if(threads.empty()) return;
+    printf("Threads (CPU time, time runnable but waiting for a CPU):\n");
+    for(const auto& t : threads) {
+        printf("  %-15s %-7s %8.1f ms CPU, %8.1f ms waiting, %6.1f us per wakeup%s%s%s\n",
+               t.name.c_str(),
+               ThreadPolicy::roleName(t.role),
+               t.cpuNs / 1e6,
+               t.waitNs / 1e6,
+               t.timeslices ? t.waitNs / 1e3 / t.timeslices : 0.0,
+               t.exited ? " (exited)" : "",
+               t.applied.empty() ? "" : "; ",
+               t.applied.c_str());
+    }
+}
+
+bool ThreadPolicy::readSchedStat(pid_t tid, uint64_t& cpuNs, uint64_t& waitNs, uint64_t& timeslices) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/schedstat", static_cast<int>(tid));
+    FILE* f = fopen(path, "r");
+    if(!f) return false;
+    unsigned long long cpu = 0, wait = 0, slices = 0;
+    bool ok = fscanf(f, "%llu %llu %llu", &cpu, &wait, &slices) == 3;
+    fclose(f);
+    if(ok) {
+        cpuNs = cpu;
+        waitNs = wait;
+        timeslices = slices;
+    }
+    return ok;
+}
+
+int ThreadPolicy::numaNode(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = opendir(path);
+    if(!dir) return -1;
+    int node = -1;
+    while(dirent* entry = readdir(dir)) {
+        if(std::strncmp(entry->d_name, "node", 4) == 0 && parseInt(entry->d_name + 4, node)) break;
+        node = -1;
+    }
+    closedir(dir);
+    return node;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// What a thread does, which decides where and how it is scheduled
+enum class ThreadRole {
+    Capture,  // depthai queue callbacks and the loops polling device queues
+    Audio,    // audio recording
+    Writer,   // capture file and video muxer writes
+    Worker,   // conversion and per-device processing
+    Control,  // stdin / socket command reader
+    Ui,       // display loop
+    Count
+};
+
+struct ThreadRolePolicy {
+    std::vector<int> cpus;  // affinity set, empty: wherever the kernel likes
+    int fifoPriority = 0;   // > 0: SCHED_FIFO at this priority
+    int nice = 0;
+    bool setNice = false;
+    bool localMemory = false;  // prefer the NUMA node of `cpus` for the thread's allocations
+};
+
+struct ThreadStats {
+    pid_t tid = 0;
+    std::string name;
+    ThreadRole role = ThreadRole::Capture;
+    std::string applied;      // what the policy ended up as, e.g. "cpus 2-3, SCHED_FIFO 30"
+    uint64_t cpuNs = 0;       // time on a CPU
+    uint64_t waitNs = 0;      // time runnable but waiting for a CPU
+    uint64_t timeslices = 0;  // times it got a CPU
+    bool exited = false;      // stats are from when the thread exited
+};
+
+// Where the host threads run and at which priority, configured per role.
+//
+// Every thread the host code starts calls enter() with its role first thing; depthai's own
+// callback threads call it from the callback, which is cheap after the first time. enter()
+// names the thread, sets its affinity, SCHED_FIFO priority or nice level, and with
+// `localMemory` makes the kernel prefer the NUMA node of its CPUs, so buffers the thread
+// allocates and touches first (FramePool recycles them from then on) sit next to it. Anything
+// the process isn't allowed to do is reported and left out: SCHED_FIFO without CAP_SYS_NICE or
+// an rtprio limit falls back to the nice level, a negative nice without permission to the
+// default, CPUs outside the process's affinity mask are dropped. Nothing is fatal.
+//
+// Threads are registered as they enter, and getStats() reads their CPU time and scheduling
+// delay (time runnable but not running) from /proc/self/task/<tid>/schedstat; a thread that
+// exits leaves its last numbers behind.
+class ThreadPolicy {
+   public:
+    ThreadPolicy();
+
+    // The one the host code's threads enter; leaked, so threads outliving main() still find it
+    static ThreadPolicy& global();
+
+    // Comma-separated roles, each with colon-separated options, later entries adding to earlier:
+    //   capture:fifo=20:cpus=1-2,audio:fifo=30:cpus=3,writer:nice=5:cpus=4-7:cpus=9:numa
+    // "rt" is shorthand for capture:fifo=20,audio:fifo=30,writer:nice=5,worker:nice=2.
+    // Before any thread enters; returns false and prints the problem on a bad spec.
+    bool configure(const std::string& spec);
+    void setRole(ThreadRole role, const ThreadRolePolicy& policy);
+    const ThreadRolePolicy& role(ThreadRole role) const {
+        return _roles[static_cast<int>(role)];
+    }
+
+    // From the thread itself. `name` (at most 15 characters are kept) defaults to the role's.
+    // Again from the same thread with the same role it returns right away.
+    void enter(ThreadRole role, const char* name = nullptr);
+
+    std::vector<ThreadStats> getStats() const;
+    void printStats() const;
+
+    static const char* roleName(ThreadRole role);
+    static bool parseRole(const std::string& name, ThreadRole& role);
+    // CPU time, run-queue wait and timeslices of one thread of this process
+    static bool readSchedStat(pid_t tid, uint64_t& cpuNs, uint64_t& waitNs, uint64_t& timeslices);
+    // NUMA node of a CPU, -1 if unknown
+    static int numaNode(int cpu);
+
+   private:
+    friend struct ThreadRecord;
+
+    std::string apply(const ThreadRolePolicy& policy);
+    void exited(size_t index);
+
+    ThreadRolePolicy _roles[static_cast<int>(ThreadRole::Count)];
+    std::vector<int> _allowedCpus;  // the process's affinity mask when the policy was made
+    mutable std::mutex _mutex;
+    std::vector<ThreadStats> _threads;
+};
@@ -0,0 +1,586 @@
+#include "VideoMuxer.hpp"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+
+#include "ThreadPolicy.hpp"
+
+namespace {
+
+constexpr size_t kBatchSize = 32;
+
+// Matroska element ids
+constexpr uint32_t kEbml = 0x1A45DFA3;
+constexpr uint32_t kSegment = 0x18538067;
+constexpr uint32_t kSeekHead = 0x114D9B74;
+constexpr uint32_t kSeek = 0x4DBB;
+constexpr uint32_t kSeekId = 0x53AB;
+constexpr uint32_t kSeekPosition = 0x53AC;
+constexpr uint32_t kInfo = 0x1549A966;
+constexpr uint32_t kTimestampScale = 0x2AD7B1;
+constexpr uint32_t kDuration = 0x4489;
+constexpr uint32_t kMuxingApp = 0x4D80;
+constexpr uint32_t kWritingApp = 0x5741;
+constexpr uint32_t kTracks = 0x1654AE6B;
+constexpr uint32_t kTrackEntry = 0xAE;
+constexpr uint32_t kCluster = 0x1F43B675;
+constexpr uint32_t kTimestamp = 0xE7;
+constexpr uint32_t kSimpleBlock = 0xA3;
+constexpr uint32_t kCues = 0x1C53BB6B;
+constexpr uint32_t kVoid = 0xEC;
+
+constexpr uint64_t kTimestampScaleNs = 1000000;  // block timestamps in ms
+constexpr size_t kSeekVoidSize = 64;             // room for the SeekHead written on close
+constexpr size_t kDurationVoidSize = 11;         // same size as the Duration element
+
+void putId(std::vector<uint8_t>& out, uint32_t id) {
+    for(int shift = 24; shift >= 0; shift -= 8) {
+        if((id >> shift) || shift == 0) out.push_back(static_cast<uint8_t>(id >> shift));
+    }
+}
+
+// Minimal-length EBML variable-size integer
+void putSize(std::vector<uint8_t>& out, uint64_t size) {
+    int len = 1;
+    while(len < 8 && size >= (uint64_t(1) << (7 * len)) - 1) len++;
+    for(int i = len - 1; i >= 0; i--) {
+        uint8_t b = static_cast<uint8_t>(size >> (8 * i));
+        if(i == len - 1) b |= static_cast<uint8_t>(0x80 >> (len - 1));
+        out.push_back(b);
+    }
+}
+
+// 8-byte size field, patched in place later; all ones means "unknown size"
+void putSize8(uint8_t* p, uint64_t size) {
+    p[0] = 0x01;
+    for(int i = 1; i < 8; i++) p[i] = static_cast<uint8_t>(size >> (8 * (7 - i)));
+}
+void putUnknownSize(std::vector<uint8_t>& out) {
+    out.push_back(0x01);
+    out.insert(out.end(), 7, 0xFF);
+}
+
+void putUInt(std::vector<uint8_t>& out, uint32_t id, uint64_t v) {
+    putId(out, id);
+    int len = 1;
+    while(len < 8 && (v >> (8 * len))) len++;
+    putSize(out, len);
+    for(int i = len - 1; i >= 0; i--) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+void putFloat(std::vector<uint8_t>& out, uint32_t id, double v) {
+    putId(out, id);
+    putSize(out, 8);
+    uint64_t bits;
+    std::memcpy(&bits, &v, 8);
+    for(int i = 7; i >= 0; i--) out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+}
+
+void putBinary(std::vector<uint8_t>& out, uint32_t id, const void* data, size_t size) {
+    putId(out, id);
+    putSize(out, size);
+    out.insert(out.end(), static_cast<const uint8_t*>(data), static_cast<const uint8_t*>(data) + size);
+}
+
+void putString(std::vector<uint8_t>& out, uint32_t id, const char* s) {
+    putBinary(out, id, s, std::strlen(s));
+}
+
+void putMaster(std::vector<uint8_t>& out, uint32_t id, const std::vector<uint8_t>& body) {
+    putId(out, id);
+    putSize(out, body.size());
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+// Void element of exactly `total` bytes (>= 2)
+void putVoid(std::vector<uint8_t>& out, size_t total) {
+    out.push_back(kVoid);
+    putSize(out, total - 2);
+    out.insert(out.end(), total - 2, 0);
+}
+
+void put16(std::vector<uint8_t>& out, uint16_t v) {
+    out.push_back(static_cast<uint8_t>(v >> 8));
+    out.push_back(static_cast<uint8_t>(v));
+}
+void put32(std::vector<uint8_t>& out, uint32_t v) {
+    for(int i = 3; i >= 0; i--) out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+}
+
+// First "00 00 01" start code at or after `p`, `end` if there is none
+const uint8_t* findStartCode(const uint8_t* p, const uint8_t* end) {
+    const uint8_t* q = p + 2;
+    while(q < end) {
+        q = static_cast<const uint8_t*>(std::memchr(q, 1, end - q));
+        if(!q) return end;
+        if(q[-1] == 0 && q[-2] == 0) return q - 2;
+        q++;
+    }
+    return end;
+}
+
+// Calls fn(nal, size) for each NAL unit of an Annex B access unit, without start codes
+template <typename Fn>
+void forEachNal(const uint8_t* data, size_t size, Fn&& fn) {
+    const uint8_t* end = data + size;
+    const uint8_t* start = findStartCode(data, end);
+    while(start < end) {
+        const uint8_t* nal = start + 3;
+        const uint8_t* next = findStartCode(nal, end);
+        // Zeros before the next start code belong to it (4-byte start codes, trailing_zero_8bits)
+        const uint8_t* nalEnd = next;
+        while(nalEnd > nal && nalEnd[-1] == 0) nalEnd--;
+        if(nalEnd > nal) fn(nal, static_cast<size_t>(nalEnd - nal));
+        start = next;
+    }
+}
+
+struct ParameterSets {
+    std::vector<uint8_t> vps, sps, pps;
+    bool keyframe = false;
+};
+
+ParameterSets scanAccessUnit(VideoCodec codec, const uint8_t* data, size_t size) {
+    ParameterSets ps;
+    if(codec == VideoCodec::MJPEG) {
+        ps.keyframe = true;
+        return ps;
+    }
+    forEachNal(data, size, [&](const uint8_t* nal, size_t n) {
+        std::vector<uint8_t>* target = nullptr;
+        if(codec == VideoCodec::H264) {
+            int type = nal[0] & 0x1F;
+            if(type == 5) ps.keyframe = true;
+            if(type == 7) target = &ps.sps;
+            if(type == 8) target = &ps.pps;
+        } else {
+            int type = (nal[0] >> 1) & 0x3F;
+            if(type >= 16 && type <= 23) ps.keyframe = true;
+            if(type == 32) target = &ps.vps;
+            if(type == 33) target = &ps.sps;
+            if(type == 34) target = &ps.pps;
+        }
+        if(target && target->empty()) target->assign(nal, nal + n);
+    });
+    return ps;
+}
+
+// RBSP bytes of a NAL unit (emulation prevention removed), at most `max`
+std::vector<uint8_t> unescape(const std::vector<uint8_t>& nal, size_t skip, size_t max) {
+    std::vector<uint8_t> rbsp;
+    int zeros = 0;
+    for(size_t i = skip; i < nal.size() && rbsp.size() < max; i++) {
+        if(zeros >= 2 && nal[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+        rbsp.push_back(nal[i]);
+    }
+    return rbsp;
+}
+
+// AVCDecoderConfigurationRecord (ISO/IEC 14496-15), 4-byte NAL lengths
+bool buildAvcC(const ParameterSets& ps, std::vector<uint8_t>& out) {
+    if(ps.sps.size() < 4 || ps.pps.empty()) return false;
+    out.push_back(1);
+    out.push_back(ps.sps[1]);  // profile_idc
+    out.push_back(ps.sps[2]);  // constraint flags
+    out.push_back(ps.sps[3]);  // level_idc
+    out.push_back(0xFF);
+    out.push_back(0xE1);
+    put16(out, static_cast<uint16_t>(ps.sps.size()));
+    out.insert(out.end(), ps.sps.begin(), ps.sps.end());
+    out.push_back(1);
+    put16(out, static_cast<uint16_t>(ps.pps.size()));
+    out.insert(out.end(), ps.pps.begin(), ps.pps.end());
+    return true;
+}
+
+// HEVCDecoderConfigurationRecord; the general profile/tier/level is copied from the SPS,
+// the rest assumes 8-bit 4:2:0 as produced by the device encoder
+bool buildHvcC(const ParameterSets& ps, std::vector<uint8_t>& out) {
+    if(ps.vps.empty() || ps.pps.empty()) return false;
+    // After the 2-byte NAL header: vps id / max sub layers / nesting, then 12 bytes of PTL
+    std::vector<uint8_t> rbsp = unescape(ps.sps, 2, 13);
+    if(rbsp.size() < 13) return false;
+    out.push_back(1);
+    out.insert(out.end(), rbsp.begin() + 1, rbsp.begin() + 12);  // profile, compat flags, constraint flags
+    out.push_back(rbsp[12]);                                      // general_level_idc
+    put16(out, 0xF000);                                           // min_spatial_segmentation_idc
+    out.push_back(0xFC);                                          // parallelismType
+    out.push_back(0xFD);                                          // chroma_format_idc = 1
+    out.push_back(0xF8);                                          // bit_depth_luma_minus8
+    out.push_back(0xF8);                                          // bit_depth_chroma_minus8
+    put16(out, 0);                                                // avgFrameRate
+    out.push_back(0x0F);  // 1 temporal layer, nested, lengthSizeMinusOne = 3
+    out.push_back(3);
+    const std::pair<int, const std::vector<uint8_t>*> arrays[] = {{32, &ps.vps}, {33, &ps.sps}, {34, &ps.pps}};
+    for(const auto& a : arrays) {
+        out.push_back(static_cast<uint8_t>(0x80 | a.first));
+        put16(out, 1);
+        put16(out, static_cast<uint16_t>(a.second->size()));
+        out.insert(out.end(), a.second->begin(), a.second->end());
+    }
+    return true;
+}
+
+bool writeAll(int fd, std::vector<iovec>& iov) {
+    size_t done = 0;
+    while(done < iov.size()) {
+        int n = static_cast<int>(std::min<size_t>(iov.size() - done, IOV_MAX));
+        ssize_t written = ::writev(fd, &iov[done], n);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        while(done < iov.size() && static_cast<size_t>(written) >= iov[done].iov_len) {
+            written -= iov[done].iov_len;
+            done++;
+        }
+        if(done < iov.size()) {
+            iov[done].iov_base = static_cast<uint8_t*>(iov[done].iov_base) + written;
+            iov[done].iov_len -= written;
+        }
+    }
+    return true;
+}
+
+bool pwriteAll(int fd, const void* data, size_t size, uint64_t offset) {
+    return ::pwrite(fd, data, size, offset) == static_cast<ssize_t>(size);
+}
+
+}  // namespace
+
+bool parseVideoCodec(const std::string& name, VideoCodec& codec) {
+    if(name == "h264") {
+        codec = VideoCodec::H264;
+    } else if(name == "h265" || name == "hevc") {
+        codec = VideoCodec::H265;
+    } else if(name == "mjpeg") {
+        codec = VideoCodec::MJPEG;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* videoCodecName(VideoCodec codec) {
+    switch(codec) {
+        case VideoCodec::H264:
+            return "h264";
+        case VideoCodec::H265:
+            return "h265";
+        case VideoCodec::MJPEG:
+            return "mjpeg";
+    }
+    return "?";
+}
+
+VideoMuxer::VideoMuxer(size_t queueCapacity) : _queue(queueCapacity, MailboxPolicy::Block) {}
+
+VideoMuxer::~VideoMuxer() {
+    close();
+}
+
+bool VideoMuxer::open(const std::string& path, VideoCodec codec, int width, int height, double fps) {
+    if(_running) return false;
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(_fd < 0) {
+        printf("VideoMuxer: cannot open %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+    _path = path;
+    _codec = codec;
+    _width = width;
+    _height = height;
+    _fps = fps > 0 ? fps : 30;
+    _offset = 0;
+    _headerWritten = false;
+    _clusterTimestampMs = -1;
+    _lastTimestampMs = 0;
+    _cues.clear();
+    _running = true;
+    _writer = std::thread(&VideoMuxer::writerLoop, this);
+    return true;
+}
+
+void VideoMuxer::close() {
+    if(_running.exchange(false)) {
+        _queue.close();
+        _writer.join();
+    }
+    if(_fd < 0) return;
+    finalize();
+    ::close(_fd);
+    _fd = -1;
+}
+
+bool VideoMuxer::write(std::shared_ptr<const void> owner, const void* data, size_t size, int64_t timestampNs) {
+    if(!_running.load(std::memory_order_relaxed) || size == 0) return false;
+    Packet packet;
+    packet.owner = std::move(owner);
+    packet.data = static_cast<const uint8_t*>(data);
+    packet.size = size;
+    packet.timestampNs = timestampNs;
+    return _queue.push(std::move(packet));
+}
+
+VideoMuxerStats VideoMuxer::getStats() const {
+    VideoMuxerStats stats;
+    auto queueStats = _queue.getStats();
+    stats.packets = _packets.load();
+    stats.bytes = _bytes.load();
+    stats.skipped = _skipped.load();
+    stats.writeErrors = _writeErrors.load();
+    stats.queueDepth = queueStats.occupancy;
+    stats.maxQueueDepth = queueStats.maxOccupancy;
+    stats.maxWriteStallUs = _maxWriteStallUs.load();
+    stats.seconds = _writeSpanUs.load() / 1e6;
+    return stats;
+}
+
+void VideoMuxer::printStats(const char* name) const {
+    auto stats = getStats();
+    printf("%s: %lu packets, %.2f MB, %.2f MB/s sustained, %lu skipped before first keyframe, max write stall %lu us, max queue %zu%s\n",
+           name,
+           (unsigned long)stats.packets,
+           stats.bytes / 1048576.0,
+           stats.mbPerSecond(),
+           (unsigned long)stats.skipped,
+           (unsigned long)stats.maxWriteStallUs,
+           stats.maxQueueDepth,
+           stats.writeErrors ? ", WRITE ERRORS" : "");
+}
+
+void VideoMuxer::writerLoop() {
+    ThreadPolicy::global().enter(ThreadRole::Writer, "mux-writer");
+    std::vector<Packet> batch;
+    batch.reserve(kBatchSize);
+    while(true) {
+        Packet packet;
+        if(!_queue.waitPop(packet, std::chrono::milliseconds(100))) {
+            if(!_running && _queue.size() == 0) break;
+            continue;
+        }
+        batch.push_back(std::move(packet));
+        while(batch.size() < kBatchSize && _queue.tryPop(packet)) batch.push_back(std::move(packet));
+        writeBatch(batch);
+        batch.clear();
+    }
+}
+
+void VideoMuxer::writeBatch(std::vector<Packet>& batch) {
+    for(const auto& packet : batch) {
+        ParameterSets ps = scanAccessUnit(_codec, packet.data, packet.size);
+        if(!_headerWritten) {
+            if(!ps.keyframe || !writeHeader(packet)) {
+                _skipped++;
+                continue;
+            }
+            _firstTimestampNs = packet.timestampNs;
+        }
+        int64_t ms = std::max<int64_t>((packet.timestampNs - _firstTimestampNs) / int64_t(kTimestampScaleNs), _lastTimestampMs);
+        if(_clusterTimestampMs < 0 || (ps.keyframe && ms - _clusterTimestampMs >= kClusterMs) || ms - _clusterTimestampMs > INT16_MAX) {
+            endCluster();
+            startCluster(ms);
+        }
+        _lastTimestampMs = ms;
+
+        uint64_t payload = 0;
+        if(_codec == VideoCodec::MJPEG) {
+            payload = packet.size;
+        } else {
+            forEachNal(packet.data, packet.size, [&](const uint8_t*, size_t n) { payload += 4 + n; });
+        }
+        _element.clear();
+        putId(_element, kSimpleBlock);
+        putSize(_element, 4 + payload);
+        _element.push_back(0x81);  // track 1
+        put16(_element, static_cast<uint16_t>(static_cast<int16_t>(ms - _clusterTimestampMs)));
+        _element.push_back(ps.keyframe ? 0x80 : 0x00);
+        addScratch(_element);
+        if(_codec == VideoCodec::MJPEG) {
+            addExternal(packet.data, packet.size);
+        } else {
+            // Annex B -> length-prefixed: only the 4-byte prefixes are new, NAL units are written in place
+            forEachNal(packet.data, packet.size, [&](const uint8_t* nal, size_t n) {
+                _element.clear();
+                put32(_element, static_cast<uint32_t>(n));
+                addScratch(_element);
+                addExternal(nal, n);
+            });
+        }
+        _packets++;
+    }
+    flush();
+}
+
+bool VideoMuxer::writeHeader(const Packet& keyframe) {
+    std::vector<uint8_t> codecPrivate;
+    const char* codecId = "V_MJPEG";
+    if(_codec != VideoCodec::MJPEG) {
+        ParameterSets ps = scanAccessUnit(_codec, keyframe.data, keyframe.size);
+        bool ok = _codec == VideoCodec::H264 ? buildAvcC(ps, codecPrivate) : buildHvcC(ps, codecPrivate);
+        if(!ok) return false;
+        codecId = _codec == VideoCodec::H264 ? "V_MPEG4/ISO/AVC" : "V_MPEGH/ISO/HEVC";
+    }
+
+    std::vector<uint8_t> out, body;
+    putUInt(body, 0x4286, 1);  // EBMLVersion
+    putUInt(body, 0x42F7, 1);  // EBMLReadVersion
+    putUInt(body, 0x42F2, 4);  // EBMLMaxIDLength
+    putUInt(body, 0x42F3, 8);  // EBMLMaxSizeLength
+    putString(body, 0x4282, "matroska");
+    putUInt(body, 0x4287, 4);  // DocTypeVersion
+    putUInt(body, 0x4285, 2);  // DocTypeReadVersion
+    putMaster(out, kEbml, body);
+
+    putId(out, kSegment);
+    _segmentSizeOffset = _offset + out.size();
+    putUnknownSize(out);
+    _segmentDataOffset = _offset + out.size();
+
+    _seekVoidOffset = _offset + out.size();
+    putVoid(out, kSeekVoidSize);
+
+    body.clear();
+    putUInt(body, kTimestampScale, kTimestampScaleNs);
+    putString(body, kMuxingApp, "depthai-host VideoMuxer");
+    putString(body, kWritingApp, "depthai-host");
+    size_t durationInBody = body.size();
+    putVoid(body, kDurationVoidSize);
+    putId(out, kInfo);
+    putSize(out, body.size());
+    _durationVoidOffset = _offset + out.size() + durationInBody;
+    out.insert(out.end(), body.begin(), body.end());
+
+    std::vector<uint8_t> video;
+    putUInt(video, 0xB0, _width);   // PixelWidth
+    putUInt(video, 0xBA, _height);  // PixelHeight
+    std::vector<uint8_t> track;
+    putUInt(track, 0xD7, 1);    // TrackNumber
+    putUInt(track, 0x73C5, 1);  // TrackUID
+    putUInt(track, 0x83, 1);    // TrackType: video
+    putUInt(track, 0x9C, 0);    // FlagLacing
+    putString(track, 0x86, codecId);
+    if(!codecPrivate.empty()) putBinary(track, 0x63A2, codecPrivate.data(), codecPrivate.size());
+    putUInt(track, 0x23E383, static_cast<uint64_t>(1e9 / _fps));  // DefaultDuration, ns
+    putMaster(track, 0xE0, video);
+    body.clear();
+    putMaster(body, kTrackEntry, track);
+    putMaster(out, kTracks, body);
+
+    addScratch(out);
+    _headerWritten = true;
+    return true;
+}
+
+void VideoMuxer::startCluster(int64_t timestampMs) {
+    _clusterOffset = _offset;
+    _clusterTimestampMs = timestampMs;
+    _cues.emplace_back(timestampMs, _clusterOffset - _segmentDataOffset);
+    _element.clear();
+    putId(_element, kCluster);
+    putUnknownSize(_element);
+    putUInt(_element, kTimestamp, timestampMs);
+    addScratch(_element);
+}
+
+void VideoMuxer::endCluster() {
+    if(_clusterTimestampMs < 0) return;
+    // The cluster's size field is filled in once its data is on disk
+    if(!flush()) return;
+    uint8_t size[8];
+    putSize8(size, _offset - (_clusterOffset + 4 + 8));
+    if(!pwriteAll(_fd, size, sizeof(size), _clusterOffset + 4)) _writeErrors++;
+    _clusterTimestampMs = -1;
+}
+
+void VideoMuxer::addScratch(const std::vector<uint8_t>& bytes) {
+    _pieces.push_back({nullptr, _scratch.size(), bytes.size()});
+    _scratch.insert(_scratch.end(), bytes.begin(), bytes.end());
+    _offset += bytes.size();
+}
+
+void VideoMuxer::addExternal(const uint8_t* data, size_t size) {
+    _pieces.push_back({data, 0, size});
+    _offset += size;
+}
+
+bool VideoMuxer::flush() {
+    if(_pieces.empty()) return true;
+    std::vector<iovec> iov;
+    iov.reserve(_pieces.size());
+    uint64_t total = 0;
+    for(const auto& piece : _pieces) {
+        const uint8_t* base = piece.external ? piece.external : _scratch.data() + piece.offset;
+        iov.push_back({const_cast<uint8_t*>(base), piece.size});
+        total += piece.size;
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    bool ok = writeAll(_fd, iov);
+    auto t1 = std::chrono::steady_clock::now();
+    _pieces.clear();
+    _scratch.clear();
+    if(!ok) {
+        // The offsets no longer match the file; stop patching sizes into it
+        _writeErrors++;
+        return false;
+    }
+    _bytes += total;
+    uint64_t stallUs = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    if(stallUs > _maxWriteStallUs.load(std::memory_order_relaxed)) _maxWriteStallUs = stallUs;
+    if(_firstWrite == std::chrono::steady_clock::time_point()) _firstWrite = t0;
+    _lastWrite = t1;
+    _writeSpanUs = std::chrono::duration_cast<std::chrono::microseconds>(_lastWrite - _firstWrite).count();
+    return true;
+}
+
+void VideoMuxer::finalize() {
+    if(!_headerWritten) {
+        printf("VideoMuxer: no keyframe with parameter sets received, %s is empty\n", _path.c_str());
+        return;
+    }
+    endCluster();
+    uint64_t cuesPosition = _offset - _segmentDataOffset;
+    std::vector<uint8_t> cues, point, positions;
+    for(const auto& cue : _cues) {
+        positions.clear();
+        putUInt(positions, 0xF7, 1);           // CueTrack
+        putUInt(positions, 0xF1, cue.second);  // CueClusterPosition
+        point.clear();
+        putUInt(point, 0xB3, cue.first);  // CueTime
+        putMaster(point, 0xB7, positions);
+        putMaster(cues, 0xBB, point);
+    }
+    _element.clear();
+    putMaster(_element, kCues, cues);
+    addScratch(_element);
+    if(!flush()) return;
+
+    // Segment size, the SeekHead pointing at the cues and the duration go into the space reserved up front
+    uint8_t size[8];
+    putSize8(size, _offset - _segmentDataOffset);
+    std::vector<uint8_t> seekHead, seek, cuesId;
+    putId(cuesId, kCues);
+    putBinary(seek, kSeekId, cuesId.data(), cuesId.size());
+    putUInt(seek, kSeekPosition, cuesPosition);
+    std::vector<uint8_t> seekBody;
+    putMaster(seekBody, kSeek, seek);
+    putMaster(seekHead, kSeekHead, seekBody);
+    putVoid(seekHead, kSeekVoidSize - seekHead.size());
+    std::vector<uint8_t> duration;
+    putFloat(duration, kDuration, static_cast<double>(_lastTimestampMs) + 1000.0 / _fps);
+
+    bool ok = pwriteAll(_fd, size, sizeof(size), _segmentSizeOffset) && pwriteAll(_fd, seekHead.data(), seekHead.size(), _seekVoidOffset) &&
+              pwriteAll(_fd, duration.data(), duration.size(), _durationVoidOffset);
+    if(!ok) _writeErrors++;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FrameMailbox.hpp"
+
+enum class VideoCodec { H264, H265, MJPEG };
+
+// "h264", "h265" / "hevc", "mjpeg"; false for anything else
+bool parseVideoCodec(const std::string& name, VideoCodec& codec);
+const char* videoCodecName(VideoCodec codec);
+
+struct VideoMuxerStats {
+    uint64_t packets = 0;
+    uint64_t bytes = 0;         // written to the file, container overhead included
+    uint64_t skipped = 0;       // packets before the first keyframe with parameter sets
+    uint64_t writeErrors = 0;
+    size_t queueDepth = 0;
+    size_t maxQueueDepth = 0;
+    uint64_t maxWriteStallUs = 0;  // longest single writev() call
+    double seconds = 0;            // from the first to the last write
+
+    double mbPerSecond() const {
+        return seconds > 0 ? bytes / 1048576.0 / seconds : 0.0;
+    }
+};
+
+// Streams device-encoded video into a Matroska file, without re-encoding.
+//
+// write() only enqueues the packet; a writer thread converts H.264 / H.265 Annex B access
+// units into length-prefixed NAL units on the fly (the length prefixes are the only bytes
+// copied, the NAL units are written straight from the packet) and appends them as
+// SimpleBlocks, batching packets into one writev(). Memory stays bounded by the queue.
+//
+// The file is playable at any point: the segment and the open cluster have unknown size until
+// close(), which fills in the sizes, duration and a cue per cluster so the result is seekable.
+// Clusters start on keyframes, at most every kClusterMs, timestamps are the device timestamps
+// relative to the first written packet.
+class VideoMuxer {
+   public:
+    static constexpr int64_t kClusterMs = 1000;
+
+    explicit VideoMuxer(size_t queueCapacity = 128);
+    ~VideoMuxer();
+
+    VideoMuxer(const VideoMuxer&) = delete;
+    VideoMuxer& operator=(const VideoMuxer&) = delete;
+
+    bool open(const std::string& path, VideoCodec codec, int width, int height, double fps);
+    // Flushes the queue and finalizes the file
+    void close();
+
+    // Thread-safe. One access unit (H.264 / H.265, Annex B) or one JPEG per packet;
+    // `owner` keeps `data` alive until it is written.
+    bool write(std::shared_ptr<const void> owner, const void* data, size_t size, int64_t timestampNs);
+
+    VideoMuxerStats getStats() const;
+    void printStats(const char* name) const;
+
+   private:
+    struct Packet {
+        std::shared_ptr<const void> owner;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        int64_t timestampNs = 0;
+    };
+    // A run of bytes to write: either in `_scratch` (external == nullptr) or in a packet
+    struct Piece {
+        const uint8_t* external;
+        size_t offset;
+        size_t size;
+    };
+
+    void writerLoop();
+    void writeBatch(std::vector<Packet>& batch);
+    bool writeHeader(const Packet& keyframe);
+    void startCluster(int64_t timestampMs);
+    void endCluster();
+    bool flush();
+    void finalize();
+
+    void addScratch(const std::vector<uint8_t>& bytes);
+    void addExternal(const uint8_t* data, size_t size);
+
+    std::string _path;
+    VideoCodec _codec = VideoCodec::H265;
+    int _width = 0;
+    int _height = 0;
+    double _fps = 30;
+    int _fd = -1;
+
+    // Writer thread state
+    uint64_t _offset = 0;              // file position after everything flushed and pending
+    bool _headerWritten = false;
+    uint64_t _segmentDataOffset = 0;   // positions in the file that close() patches
+    uint64_t _segmentSizeOffset = 0;
+    uint64_t _seekVoidOffset = 0;
+    uint64_t _durationVoidOffset = 0;
+    int64_t _firstTimestampNs = 0;
+    int64_t _lastTimestampMs = 0;
+    int64_t _clusterTimestampMs = -1;  // -1: no open cluster
+    uint64_t _clusterOffset = 0;
+    std::vector<std::pair<int64_t, uint64_t>> _cues;  // cluster timestamp, segment-relative position
+    std::vector<uint8_t> _scratch;
+    std::vector<Piece> _pieces;
+    std::vector<uint8_t> _element;
+    std::chrono::steady_clock::time_point _firstWrite, _lastWrite;
+
+    FrameMailbox<Packet> _queue;
+    std::thread _writer;
+    std::atomic<bool> _running{false};
+
+    std::atomic<uint64_t> _packets{0};
+    std::atomic<uint64_t> _bytes{0};
+    std::atomic<uint64_t> _skipped{0};
+    std::atomic<uint64_t> _writeErrors{0};
+    std::atomic<uint64_t> _maxWriteStallUs{0};
+    std::atomic<int64_t> _writeSpanUs{0};
+};
@@ -0,0 +1,344 @@
+#include "YuvToBgr.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define YUV_TO_BGR_X86 1
+    #include <immintrin.h>
+#endif
+
+namespace {
+
+// BT.601 video range, 20-bit fixed point, same values as OpenCV's ITUR_BT_601_* constants
+constexpr int kShift = 20;
+constexpr int kHalf = 1 << (kShift - 1);
+constexpr int kCY = 1220542;
+constexpr int kCUB = 2116026;
+constexpr int kCUG = -409993;
+constexpr int kCVG = -852492;
+constexpr int kCVR = 1673527;
+
+// Converts one row of n pixels with full-resolution Y, U and V
+using RowKernel = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int n);
+
+inline uint8_t clampU8(int x) {
+    return static_cast<uint8_t>(x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+inline void pixelToBgr(int y, int u, int v, uint8_t* bgr) {
+    int yy = std::max(0, y - 16) * kCY;
+    int uu = u - 128;
+    int vv = v - 128;
+    bgr[0] = clampU8((yy + kHalf + kCUB * uu) >> kShift);
+    bgr[1] = clampU8((yy + kHalf + kCVG * vv + kCUG * uu) >> kShift);
+    bgr[2] = clampU8((yy + kHalf + kCVR * vv) >> kShift);
+}
+
+void rowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int n) {
+    for(int i = 0; i < n; i++) pixelToBgr(y[i], u[i], v[i], bgr + 3 * i);
+}
+
+#ifdef YUV_TO_BGR_X86
+
+// 4 pixels, 32-bit lanes; same arithmetic as pixelToBgr
+__attribute__((target("sse4.1"))) inline void bgr4Sse(__m128i y, __m128i u, __m128i v, __m128i& b, __m128i& g, __m128i& r) {
+    const __m128i zero = _mm_setzero_si128();
+    y = _mm_mullo_epi32(_mm_max_epi32(_mm_sub_epi32(y, _mm_set1_epi32(16)), zero), _mm_set1_epi32(kCY));
+    y = _mm_add_epi32(y, _mm_set1_epi32(kHalf));
+    u = _mm_sub_epi32(u, _mm_set1_epi32(128));
+    v = _mm_sub_epi32(v, _mm_set1_epi32(128));
+    b = _mm_srai_epi32(_mm_add_epi32(y, _mm_mullo_epi32(u, _mm_set1_epi32(kCUB))), kShift);
+    g = _mm_srai_epi32(_mm_add_epi32(y, _mm_add_epi32(_mm_mullo_epi32(v, _mm_set1_epi32(kCVG)), _mm_mullo_epi32(u, _mm_set1_epi32(kCUG)))),
+                       kShift);
+    r = _mm_srai_epi32(_mm_add_epi32(y, _mm_mullo_epi32(v, _mm_set1_epi32(kCVR))), kShift);
+}
+
+// Interleaves 16 B, G and R bytes into 48 bytes of packed BGR
+__attribute__((target("sse4.1"))) inline void storeBgr16(__m128i b, __m128i g, __m128i r, uint8_t* out) {
+    const __m128i b0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+    const __m128i g0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+    const __m128i r0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+    const __m128i b1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+    const __m128i g1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+    const __m128i r1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+    const __m128i b2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+    const __m128i g2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+    const __m128i r2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+    __m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b0), _mm_shuffle_epi8(g, g0)), _mm_shuffle_epi8(r, r0));
+    __m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b1), _mm_shuffle_epi8(g, g1)), _mm_shuffle_epi8(r, r1));
+    __m128i o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(b, b2), _mm_shuffle_epi8(g, g2)), _mm_shuffle_epi8(r, r2));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), o0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), o1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 32), o2);
+}
+
+__attribute__((target("sse4.1"))) inline __m128i load4x32(const uint8_t* p) {
+    int32_t bytes;
+    std::memcpy(&bytes, p, sizeof(bytes));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+}
+
+__attribute__((target("sse4.1"))) void rowSse41(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int n) {
+    int i = 0;
+    for(; i + 16 <= n; i += 16) {
+        __m128i b[4], g[4], r[4];
+        for(int k = 0; k < 4; k++) {
+            bgr4Sse(load4x32(y + i + 4 * k), load4x32(u + i + 4 * k), load4x32(v + i + 4 * k), b[k], g[k], r[k]);
+        }
+        // Signed pack to 16 bit, then unsigned-saturating pack to 8 bit does the clamping
+        __m128i b8 = _mm_packus_epi16(_mm_packs_epi32(b[0], b[1]), _mm_packs_epi32(b[2], b[3]));
+        __m128i g8 = _mm_packus_epi16(_mm_packs_epi32(g[0], g[1]), _mm_packs_epi32(g[2], g[3]));
+        __m128i r8 = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3]));
+        storeBgr16(b8, g8, r8, bgr + 3 * i);
+    }
+    rowScalar(y + i, u + i, v + i, bgr + 3 * i, n - i);
+}
+
+__attribute__((target("avx2"))) inline __m256i load8x32(const uint8_t* p) {
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+}
+
+// Packs 4x8 32-bit lanes (pixels 0..31 in order) to 32 saturated bytes in order
+__attribute__((target("avx2"))) inline __m256i pack32(const __m256i* c) {
+    __m256i lo = _mm256_permute4x64_epi64(_mm256_packs_epi32(c[0], c[1]), 0xD8);
+    __m256i hi = _mm256_permute4x64_epi64(_mm256_packs_epi32(c[2], c[3]), 0xD8);
+    return _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+}
+
+__attribute__((target("avx2"))) void rowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* bgr, int n) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c16 = _mm256_set1_epi32(16);
+    const __m256i c128 = _mm256_set1_epi32(128);
+    const __m256i half = _mm256_set1_epi32(kHalf);
+    const __m256i cy = _mm256_set1_epi32(kCY);
+    const __m256i cub = _mm256_set1_epi32(kCUB);
+    const __m256i cug = _mm256_set1_epi32(kCUG);
+    const __m256i cvg = _mm256_set1_epi32(kCVG);
+    const __m256i cvr = _mm256_set1_epi32(kCVR);
+    int i = 0;
+    for(; i + 32 <= n; i += 32) {
+        __m256i b[4], g[4], r[4];
+        for(int k = 0; k < 4; k++) {
+            __m256i yy = load8x32(y + i + 8 * k);
+            __m256i uu = _mm256_sub_epi32(load8x32(u + i + 8 * k), c128);
+            __m256i vv = _mm256_sub_epi32(load8x32(v + i + 8 * k), c128);
+            yy = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_max_epi32(_mm256_sub_epi32(yy, c16), zero), cy), half);
+            b[k] = _mm256_srai_epi32(_mm256_add_epi32(yy, _mm256_mullo_epi32(uu, cub)), kShift);
+            g[k] = _mm256_srai_epi32(_mm256_add_epi32(yy, _mm256_add_epi32(_mm256_mullo_epi32(vv, cvg), _mm256_mullo_epi32(uu, cug))), kShift);
+            r[k] = _mm256_srai_epi32(_mm256_add_epi32(yy, _mm256_mullo_epi32(vv, cvr)), kShift);
+        }
+        __m256i b8 = pack32(b), g8 = pack32(g), r8 = pack32(r);
+        storeBgr16(_mm256_castsi256_si128(b8), _mm256_castsi256_si128(g8), _mm256_castsi256_si128(r8), bgr + 3 * i);
+        storeBgr16(_mm256_extracti128_si256(b8, 1), _mm256_extracti128_si256(g8, 1), _mm256_extracti128_si256(r8, 1), bgr + 3 * i + 48);
+    }
+    rowSse41(y + i, u + i, v + i, bgr + 3 * i, n - i);
+}
+
+#endif  // YUV_TO_BGR_X86
+
+RowKernel rowKernelFor(ColorKernel kernel) {
+    ColorKernel best = bestColorKernel();
+    if(kernel == ColorKernel::Auto || static_cast<int>(kernel) > static_cast<int>(best)) kernel = best;
+    switch(kernel) {
+#ifdef YUV_TO_BGR_X86
+        case ColorKernel::AVX2:
+            return rowAvx2;
+        case ColorKernel::SSE41:
+            return rowSse41;
+#endif
+        default:
+            return rowScalar;
+    }
+}
+
+// Source range [begin, end) covered by each destination index, at least one element wide
+void boxBounds(int srcSize, int dstSize, std::vector<int>& begin, std::vector<int>& end) {
+    begin.resize(dstSize);
+    end.resize(dstSize);
+    for(int i = 0; i < dstSize; i++) {
+        int b = static_cast<int>(static_cast<int64_t>(i) * srcSize / dstSize);
+        int e = static_cast<int>(static_cast<int64_t>(i + 1) * srcSize / dstSize);
+        begin[i] = std::min(b, srcSize - 1);
+        end[i] = std::min(std::max(e, b + 1), srcSize);
+    }
+}
+
+// Chroma range for a luma range, chroma is subsampled by 2
+inline void chromaBounds(int b, int e, int chromaSize, int& cb, int& ce) {
+    cb = std::min(b / 2, chromaSize - 1);
+    ce = std::min(std::max((e + 1) / 2, cb + 1), chromaSize);
+}
+
+}  // namespace
+
+Yuv420Image Yuv420Image::nv12(const uint8_t* data, int width, int height) {
+    Yuv420Image img;
+    img.y = data;
+    img.u = data + static_cast<size_t>(width) * height;
+    img.v = img.u + 1;
+    img.yStride = width;
+    img.uvStride = width;
+    img.uvStep = 2;
+    img.width = width;
+    img.height = height;
+    return img;
+}
+
+Yuv420Image Yuv420Image::i420(const uint8_t* data, int width, int height) {
+    Yuv420Image img;
+    size_t chromaSize = static_cast<size_t>(width / 2) * (height / 2);
+    img.y = data;
+    img.u = data + static_cast<size_t>(width) * height;
+    img.v = img.u + chromaSize;
+    img.yStride = width;
+    img.uvStride = width / 2;
+    img.uvStep = 1;
+    img.width = width;
+    img.height = height;
+    return img;
+}
+
+ColorKernel bestColorKernel() {
+#ifdef YUV_TO_BGR_X86
+    static const ColorKernel best = [] {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) return ColorKernel::AVX2;
+        if(__builtin_cpu_supports("sse4.1")) return ColorKernel::SSE41;
+        return ColorKernel::Scalar;
+    }();
+    return best;
+#else
+    return ColorKernel::Scalar;
+#endif
+}
+
+const char* colorKernelName(ColorKernel kernel) {
+    switch(kernel) {
+        case ColorKernel::Auto:
+            return colorKernelName(bestColorKernel());
+        case ColorKernel::Scalar:
+            return "scalar";
+        case ColorKernel::SSE41:
+            return "sse4.1";
+        case ColorKernel::AVX2:
+            return "avx2";
+    }
+    return "unknown";
+}
+
+void yuv420ToBgr(const Yuv420Image& src, uint8_t* bgr, size_t bgrStride, ColorKernel kernel) {
+    RowKernel row = rowKernelFor(kernel);
+    int chromaWidth = (src.width + 1) / 2;
+    thread_local std::vector<uint8_t> uRow, vRow;
+    uRow.resize(chromaWidth * 2);
+    vRow.resize(chromaWidth * 2);
+    for(int r = 0; r < src.height; r++) {
+        if((r & 1) == 0) {
+            // Upsample the chroma row once per pair of luma rows
+            const uint8_t* u = src.u + (r / 2) * src.uvStride;
+            const uint8_t* v = src.v + (r / 2) * src.uvStride;
+            for(int i = 0; i < chromaWidth; i++) {
+                uRow[2 * i] = uRow[2 * i + 1] = u[i * src.uvStep];
+                vRow[2 * i] = vRow[2 * i + 1] = v[i * src.uvStep];
+            }
+        }
+        row(src.y + r * src.yStride, uRow.data(), vRow.data(), bgr + r * bgrStride, src.width);
+    }
+}
+
+void yuv420ToBgrResized(const Yuv420Image& src, uint8_t* bgr, size_t bgrStride, int dstWidth, int dstHeight, ColorKernel kernel) {
+    if(dstWidth == src.width && dstHeight == src.height) {
+        yuv420ToBgr(src, bgr, bgrStride, kernel);
+        return;
+    }
+    RowKernel row = rowKernelFor(kernel);
+    int chromaWidth = (src.width + 1) / 2;
+    int chromaHeight = (src.height + 1) / 2;
+
+    // Source boxes per output column, fixed for the whole frame
+    struct Column {
+        int x0, x1, cx0, cx1;
+    };
+    thread_local std::vector<int> xBegin, xEnd, yBegin, yEnd;
+    thread_local std::vector<Column> columns;
+    boxBounds(src.width, dstWidth, xBegin, xEnd);
+    boxBounds(src.height, dstHeight, yBegin, yEnd);
+    columns.resize(dstWidth);
+    int maxWidth = 1;
+    for(int i = 0; i < dstWidth; i++) {
+        Column& c = columns[i];
+        c.x0 = xBegin[i];
+        c.x1 = xEnd[i];
+        chromaBounds(c.x0, c.x1, chromaWidth, c.cx0, c.cx1);
+        maxWidth = std::max(maxWidth, std::max(c.x1 - c.x0, c.cx1 - c.cx0));
+    }
+
+    thread_local std::vector<uint32_t> ySum, uSum, vSum;
+    thread_local std::vector<uint64_t> yRecip, cRecip;
+    thread_local std::vector<uint8_t> yRow, uRow, vRow;
+    ySum.resize(src.width);
+    uSum.resize(chromaWidth);
+    vSum.resize(chromaWidth);
+    yRecip.resize(maxWidth + 1);
+    cRecip.resize(maxWidth + 1);
+    yRow.resize(dstWidth);
+    uRow.resize(dstWidth);
+    vRow.resize(dstWidth);
+
+    for(int oy = 0; oy < dstHeight; oy++) {
+        // Vertical box sums of the source rows this output row covers
+        int y0 = yBegin[oy], y1 = yEnd[oy];
+        int cy0, cy1;
+        chromaBounds(y0, y1, chromaHeight, cy0, cy1);
+        uint32_t *yAcc = ySum.data(), *uAcc = uSum.data(), *vAcc = vSum.data();
+        std::fill(yAcc, yAcc + src.width, 0);
+        std::fill(uAcc, uAcc + chromaWidth, 0);
+        std::fill(vAcc, vAcc + chromaWidth, 0);
+        for(int sy = y0; sy < y1; sy++) {
+            const uint8_t* yp = src.y + sy * src.yStride;
+            for(int x = 0; x < src.width; x++) yAcc[x] += yp[x];
+        }
+        const int step = src.uvStep;
+        for(int sy = cy0; sy < cy1; sy++) {
+            const uint8_t* up = src.u + sy * src.uvStride;
+            const uint8_t* vp = src.v + sy * src.uvStride;
+            for(int x = 0; x < chromaWidth; x++) {
+                uAcc[x] += up[x * step];
+                vAcc[x] += vp[x * step];
+            }
+        }
+
+        // 32-bit reciprocals of the box areas in this row, avoids a division per pixel. 16 bits
+        // are too coarse for large boxes: a box of 255s could average to 256 and wrap to 0.
+        for(int w = 1; w <= maxWidth; w++) {
+            uint64_t ny = w * (y1 - y0), nc = w * (cy1 - cy0);
+            yRecip[w] = ((uint64_t(1) << 32) + ny / 2) / ny;
+            cRecip[w] = ((uint64_t(1) << 32) + nc / 2) / nc;
+        }
+
+        // Horizontal box average, rounded. Raw pointers: the uint8_t stores would otherwise
+        // force the compiler to reload every thread_local vector on each iteration
+        const Column* cols = columns.data();
+        const uint32_t *ys = ySum.data(), *us = uSum.data(), *vs = vSum.data();
+        const uint64_t *yr = yRecip.data(), *cr = cRecip.data();
+        uint8_t *yo = yRow.data(), *uo = uRow.data(), *vo = vRow.data();
+        for(int ox = 0; ox < dstWidth; ox++) {
+            const Column c = cols[ox];
+            uint32_t sy = 0, su = 0, sv = 0;
+            for(int x = c.x0; x < c.x1; x++) sy += ys[x];
+            for(int x = c.cx0; x < c.cx1; x++) {
+                su += us[x];
+                sv += vs[x];
+            }
+            uint64_t ry = yr[c.x1 - c.x0];
+            uint64_t rc = cr[c.cx1 - c.cx0];
+            // Exact up to boxes of millions of pixels; the clamp only guards against more
+            yo[ox] = static_cast<uint8_t>(std::min<uint64_t>((sy * ry + 0x80000000u) >> 32, 255));
+            uo[ox] = static_cast<uint8_t>(std::min<uint64_t>((su * rc + 0x80000000u) >> 32, 255));
+            vo[ox] = static_cast<uint8_t>(std::min<uint64_t>((sv * rc + 0x80000000u) >> 32, 255));
+        }
+        row(yo, uo, vo, bgr + oy * bgrStride, dstWidth);
+    }
+}
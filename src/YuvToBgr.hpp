@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Host-side YUV 4:2:0 -> BGR conversion for the preview path.
+//
+// Uses the same BT.601 fixed-point coefficients as cv::cvtColor(COLOR_YUV2BGR_NV12), so the
+// full-resolution output is bit-exact with OpenCV. The resized variant box-filters Y/U/V down
+// to the target size first and only converts the destination pixels; it never builds a
+// full-resolution BGR image.
+
+enum class ColorKernel { Auto, Scalar, SSE41, AVX2 };
+
+// Semi-planar (NV12: uvStep 2, v = u + 1) or planar (I420: uvStep 1) 4:2:0 image
+struct Yuv420Image {
+    const uint8_t* y = nullptr;
+    const uint8_t* u = nullptr;
+    const uint8_t* v = nullptr;
+    size_t yStride = 0;
+    size_t uvStride = 0;
+    int uvStep = 2;
+    int width = 0;
+    int height = 0;
+
+    static Yuv420Image nv12(const uint8_t* data, int width, int height);
+    static Yuv420Image i420(const uint8_t* data, int width, int height);
+};
+
+// Best kernel supported by the CPU we run on
+ColorKernel bestColorKernel();
+const char* colorKernelName(ColorKernel kernel);
+
+// Full-resolution conversion into `bgr` (width * height * 3 bytes, rows `bgrStride` apart)
+void yuv420ToBgr(const Yuv420Image& src, uint8_t* bgr, size_t bgrStride, ColorKernel kernel = ColorKernel::Auto);
+
+// Conversion and downscale to dstWidth x dstHeight in one pass
+void yuv420ToBgrResized(const Yuv420Image& src,
+                        uint8_t* bgr,
+                        size_t bgrStride,
+                        int dstWidth,
+                        int dstHeight,
+                        ColorKernel kernel = ColorKernel::Auto);
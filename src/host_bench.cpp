@@ -0,0 +1,987 @@
+// Benchmarks of the host-side hot paths; runs without a device.
+//
+// Inputs are synthetic, or taken from a capture file recorded with rgb-video:
+//   host-bench [--capture=rec.cap] --benchmark_out=results.json --benchmark_out_format=json
+// The JSON output is what gets compared across commits.
+//
+// `host-bench --shm-fanout=<subscribers> [--shm-fps=60]` instead runs the shared-memory ring
+// with that many subscriber processes (the last one deliberately slow) on synthetic 1080p
+// frames for five seconds and prints per-subscriber latency.
+//
+// `host-bench --multi=<devices> [--multi-fps=30]` runs DeviceOrchestrator with 1, 2, ... up to
+// that many synthetic devices (1080p NV12, or the capture's video frame with --capture), each
+// frame scaled to a BGR preview on the device's worker, and prints the host CPU per device.
+//
+// `host-bench --sched-hogs=<threads> [--threads=rt]` runs a 10 ms periodic thread, standing in
+// for the audio and capture threads, against that many busy-looping threads, once with default
+// scheduling and once with the ThreadPolicy spec, and prints how late its wakeups were.
+//
+// `host-bench --record-soak=<seconds> [--record-dir=/tmp] [--record-direct]` records synthetic
+// 4K H.265 at ~50 Mbit/s and rgb-video's three audio tracks through SegmentedFile in 5 s
+// segments, prints the write latency percentiles and checks that the joined segments hold
+// everything that was written.
+
+#include <benchmark/benchmark.h>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "AudioRecorder.hpp"
+#include "AudioTap.hpp"
+#include "AudioTimeline.hpp"
+#include "CaptureFile.hpp"
+#include "CaptureReplay.hpp"
+#include "ConversionPool.hpp"
+#include "DepthColorizer.hpp"
+#include "DetectionTracker.hpp"
+#include "DeviceOrchestrator.hpp"
+#include "FrameMailbox.hpp"
+#include "FramePool.hpp"
+#include "FrameSink.hpp"
+#include "PdafDecoder.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineMetrics.hpp"
+#include "SegmentedFile.hpp"
+#include "ShmFrameRing.hpp"
+#include "StreamSync.hpp"
+#include "ThreadPolicy.hpp"
+#include "VideoMuxer.hpp"
+#include "YuvToBgr.hpp"
+
+namespace {
+
+std::shared_ptr<CaptureReader> _capture;
+
+std::vector<uint8_t> randomBytes(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> data(size);
+    for(auto& b : data) b = static_cast<uint8_t>(rng());
+    return data;
+}
+
+// First recorded message of `stream` with the given shape, or empty
+std::vector<uint8_t> recorded(const char* stream, int width, int height) {
+    std::vector<uint8_t> data;
+    if(!_capture) return data;
+    int id = _capture->streamId(stream);
+    for(size_t i = 0; id >= 0 && i < _capture->size(); i++) {
+        if(_capture->entry(i).stream != id) continue;
+        CaptureMessage msg = _capture->message(i);
+        if(width && (int(msg.width) != width || int(msg.height) != height)) continue;
+        data.assign(msg.data, msg.data + msg.size);
+        break;
+    }
+    return data;
+}
+
+// NV12 frame: a smooth gradient with noise, so the box filter sees realistic data
+std::vector<uint8_t> nv12Frame(int width, int height) {
+    auto data = recorded("video", width, height);
+    if(data.size() >= size_t(width) * height * 3 / 2) return data;
+    data = randomBytes(size_t(width) * height * 3 / 2, 1);
+    for(int r = 0; r < height; r++) {
+        for(int c = 0; c < width; c++) data[r * width + c] = static_cast<uint8_t>((r + c) / 8 + (data[r * width + c] & 15));
+    }
+    return data;
+}
+
+std::vector<uint16_t> depthFrame(int width, int height) {
+    std::vector<uint16_t> depth(size_t(width) * height);
+    auto data = recorded("tof", width, height);
+    if(data.size() >= depth.size() * 2) {
+        std::memcpy(depth.data(), data.data(), depth.size() * 2);
+        return depth;
+    }
+    std::mt19937 rng(2);
+    for(int r = 0; r < height; r++) {
+        for(int c = 0; c < width; c++) {
+            // Walls at 0.5-4 m with ~5% invalid pixels
+            uint16_t d = static_cast<uint16_t>(500 + (r * 7 + c * 3) % 3500 + rng() % 32);
+            depth[r * width + c] = rng() % 20 == 0 ? 0 : d;
+        }
+    }
+    return depth;
+}
+
+// `objects` objects on a grid, each moving about its cell and reported as a cluster of three
+// jittered boxes plus a low-confidence stray, the way a detection network outputs them. The
+// motion repeats every `frames` frames, so the batches can be replayed in a loop.
+std::vector<DetectionBatch> detectionStream(int objects, int frames, int framesPerBatch) {
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    int grid = static_cast<int>(std::ceil(std::sqrt(objects)));
+    float size = 0.5f / grid;
+    std::vector<DetectionBatch> batches;
+    for(int f = 0; f < frames; f++) {
+        if(f % framesPerBatch == 0) batches.emplace_back();
+        DetectionBatch& batch = batches.back();
+        batch.beginFrame(f);
+        for(int i = 0; i < objects; i++) {
+            // Triangle wave over the period, phase per object
+            float phase = std::fmod(float(f) / frames + float(i) / objects, 1.0f);
+            float offset = 0.4f * size * (1.0f - 4.0f * std::fabs(phase - 0.5f));
+            float x = (i % grid + 0.25f) / grid + offset;
+            float y = (i / grid + 0.25f) / grid - offset;
+            for(int k = 0; k < 3; k++) {
+                auto jitter = [&]() { return (unit(rng) - 0.5f) * 0.1f * size; };
+                batch.add(i % 4, 0.6f + 0.35f * unit(rng), x + jitter(), y + jitter(), x + size + jitter(), y + size + jitter());
+            }
+            float sx = unit(rng), sy = unit(rng);
+            batch.add(i % 4, 0.4f * unit(rng), sx, sy, sx + size, sy + size);
+        }
+    }
+    return batches;
+}
+
+std::string tempPath(const char* name) {
+    return std::string("/tmp/host-bench-") + std::to_string(getpid()) + "-" + name;
+}
+
+// Minimal ImgFrame-shaped audio packet for AudioTap
+struct BenchPayload {
+    uint8_t* data = nullptr;
+    uint32_t length = 0;
+};
+struct BenchPacket {
+    std::shared_ptr<BenchPayload> packet = std::make_shared<BenchPayload>();
+    int width = 0;
+    int height = 0;
+    int getWidth() const {
+        return width;
+    }
+    int getHeight() const {
+        return height;
+    }
+};
+
+}  // namespace
+
+// ---- NV12 -> BGR ----
+
+static void BM_Nv12ToBgr(benchmark::State& state) {
+    int width = state.range(0), height = state.range(1);
+    auto kernel = static_cast<ColorKernel>(state.range(2));
+    if(kernel != ColorKernel::Scalar && bestColorKernel() < kernel) {
+        state.SkipWithError("kernel not supported by this CPU");
+        return;
+    }
+    auto nv12 = nv12Frame(width, height);
+    std::vector<uint8_t> bgr(size_t(width) * height * 3);
+    Yuv420Image src = Yuv420Image::nv12(nv12.data(), width, height);
+    for(auto _ : state) {
+        yuv420ToBgr(src, bgr.data(), width * 3, kernel);
+        benchmark::DoNotOptimize(bgr.data());
+    }
+    state.SetLabel(colorKernelName(kernel));
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK(BM_Nv12ToBgr)
+    ->ArgNames({"w", "h", "kernel"})
+    ->Args({1920, 1080, int(ColorKernel::Scalar)})
+    ->Args({1920, 1080, int(ColorKernel::SSE41)})
+    ->Args({1920, 1080, int(ColorKernel::AVX2)})
+    ->Args({3840, 2160, int(ColorKernel::AVX2)})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_Nv12ToBgrOpenCV(benchmark::State& state) {
+    int width = state.range(0), height = state.range(1);
+    auto nv12 = nv12Frame(width, height);
+    cv::Mat src(height * 3 / 2, width, CV_8UC1, nv12.data()), bgr;
+    for(auto _ : state) {
+        cv::cvtColor(src, bgr, cv::COLOR_YUV2BGR_NV12);
+        benchmark::DoNotOptimize(bgr.data);
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK(BM_Nv12ToBgrOpenCV)->ArgNames({"w", "h"})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMillisecond);
+
+// Preview path: 4K NV12 to a 1280x720 BGR image
+static void BM_PreviewFused(benchmark::State& state) {
+    auto nv12 = nv12Frame(3840, 2160);
+    cv::Mat bgr(720, 1280, CV_8UC3);
+    Yuv420Image src = Yuv420Image::nv12(nv12.data(), 3840, 2160);
+    for(auto _ : state) {
+        yuv420ToBgrResized(src, bgr.data, bgr.step, 1280, 720);
+        benchmark::DoNotOptimize(bgr.data);
+    }
+}
+BENCHMARK(BM_PreviewFused)->Unit(benchmark::kMillisecond);
+
+static void BM_PreviewOpenCV(benchmark::State& state) {
+    auto nv12 = nv12Frame(3840, 2160);
+    cv::Mat src(2160 * 3 / 2, 3840, CV_8UC1, nv12.data()), bgr, preview;
+    for(auto _ : state) {
+        cv::cvtColor(src, bgr, cv::COLOR_YUV2BGR_NV12);
+        cv::resize(bgr, preview, cv::Size(1280, 720), 0, 0, cv::INTER_AREA);
+        benchmark::DoNotOptimize(preview.data);
+    }
+}
+BENCHMARK(BM_PreviewOpenCV)->Unit(benchmark::kMillisecond);
+
+// ---- Frame buffers ----
+
+// A 1080p BGR Mat allocated and freed per frame, arg 1 with the pool as allocator
+static void BM_FrameAlloc(benchmark::State& state) {
+    FramePool pool;
+    if(state.range(0)) cv::Mat::setDefaultAllocator(&pool);
+    for(auto _ : state) {
+        cv::Mat frame(1080, 1920, CV_8UC3);
+        frame.data[0] = 1;  // touch the first page
+        benchmark::DoNotOptimize(frame.data);
+    }
+    cv::Mat::setDefaultAllocator(nullptr);
+    state.SetLabel(state.range(0) ? "FramePool" : "default");
+}
+BENCHMARK(BM_FrameAlloc)->ArgName("pooled")->Arg(0)->Arg(1);
+
+// ---- ToF ----
+
+static void BM_DepthColorizer(benchmark::State& state) {
+    int width = state.range(0), height = state.range(1);
+    auto depth = depthFrame(width, height);
+    DepthColorizer colorizer;
+    cv::Mat src(height, width, CV_16UC1, depth.data());
+    for(auto _ : state) benchmark::DoNotOptimize(colorizer.colorize(src).data);
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK(BM_DepthColorizer)->ArgNames({"w", "h"})->Args({640, 480})->Unit(benchmark::kMicrosecond);
+
+static void BM_DepthColorizeOpenCV(benchmark::State& state) {
+    int width = state.range(0), height = state.range(1);
+    auto depth = depthFrame(width, height);
+    cv::Mat src(height, width, CV_16UC1, depth.data()), norm, color;
+    for(auto _ : state) {
+        cv::normalize(src, norm, 255, 0, cv::NORM_MINMAX, CV_8UC1);
+        cv::applyColorMap(norm, color, cv::COLORMAP_JET);
+        benchmark::DoNotOptimize(color.data);
+    }
+    state.SetItemsProcessed(state.iterations() * width * height);
+}
+BENCHMARK(BM_DepthColorizeOpenCV)->ArgNames({"w", "h"})->Args({640, 480})->Unit(benchmark::kMicrosecond);
+
+// ---- PDAF ----
+
+static void BM_PdafDecode(benchmark::State& state) {
+    auto mode = static_cast<PdafMode>(state.range(0));
+    auto data = recorded("raw", 0, 0);
+    if(data.size() < pdafPayloadSize(mode)) data = randomBytes(pdafPayloadSize(mode), 3);
+    PdafGrid grid;
+    PdafFocusMetric metric;
+    int lens = 0;
+    for(auto _ : state) {
+        decodePdaf(data.data(), data.size(), mode, grid);
+        metric.update(grid, lens++ & 255);
+        benchmark::DoNotOptimize(metric.defocus());
+    }
+    state.SetLabel(mode == PdafMode::Grid8x6 ? "8x6" : "16x12");
+}
+BENCHMARK(BM_PdafDecode)->ArgName("mode")->Arg(int(PdafMode::Grid16x12))->Arg(int(PdafMode::Grid8x6));
+
+// ---- Detections ----
+
+// Threshold, NMS and tracking of a synthetic stream, `frames` frames per batch. The tracks
+// counter stays at the number of objects as long as every object keeps its id.
+static void BM_DetectionTracker(benchmark::State& state) {
+    int objects = state.range(0), framesPerBatch = state.range(1);
+    auto stream = detectionStream(objects, 120, framesPerBatch);
+    DetectionConfig config;
+    config.maxPerFrame = 1000;
+    DetectionTracker tracker(config);
+    DetectionBatch batch;
+    size_t next = 0;
+    int64_t detections = 0;
+    for(auto _ : state) {
+        batch = stream[next++ % stream.size()];
+        detections += batch.size();
+        tracker.process(batch);
+        benchmark::DoNotOptimize(batch.trackId.data());
+    }
+    state.SetItemsProcessed(detections);
+    state.counters["frames"] = benchmark::Counter(double(state.iterations()) * framesPerBatch, benchmark::Counter::kIsRate);
+    state.counters["tracks"] = double(tracker.getStats().tracks);
+}
+BENCHMARK(BM_DetectionTracker)
+    ->ArgNames({"objects", "frames"})
+    ->Args({20, 1})
+    ->Args({100, 1})
+    ->Args({300, 1})
+    ->Args({300, 4})
+    ->Unit(benchmark::kMicrosecond);
+
+// ---- Audio ----
+
+template <void (*Convert)(const uint8_t*, float*, size_t), int SampleBytes>
+static void BM_AudioToFloat(benchmark::State& state) {
+    size_t samples = state.range(0);
+    auto src = randomBytes(samples * SampleBytes, 4);
+    std::vector<float> dst(samples);
+    for(auto _ : state) {
+        Convert(src.data(), dst.data(), samples);
+        benchmark::DoNotOptimize(dst.data());
+    }
+    state.SetItemsProcessed(state.iterations() * samples);
+}
+BENCHMARK_TEMPLATE(BM_AudioToFloat, convertS16ToFloat, 2)->Arg(960);
+BENCHMARK_TEMPLATE(BM_AudioToFloat, convertS24ToFloat, 3)->Arg(960);
+BENCHMARK_TEMPLATE(BM_AudioToFloat, convertS32ToFloat, 4)->Arg(960);
+
+// One 10 ms, 48 kHz stereo packet through a tap with a raw and a float sink
+static void BM_AudioTap(benchmark::State& state) {
+    int sampleBytes = state.range(0);
+    auto data = randomBytes(480 * 2 * sampleBytes, 5);
+    auto packet = std::make_shared<BenchPacket>();
+    packet->packet->data = data.data();
+    packet->packet->length = static_cast<uint32_t>(data.size());
+    packet->width = 2;
+    packet->height = 480;
+    auto tap = makeAudioTap<BenchPacket>(sampleBytes, 2);
+    size_t bytes = 0;
+    float sum = 0;
+    tap->addRawSink([&](const std::shared_ptr<BenchPacket>&, const uint8_t*, size_t n) { bytes += n; });
+    tap->addFloatSink([&](const std::shared_ptr<BenchPacket>&, const float* s, size_t frames, int) { sum += s[frames - 1]; });
+    for(auto _ : state) tap->process(packet);
+    benchmark::DoNotOptimize(sum);
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_AudioTap)->ArgName("sampleBytes")->Arg(2)->Arg(3)->Arg(4);
+
+// 100 s of 10 ms, 48 kHz stereo packets with 1% lost and 2% swapped with their successor, and
+// up to 0.2 ms of timestamp jitter. The timeline output must come out at the recorded length.
+static void BM_AudioTimeline(benchmark::State& state) {
+    const int64_t packets = 10000;
+    const size_t frames = 480;
+    auto chunkData = std::make_shared<std::vector<uint8_t>>(randomBytes(frames * 4, 7));
+    std::mt19937 rng(8);
+    std::vector<int64_t> order;
+    for(int64_t i = 0; i < packets; i++) {
+        if(rng() % 100 != 0) order.push_back(i);
+    }
+    for(size_t i = 0; i + 1 < order.size(); i++) {
+        if(rng() % 50 == 0) std::swap(order[i], order[i + 1]);
+    }
+    std::vector<int64_t> jitter(packets);
+    for(auto& j : jitter) j = rng() % 200000;
+    for(auto _ : state) {
+        uint64_t bytes = 0;
+        AudioTimeline timeline(48000, 4, 8, [&bytes](AudioChunk chunk) { bytes += chunk.size; });
+        for(int64_t seq : order) {
+            AudioChunk chunk;
+            chunk.owner = chunkData;
+            chunk.data = chunkData->data();
+            chunk.size = chunkData->size();
+            timeline.push(seq, seq * 10000000LL + jitter[seq], frames, std::move(chunk));
+        }
+        timeline.flush();
+        int64_t expected = (order.back() + 1) * frames;
+        if(std::llabs(int64_t(timeline.stats().frames) - expected) > int64_t(frames) || bytes != timeline.stats().frames * 4) {
+            state.SkipWithError("timeline length doesn't match the stream");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * order.size());
+}
+BENCHMARK(BM_AudioTimeline)->Unit(benchmark::kMillisecond);
+
+// 10 s of 48 kHz stereo 16-bit audio in 10 ms chunks, through the writer thread to disk
+static void BM_AudioRecorderWrite(benchmark::State& state) {
+    auto chunkData = std::make_shared<std::vector<uint8_t>>(randomBytes(480 * 2 * 2, 6));
+    std::string path = tempPath("audio.wav");
+    for(auto _ : state) {
+        AudioRecorder recorder;
+        int track = recorder.addTrack(path, 48000, 2, 2);
+        recorder.start();
+        for(int i = 0; i < 1000; i++) {
+            AudioChunk chunk;
+            chunk.owner = chunkData;
+            chunk.data = chunkData->data();
+            chunk.size = chunkData->size();
+            recorder.push(track, std::move(chunk));
+        }
+        recorder.stop();
+    }
+    unlink(path.c_str());
+    state.SetBytesProcessed(state.iterations() * 1000 * chunkData->size());
+}
+BENCHMARK(BM_AudioRecorderWrite)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// ---- Capture files ----
+
+// 300 1080p NV12 frames written and indexed
+static void BM_CaptureWrite(benchmark::State& state) {
+    auto frame = std::make_shared<std::vector<uint8_t>>(nv12Frame(1920, 1080));
+    std::string path = tempPath("write.cap");
+    for(auto _ : state) {
+        CaptureWriter writer;
+        writer.open(path);
+        int stream = writer.addStream("video");
+        CaptureInfo info;
+        info.width = 1920;
+        info.height = 1080;
+        for(int i = 0; i < 300; i++) {
+            info.sequence = i;
+            info.deviceTimestampNs = i * 33333333LL;
+            writer.append(stream, info, frame, frame->data(), frame->size());
+        }
+        writer.close();
+    }
+    unlink(path.c_str());
+    state.SetBytesProcessed(state.iterations() * 300 * frame->size());
+}
+BENCHMARK(BM_CaptureWrite)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Max-speed replay of 10000 small messages, i.e. the per-message cost of the replay source
+static void BM_CaptureReplay(benchmark::State& state) {
+    std::string path = tempPath("replay.cap");
+    {
+        CaptureWriter writer;
+        writer.open(path);
+        int stream = writer.addStream("mic");
+        auto chunk = std::make_shared<std::vector<uint8_t>>(1920);
+        CaptureInfo info;
+        for(int i = 0; i < 10000; i++) {
+            info.sequence = i;
+            info.deviceTimestampNs = i * 10000000LL;
+            writer.append(stream, info, chunk, chunk->data(), chunk->size());
+        }
+        writer.close();
+    }
+    auto reader = std::make_shared<CaptureReader>();
+    reader->open(path);
+    unlink(path.c_str());
+    CaptureReplay replay(reader);
+    uint64_t bytes = 0;
+    replay.onStream("mic", [&](const std::shared_ptr<ReplayFrame>& frame) { bytes += frame->packet->length; });
+    for(auto _ : state) replay.run(0);
+    state.SetItemsProcessed(state.iterations() * reader->size());
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_CaptureReplay)->Unit(benchmark::kMillisecond);
+
+// ---- Encoded video muxing ----
+
+namespace {
+
+struct EncodedPacket {
+    std::shared_ptr<const void> owner;
+    const uint8_t* data;
+    size_t size;
+    int64_t timestampNs;
+};
+
+// Annex B access unit with random slice data; keyframes carry VPS / SPS / PPS like the
+// device encoder's output
+std::shared_ptr<std::vector<uint8_t>> syntheticH265(bool keyframe, size_t sliceBytes, std::mt19937& rng) {
+    auto au = std::make_shared<std::vector<uint8_t>>();
+    auto nal = [&](std::initializer_list<uint8_t> header, size_t payload) {
+        const uint8_t startCode[] = {0, 0, 0, 1};
+        au->insert(au->end(), startCode, startCode + 4);
+        au->insert(au->end(), header);
+        for(size_t i = 0; i < payload; i++) au->push_back(static_cast<uint8_t>(rng() % 255 + 1));
+    };
+    if(keyframe) {
+        nal({0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF}, 18);
+        nal({0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x78}, 30);
+        nal({0x44, 0x01, 0xC1}, 5);
+        nal({0x26, 0x01}, sliceBytes);
+    } else {
+        nal({0x02, 0x01}, sliceBytes);
+    }
+    return au;
+}
+
+// The `enc` stream of the capture file if there is one, else 10 s of synthetic 4K H.265:
+// ~25 Mbit/s with a keyframe per second
+std::vector<EncodedPacket> encodedPackets(VideoCodec& codec) {
+    std::vector<EncodedPacket> packets;
+    int id = _capture ? _capture->streamId("enc") : -1;
+    for(size_t i = 0; id >= 0 && i < _capture->size(); i++) {
+        if(_capture->entry(i).stream != id) continue;
+        CaptureMessage msg = _capture->message(i);
+        packets.push_back({_capture->mapping(), msg.data, msg.size, msg.deviceTimestampNs});
+    }
+    if(!packets.empty()) {
+        const uint8_t* p = packets[0].data;
+        codec = p[0] == 0xFF && p[1] == 0xD8 ? VideoCodec::MJPEG : (p[4] & 0x7E) == 0x40 ? VideoCodec::H265 : VideoCodec::H264;
+        return packets;
+    }
+    codec = VideoCodec::H265;
+    std::mt19937 rng(3);
+    for(int i = 0; i < 300; i++) {
+        bool keyframe = i % 30 == 0;
+        auto au = syntheticH265(keyframe, keyframe ? 400000 : 90000, rng);
+        packets.push_back({au, au->data(), au->size(), i * 33333333LL});
+    }
+    return packets;
+}
+
+}  // namespace
+
+// Canned bitstream packets into a Matroska file: sustained muxing + write throughput
+static void BM_VideoMux(benchmark::State& state) {
+    VideoCodec codec;
+    auto packets = encodedPackets(codec);
+    std::string path = tempPath("mux.mkv");
+    uint64_t bytes = 0;
+    for(auto _ : state) {
+        VideoMuxer muxer;
+        muxer.open(path, codec, 3840, 2160, 30);
+        for(const auto& p : packets) muxer.write(p.owner, p.data, p.size, p.timestampNs);
+        muxer.close();
+        bytes += muxer.getStats().bytes;
+    }
+    unlink(path.c_str());
+    state.SetItemsProcessed(state.iterations() * packets.size());
+    state.SetBytesProcessed(bytes);
+}
+BENCHMARK(BM_VideoMux)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// ---- Pipeline cache ----
+
+// Store and load of a serialized pipeline the size of rgb-video's (~40 KB of JSON); a loaded
+// entry that doesn't match what was stored fails the benchmark
+static void BM_PipelineCache(benchmark::State& state) {
+    auto bytes = randomBytes(40 << 10, 5);
+    std::string dir = tempPath("pipelines");
+    PipelineCache cache(dir);
+    std::string key = "host-bench uvc=0 tof=1 mic=1";
+    std::vector<uint8_t> loaded;
+    for(auto _ : state) {
+        if(!cache.store(key, bytes) || !cache.load(key, loaded) || loaded != bytes) {
+            state.SkipWithError("cache round trip failed");
+            break;
+        }
+        // A different key with the same hash slot must miss, not return this entry
+        if(cache.load(key + " ", loaded)) state.SkipWithError("cache hit for another key");
+    }
+    unlink(cache.pathFor(key).c_str());
+    rmdir(dir.c_str());
+    state.SetBytesProcessed(state.iterations() * bytes.size() * 2);
+}
+BENCHMARK(BM_PipelineCache)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+// ---- Shared-memory fan-out ----
+
+// Publishing one 1080p NV12 frame: the copy into the slot plus the wakeup
+static void BM_ShmPublish(benchmark::State& state) {
+    auto frame = nv12Frame(1920, 1080);
+    std::string name = "/host-bench-" + std::to_string(getpid());
+    ShmRingPublisher publisher;
+    if(!publisher.open(name, 8, frame.size())) {
+        state.SkipWithError("cannot create shared memory ring");
+        return;
+    }
+    CaptureInfo info;
+    info.width = 1920;
+    info.height = 1080;
+    for(auto _ : state) {
+        publisher.publish("video", info, frame.data(), frame.size());
+        info.sequence++;
+    }
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_ShmPublish)->Unit(benchmark::kMicrosecond);
+
+namespace {
+
+void printLatency(const char* name, const LatencyHistogram& h, uint64_t maxNs) {
+    printf("%-14s p50 %7.1f us  p99 %7.1f us  p99.9 %7.1f us  max %7.1f us\n",
+           name, h.percentile(0.5) / 1000.0, h.percentile(0.99) / 1000.0, h.percentile(0.999) / 1000.0, maxNs / 1000.0);
+}
+
+// Subscriber process: reads every frame in place, as an analytics consumer would
+void runShmSubscriber(const std::string& name, int id, bool slow) {
+    ShmRingSubscriber subscriber;
+    if(!subscriber.attach(name)) _exit(1);
+    LatencyHistogram latency;
+    uint64_t maxNs = 0, torn = 0, checksum = 0;
+    ShmFrame frame;
+    while(subscriber.acquire(frame, 1000)) {
+        uint64_t ns = std::chrono::steady_clock::now().time_since_epoch().count() - frame.publishNs;
+        latency.add(LatencyHistogram::bucketOf(ns), 1);
+        maxNs = std::max(maxNs, ns);
+        for(size_t i = 0; i < frame.size; i += 64) checksum += frame.data[i];
+        if(!subscriber.valid(frame)) torn++;
+        if(slow) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    auto stats = subscriber.getStats();
+    char label[32];
+    snprintf(label, sizeof(label), "subscriber %d%s", id, slow ? "*" : "");
+    printf("%-14s %lu frames, %lu dropped, %lu overwritten while read (checksum %lu)\n",
+           label, (unsigned long)stats.received, (unsigned long)stats.dropped, (unsigned long)torn, (unsigned long)(checksum & 0xff));
+    printLatency(label, latency, maxNs);
+    fflush(stdout);
+    _exit(0);
+}
+
+int runShmFanout(int subscribers, int fps) {
+    const int seconds = 5;
+    auto frame = nv12Frame(1920, 1080);
+    std::string name = "/host-bench-" + std::to_string(getpid());
+    ShmRingPublisher publisher;
+    if(!publisher.open(name, 8, frame.size())) return 1;
+    printf("Publishing 1080p NV12 at %d fps to %d subscribers for %d s (* = slow subscriber)\n", fps, subscribers, seconds);
+    std::vector<pid_t> children;
+    for(int i = 0; i < subscribers; i++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if(pid == 0) runShmSubscriber(name, i, subscribers > 1 && i == subscribers - 1);
+        if(pid > 0) children.push_back(pid);
+    }
+    // Let the subscribers attach before the first frame
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    LatencyHistogram publishCost;
+    uint64_t maxNs = 0;
+    CaptureInfo info;
+    info.width = 1920;
+    info.height = 1080;
+    auto period = std::chrono::nanoseconds(1000000000LL / std::max(fps, 1));
+    auto next = std::chrono::steady_clock::now();
+    for(int i = 0; i < fps * seconds; i++) {
+        std::this_thread::sleep_until(next);
+        next += period;
+        auto t0 = std::chrono::steady_clock::now();
+        info.sequence = i;
+        publisher.publish("video", info, frame.data(), frame.size());
+        uint64_t ns = (std::chrono::steady_clock::now() - t0).count();
+        publishCost.add(LatencyHistogram::bucketOf(ns), 1);
+        maxNs = std::max(maxNs, ns);
+    }
+    publisher.close();
+    int failed = 0;
+    for(pid_t pid : children) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+    }
+    printLatency("publish", publishCost, maxNs);
+    return failed ? 1 : 0;
+}
+
+// Synthetic devices deliver on their own threads like XLink callbacks; the workers do the
+// preview conversion each frame would get in the UI path
+int runMultiDevice(int maxDevices, int fps) {
+    const int seconds = 3;
+    auto frame = std::make_shared<std::vector<uint8_t>>(nv12Frame(1920, 1080));
+    printf("%d fps of 1080p NV12 per device, converted to 640x360 BGR, %d s per run, %d CPUs\n", fps, seconds, DeviceOrchestrator::cpuCount());
+    for(int n = 1; n <= maxDevices; n++) {
+        printf("--- %d device%s\n", n, n > 1 ? "s" : "");
+        NullSink sink;
+        DeviceOrchestrator orchestrator(&sink);
+        std::vector<cv::Mat> previews;
+        for(int i = 0; i < n; i++) {
+            orchestrator.addDevice("cam" + std::to_string(i), DeviceOrchestrator::spreadCpu(i));
+            previews.emplace_back(360, 640, CV_8UC3);
+        }
+        orchestrator.setProcess([&previews](int device, const SinkFrame& f) {
+            Yuv420Image src = Yuv420Image::nv12(f.data, f.info.width, f.info.height);
+            yuv420ToBgrResized(src, previews[device].data, previews[device].step, 640, 360);
+            return true;
+        });
+        orchestrator.start();
+
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> devices;
+        for(int i = 0; i < n; i++) {
+            devices.emplace_back([&, i]() {
+                auto period = std::chrono::nanoseconds(1000000000LL / std::max(fps, 1));
+                auto next = std::chrono::steady_clock::now();
+                SinkFrame f;
+                f.stream = "video";
+                f.info.width = 1920;
+                f.info.height = 1080;
+                f.data = frame->data();
+                f.size = frame->size();
+                f.owner = frame;
+                while(!stop) {
+                    std::this_thread::sleep_until(next);
+                    next += period;
+                    orchestrator.submit(i, f);
+                    f.info.sequence++;
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        stop = true;
+        for(auto& t : devices) t.join();
+        orchestrator.stop();
+        orchestrator.printStats();
+    }
+    return 0;
+}
+
+// The periodic thread has the audio role, the hogs the worker role
+int runSchedLatency(int hogs, const std::string& spec) {
+    const int seconds = 3;
+    const auto period = std::chrono::milliseconds(10);
+    printf("10 ms periodic thread against %d CPU hogs, %d CPUs, %d s per run\n", hogs, DeviceOrchestrator::cpuCount(), seconds);
+    for(int run = 0; run < 2; run++) {
+        ThreadPolicy policy;
+        if(run == 1 && !policy.configure(spec)) return 1;
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> threads;
+        for(int i = 0; i < hogs; i++) {
+            threads.emplace_back([&]() {
+                policy.enter(ThreadRole::Worker, "hog");
+                uint64_t spins = 0;
+                while(!stop.load(std::memory_order_relaxed)) benchmark::DoNotOptimize(++spins);
+            });
+        }
+        LatencyHistogram lateness;
+        uint64_t maxNs = 0;
+        threads.emplace_back([&]() {
+            policy.enter(ThreadRole::Audio, "periodic");
+            auto next = std::chrono::steady_clock::now();
+            while(!stop) {
+                next += period;
+                std::this_thread::sleep_until(next);
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - next).count();
+                lateness.add(LatencyHistogram::bucketOf(ns), 1);
+                maxNs = std::max(maxNs, ns);
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        stop = true;
+        for(auto& t : threads) t.join();
+        printf("--- %s\n", run ? spec.c_str() : "default scheduling");
+        printLatency("wakeup late", lateness, maxNs);
+        policy.printStats();
+    }
+    return 0;
+}
+
+// Joins a recording, checks it holds `dataBytes` after the header and removes it all
+bool checkJoined(const std::string& indexPath, SegmentedFile::HeaderUpdate update, uint64_t dataBytes) {
+    SegmentIndex index;
+    std::string joined = indexPath + ".joined";
+    bool ok = SegmentedFile::readIndex(indexPath, index) && SegmentedFile::concatenate(indexPath, joined, update);
+    struct stat st;
+    ok = ok && stat(joined.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) == index.headerBytes + dataBytes;
+    printf("%-14s %zu segments, %.2f MB: %s\n", index.format.c_str(), index.segments.size(), dataBytes / 1048576.0, ok ? "joined ok" : "MISMATCH");
+    for(const auto& segment : index.segments) unlink(segment.path.c_str());
+    unlink(indexPath.c_str());
+    unlink(joined.c_str());
+    return ok;
+}
+
+// The video writer runs on its own thread like VideoMuxer's, the audio goes through AudioRecorder
+int runRecordSoak(int seconds, const std::string& dir, bool direct) {
+    RecordingOptions options;
+    options.segmentMs = 5000;
+    options.direct = direct;
+    std::string base = dir + "/host-bench-" + std::to_string(getpid()) + "-";
+    printf("Recording %d s of 4K H.265 (~50 Mbit/s, 30 fps) and 3 audio tracks to %s, 5 s segments, %s\n",
+           seconds, dir.c_str(), direct ? "O_DIRECT" : "page cache");
+
+    // One GOP, cycled: a keyframe per second, four times the size of the other frames
+    std::mt19937 rng(5);
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> gop;
+    for(int i = 0; i < 30; i++) gop.push_back(syntheticH265(i == 0, i == 0 ? 760000 : 190000, rng));
+
+    SegmentedFile video(base + "video.h265", "raw", options);
+    if(!video.open()) return 1;
+    struct Track {
+        const char* name;
+        int sampleRate;
+        int channels;
+        int id;
+        uint64_t bytes;
+        std::shared_ptr<std::vector<uint8_t>> chunk;
+    };
+    std::vector<Track> tracks = {{"audio.wav", 48000, 2, -1, 0, nullptr}, {"audioBack.wav", 48000, 1, -1, 0, nullptr}, {"audioNc.wav", 16000, 2, -1, 0, nullptr}};
+    AudioRecorder recorder(512, options);
+    for(auto& t : tracks) {
+        t.id = recorder.addTrack(base + t.name, t.sampleRate, t.channels, 2);
+        if(t.id < 0) return 1;
+        // 10 ms packets
+        t.chunk = std::make_shared<std::vector<uint8_t>>(randomBytes(t.sampleRate / 100 * t.channels * 2, t.sampleRate + t.channels));
+    }
+    recorder.start();
+
+    std::atomic<bool> stop{false};
+    uint64_t videoBytes = 0, lateFrames = 0;
+    std::thread writer([&]() {
+        const auto period = std::chrono::nanoseconds(33333333);
+        auto next = std::chrono::steady_clock::now();
+        for(size_t i = 0; !stop; i++) {
+            std::this_thread::sleep_until(next);
+            const auto& au = *gop[i % gop.size()];
+            video.write(au.data(), au.size());
+            video.poll();
+            videoBytes += au.size();
+            next += period;
+            // The next frame would already be waiting
+            if(std::chrono::steady_clock::now() > next) lateFrames++;
+        }
+    });
+    auto next = std::chrono::steady_clock::now();
+    auto end = next + std::chrono::seconds(seconds);
+    while(next < end) {
+        std::this_thread::sleep_until(next);
+        next += std::chrono::milliseconds(10);
+        for(auto& t : tracks) {
+            AudioChunk chunk;
+            chunk.owner = t.chunk;
+            chunk.data = t.chunk->data();
+            chunk.size = t.chunk->size();
+            if(recorder.push(t.id, std::move(chunk))) t.bytes += t.chunk->size();
+        }
+    }
+    stop = true;
+    writer.join();
+    video.close();
+    recorder.stop();
+
+    auto stats = video.getStats();
+    printf("video: %.1f MB/s, %lu frames (%lu late), %lu segments, %lu checkpoints (max %.1f ms), %lu errors\n",
+           stats.bytes / 1048576.0 / seconds,
+           (unsigned long)stats.writes,
+           (unsigned long)lateFrames,
+           (unsigned long)stats.segments,
+           (unsigned long)stats.checkpoints,
+           stats.maxCheckpointNs / 1e6,
+           (unsigned long)stats.errors);
+    printLatency("video write", stats.writeLatency, stats.maxWriteNs);
+    recorder.printStats();
+
+    bool ok = stats.errors == 0 && recorder.getStats().writeErrors == 0;
+    ok = checkJoined(video.indexPath(), nullptr, videoBytes) && ok;
+    for(const auto& t : tracks) ok = checkJoined(base + t.name + ".index", &AudioRecorder::updateWavHeader, t.bytes) && ok;
+    return ok ? 0 : 1;
+}
+
+}  // namespace
+
+// ---- Queue handoff ----
+
+// Round trip to a consumer thread and back through two mailboxes, i.e. two handoffs
+static void BM_MailboxPingPong(benchmark::State& state) {
+    FrameMailbox<int> request(8, MailboxPolicy::Block), reply(8, MailboxPolicy::Block);
+    std::thread echo([&] {
+        int v;
+        while(request.waitPop(v, std::chrono::seconds(1))) reply.push(v);
+    });
+    int v = 0;
+    for(auto _ : state) {
+        request.push(v);
+        while(!reply.waitPop(v, std::chrono::seconds(1))) {
+        }
+    }
+    request.close();
+    echo.join();
+}
+BENCHMARK(BM_MailboxPingPong)->UseRealTime();
+
+// Producer-side cost of a latest-wins push while a consumer drains
+static void BM_MailboxLatestWins(benchmark::State& state) {
+    FrameMailbox<std::shared_ptr<int>> mailbox(2, MailboxPolicy::LatestWins);
+    std::atomic<bool> done{false};
+    std::thread consumer([&] {
+        std::shared_ptr<int> v;
+        while(!done) mailbox.waitPop(v, std::chrono::milliseconds(10));
+    });
+    auto item = std::make_shared<int>(1);
+    for(auto _ : state) mailbox.push(item);
+    done = true;
+    consumer.join();
+}
+BENCHMARK(BM_MailboxLatestWins);
+
+// submit() to the first converted result for an identity conversion, per worker count
+static void BM_ConversionPoolHandoff(benchmark::State& state) {
+    ConversionPool<int, int> pool([](const int& v) { return v; }, state.range(0));
+    int out;
+    for(auto _ : state) {
+        pool.submit(1);
+        while(!pool.waitGet(out, std::chrono::seconds(1))) {
+        }
+    }
+}
+BENCHMARK(BM_ConversionPoolHandoff)->ArgName("workers")->Arg(0)->Arg(1)->UseRealTime();
+
+// One video frame plus ToF and PDAF messages matched into a bundle
+static void BM_StreamSync(benchmark::State& state) {
+    StreamSync<int> sync(3, std::chrono::milliseconds(10));
+    StreamSync<int>::Bundle bundle;
+    int64_t ts = 0;
+    for(auto _ : state) {
+        ts += 33333333;
+        sync.push(1, ts - 2000000, 1);
+        sync.push(2, ts + 1000000, 2);
+        sync.push(0, ts, 0);
+        while(sync.tryPop(bundle)) benchmark::DoNotOptimize(bundle.mask);
+    }
+}
+BENCHMARK(BM_StreamSync);
+
+static void BM_PipelineMetricsStamp(benchmark::State& state) {
+    PipelineMetrics metrics;
+    int stage = metrics.addStage("bench");
+    auto captured = std::chrono::steady_clock::now();
+    for(auto _ : state) metrics.stamp(stage, captured);
+}
+BENCHMARK(BM_PipelineMetricsStamp);
+
+int main(int argc, char** argv) {
+    // Our own flags go first, the rest is for the benchmark library
+    std::vector<char*> args;
+    int shmSubscribers = 0;
+    int shmFps = 60;
+    int multiDevices = 0;
+    int multiFps = 30;
+    int schedHogs = 0;
+    std::string threadSpec = "rt";
+    int recordSeconds = 0;
+    std::string recordDir = "/tmp";
+    bool recordDirect = false;
+    for(int i = 0; i < argc; i++) {
+        if(std::strncmp(argv[i], "--capture=", 10) == 0) {
+            _capture = std::make_shared<CaptureReader>();
+            if(!_capture->open(argv[i] + 10)) return 1;
+        } else if(std::strncmp(argv[i], "--shm-fanout=", 13) == 0) {
+            shmSubscribers = std::max(1, std::atoi(argv[i] + 13));
+        } else if(std::strncmp(argv[i], "--shm-fps=", 10) == 0) {
+            shmFps = std::max(1, std::atoi(argv[i] + 10));
+        } else if(std::strncmp(argv[i], "--multi=", 8) == 0) {
+            multiDevices = std::max(1, std::atoi(argv[i] + 8));
+        } else if(std::strncmp(argv[i], "--multi-fps=", 12) == 0) {
+            multiFps = std::max(1, std::atoi(argv[i] + 12));
+        } else if(std::strncmp(argv[i], "--sched-hogs=", 13) == 0) {
+            schedHogs = std::max(1, std::atoi(argv[i] + 13));
+        } else if(std::strncmp(argv[i], "--threads=", 10) == 0) {
+            threadSpec = argv[i] + 10;
+        } else if(std::strncmp(argv[i], "--record-soak=", 14) == 0) {
+            recordSeconds = std::max(1, std::atoi(argv[i] + 14));
+        } else if(std::strncmp(argv[i], "--record-dir=", 13) == 0) {
+            recordDir = argv[i] + 13;
+        } else if(std::strcmp(argv[i], "--record-direct") == 0) {
+            recordDirect = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if(shmSubscribers) return runShmFanout(shmSubscribers, shmFps);
+    if(multiDevices) return runMultiDevice(multiDevices, multiFps);
+    if(schedHogs) return runSchedLatency(schedHogs, threadSpec);
+    if(recordSeconds) return runRecordSoak(recordSeconds, recordDir, recordDirect);
+    int count = static_cast<int>(args.size());
+    benchmark::Initialize(&count, args.data());
+    if(benchmark::ReportUnrecognizedArguments(count, args.data())) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -1,3 +1,4 @@
+#include <future>
 #include <iostream>
 
 // Includes common necessary includes for development using depthai library
@@ -5,19 +6,83 @@
 #include "depthai/pipeline/node/UVC.hpp"
 #include <depthai/pipeline/node/UAC.hpp>
 
+#include "CaptureDai.hpp"
+#include "ControlInput.hpp"
+#include "ControlScheduler.hpp"
+#include "ConversionPool.hpp"
+#include "FramePool.hpp"
+#include "FrameSink.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineMetrics.hpp"
+#include "PreviewFrame.hpp"
+#include "QueueNotifier.hpp"
+#include "RoiController.hpp"
+#include "StartupProfiler.hpp"
+#include "StreamLoss.hpp"
+#include "ThreadPolicy.hpp"
+#include "VideoMuxer.hpp"
+
 std::shared_ptr<dai::Device> _device;
 std::shared_ptr<dai::DataOutputQueue> _videoQueue;
 int videoCallbackId = -1;
 std::shared_ptr<dai::DataInputQueue> _controlQueue;
+// Camera commands merge here and go out at most once per frame, from the callback or the loop
+ControlScheduler _cameraControls(std::chrono::microseconds(1000000 / 30));
+
+// Runtime crop of the 4K ISP output before the resize; at most one config is sent per frame
+std::shared_ptr<dai::DataInputQueue> _manipConfigQueue;
+RoiController _roi(3840, 2160, 1920, 1080);
+
+// Device-encoded full-resolution video, muxed to disk as it arrives
+std::shared_ptr<dai::DataOutputQueue> _encodedQueue;
+VideoMuxer _muxer;
+
+// Converted preview plus the frame's capture time, for latency accounting
+struct PreviewImage {
+    cv::Mat bgr;
+    std::chrono::steady_clock::time_point captured;
+};
+
+// Display only ever needs the newest frame: the callback hands over the ImgFrame and the
+// NV12 -> BGR conversion runs on demand in the pool, frames the UI loop skips are never converted
+std::unique_ptr<ConversionPool<std::shared_ptr<dai::ImgFrame>, PreviewImage>> _previewConverter;
+
+// Headless mode: frames go straight from the callback to the sink, no conversion or GUI
+std::unique_ptr<FrameSink> _sink;
+// Optional fan-out of every video frame to other processes, in either mode
+std::unique_ptr<FrameSink> _publisher;
+
+// Time from launch to the first frame of each stream, by phase
+StartupProfiler _startup;
+int _startupVideo = -1;
+int _startupEncoded = -1;
+
+// Capture -> callback -> converted -> displayed latency of the video stream
+PipelineMetrics _metrics;
+int _stageCallback = _metrics.addStage("video.callback");
+int _stageConverted = _metrics.addStage("video.converted");
+int _stageDisplayed = _metrics.addStage("video.displayed");
+int _stageSink = _metrics.addStage("video.sink");
 
-std::queue<cv::Mat> _previewQueue;
-std::mutex _queueMtx;
+// Sequence gaps of the video and encoded streams; both are consumed in their callbacks, so
+// all loss shows up as device drops
+LossMonitor _loss;
+int _videoLoss = _loss.addStream("video", 3);
+int _encodedLoss = _loss.addStream("enc", 30);
+
+// Time spent inside the XLink callback, to compare inline conversion against the pool
+std::atomic<uint64_t> _callbackNs{0};
+std::atomic<uint64_t> _callbackFrames{0};
 
 bool _isStreaming = false;
 
-dai::Pipeline getMainPipeline(bool enableUVC, bool enableUAC) {
+// With `encodePath` set, the camera's video output is also encoded on the device and the muxer
+// opened for it; `enablePreview` false drops the 1080p NV12 stream for encode-only recording
+// `ok` is false if a host-side output of the pipeline (the encoded video file) can't be opened
+dai::Pipeline getMainPipeline(bool enableUVC, bool enableUAC, bool enablePreview, const std::string& encodePath, VideoCodec codec, bool& ok) {
     // Create pipeline
     dai::Pipeline pipeline;
+    ok = true;
     // Define source and output
     auto camRgb = pipeline.create<dai::node::ColorCamera>();
     camRgb->setImageOrientation(dai::CameraImageOrientation::ROTATE_180_DEG);
@@ -66,7 +131,19 @@ dai::Pipeline getMainPipeline(bool enableUVC, bool enableUAC) {
 
         imageManipConfig->out.link(imageManip->inputConfig);
         camRgb->isp.link(imageManip->inputImage);
-        imageManip->out.link(xoutVideo->input);
+        if (enablePreview) imageManip->out.link(xoutVideo->input);
+    }
+
+    if (!encodePath.empty()) {
+        auto videoEnc = pipeline.create<dai::node::VideoEncoder>();
+        videoEnc->setDefaultProfilePreset(camRgb->getFps(), encoderProfile(codec));
+        // A keyframe per second, the muxer starts its clusters on them
+        videoEnc->setKeyframeFrequency(static_cast<int>(camRgb->getFps()));
+        auto xoutEnc = pipeline.create<dai::node::XLinkOut>();
+        xoutEnc->setStreamName("enc");
+        camRgb->video.link(videoEnc->input);
+        videoEnc->bitstream.link(xoutEnc->input);
+        if (!_muxer.open(encodePath, codec, camRgb->getVideoWidth(), camRgb->getVideoHeight(), camRgb->getFps())) ok = false;
     }
     return pipeline;
 }
@@ -74,11 +151,29 @@ dai::Pipeline getMainPipeline(bool enableUVC, bool enableUAC) {
 void addVideoQueueCallback() {
     if(_videoQueue != nullptr && videoCallbackId == -1) {
         auto videoCallback = [](std::shared_ptr<dai::ADatatype> data) {
+            ThreadPolicy::global().enter(ThreadRole::Capture, "video-cb");
+            auto t0 = std::chrono::steady_clock::now();
             if (auto videoFrame = std::dynamic_pointer_cast<dai::ImgFrame>(data)) {
+                _metrics.stamp(_stageCallback, videoFrame->getTimestamp());
+                _startup.firstFrame(_startupVideo);
+                _loss.arrived(_videoLoss, videoFrame->getSequenceNum(), videoFrame->packet->length);
+                _loss.consumed(_videoLoss, videoFrame->getSequenceNum());
+                _roi.onFrame(payloadSize(*videoFrame));
+                trackCameraControl(_cameraControls, *videoFrame);
+                sendCameraControl(_cameraControls, *_controlQueue);
+                Roi roi;
+                if (_manipConfigQueue && _roi.takePending(roi)) _manipConfigQueue->send(manipConfig(roi));
 //                printf("new frame: %d x %d\n", videoFrame->getWidth(), videoFrame->getHeight());
-                std::unique_lock<std::mutex> lock(_queueMtx);
-                _previewQueue.push(videoFrame->getCvFrame());
+                if (_publisher) _publisher->consume(sinkFrame("video", videoFrame));
+                if (_sink) {
+                    if (_sink->consume(sinkFrame("video", videoFrame))) _metrics.stamp(_stageSink, videoFrame->getTimestamp());
+                } else {
+                    _previewConverter->submit(std::move(videoFrame));
+                }
             }
+            auto t1 = std::chrono::steady_clock::now();
+            _callbackNs += std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            _callbackFrames++;
         };
         videoCallbackId = _videoQueue->addCallback(videoCallback);
         printf("Callback added\n");
@@ -93,63 +188,231 @@ void removeVideoQueueCallback() {
     }
 }
 
+// "roi <x> <y> <w> <h> [<outW> <outH>]" in normalized coordinates, or "roi reset"
+bool handleRoiCommand(const std::string& command) {
+    if (command.compare(0, 4, "roi ") != 0) return false;
+    float x, y, w, h;
+    int outW = 0, outH = 0;
+    if (command == "roi reset") {
+        _roi.reset();
+    } else if (sscanf(command.c_str() + 4, "%f %f %f %f %d %d", &x, &y, &w, &h, &outW, &outH) >= 4) {
+        _roi.setRoi(x, y, w, h, outW, outH);
+    } else {
+        printf("Usage: roi <x> <y> <w> <h> [<outW> <outH>] | roi reset\n");
+    }
+    return true;
+}
+
 int main(int argc, char** argv) {
     bool enableUVC = false;
     bool enableUAC = true;
-    auto pipeline = getMainPipeline(enableUVC, enableUAC);
-    // Connect to device and start pipeline
+    // Arguments, in any order:
+    //   <n>             number of conversion workers, 0 converts inline on the callback thread
+    //   headless        no window; frames go to the sink, keys come from stdin / the control socket
+    //   sink=<spec>     headless sink: null (default), file:<path> or shm:<name>
+    //   publish=<name>  also publish video frames to the shared-memory ring <name>, e.g. /camera
+    //   encode=<file>   record device-encoded 4K video to a Matroska file (.mkv); headless without
+    //                   sink= it is the only video stream sent to the host
+    //   codec=<codec>   h265 (default), h264 or mjpeg
+    //   control=<path>  also read commands from a UNIX socket, e.g. `echo q | nc -U <path>`
+    //   threads=<spec>  CPUs and priorities per thread role, e.g. rt or audio:fifo=30:cpus=3 (see ThreadPolicy.hpp)
+    int convertWorkers = 1;
+    bool headless = false;
+    std::string sinkSpec = "null";
+    std::string controlSocket;
+    std::string publishName;
+    std::string encodePath;
+    VideoCodec codec = VideoCodec::H265;
+    bool sinkGiven = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "headless") {
+            headless = true;
+        } else if (arg.compare(0, 5, "sink=") == 0) {
+            sinkSpec = arg.substr(5);
+            sinkGiven = true;
+        } else if (arg.compare(0, 8, "control=") == 0) {
+            controlSocket = arg.substr(8);
+        } else if (arg.compare(0, 7, "encode=") == 0) {
+            encodePath = arg.substr(7);
+        } else if (arg.compare(0, 6, "codec=") == 0) {
+            if (!parseVideoCodec(arg.substr(6), codec)) printf("Unknown codec %s, using %s\n", arg.c_str() + 6, videoCodecName(codec));
+        } else if (arg.compare(0, 8, "publish=") == 0) {
+            publishName = arg.substr(8);
+        } else if (arg.compare(0, 8, "threads=") == 0) {
+            if (!ThreadPolicy::global().configure(arg.substr(8))) return 1;
+        } else if (!arg.empty() && std::isdigit(static_cast<unsigned char>(arg[0]))) {
+            convertWorkers = std::max(0, std::atoi(arg.c_str()));
+        } else {
+            printf("Unrecognized argument: %s\n", arg.c_str());
+        }
+    }
+    ThreadPolicy::global().enter(ThreadRole::Ui, "ui");
+    if (headless) {
+        _sink = makeFrameSink(sinkSpec);
+        if (!_sink) return 1;
+    }
+    if (!publishName.empty()) {
+        _publisher = makeFrameSink("shm:" + publishName);
+        if (!_publisher) return 1;
+    }
+    // Wakes the headless loop on commands; with a window, waitGet() already bounds the latency
+    QueueNotifier notifier;
+    int controlSource = notifier.addSource();
+    ControlInput controls;
+    controls.setOnCommand([&notifier, controlSource]() { notifier.notify(controlSource); });
+    if ((headless || !controlSocket.empty()) && !controls.start(headless, controlSocket)) return 1;
+    // Recycle frame-sized cv::Mat buffers across frames instead of malloc/free per frame
+    auto& framePool = FramePool::installAsDefault(128 << 20);
+    _previewConverter.reset(new ConversionPool<std::shared_ptr<dai::ImgFrame>, PreviewImage>(
+        [](const std::shared_ptr<dai::ImgFrame>& frame) {
+            PreviewImage image{getPreviewFrame(frame, cv::Size(1280, 720)), frame->getTimestamp()};
+            _metrics.stamp(_stageConverted, image.captured);
+            return image;
+        },
+        convertWorkers));
+    bool enablePreview = !(headless && !encodePath.empty() && !sinkGiven && publishName.empty());
+    if (enablePreview && !enableUVC) _startupVideo = _startup.addStream("video");
+    if (!encodePath.empty()) _startupEncoded = _startup.addStream("enc");
+    // The device boots (firmware upload, seconds) while the pipeline is built on the host
     auto config = dai::Device::Config();
     config.board.uvcEnable = enableUVC;
     printf("=== Creating device with board config...\n");
-    _device = std::make_shared<dai::Device>(config);
+    auto booting = std::async(std::launch::async, [config]() {
+        StartupPhase phase(_startup, "device.boot");
+        return std::make_shared<dai::Device>(config);
+    });
+    int buildPhase = _startup.begin("pipeline.build");
+    bool pipelineOk = false;
+    auto pipeline = getMainPipeline(enableUVC, enableUAC, enablePreview, encodePath, codec, pipelineOk);
+    _startup.end(buildPhase);
+    // The device future waits for the boot to finish, so the device is closed cleanly
+    if (!pipelineOk) return 1;
+    {
+        StartupPhase phase(_startup, "pipeline.serialize");
+        PipelineCache pipelineCache;
+        std::string configKey = std::string("test-app") + (enableUVC ? " uvc" : "") + (enableUAC ? " uac" : "") + (enablePreview ? " preview" : "") +
+                                (encodePath.empty() ? "" : std::string(" encode ") + videoCodecName(codec));
+        cachePipeline(pipelineCache, configKey, pipeline);
+    }
+    _device = booting.get();
     printf("=== Device created, connected cameras:\n");
     for (const auto& s : _device->getCameraSensorNames()) {
         std::cout << "  > " << s.first << " : " << s.second << "\n";
     }
     printf("Starting pipeline...\n");
+    int uploadPhase = _startup.begin("pipeline.upload");
     _device->startPipeline(pipeline);
+    _startup.end(uploadPhase);
     printf("=== Started!\n");
     _isStreaming = true;
     _videoQueue = _device->getOutputQueue("video", 3, false);
     _controlQueue = _device->getInputQueue("control", 1, false);
+    if (!enableUVC) _manipConfigQueue = _device->getInputQueue("manipConfigQueue", 1, false);
+    if (!encodePath.empty()) {
+        // Blocking: a bitstream packet lost on the host corrupts the video up to the next keyframe.
+        // The callback only enqueues on the muxer, so it doesn't hold the queue up.
+        _encodedQueue = _device->getOutputQueue("enc", 30, true);
+        _encodedQueue->addCallback([](std::shared_ptr<dai::ADatatype> data) {
+            ThreadPolicy::global().enter(ThreadRole::Capture, "enc-cb");
+            if (auto frame = std::dynamic_pointer_cast<dai::ImgFrame>(data)) {
+                _startup.firstFrame(_startupEncoded);
+                _loss.arrived(_encodedLoss, frame->getSequenceNum(), frame->packet->length);
+                _loss.consumed(_encodedLoss, frame->getSequenceNum());
+                muxFrame(_muxer, frame);
+            }
+        });
+        printf("Recording %s video to %s\n", videoCodecName(codec), encodePath.c_str());
+    }
 
     addVideoQueueCallback();
-    cv::namedWindow("video", cv::WINDOW_NORMAL);
-    cv::resizeWindow("video", 1280, 720);
+    if (!headless) {
+        cv::namedWindow("video", cv::WINDOW_NORMAL);
+        cv::resizeWindow("video", 1280, 720);
+    } else {
+        printf("Headless, sink %s. Commands on stdin: s = start/stop streaming, +/- = zoom, ijkl = pan, r = reset, \"roi x y w h\", q = quit\n", sinkSpec.c_str());
+    }
 
     while(true) {
-        cv::Mat previewFrame;
-        {
-        std::unique_lock<std::mutex> lock(_queueMtx);
-            if (!_previewQueue.empty()) {
-                previewFrame = _previewQueue.front();
-                _previewQueue.pop();
+        int key = -1;
+        if (headless) {
+            // Nothing to do here but commands and stats, the callback feeds the sink
+            notifier.wait(std::min<std::chrono::steady_clock::duration>(std::chrono::seconds(1), _cameraControls.nextDue()));
+        } else {
+            // Blocks until a converted frame is ready; the timeout keeps GUI events flowing without one
+            PreviewImage preview;
+            if (_previewConverter->waitGet(preview, std::chrono::milliseconds(20))) {
+                cv::imshow("video", preview.bgr);
+                _metrics.stamp(_stageDisplayed, preview.captured);
             }
+            key = cv::waitKey(1);
         }
-        if (!previewFrame.empty()) {
-            cv::imshow("video", previewFrame);
-        }
+        // Commands still go out while streaming is stopped and no callbacks run
+        sendCameraControl(_cameraControls, *_controlQueue);
+        _startup.printWhenStarted();
+        _metrics.printEvery(std::chrono::seconds(5));
 
-        int key = cv::waitKey(1);
+        std::string command;
+        if (key < 0 && controls.poll(command) && !handleRoiCommand(command)) key = command[0];
         if(key == 'q') {
+            removeVideoQueueCallback();
             if (_device->isPipelineRunning()) {
                 _device->close();
             }
+            controls.stop();
+            if (!encodePath.empty()) {
+                _muxer.close();
+                _muxer.printStats("Encoded video");
+            }
+            _previewConverter->stop();
+            if (_sink) {
+                _sink->close();
+                _sink->printStats(("Sink " + sinkSpec).c_str());
+            }
+            if (_publisher) {
+                _publisher->close();
+                _publisher->printStats(("Published to " + publishName).c_str());
+            }
+            auto stats = _previewConverter->getStats();
+            printf("Preview: %lu frames received, %lu converted, %lu skipped unconverted, %lu converted but not shown\n",
+                   (unsigned long)stats.submitted, (unsigned long)stats.converted, (unsigned long)stats.skipped, (unsigned long)stats.stale);
+            if (_callbackFrames > 0) {
+                printf("Callback thread: %.1f us per frame (%d conversion workers)\n",
+                       _callbackNs / 1000.0 / _callbackFrames, convertWorkers);
+            }
+            _roi.printStats("ROI");
+            _cameraControls.printStats("Camera control");
+            if (!_startup.allStreamsStarted()) _startup.print();
+            _loss.printStats();
+            framePool.printStats("Frame pool");
+            ThreadPolicy::global().printStats();
+            _metrics.printSummary();
             break;
         } else if(key == 's') {
-            dai::CameraControl ctrl;
+            CameraCommand cmd;
             if (_isStreaming) {
-                ctrl.setStopStreaming();
+                cmd.streaming = CameraCommand::Streaming::Stop;
                 removeVideoQueueCallback();
+                _previewConverter->clear();
                 printf("Stopped video streaming\n");
             } else {
-                ctrl.setStartStreaming();
-                ctrl.setAutoFocusMode(dai::CameraControl::AutoFocusMode::CONTINUOUS_VIDEO);
+                cmd.streaming = CameraCommand::Streaming::Start;
+                cmd.autoFocusMode = static_cast<int>(dai::CameraControl::AutoFocusMode::CONTINUOUS_VIDEO);
                 addVideoQueueCallback();
                 printf("Started video streaming\n");
             }
             _isStreaming = !_isStreaming;
-            _controlQueue->send(ctrl);
+            _cameraControls.submit(cmd);
+        } else if (key == '+' || key == '=') {  // Digital zoom
+            _roi.zoom(1.25f);
+        } else if (key == '-') {
+            _roi.zoom(0.8f);
+        } else if (key == 'i' || key == 'k') {  // Pan
+            _roi.pan(0, key == 'i' ? -0.1f : 0.1f);
+        } else if (key == 'j' || key == 'l') {
+            _roi.pan(key == 'j' ? -0.1f : 0.1f, 0);
+        } else if (key == 'r') {
+            _roi.reset();
         }
     }
     return 0;
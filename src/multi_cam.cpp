@@ -0,0 +1,165 @@
+#include <future>
+#include <iostream>
+
+#include "depthai/depthai.hpp"
+
+#include "CaptureDai.hpp"
+#include "ControlInput.hpp"
+#include "DeviceOrchestrator.hpp"
+#include "FramePool.hpp"
+#include "FrameSink.hpp"
+#include "QueueNotifier.hpp"
+#include "StreamLoss.hpp"
+#include "ThreadPolicy.hpp"
+
+// Host side of several devices in one process: every connected device gets the same pipeline
+// (4K ISP scaled to 1080p NV12 on the device), its own worker thread pinned to a CPU, and a
+// share of one sink. Headless; commands on stdin or the control socket, `q` quits.
+// Arguments, in any order:
+//   <n>             use at most n devices (default: all connected)
+//   sink=<spec>     sink shared by all devices: null (default), file:<path> or shm:<name>;
+//                   streams are named <device>.video, e.g. cam0.video
+//   control=<path>  also read commands from a UNIX socket, e.g. `echo q | nc -U <path>`
+//   nopin           don't pin the per-device workers to CPUs
+//   threads=<spec>  CPUs and priorities per thread role, e.g. rt or capture:fifo=20 (see
+//                   ThreadPolicy.hpp); with nopin the worker role's CPUs apply to all workers
+//
+// `host-bench --multi=<n>` runs the same orchestration on synthetic devices, to measure the
+// host CPU each added stream costs without the cameras.
+
+dai::Pipeline getDevicePipeline(int fps) {
+    dai::Pipeline pipeline;
+    auto camRgb = pipeline.create<dai::node::ColorCamera>();
+    camRgb->setResolution(dai::ColorCameraProperties::SensorResolution::THE_4_K);
+    camRgb->initialControl.setAntiBandingMode(dai::CameraControl::AntiBandingMode::MAINS_50_HZ);
+    camRgb->setFps(fps);
+    camRgb->setInterleaved(false);
+
+    auto imageManip = pipeline.create<dai::node::ImageManip>();
+    imageManip->setMaxOutputFrameSize(1920 * 1080 * 3 / 2);
+    imageManip->inputImage.setBlocking(false);
+    imageManip->inputImage.setQueueSize(1);
+    imageManip->initialConfig.setResize(1920, 1080);
+    imageManip->initialConfig.setFrameType(dai::ImgFrame::Type::NV12);
+    camRgb->isp.link(imageManip->inputImage);
+
+    auto xoutVideo = pipeline.create<dai::node::XLinkOut>();
+    xoutVideo->setStreamName("video");
+    xoutVideo->input.setBlocking(false);
+    xoutVideo->input.setQueueSize(1);
+    imageManip->out.link(xoutVideo->input);
+    return pipeline;
+}
+
+int main(int argc, char** argv) {
+    int maxDevices = 0;
+    std::string sinkSpec = "null";
+    std::string controlSocket;
+    bool pin = true;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 5, "sink=") == 0) {
+            sinkSpec = arg.substr(5);
+        } else if (arg.compare(0, 8, "control=") == 0) {
+            controlSocket = arg.substr(8);
+        } else if (arg == "nopin") {
+            pin = false;
+        } else if (arg.compare(0, 8, "threads=") == 0) {
+            if (!ThreadPolicy::global().configure(arg.substr(8))) return 1;
+        } else if (!arg.empty() && std::isdigit(static_cast<unsigned char>(arg[0]))) {
+            maxDevices = std::max(0, std::atoi(arg.c_str()));
+        } else {
+            printf("Unrecognized argument: %s\n", arg.c_str());
+        }
+    }
+
+    ThreadPolicy::global().enter(ThreadRole::Ui, "main");
+
+    auto infos = dai::Device::getAllAvailableDevices();
+    if (maxDevices > 0 && static_cast<int>(infos.size()) > maxDevices) infos.resize(maxDevices);
+    if (infos.empty()) {
+        printf("No devices found\n");
+        return 1;
+    }
+
+    // One pool and one sink for all devices
+    auto& framePool = FramePool::installAsDefault(256 << 20);
+    auto sink = makeFrameSink(sinkSpec);
+    if (!sink) return 1;
+
+    // Booting takes seconds per device, do it for all of them at once
+    printf("=== Starting %d devices...\n", static_cast<int>(infos.size()));
+    auto pipeline = getDevicePipeline(30);
+    std::vector<std::future<std::shared_ptr<dai::Device>>> booting;
+    for (const auto& info : infos) {
+        booting.push_back(std::async(std::launch::async, [&pipeline, info]() { return std::make_shared<dai::Device>(pipeline, info); }));
+    }
+    std::vector<std::shared_ptr<dai::Device>> devices;
+    for (size_t i = 0; i < booting.size(); i++) {
+        try {
+            devices.push_back(booting[i].get());
+            printf("  > cam%d : %s\n", static_cast<int>(devices.size()) - 1, infos[i].getMxId().c_str());
+        } catch (const std::exception& e) {
+            printf("  > %s failed: %s\n", infos[i].getMxId().c_str(), e.what());
+        }
+    }
+    if (devices.empty()) return 1;
+
+    DeviceOrchestrator orchestrator(sink.get());
+    LossMonitor loss;
+    // Register every device and stream before the first callback: the callbacks index into
+    // both, and adding to them isn't safe while frames arrive
+    std::vector<int> ids, streams;
+    for (size_t i = 0; i < devices.size(); i++) {
+        std::string name = "cam" + std::to_string(i);
+        ids.push_back(orchestrator.addDevice(name, pin ? DeviceOrchestrator::spreadCpu(static_cast<int>(i)) : -1));
+        streams.push_back(loss.addStream(name + ".video", 1));
+    }
+    std::vector<std::shared_ptr<dai::DataOutputQueue>> queues;
+    for (size_t i = 0; i < devices.size(); i++) {
+        int id = ids[i];
+        int stream = streams[i];
+        auto queue = devices[i]->getOutputQueue("video", 1, false);
+        // The XLink thread of each device only hands the frame over; the sink runs on the worker
+        std::string threadName = "cam" + std::to_string(i) + "-xlink";
+        queue->addCallback([&orchestrator, &loss, id, stream, threadName](std::shared_ptr<dai::ADatatype> data) {
+            ThreadPolicy::global().enter(ThreadRole::Capture, threadName.c_str());
+            if (auto frame = std::dynamic_pointer_cast<dai::ImgFrame>(data)) {
+                loss.arrived(stream, frame->getSequenceNum(), frame->packet->length);
+                loss.consumed(stream, frame->getSequenceNum());
+                orchestrator.submit(id, sinkFrame("video", frame));
+            }
+        });
+        queues.push_back(queue);
+    }
+    orchestrator.start();
+
+    QueueNotifier notifier;
+    int controlSource = notifier.addSource();
+    ControlInput controls;
+    controls.setOnCommand([&notifier, controlSource]() { notifier.notify(controlSource); });
+    if (!controls.start(true, controlSocket)) return 1;
+    printf("=== %d devices running, sink %s. q = quit\n", static_cast<int>(devices.size()), sinkSpec.c_str());
+
+    auto nextStats = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (true) {
+        notifier.wait(std::chrono::seconds(1));
+        if (std::chrono::steady_clock::now() >= nextStats) {
+            nextStats += std::chrono::seconds(5);
+            orchestrator.printStats();
+        }
+        int key = controls.pollKey();
+        if (key == 'q' || key == 'Q') break;
+    }
+
+    controls.stop();
+    for (auto& device : devices) device->close();
+    orchestrator.stop();
+    sink->close();
+    orchestrator.printStats();
+    loss.printStats();
+    sink->printStats(("Sink " + sinkSpec).c_str());
+    framePool.printStats("Frame pool");
+    ThreadPolicy::global().printStats();
+    return 0;
+}
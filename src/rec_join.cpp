@@ -0,0 +1,43 @@
+#include <cstdio>
+#include <string>
+
+#include "AudioRecorder.hpp"
+#include "SegmentedFile.hpp"
+
+// Joins a segmented recording back into one file:
+//   rec-join <file>.index <out>
+// Works on the index of a recording that was still going, e.g. after a crash: every segment
+// contributes what its last checkpoint made durable.
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: %s <recording>.index <out>\n", argv[0]);
+        return 1;
+    }
+    SegmentIndex index;
+    if (!SegmentedFile::readIndex(argv[1], index)) {
+        printf("Cannot read index %s\n", argv[1]);
+        return 1;
+    }
+    SegmentedFile::HeaderUpdate update;
+    if (index.format == "wav") {
+        update = &AudioRecorder::updateWavHeader;
+    } else if (index.format != "raw") {
+        printf("Unknown format %s in %s\n", index.format.c_str(), argv[1]);
+        return 1;
+    }
+
+    uint64_t total = 0;
+    size_t incomplete = 0;
+    for (const auto& segment : index.segments) {
+        total += segment.dataBytes;
+        if (!segment.complete) incomplete++;
+    }
+    if (!SegmentedFile::concatenate(argv[1], argv[2], update)) return 1;
+    printf("%s: %zu segments, %.2f MB%s\n",
+           argv[2],
+           index.segments.size(),
+           total / 1048576.0,
+           incomplete ? " (recording was not closed, up to its last checkpoint)" : "");
+    return 0;
+}
@@ -1,10 +1,46 @@
+#include <cstdlib>
+#include <future>
 #include <iostream>
-#include <fstream>
 
 // Includes common necessary includes for development using depthai library
 #include "depthai/depthai.hpp"
-
-// Pass the argument `uvc` to run in UVC mode
+#include "AudioRecorder.hpp"
+#include "AudioTap.hpp"
+#include "AudioTimeline.hpp"
+#include "CaptureDai.hpp"
+#include "ControlInput.hpp"
+#include "ControlScheduler.hpp"
+#include "DepthColorizer.hpp"
+#include "DetectionTracker.hpp"
+#include "FramePool.hpp"
+#include "FrameSink.hpp"
+#include "PdafDecoder.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineMetrics.hpp"
+#include "PreviewFrame.hpp"
+#include "QueueNotifier.hpp"
+#include "StartupProfiler.hpp"
+#include "StreamLoss.hpp"
+#include "StreamSync.hpp"
+#include "ThreadPolicy.hpp"
+#include "VideoMuxer.hpp"
+
+// Pass the argument `uvc` to run in UVC mode (or `tof`, `mic`, `micnc`). Further arguments:
+//   record=<file>   record all host-bound streams to a capture file, for offline replay
+//   headless        no windows; frames go to the sink, keys come from stdin / the control socket
+//   sink=<spec>     headless sink: null (default), file:<path> or shm:<name>
+//   control=<path>  also read commands from a UNIX socket, e.g. `echo q | nc -U <path>`
+//   encode=<file>   record device-encoded video to a Matroska file (.mkv); headless without
+//                   sink= the raw video stream is not sent to the host at all
+//   codec=<codec>   h265 (default), h264 or mjpeg
+//   qdepth=<min>:<max>  host queue depth adapted per stream to its drops and bursts, instead
+//                   of a fixed 8; loss per stream (device / host) is printed on quit either way
+//   threads=<spec>  CPUs and priorities per thread role, e.g. rt or audio:fifo=30:cpus=3 (see
+//                   ThreadPolicy.hpp); the main loop polls the device queues, so it is capture
+//   segment=<s>     split the audio files into complete WAV files of that many seconds, listed
+//                   in <file>.index; `rec-join <file>.index <out>` joins them again. Recordings
+//                   are checkpointed every second either way, so a crash loses at most that
+//   odirect         write the audio files with O_DIRECT instead of through the page cache
 
 static int clamp(int num, int v0, int v1) {
     return std::max(v0, std::min(num, v1));
@@ -21,21 +57,81 @@ int main(int argc, char** argv) {
     bool downscale = 1;
     bool getPdaf = 0;
     int audioSampleSize = 2; // 2, 3, 4. Note: must be 2 for NC
-    if(argc > 1) {
-        if (std::string(argv[1]) == "uvc") {
+    bool headless = false;
+    std::string capturePath;
+    std::string sinkSpec = "null";
+    std::string controlSocket;
+    std::string encodePath;
+    VideoCodec codec = VideoCodec::H265;
+    bool sinkGiven = false;
+    int qsize = 8;
+    int qsizeMax = 8;
+    RecordingOptions recording;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "uvc") {
             enableUVC = 1;
-        } else if (std::string(argv[1]) == "tof") {
+        } else if (arg == "tof") {
             enableToF = 1;
-        } else if (std::string(argv[1]) == "mic") {
+        } else if (arg == "mic") {
             enableMic = 1;
-        } else if (std::string(argv[1]) == "micnc") {
+        } else if (arg == "micnc") {
             enableMic = 1;
             enableMicNc = 1;
             audioSampleSize = 2;
+        } else if (arg == "headless") {
+            headless = true;
+        } else if (arg.compare(0, 7, "record=") == 0) {
+            capturePath = arg.substr(7);
+        } else if (arg.compare(0, 5, "sink=") == 0) {
+            sinkSpec = arg.substr(5);
+            sinkGiven = true;
+        } else if (arg.compare(0, 8, "control=") == 0) {
+            controlSocket = arg.substr(8);
+        } else if (arg.compare(0, 7, "encode=") == 0) {
+            encodePath = arg.substr(7);
+        } else if (arg.compare(0, 6, "codec=") == 0) {
+            if (!parseVideoCodec(arg.substr(6), codec)) printf("Unknown codec %s, using %s\n", arg.c_str() + 6, videoCodecName(codec));
+        } else if (arg.compare(0, 7, "qdepth=") == 0) {
+            if (sscanf(arg.c_str() + 7, "%d:%d", &qsize, &qsizeMax) != 2 || qsize < 1 || qsizeMax < qsize) {
+                printf("Bad %s, expected qdepth=<min>:<max>\n", arg.c_str());
+                return 1;
+            }
+        } else if (arg.compare(0, 8, "threads=") == 0) {
+            if (!ThreadPolicy::global().configure(arg.substr(8))) return 1;
+        } else if (arg.compare(0, 8, "segment=") == 0) {
+            recording.segmentMs = static_cast<int64_t>(std::atof(arg.c_str() + 8) * 1000);
+        } else if (arg == "odirect") {
+            recording.direct = true;
         } else {
-            printf("Unrecognized argument: %s\n", argv[1]);
+            printf("Unrecognized argument: %s\n", arg.c_str());
         }
     }
+    ThreadPolicy::global().enter(ThreadRole::Capture, "main");
+    // Headless: everything the windows would show goes to the sink instead, unconverted
+    std::unique_ptr<FrameSink> sink;
+    if (headless) {
+        sink = makeFrameSink(sinkSpec);
+        if (!sink) return 1;
+    }
+    bool enableEncoder = !encodePath.empty();
+    // Nothing on the host needs the raw video when only the encoded stream is recorded
+    bool videoToHost = !enableUVC && !(headless && enableEncoder && !sinkGiven);
+
+    // Recycle frame-sized cv::Mat buffers (preview, ToF colormap) across frames and streams
+    auto& framePool = FramePool::installAsDefault(128 << 20);
+
+    // Time from launch to the first frame of each stream, by phase. The device boots (firmware
+    // upload, seconds) while the pipeline is built on the host.
+    StartupProfiler startup;
+    auto config = dai::Device::Config();
+    config.board.uvcEnable = enableUVC;
+    printf("=== Creating device with board config...\n");
+    auto booting = std::async(std::launch::async, [config, &startup]() {
+        StartupPhase phase(startup, "device.boot");
+        return std::make_shared<dai::Device>(config);
+    });
+    int buildPhase = startup.begin("pipeline.build");
 
     // Create pipeline
     dai::Pipeline pipeline;
@@ -74,10 +170,23 @@ int main(int argc, char** argv) {
         uvc->setGpiosOnStreamOn({{58,1}, {37,1}, {34,1}});
         uvc->setGpiosOnStreamOff({{58,0}, {37,0}, {34,0}});
         //camRgb->video.link(xoutVideo->input); // Could actually keep this as well
-    } else {
+    } else if (videoToHost) {
         camRgb->video.link(xoutVideo->input);
     }
 
+    // Encoded on the device, muxed on the host without re-encoding
+    VideoMuxer muxer;
+    if (enableEncoder) {
+        auto videoEnc = pipeline.create<dai::node::VideoEncoder>();
+        auto xoutEnc = pipeline.create<dai::node::XLinkOut>();
+        xoutEnc->setStreamName("enc");
+        videoEnc->setDefaultProfilePreset(camRgb->getFps(), encoderProfile(codec));
+        videoEnc->setKeyframeFrequency(static_cast<int>(camRgb->getFps()));  // clusters start on keyframes
+        camRgb->video.link(videoEnc->input);
+        videoEnc->bitstream.link(xoutEnc->input);
+        if (!muxer.open(encodePath, codec, camRgb->getVideoWidth(), camRgb->getVideoHeight(), camRgb->getFps())) return 1;
+    }
+
     bool pdafMode8x6 = true; // default: false (16x12)
     if (getPdaf) {
         auto xoutRaw = pipeline.create<dai::node::XLinkOut>();
@@ -101,9 +210,53 @@ int main(int argc, char** argv) {
         tof->out.link(xoutToF->input);
     }
 
-    std::ofstream fAudio;
-    std::ofstream fAudioBack;
-    std::ofstream fAudioNc;
+    // Capture file: streams are registered up front, messages are appended without copying
+    CaptureWriter capture;
+    bool enableCapture = !capturePath.empty() && capture.open(capturePath);
+    auto captureStream = [&](const char* name, bool enabled) { return enableCapture && enabled ? capture.addStream(name) : -1; };
+    int videoCapture = captureStream("video", videoToHost);
+    int encCapture = captureStream("enc", enableEncoder);
+    int rawCapture = captureStream("raw", getPdaf);
+    int tofCapture = captureStream("tof", enableToF);
+    int micCapture = captureStream("mic", enableMic);
+    int micBackCapture = captureStream("micBack", enableMic);
+    int micNcCapture = captureStream("micNc", enableMicNc);
+    int nnCapture = captureStream("nn", enableNN);
+    auto captureTo = [&capture](int stream) {
+        return [&capture, stream](const std::shared_ptr<dai::ImgFrame>& packet, const uint8_t* data, size_t bytes) {
+            captureFrame(capture, stream, packet, data, bytes);
+        };
+    };
+    auto sinkTo = [&sink](const char* stream) {
+        return [&sink, stream](const std::shared_ptr<dai::ImgFrame>& packet, const uint8_t* data, size_t bytes) {
+            sink->consume(sinkFrame(stream, packet, data, bytes));
+        };
+    };
+
+    // Audio is written to WAV files by the recorder thread, the loop below only enqueues packets.
+    // Each stream goes through a tap specialized for its sample size and channel count.
+    AudioRecorder recorder(512, recording);
+    std::unique_ptr<AudioTapBase<dai::ImgFrame>> micTap, micBackTap, micNcTap;
+    // Packets are put back in sequence order by a timeline per stream, which fills lost packets
+    // with silence, so the files stay aligned with the device clock (and the video) however many
+    // packets the queues drop. Zero-copy: the recorder keeps the packet alive until it is written.
+    std::vector<std::pair<std::string, std::unique_ptr<AudioTimeline>>> timelines;
+    auto recordTo = [&recorder, &timelines, audioSampleSize](const char* path, int sampleRate, int channels) {
+        int track = recorder.addTrack(path, sampleRate, channels, audioSampleSize);
+        int frameBytes = channels * audioSampleSize;
+        timelines.emplace_back(path, std::unique_ptr<AudioTimeline>(new AudioTimeline(sampleRate, frameBytes, 8, [&recorder, track](AudioChunk chunk) {
+            recorder.push(track, std::move(chunk));
+        })));
+        AudioTimeline* timeline = timelines.back().second.get();
+        return [timeline, frameBytes](const std::shared_ptr<dai::ImgFrame>& packet, const uint8_t* data, size_t bytes) {
+            AudioChunk chunk;
+            chunk.owner = packet;
+            chunk.data = data;
+            chunk.size = bytes;
+            int64_t ts = std::chrono::duration_cast<std::chrono::nanoseconds>(packet->getTimestampDevice().time_since_epoch()).count();
+            timeline->push(packet->getSequenceNum(), ts, bytes / frameBytes, std::move(chunk));
+        };
+    };
     int gain_dB = 30;
     if (enableMic) {
         auto uac = pipeline.create<dai::node::UAC>();
@@ -144,15 +297,30 @@ int main(int argc, char** argv) {
             procCfgIn->setStreamName("procCfg");
             procCfgIn->out.link(audioProc->inputConfig);
 
-            fAudioNc.open("audioNc.raw", std::ios::trunc | std::ios::binary);
+            micNcTap = makeAudioTap<dai::ImgFrame>(audioSampleSize, 2);
+            micNcTap->setPayloadBytes(&payloadSize);
+            micNcTap->addRawSink(recordTo("audioNc.wav", 16000, 2));
+            if (micNcCapture >= 0) micNcTap->addRawSink(captureTo(micNcCapture));
+            if (sink) micNcTap->addRawSink(sinkTo("micNc"));
         } else {
             mic->out.link(uac->input);
         }
 
         mic->initialConfig.setMicGainDecibels(gain_dB);
 
-        fAudio.open("audio.raw", std::ios::trunc | std::ios::binary);
-        fAudioBack.open("audioBack.raw", std::ios::trunc | std::ios::binary);
+        micTap = makeAudioTap<dai::ImgFrame>(audioSampleSize, 2);
+        micTap->setPayloadBytes(&payloadSize);
+        micTap->addRawSink(recordTo("audio.wav", 48000, 2));
+        micBackTap = makeAudioTap<dai::ImgFrame>(audioSampleSize, 1);
+        micBackTap->setPayloadBytes(&payloadSize);
+        micBackTap->addRawSink(recordTo("audioBack.wav", 48000, 1));
+        if (micCapture >= 0) micTap->addRawSink(captureTo(micCapture));
+        if (micBackCapture >= 0) micBackTap->addRawSink(captureTo(micBackCapture));
+        if (sink) {
+            micTap->addRawSink(sinkTo("mic"));
+            micBackTap->addRawSink(sinkTo("micBack"));
+        }
+        recorder.start();
     }
 
     if (enableNN) {
@@ -177,43 +345,125 @@ int main(int argc, char** argv) {
         nn->out.link(nnOut->input);
     }
 
+    startup.end(buildPhase);
+    {
+        StartupPhase phase(startup, "pipeline.serialize");
+        PipelineCache pipelineCache;
+        std::string configKey = "rgb-video uvc=" + std::to_string(enableUVC) + " tof=" + std::to_string(enableToF) + " mic=" + std::to_string(enableMic) +
+                                " micnc=" + std::to_string(enableMicNc) + " nn=" + std::to_string(enableNN) + " pdaf=" + std::to_string(getPdaf) +
+                                " video=" + std::to_string(videoToHost) + " sample=" + std::to_string(audioSampleSize) +
+                                (enableEncoder ? std::string(" encode=") + videoCodecName(codec) : "");
+        cachePipeline(pipelineCache, configKey, pipeline);
+    }
+
     // Connect to device and start pipeline
-    auto config = dai::Device::Config();
-    config.board.uvcEnable = enableUVC;
-    printf("=== Creating device with board config...\n");
-    dai::Device device(config);
+    auto device = booting.get();
     printf("=== Device created, connected cameras:\n");
-    for (auto s : device.getCameraSensorNames()) {
+    for (auto s : device->getCameraSensorNames()) {
         std::cout << "  > " << s.first << " : " << s.second << "\n";
     }
     printf("Starting pipeline...\n");
-    device.startPipeline(pipeline);
+    int uploadPhase = startup.begin("pipeline.upload");
+    device->startPipeline(pipeline);
+    startup.end(uploadPhase);
     printf("=== Started!\n");
     if (enableUVC) printf(">>> Keep this running, and open a separate UVC viewer\n");
 
-    int qsize = 8;
     bool blocking = false;
-    auto video = device.getOutputQueue("video", qsize, blocking);
-
-    auto raw = getPdaf ? device.getOutputQueue("raw", qsize, blocking) : nullptr;
-    auto depth = enableToF ? device.getOutputQueue("tof", qsize, blocking) : nullptr;
-    auto audio = enableMic ? device.getOutputQueue("mic", qsize, blocking) : nullptr;
-    auto audioBack = enableMic ? device.getOutputQueue("micBack", qsize, blocking) : nullptr;
-    auto audioNc = enableMicNc ? device.getOutputQueue("micNc", qsize, blocking) : nullptr;
-    auto nn = enableNN ? device.getOutputQueue("nn", qsize, blocking) : nullptr;
-
-    auto micCfgQ = enableMic ? device.getInputQueue("micCfg") : nullptr;
-    auto procCfgQ = enableMicNc ? device.getInputQueue("procCfg") : nullptr;
-
-    auto controlQueue = device.getInputQueue("control");
+    auto video = device->getOutputQueue("video", qsize, blocking);
+
+    auto raw = getPdaf ? device->getOutputQueue("raw", qsize, blocking) : nullptr;
+    auto depth = enableToF ? device->getOutputQueue("tof", qsize, blocking) : nullptr;
+    auto audio = enableMic ? device->getOutputQueue("mic", qsize, blocking) : nullptr;
+    auto audioBack = enableMic ? device->getOutputQueue("micBack", qsize, blocking) : nullptr;
+    auto audioNc = enableMicNc ? device->getOutputQueue("micNc", qsize, blocking) : nullptr;
+    auto nn = enableNN ? device->getOutputQueue("nn", qsize, blocking) : nullptr;
+    // Blocking: a bitstream packet lost on the host corrupts the video up to the next keyframe
+    auto encoded = enableEncoder ? device->getOutputQueue("enc", 30, true) : nullptr;
+
+    // Sequence gaps per stream, split into device and host drops; non-blocking queues start at
+    // the minimum depth and grow while the loop can't keep up
+    LossMonitor loss;
+    auto lossStream = [&](const char* name, const std::shared_ptr<dai::DataOutputQueue>& queue, int minDepth, int maxDepth) {
+        if (!queue) return -1;
+        int stream = loss.addStream(name, minDepth, minDepth, maxDepth);
+        watchLoss(loss, stream, queue);
+        return stream;
+    };
+    int videoLoss = lossStream("video", video, qsize, qsizeMax);
+    int rawLoss = lossStream("raw", raw, qsize, qsizeMax);
+    int tofLoss = lossStream("tof", depth, qsize, qsizeMax);
+    int micLoss = lossStream("mic", audio, qsize, qsizeMax);
+    int micBackLoss = lossStream("micBack", audioBack, qsize, qsizeMax);
+    int micNcLoss = lossStream("micNc", audioNc, qsize, qsizeMax);
+    int nnLoss = lossStream("nn", nn, qsize, qsizeMax);
+    int encLoss = lossStream("enc", encoded, 30, 30);
+    int videoStartup = video && videoToHost ? startup.addStream("video") : -1;
+    int rawStartup = raw ? startup.addStream("raw") : -1;
+    int tofStartup = depth ? startup.addStream("tof") : -1;
+    int micStartup = audio ? startup.addStream("mic") : -1;
+    int encStartup = encoded ? startup.addStream("enc") : -1;
+    auto adaptQueues = [&]() {
+        adaptQueue(loss, videoLoss, video);
+        adaptQueue(loss, rawLoss, raw);
+        adaptQueue(loss, tofLoss, depth);
+        adaptQueue(loss, micLoss, audio);
+        adaptQueue(loss, micBackLoss, audioBack);
+        adaptQueue(loss, micNcLoss, audioNc);
+        adaptQueue(loss, nnLoss, nn);
+    };
+
+    auto micCfgQ = enableMic ? device->getInputQueue("micCfg") : nullptr;
+    auto procCfgQ = enableMicNc ? device->getInputQueue("procCfg") : nullptr;
+
+    auto controlQueue = device->getInputQueue("control");
+    // Focus / streaming changes are merged and sent at most once per frame
+    ControlScheduler cameraControls(std::chrono::microseconds(1000000 / 30));
 
     int lensPos = 150;
     int lensMin = 0;
     int lensMax = 255;
 
     using namespace std::chrono;
-    auto tprev = steady_clock::now();
-    int count = 0;
+
+    // Latency from capture (device timestamp on the host clock) to each stage, summarized every 5 s
+    PipelineMetrics metrics;
+    int videoReceived = metrics.addStage("video.received");
+    int videoShown = metrics.addStage("video.displayed");
+    int tofReceived = metrics.addStage("tof.received");
+    int tofShown = metrics.addStage("tof.displayed");
+    int rawReceived = metrics.addStage("raw.received");
+    int rawDecoded = metrics.addStage("raw.decoded");
+    int micReceived = metrics.addStage("mic.received");
+    int videoSunk = metrics.addStage("video.sink");
+    int tofSunk = metrics.addStage("tof.sink");
+
+    // Single-pass LUT colorizer with a temporally smoothed range, reuses its output buffer
+    DepthColorizer depthColorizer;
+
+    // PDAF grid is decoded into the same buffers every frame
+    PdafGrid pdafGrid;
+    PdafFocusMetric focusMetric;
+
+    // Detections are thresholded, NMS-filtered and tracked in batches of whatever arrived since
+    // the last pass, then drawn on the video frame with the same sequence number
+    DetectionTracker detections;
+    DetectionBatch nnBatch;
+
+    // Video, ToF and PDAF are matched by device timestamp and handled as one bundle, so the
+    // depth map and PDAF grid shown with a video frame are the ones captured with it. The first
+    // enabled stream drives the bundles. Frames without a match within 10 ms (sensors that
+    // aren't hardware-synced, other frame rates) come out on their own and are shown, sunk and
+    // decoded all the same. Audio is recorded as it comes and doesn't go through here.
+    int numSync = 0;
+    int videoSync = videoToHost ? numSync++ : -1;
+    int tofSync = enableToF ? numSync++ : -1;
+    int rawSync = getPdaf ? numSync++ : -1;
+    StreamSync<std::shared_ptr<dai::ImgFrame>> frameSync(std::max(numSync, 1), milliseconds(10));
+    StreamSync<std::shared_ptr<dai::ImgFrame>>::Bundle bundle;
+    auto syncFrame = [&frameSync](int stream, const std::shared_ptr<dai::ImgFrame>& frame) {
+        frameSync.push(stream, duration_cast<nanoseconds>(frame->getTimestampDevice().time_since_epoch()).count(), frame);
+    };
 
     bool muted = false;
     bool disableOutput = false;
@@ -227,187 +477,208 @@ int main(int argc, char** argv) {
     dai::AudioInConfig procConfig;
     procConfig.setPassthrough(passthrough);
 
+    // The loop sleeps until any output queue has data instead of polling, and pumps GUI events
+    // right after showing something or at least every GUI_INTERVAL. Headless, only queues and
+    // control commands wake it.
+    QueueNotifier notifier;
+    for (auto& q : {video, raw, depth, audio, audioBack, audioNc, nn, encoded}) notifier.watch(q);
+    const auto GUI_INTERVAL = headless ? seconds(1) : milliseconds(20);
+    auto nextGui = steady_clock::now();
+
+    int controlSource = notifier.addSource();
+    ControlInput controls;
+    controls.setOnCommand([&notifier, controlSource]() { notifier.notify(controlSource); });
+    if ((headless || !controlSocket.empty()) && !controls.start(headless, controlSocket)) return 1;
+    if (headless) printf("Headless, sink %s. Commands on stdin, same keys as the windows\n", sinkSpec.c_str());
+
     while(true) {
-        auto videoIn = video->tryGet<dai::ImgFrame>();
+        auto now = steady_clock::now();
+        auto timeout = std::min(nextGui > now ? nextGui - now : steady_clock::duration::zero(), cameraControls.nextDue(now));
+        notifier.wait(timeout);
+        bool shown = false;
+
         if (0) { // focus sweep test
             static int dir_step = 3;
             lensPos += dir_step;
             if (lensPos > 255 || lensPos < 0) dir_step *= -1;
             lensPos = clamp(lensPos, 0, 255);
             printf("Setting manual focus, lens position: %d\n", lensPos);
-            dai::CameraControl ctrl;
-            ctrl.setManualFocus(lensPos);
-            controlQueue->send(ctrl);
+            CameraCommand cmd;
+            cmd.lensPosition = lensPos;
+            cameraControls.submit(cmd);
         }
-
-        if (1) { // FPS calc
-            auto tnow = steady_clock::now();
-            count++;
-            auto tdiff = duration<double>(tnow - tprev).count();
-            if (tdiff >= 1) {
-                double fps = count / tdiff;
-                // printf("FPS: %.3f\n", fps);
-                count = 0;
-                tprev = tnow;
-            }
+        sendCameraControl(cameraControls, *controlQueue);
+
+        startup.printWhenStarted();
+        metrics.printEvery(seconds(5));
+        adaptQueues();
+
+        while (auto videoIn = video->tryGet<dai::ImgFrame>()) {
+            metrics.stamp(videoReceived, videoIn->getTimestamp());
+            loss.consumed(videoLoss, videoIn->getSequenceNum());
+            startup.firstFrame(videoStartup);
+            trackCameraControl(cameraControls, *videoIn);
+            if (videoCapture >= 0) captureFrame(capture, videoCapture, videoIn);
+            syncFrame(videoSync, videoIn);
         }
-
         if (getPdaf) {
-            auto rawIn = raw->tryGet<dai::ImgFrame>();
-            if (rawIn) {
+            while (auto rawIn = raw->tryGet<dai::ImgFrame>()) {
+                metrics.stamp(rawReceived, rawIn->getTimestamp());
+                loss.consumed(rawLoss, rawIn->getSequenceNum());
+                startup.firstFrame(rawStartup);
                 // Due to zero-copy, we can't use `rawIn->getData()`
+                if (rawCapture >= 0) captureFrame(capture, rawCapture, rawIn, rawIn->packet->data, payloadSize(*rawIn));
+                syncFrame(rawSync, rawIn);
+            }
+        }
+        if (enableToF) {
+            while (auto depthIn = depth->tryGet<dai::ImgFrame>()) {
+                metrics.stamp(tofReceived, depthIn->getTimestamp());
+                loss.consumed(tofLoss, depthIn->getSequenceNum());
+                startup.firstFrame(tofStartup);
+                if (tofCapture >= 0) captureFrame(capture, tofCapture, depthIn);
+                syncFrame(tofSync, depthIn);
+            }
+        }
+        if (enableNN) {
+            nnBatch.clear();
+            while (auto nnIn = nn->tryGet<dai::ImgDetections>()) {
+                loss.consumed(nnLoss, nnIn->getSequenceNum());
+                if (nnCapture >= 0) captureDetections(capture, nnCapture, nnIn);
+                addDetections(nnBatch, *nnIn);
+            }
+            if (nnBatch.frames() > 0) detections.process(nnBatch);
+        }
+
+        while (frameSync.tryPop(bundle)) {
+            if (rawSync >= 0 && bundle.has(rawSync)) {
+                auto& rawIn = bundle.items[rawSync];
                 uint8_t *pdaf = rawIn->packet->data;
-                uint32_t size = rawIn->packet->length; // note: this includes variable-size ImgFrame metadata!
-
-                int k = 0; // offset into the packet
-                int flex_mask =  pdaf[k];
-                int area_mode = pdafMode8x6;//(pdaf[k+1] >> 4) & 0x3; // FIXME why automatic not working?
-                // printf("\nPDAF sensor data, flexible ROI bitmask 0x%02x, mode %d, [CONF]valPx\n",
-                //         flex_mask, area_mode);
-                k += 5; // skip over header
-                k += 5; // skip over first window (always invalid?)
-
-                int w = (area_mode == 0) ? 16 : 8;
-                int h = (area_mode == 0) ? 12 : 6;
-
-                for (int i = 0; i < h; i++) {
-                    // printf("%2d:", i);
-                    // Note we have 16 windows per 'row', skipping over the invalid ones
-                    for (int j = 0; j < 16/*!!!*/; j++) {
-                        if (j < w) {
-                            int conf = pdaf[k] << 3
-                                       | ((pdaf[k+1] >> 3) & 0x7);
-                            int tmp  = ((pdaf[k+1] & 0x3) << 8)
-                                       | ( pdaf[k+2] & 0xC0)
-                                       | ((pdaf[k+2] & 0x0F) << 2)
-                                       | ( pdaf[k+3] >> 6);
-                            if (pdaf[k+1] & (1 << 2)) tmp |= 0xFC00; // sign, extended to 16 bit
-                            float pd = (int16_t)tmp; // reinterpret (signed)
-                            pd /= 16; // 4 subpixel bits
-                            // printf(" [%4d]%8.4f", conf, pd);
-                        }
-                        k += 5;
-                    }
-                    // printf("\n");
+                // Without the ImgFrame metadata, so a short payload is rejected rather than decoded from it
+                size_t size = payloadSize(*rawIn);
+                // FIXME mode from the header, (pdaf[1] >> 4) & 0x3, doesn't work, use the configured one
+                auto mode = pdafMode8x6 ? PdafMode::Grid8x6 : PdafMode::Grid16x12;
+                bool decoded = decodePdaf(pdaf, size, mode, pdafGrid);
+                metrics.stamp(rawDecoded, rawIn->getTimestamp());
+                if (decoded && focusMetric.update(pdafGrid, lensPos)) {
+                    // printf("PDAF defocus %8.4f, confidence %6.1f, estimated lens position %d\n",
+                    //         focusMetric.defocus(), focusMetric.confidence(), focusMetric.estimateLensPosition(lensMin, lensMax));
                 }
             }
-        }
 
-        // Get BGR frame from NV12 encoded video frame to show with opencv
-        // Visualizing the frame on slower hosts might have overhead
-        if (videoIn) cv::imshow("video", videoIn->getCvFrame());
+            if (sink) {
+                if (videoSync >= 0 && bundle.has(videoSync) && sink->consume(sinkFrame("video", bundle.items[videoSync]))) {
+                    metrics.stamp(videoSunk, bundle.items[videoSync]->getTimestamp());
+                }
+                if (tofSync >= 0 && bundle.has(tofSync) && sink->consume(sinkFrame("tof", bundle.items[tofSync]))) {
+                    metrics.stamp(tofSunk, bundle.items[tofSync]->getTimestamp());
+                }
+                continue;
+            }
+
+            // Get BGR frame from NV12 encoded video frame to show with opencv, converted
+            // straight to preview size so the full-resolution BGR image is never built
+            if (videoSync >= 0 && bundle.has(videoSync)) {
+                cv::Mat preview = getPreviewFrame(bundle.items[videoSync], cv::Size(1280, 720));
+                if (enableNN) {
+                    // Inference trails the video; without results for this frame, show the newest of the last few
+                    if (auto found = detections.attach(bundle.items[videoSync]->getSequenceNum(), 5)) drawDetections(preview, *found);
+                }
+                cv::imshow("video", preview);
+                metrics.stamp(videoShown, bundle.items[videoSync]->getTimestamp());
+                shown = true;
+            }
 
-        if (enableToF) {
-            auto depthIn = depth->tryGet<dai::ImgFrame>();
-            if (depthIn) {
-                auto depthFrm = depthIn->getFrame();
-                cv::Mat norm;
-                cv::normalize(depthFrm, norm, 255, 0, cv::NORM_MINMAX, CV_8UC1);
-                cv::applyColorMap(norm, norm, cv::COLORMAP_JET);
-                cv::imshow("tof-depth", norm);
+            if (tofSync >= 0 && bundle.has(tofSync)) {
+                auto depthFrm = bundle.items[tofSync]->getFrame();
+                cv::imshow("tof-depth", depthColorizer.colorize(depthFrm));
+                metrics.stamp(tofShown, bundle.items[tofSync]->getTimestamp());
+                shown = true;
             }
         }
 
-        if (enableNN) {
-            auto nnIn = nn->tryGet<dai::ImgDetections>();
-            if (nnIn) {
-                printf("Got NN results\n");
+        if (enableEncoder) {
+            while (auto encIn = encoded->tryGet<dai::ImgFrame>()) {
+                loss.consumed(encLoss, encIn->getSequenceNum());
+                startup.firstFrame(encStartup);
+                if (encCapture >= 0) captureFrame(capture, encCapture, encIn, encIn->packet->data, payloadSize(*encIn));
+                muxFrame(muxer, encIn);
             }
         }
 
         if (enableMic) {
-            // Main/front mics - 2x 48kHz
-            auto audioIn = audio->tryGet<dai::ImgFrame>();
-            if (audioIn) {
-#if 0 // works without zero-copy
-                auto audioData = audioIn->getData();
-                printf("MIC      seq %ld, data size %lu, samples %d, mics %d\n",
-                        audioIn->getSequenceNum(),
-                        audioData.size(),
-                        audioIn->getHeight(),
-                        audioIn->getWidth() );
-                fAudio.write((char*)&audioData[0], audioData.size());
-#else // with zero-copy
-                uint8_t *audioData = audioIn->packet->data;
-                // uint32_t size = audioIn->packet->length; // not ok, includes metadata
-                uint32_t size = audioSampleSize * audioIn->getHeight() * audioIn->getWidth();
-                printf("MIC      seq %ld, data size %u, samples %d, mics %d\n",
-                       audioIn->getSequenceNum(),
-                       size,
-                       audioIn->getHeight(),
-                       audioIn->getWidth() );
-                fAudio.write((char*)audioData, size);
-#endif
+            // Main/front mics - 2x 48kHz, back mic - 1x 48kHz
+            while (auto audioIn = audio->tryGet<dai::ImgFrame>()) {
+                metrics.stamp(micReceived, audioIn->getTimestamp());
+                loss.consumed(micLoss, audioIn->getSequenceNum());
+                startup.firstFrame(micStartup);
+                micTap->process(audioIn);
             }
-
-            // Back mic - 1x 48kHz
-            audioIn = audioBack->tryGet<dai::ImgFrame>();
-            if (audioIn) {
-#if 0 // works without zero-copy
-                auto audioData = audioIn->getData();
-                printf("MIC-back seq %ld, data size %lu, samples %d, mics %d\n",
-                        audioIn->getSequenceNum(),
-                        audioData.size(),
-                        audioIn->getHeight(),
-                        audioIn->getWidth() );
-                fAudio.write((char*)&audioData[0], audioData.size());
-#else // with zero-copy
-                uint8_t *audioData = audioIn->packet->data;
-                // uint32_t size = audioIn->packet->length; // not ok, includes metadata
-                uint32_t size = audioSampleSize * audioIn->getHeight() * audioIn->getWidth();
-                printf("MIC-back seq %ld, data size %u, samples %d, mics %d\n",
-                       audioIn->getSequenceNum(),
-                       size,
-                       audioIn->getHeight(),
-                       audioIn->getWidth() );
-                fAudioBack.write((char*)audioData, size);
-#endif
+            while (auto audioIn = audioBack->tryGet<dai::ImgFrame>()) {
+                loss.consumed(micBackLoss, audioIn->getSequenceNum());
+                micBackTap->process(audioIn);
             }
 
             if (enableMicNc) {
                 // AudioProc output (with noise cancelation) - 2x 16kHz
-                audioIn = audioNc->tryGet<dai::ImgFrame>();
-                if (audioIn) {
-#if 0 // works without zero-copy
-                    auto audioData = audioIn->getData();
-                printf("MIC-NC   seq %ld, data size %lu, samples %d, mics %d\n",
-                        audioIn->getSequenceNum(),
-                        audioData.size(),
-                        audioIn->getHeight(),
-                        audioIn->getWidth() );
-                fAudio.write((char*)&audioData[0], audioData.size());
-#else // with zero-copy
-                    uint8_t *audioData = audioIn->packet->data;
-                    // uint32_t size = audioIn->packet->length; // not ok, includes metadata
-                    uint32_t size = audioSampleSize * audioIn->getHeight() * audioIn->getWidth();
-                    printf("MIC-NC   seq %ld, data size %u, samples %d, mics %d\n",
-                           audioIn->getSequenceNum(),
-                           size,
-                           audioIn->getHeight(),
-                           audioIn->getWidth() );
-                    fAudioNc.write((char*)audioData, size);
-#endif
+                while (auto audioIn = audioNc->tryGet<dai::ImgFrame>()) {
+                    loss.consumed(micNcLoss, audioIn->getSequenceNum());
+                    micNcTap->process(audioIn);
                 }
             }
         }
 
-
-        int key = cv::waitKey(10);
+        int key = controls.pollKey();
+        if (!headless && key < 0) {
+            if (!shown && steady_clock::now() < nextGui) continue;
+            nextGui = steady_clock::now() + GUI_INTERVAL;
+            key = cv::waitKey(1);
+        } else if (headless && steady_clock::now() >= nextGui) {
+            nextGui = steady_clock::now() + GUI_INTERVAL;
+        }
         if(key == 'q' || key == 'Q') {
+            controls.stop();
+            for (auto& timeline : timelines) timeline.second->flush();
+            recorder.stop();
+            if (enableEncoder) {
+                muxer.close();
+                muxer.printStats("Encoded video");
+            }
+            if (sink) {
+                sink->close();
+                sink->printStats(("Sink " + sinkSpec).c_str());
+            }
+            if (enableMic) recorder.printStats();
+            for (auto& timeline : timelines) timeline.second->printStats(timeline.first.c_str());
+            // All streams run off the device clock; the NC output is resampled to 16 kHz on the device
+            for (size_t i = 1; i < timelines.size(); i++) {
+                printf("Audio drift %s vs %s: %+.2f ms\n", timelines[i].first.c_str(), timelines[0].first.c_str(),
+                       AudioTimeline::driftMs(*timelines[i].second, *timelines[0].second));
+            }
+            capture.close();
+            if (enableCapture) capture.printStats();
+            if (numSync > 1) frameSync.printStats("Frame sync");
+            if (enableNN) detections.printStats("Detections");
+            framePool.printStats("Frame pool");
+            cameraControls.printStats("Camera control");
+            if (!startup.allStreamsStarted()) startup.print();
+            loss.printStats();
+            ThreadPolicy::global().printStats();
+            metrics.printSummary();
             return 0;
         } else if(key == 'x') {
             static bool running = true;
             running = !running;
 
-            dai::CameraControl ctrl;
+            CameraCommand cmd;
             if (running) {
                 printf("cam stop\n");
-                ctrl.setStopStreaming();
+                cmd.streaming = CameraCommand::Streaming::Stop;
             } else {
                 printf("cam start\n");
-                ctrl.setStartStreaming();
+                cmd.streaming = CameraCommand::Streaming::Start;
             }
-            controlQueue->send(ctrl);
+            cameraControls.submit(cmd);
         } else if (key == 'm') {  // Mute / unmute
             muted = !muted;
             printf("Audio control: %s\n", muted ? "mute" : "unmute");
@@ -446,23 +717,23 @@ int main(int argc, char** argv) {
             //     controlQueue->send(ctrl);
         } else if(key == 't') {
             printf("Autofocus trigger (and disable continuous)\n");
-            dai::CameraControl ctrl;
-            ctrl.setAutoFocusMode(dai::CameraControl::AutoFocusMode::AUTO);
-            ctrl.setAutoFocusTrigger();
-            controlQueue->send(ctrl);
+            CameraCommand cmd;
+            cmd.autoFocusMode = static_cast<int>(dai::CameraControl::AutoFocusMode::AUTO);
+            cmd.autoFocusTrigger = true;
+            cameraControls.submit(cmd);
         } else if(key == 'f') {
             printf("Autofocus enable, continuous\n");
-            dai::CameraControl ctrl;
-            ctrl.setAutoFocusMode(dai::CameraControl::AutoFocusMode::CONTINUOUS_VIDEO);
-            controlQueue->send(ctrl);
+            CameraCommand cmd;
+            cmd.autoFocusMode = static_cast<int>(dai::CameraControl::AutoFocusMode::CONTINUOUS_VIDEO);
+            cameraControls.submit(cmd);
         } else if(key == ',' || key == '.') {
             if(key == ',') lensPos -= LENS_STEP;
             if(key == '.') lensPos += LENS_STEP;
             lensPos = clamp(lensPos, lensMin, lensMax);
             printf("Setting manual focus, lens position: %d\n", lensPos);
-            dai::CameraControl ctrl;
-            ctrl.setManualFocus(lensPos);
-            controlQueue->send(ctrl);
+            CameraCommand cmd;
+            cmd.lensPosition = lensPos;
+            cameraControls.submit(cmd);
         }
     }
     return 0;
@@ -0,0 +1,205 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "AudioSamples.hpp"
+#include "AudioTap.hpp"
+
+namespace {
+
+// ImgFrame-shaped audio packet: getHeight() frames of getWidth() channels at packet->data
+struct TestPayload {
+    std::vector<uint8_t> bytes;
+    uint8_t* data = nullptr;
+    uint32_t length = 0;  // payload and trailer
+};
+struct TestPacket {
+    std::shared_ptr<TestPayload> packet = std::make_shared<TestPayload>();
+    int width = 0;
+    int height = 0;
+    int getWidth() const {
+        return width;
+    }
+    int getHeight() const {
+        return height;
+    }
+};
+
+constexpr size_t kTrailerBytes = 48;
+constexpr uint8_t kTrailer = 0xA5;
+
+// Known sample values covering the extremes of the sample size
+int64_t sampleValue(int sampleBytes, size_t index) {
+    int64_t max = (int64_t(1) << (8 * sampleBytes - 1)) - 1;
+    int64_t min = -max - 1;
+    switch(index % 5) {
+        case 0:
+            return max;
+        case 1:
+            return min;
+        case 2:
+            return 0;
+        case 3:
+            return -1;
+        default:
+            return (int64_t(index) * 7919 % (2 * max)) - max;
+    }
+}
+
+// Little-endian packed samples followed by metadata-like trailer bytes, as XLink delivers them
+std::shared_ptr<TestPacket> makePacket(int sampleBytes, int channels, int frames) {
+    auto p = std::make_shared<TestPacket>();
+    p->width = channels;
+    p->height = frames;
+    for(size_t i = 0; i < size_t(frames) * channels; i++) {
+        int64_t v = sampleValue(sampleBytes, i);
+        for(int b = 0; b < sampleBytes; b++) p->packet->bytes.push_back(static_cast<uint8_t>(uint64_t(v) >> (8 * b)));
+    }
+    p->packet->bytes.insert(p->packet->bytes.end(), kTrailerBytes, kTrailer);
+    p->packet->data = p->packet->bytes.data();
+    p->packet->length = static_cast<uint32_t>(p->packet->bytes.size());
+    return p;
+}
+
+// Left-justified, see AudioSamples.hpp
+int32_t expectedInt32(int sampleBytes, size_t index) {
+    return static_cast<int32_t>(static_cast<uint32_t>(sampleValue(sampleBytes, index)) << (32 - 8 * sampleBytes));
+}
+
+float expectedFloat(int sampleBytes, size_t index) {
+    return static_cast<float>(expectedInt32(sampleBytes, index)) / 2147483648.0f;
+}
+
+template <int SampleBytes, int Channels>
+void checkTap() {
+    SCOPED_TRACE(testing::Message() << SampleBytes * 8 << "-bit, " << Channels << " channels");
+    const int frames = 37;  // not a multiple of any SIMD width
+    auto packet = makePacket(SampleBytes, Channels, frames);
+    const size_t samples = size_t(frames) * Channels;
+
+    auto tap = makeAudioTap<TestPacket>(SampleBytes, Channels);
+    ASSERT_TRUE(tap);
+    EXPECT_EQ(tap->sampleBytes(), SampleBytes);
+    EXPECT_EQ(tap->channels(), Channels);
+
+    const uint8_t* rawData = nullptr;
+    size_t rawBytes = 0;
+    tap->addRawSink([&](const std::shared_ptr<TestPacket>&, const uint8_t* data, size_t bytes) {
+        rawData = data;
+        rawBytes = bytes;
+    });
+    std::vector<float> floats;
+    tap->addFloatSink([&](const std::shared_ptr<TestPacket>&, const float* s, size_t n, int channels) {
+        EXPECT_EQ(channels, Channels);
+        floats.assign(s, s + n * channels);
+    });
+    auto* typed = dynamic_cast<AudioTap<SampleBytes, Channels, TestPacket>*>(tap.get());
+    ASSERT_TRUE(typed);
+    std::vector<int32_t> ints;
+    typed->addSink([&](const std::shared_ptr<TestPacket>&, AudioSpan<SampleBytes, Channels> span) {
+        ASSERT_EQ(span.frames(), size_t(frames));
+        for(size_t f = 0; f < span.frames(); f++) {
+            for(int c = 0; c < Channels; c++) EXPECT_EQ(span.sample(f, c), expectedInt32(SampleBytes, f * Channels + c));
+        }
+        ints.resize(span.samples());
+        span.toInt32(ints.data());
+    });
+
+    ASSERT_TRUE(tap->process(packet));
+    EXPECT_EQ(tap->packets(), 1u);
+
+    // Zero-copy, and the trailer is not part of the samples
+    EXPECT_EQ(rawData, packet->packet->data);
+    EXPECT_EQ(rawBytes, samples * SampleBytes);
+    EXPECT_EQ(rawData[rawBytes], kTrailer);
+
+    ASSERT_EQ(ints.size(), samples);
+    ASSERT_EQ(floats.size(), samples);
+    for(size_t i = 0; i < samples; i++) {
+        EXPECT_EQ(ints[i], expectedInt32(SampleBytes, i)) << "sample " << i;
+        EXPECT_EQ(floats[i], expectedFloat(SampleBytes, i)) << "sample " << i;
+        EXPECT_GE(floats[i], -1.0f);
+        EXPECT_LE(floats[i], 1.0f);
+    }
+}
+
+// Every count up to a few SIMD widths, with guard values after the output
+template <typename Convert, typename Expected, typename T>
+void checkConversion(int sampleBytes, Convert convert, Expected expected, T guard) {
+    for(size_t count = 0; count <= 40; count++) {
+        auto packet = makePacket(sampleBytes, 1, static_cast<int>(count));
+        std::vector<T> out(count + 4, guard);
+        convert(packet->packet->data, out.data(), count);
+        for(size_t i = 0; i < count; i++) ASSERT_EQ(out[i], expected(sampleBytes, i)) << count << " samples, at " << i;
+        for(size_t i = count; i < out.size(); i++) ASSERT_EQ(out[i], guard) << count << " samples, written past the end";
+    }
+}
+
+}  // namespace
+
+TEST(AudioTap, S16) {
+    checkTap<2, 1>();
+    checkTap<2, 2>();
+}
+
+TEST(AudioTap, S24) {
+    checkTap<3, 1>();
+    checkTap<3, 2>();
+}
+
+TEST(AudioTap, S32) {
+    checkTap<4, 1>();
+    checkTap<4, 2>();
+}
+
+TEST(AudioTap, RejectsMismatchedPackets) {
+    auto tap = makeAudioTap<TestPacket>(2, 2);
+    ASSERT_TRUE(tap);
+    int calls = 0;
+    tap->addRawSink([&](const std::shared_ptr<TestPacket>&, const uint8_t*, size_t) { calls++; });
+    EXPECT_FALSE(tap->process(makePacket(2, 1, 10)));
+    EXPECT_FALSE(tap->process(makePacket(2, 2, 0)));
+    EXPECT_FALSE(tap->process(nullptr));
+    EXPECT_EQ(tap->rejected(), 3u);
+    EXPECT_EQ(tap->packets(), 0u);
+    EXPECT_EQ(calls, 0);
+}
+
+TEST(AudioTap, RejectsShortPackets) {
+    auto tap = makeAudioTap<TestPacket>(2, 2);
+    ASSERT_TRUE(tap);
+    int calls = 0;
+    tap->addRawSink([&](const std::shared_ptr<TestPacket>&, const uint8_t*, size_t) { calls++; });
+
+    // More frames than the whole buffer holds
+    auto packet = makePacket(2, 2, 10);
+    packet->height = 40;
+    EXPECT_FALSE(tap->process(packet));
+    // Within the buffer, but reaching into the trailer: only the exact payload size catches it
+    packet->height = 11;
+    EXPECT_TRUE(tap->process(packet));
+    tap->setPayloadBytes([](const TestPacket& p) { return p.packet->length - kTrailerBytes; });
+    EXPECT_FALSE(tap->process(packet));
+    packet->height = 10;
+    EXPECT_TRUE(tap->process(packet));
+
+    EXPECT_EQ(tap->rejected(), 2u);
+    EXPECT_EQ(tap->packets(), 2u);
+    EXPECT_EQ(calls, 2);
+}
+
+TEST(AudioTap, UnsupportedFormats) {
+    EXPECT_FALSE(makeAudioTap<TestPacket>(1, 2));
+    EXPECT_FALSE(makeAudioTap<TestPacket>(2, 3));
+}
+
+TEST(AudioSamples, ConversionsAllCounts) {
+    checkConversion(2, convertS16ToInt32, expectedInt32, int32_t(0x5A5A5A5A));
+    checkConversion(3, convertS24ToInt32, expectedInt32, int32_t(0x5A5A5A5A));
+    checkConversion(4, convertS32ToInt32, expectedInt32, int32_t(0x5A5A5A5A));
+    checkConversion(2, convertS16ToFloat, expectedFloat, 42.0f);
+    checkConversion(3, convertS24ToFloat, expectedFloat, 42.0f);
+    checkConversion(4, convertS32ToFloat, expectedFloat, 42.0f);
+}
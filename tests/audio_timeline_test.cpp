@@ -0,0 +1,188 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "AudioTimeline.hpp"
+
+namespace {
+
+constexpr int kSampleRate = 48000;
+constexpr int kFrameBytes = 4;
+constexpr size_t kPacketFrames = 480;  // 10 ms
+constexpr int64_t kPacketNs = 10000000;
+constexpr size_t kDepth = 4;
+
+// Emitted audio: the sequence number of a packet, or -1 for a run of silence
+struct Emitted {
+    int64_t sequence;
+    size_t frames;
+
+    bool operator==(const Emitted& other) const {
+        return sequence == other.sequence && frames == other.frames;
+    }
+};
+
+std::ostream& operator<<(std::ostream& os, const Emitted& e) {
+    return os << "{" << e.sequence << ", " << e.frames << "}";
+}
+
+Emitted packet(int64_t sequence) {
+    return {sequence, kPacketFrames};
+}
+Emitted silence(size_t frames) {
+    return {-1, frames};
+}
+
+class AudioTimelineTest : public ::testing::Test {
+   protected:
+    AudioTimeline timeline{kSampleRate, kFrameBytes, kDepth, [this](AudioChunk chunk) { collect(chunk); }};
+    std::vector<Emitted> emitted;
+
+    // Every sample of a packet holds its sequence number + 1, so silence is the only zeros
+    void push(int64_t sequence, int64_t timestampNs) {
+        auto data = std::make_shared<std::vector<uint8_t>>(kPacketFrames * kFrameBytes, static_cast<uint8_t>(sequence % 255 + 1));
+        AudioChunk chunk;
+        chunk.data = data->data();
+        chunk.size = data->size();
+        chunk.owner = data;
+        timeline.push(sequence, timestampNs, kPacketFrames, std::move(chunk));
+    }
+    void push(int64_t sequence) {
+        push(sequence, sequence * kPacketNs);
+    }
+
+   private:
+    void collect(const AudioChunk& chunk) {
+        ASSERT_NE(chunk.data, nullptr);
+        ASSERT_EQ(chunk.size % kFrameBytes, 0u);
+        size_t frames = chunk.size / kFrameBytes;
+        if(chunk.data[0] == 0) {
+            for(size_t i = 0; i < chunk.size; i++) ASSERT_EQ(chunk.data[i], 0);
+            // Silence may come in several chunks; one run is one entry
+            if(!emitted.empty() && emitted.back().sequence < 0) {
+                emitted.back().frames += frames;
+            } else {
+                emitted.push_back(silence(frames));
+            }
+            return;
+        }
+        emitted.push_back({chunk.data[0] - 1, frames});
+    }
+};
+
+}  // namespace
+
+TEST_F(AudioTimelineTest, InOrderPassesThrough) {
+    for(int64_t i = 0; i < 10; i++) {
+        push(i);
+        ASSERT_EQ(emitted.size(), size_t(i + 1)) << "an in-order packet is emitted right away";
+    }
+    for(int64_t i = 0; i < 10; i++) EXPECT_EQ(emitted[i], packet(i));
+    const auto& stats = timeline.stats();
+    EXPECT_EQ(stats.packets, 10u);
+    EXPECT_EQ(stats.frames, 10 * kPacketFrames);
+    EXPECT_EQ(stats.gaps, 0u);
+    EXPECT_NEAR(stats.offsetMs(), 0.0, 0.01);
+}
+
+TEST_F(AudioTimelineTest, GapFilledWithSilenceFromDeviceClock) {
+    // 3 and 4 never arrive, and the device clock says they were 25 ms rather than 20 ms
+    for(int64_t i = 0; i < 3; i++) push(i);
+    for(int64_t i = 5; i < 12; i++) push(i, i * kPacketNs + 5000000);
+    std::vector<Emitted> expected = {packet(0), packet(1), packet(2), silence(25 * kSampleRate / 1000)};
+    for(int64_t i = 5; i < 12; i++) expected.push_back(packet(i));
+    EXPECT_EQ(emitted, expected);
+    EXPECT_EQ(timeline.stats().gaps, 1u);
+    EXPECT_EQ(timeline.stats().silenceFrames, 25u * kSampleRate / 1000);
+    EXPECT_NEAR(timeline.stats().offsetMs(), 0.0, 0.01);
+}
+
+TEST_F(AudioTimelineTest, GapFallsBackToPacketCountWhenClockDisagrees) {
+    // Two packets missing but the timestamps jump by a second: trust the count
+    for(int64_t i = 0; i < 3; i++) push(i);
+    for(int64_t i = 5; i < 12; i++) push(i, i * kPacketNs + 1000000000);
+    ASSERT_GE(emitted.size(), 4u);
+    EXPECT_EQ(emitted[3], silence(2 * kPacketFrames));
+    EXPECT_EQ(emitted[4], packet(5));
+}
+
+TEST_F(AudioTimelineTest, GapGivenUpOnlyAfterDepthPackets) {
+    push(0);
+    push(2);
+    push(3);
+    push(4);
+    EXPECT_EQ(emitted, std::vector<Emitted>{packet(0)}) << "1 may still arrive";
+    push(5);
+    std::vector<Emitted> expected = {packet(0), silence(kPacketFrames), packet(2), packet(3), packet(4), packet(5)};
+    EXPECT_EQ(emitted, expected);
+}
+
+TEST_F(AudioTimelineTest, ReorderedPacketsEmittedInOrder) {
+    push(0);
+    push(2);
+    push(3);
+    push(1);
+    push(5);
+    push(4);
+    std::vector<Emitted> expected;
+    for(int64_t i = 0; i < 6; i++) expected.push_back(packet(i));
+    EXPECT_EQ(emitted, expected);
+    EXPECT_EQ(timeline.stats().reordered, 2u);
+    EXPECT_EQ(timeline.stats().gaps, 0u);
+}
+
+TEST_F(AudioTimelineTest, LateAndDuplicatePacketsDropped) {
+    for(int64_t i = 0; i < 3; i++) push(i);
+    push(1);  // already played out
+    push(4);  // held, waiting for 3
+    push(4);
+    push(3);
+    std::vector<Emitted> expected;
+    for(int64_t i = 0; i < 5; i++) expected.push_back(packet(i));
+    EXPECT_EQ(emitted, expected);
+    EXPECT_EQ(timeline.stats().late, 1u);
+    EXPECT_EQ(timeline.stats().duplicates, 1u);
+    EXPECT_EQ(timeline.stats().frames, 5 * kPacketFrames);
+}
+
+TEST_F(AudioTimelineTest, RestartsAfterBackwardsSequenceJump) {
+    for(int64_t i = 100; i < 110; i++) push(i);
+    push(108);  // a little behind: late, not a restart
+    EXPECT_EQ(timeline.stats().late, 1u);
+    // Far behind: the device restarted its stream, and its timestamps carry on
+    for(int64_t i = 0; i < 3; i++) push(i, (110 + i) * kPacketNs);
+    std::vector<Emitted> expected;
+    for(int64_t i = 100; i < 110; i++) expected.push_back(packet(i));
+    for(int64_t i = 0; i < 3; i++) expected.push_back(packet(i));
+    EXPECT_EQ(emitted, expected);
+    EXPECT_EQ(timeline.stats().late, 1u);
+    EXPECT_EQ(timeline.stats().gaps, 0u);
+}
+
+TEST_F(AudioTimelineTest, RestartFlushesHeldPackets) {
+    for(int64_t i = 100; i < 103; i++) push(i);
+    push(104);  // held, waiting for 103
+    push(0, 105 * kPacketNs);
+    std::vector<Emitted> expected = {packet(100), packet(101), packet(102), silence(kPacketFrames), packet(104), packet(0)};
+    EXPECT_EQ(emitted, expected);
+}
+
+TEST_F(AudioTimelineTest, FlushEmitsHeldPackets) {
+    timeline.flush();
+    EXPECT_TRUE(emitted.empty()) << "nothing pushed yet";
+    push(0);
+    push(2);
+    push(3);
+    EXPECT_EQ(emitted, std::vector<Emitted>{packet(0)});
+    timeline.flush();
+    std::vector<Emitted> expected = {packet(0), silence(kPacketFrames), packet(2), packet(3)};
+    EXPECT_EQ(emitted, expected);
+    timeline.flush();
+    EXPECT_EQ(emitted, expected) << "a second flush has nothing left";
+    // The timeline carries on after a flush
+    push(4);
+    expected.push_back(packet(4));
+    EXPECT_EQ(emitted, expected);
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CaptureFile.hpp"
+
+namespace {
+
+constexpr int kMessages = 20;
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) return data;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    size_t n = fread(data.data(), 1, data.size(), f);
+    fclose(f);
+    data.resize(n);
+    return data;
+}
+
+void writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+
+template <typename T>
+T get(const std::vector<uint8_t>& file, size_t offset) {
+    T value;
+    std::memcpy(&value, file.data() + offset, sizeof(value));
+    return value;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>& file, size_t offset, T value) {
+    std::memcpy(file.data() + offset, &value, sizeof(value));
+}
+
+class CaptureFileTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        _path = ::testing::TempDir() + "capture_file_test_" + std::to_string(getpid()) + ".cap";
+        CaptureWriter writer;
+        ASSERT_TRUE(writer.open(_path));
+        int video = writer.addStream("video");
+        int mic = writer.addStream("mic");
+        for(int i = 0; i < kMessages; i++) {
+            auto payload = std::make_shared<std::vector<uint8_t>>(100 + i * 37, static_cast<uint8_t>(i));
+            CaptureInfo info;
+            info.sequence = i;
+            info.deviceTimestampNs = int64_t(i) * 1000000;
+            ASSERT_TRUE(writer.append(i % 2 ? mic : video, info, payload, payload->data(), payload->size()));
+        }
+        writer.close();
+        _file = readFile(_path);
+        ASSERT_GT(_file.size(), sizeof(capture::FileHeader) + sizeof(capture::Footer));
+    }
+    void TearDown() override {
+        std::remove(_path.c_str());
+        std::remove(_corruptPath.c_str());
+    }
+
+    capture::Footer footer() const {
+        return get<capture::Footer>(_file, _file.size() - sizeof(capture::Footer));
+    }
+    size_t indexEntryOffset(size_t i) const {
+        return footer().indexOffset + i * sizeof(capture::IndexEntry);
+    }
+
+    // Opens a modified copy; every message it hands out must lie inside the file
+    void openCorrupt(const std::vector<uint8_t>& data, CaptureReader& reader) {
+        _corruptPath = _path + ".corrupt";
+        writeFile(_corruptPath, data);
+        ASSERT_TRUE(reader.open(_corruptPath));
+        const uint8_t* begin = reader.mapping().get();
+        const uint8_t* end = begin + data.size();
+        for(size_t i = 0; i < reader.size(); i++) {
+            auto msg = reader.message(i);
+            ASSERT_GE(msg.data, begin);
+            ASSERT_LE(msg.size, size_t(end - msg.data)) << "message " << i;
+            ASSERT_LT(msg.stream, reader.streamCount());
+        }
+    }
+
+    // A corrupt index is ignored and the messages are recovered by scanning
+    void expectRecoveredAll(const std::vector<uint8_t>& data) {
+        CaptureReader reader;
+        openCorrupt(data, reader);
+        EXPECT_TRUE(reader.indexRecovered());
+        ASSERT_EQ(reader.size(), size_t(kMessages));
+        for(int i = 0; i < kMessages; i++) {
+            auto msg = reader.message(i);
+            EXPECT_EQ(msg.sequence, i);
+            EXPECT_EQ(msg.size, size_t(100 + i * 37));
+            EXPECT_EQ(msg.data[msg.size - 1], static_cast<uint8_t>(i));
+        }
+    }
+
+    std::string _path;
+    std::string _corruptPath;
+    std::vector<uint8_t> _file;
+};
+
+}  // namespace
+
+TEST_F(CaptureFileTest, ReadsIndex) {
+    CaptureReader reader;
+    ASSERT_TRUE(reader.open(_path));
+    EXPECT_FALSE(reader.indexRecovered());
+    ASSERT_EQ(reader.size(), size_t(kMessages));
+    EXPECT_EQ(reader.streamName(0), "video");
+    EXPECT_EQ(reader.streamId("mic"), 1);
+    for(int i = 0; i < kMessages; i++) {
+        auto msg = reader.message(i);
+        EXPECT_EQ(msg.stream, i % 2);
+        EXPECT_EQ(msg.size, size_t(100 + i * 37));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(msg.data) % capture::kAlignment, 0u);
+    }
+}
+
+TEST_F(CaptureFileTest, OverflowingCountsFallBackToScan) {
+    // messageCount * sizeof(IndexEntry) wraps around to the real table size
+    auto data = _file;
+    auto f = footer();
+    f.messageCount += uint64_t(1) << 59;
+    put(data, data.size() - sizeof(capture::Footer), f);
+    expectRecoveredAll(data);
+
+    data = _file;
+    f = footer();
+    f.streamCount += uint64_t(1) << 61;
+    put(data, data.size() - sizeof(capture::Footer), f);
+    expectRecoveredAll(data);
+
+    data = _file;
+    f = footer();
+    f.indexOffset = UINT64_MAX - 100;
+    put(data, data.size() - sizeof(capture::Footer), f);
+    expectRecoveredAll(data);
+}
+
+TEST_F(CaptureFileTest, MessageEntryWithoutRecordFallsBackToScan) {
+    // Points into the middle of a payload
+    auto data = _file;
+    auto entry = get<capture::IndexEntry>(data, indexEntryOffset(3));
+    entry.offset += capture::kAlignment;
+    put(data, indexEntryOffset(3), entry);
+    expectRecoveredAll(data);
+
+    // Points into the index itself
+    data = _file;
+    entry.offset = footer().indexOffset;
+    put(data, indexEntryOffset(5), entry);
+    expectRecoveredAll(data);
+}
+
+TEST_F(CaptureFileTest, PayloadPastIndexIsRejected) {
+    // The last message claims to run into the index: the index is not trusted, and the scan
+    // stops at the torn record
+    auto data = _file;
+    auto entry = get<capture::IndexEntry>(data, indexEntryOffset(kMessages - 1));
+    auto header = get<capture::RecordHeader>(data, entry.offset);
+    header.payloadSize += 4096;
+    put(data, entry.offset, header);
+    CaptureReader reader;
+    openCorrupt(data, reader);
+    EXPECT_TRUE(reader.indexRecovered());
+    EXPECT_EQ(reader.size(), size_t(kMessages - 1));
+
+    // Huge payload size: no entry can reach it
+    data = _file;
+    header.payloadSize = UINT64_MAX - 10;
+    put(data, entry.offset, header);
+    CaptureReader huge;
+    openCorrupt(data, huge);
+    EXPECT_TRUE(huge.indexRecovered());
+    EXPECT_EQ(huge.size(), size_t(kMessages - 1));
+}
+
+TEST_F(CaptureFileTest, StreamNameSizeIsChecked) {
+    auto data = _file;
+    auto f = footer();
+    auto stream = get<capture::StreamEntry>(data, f.indexOffset + f.messageCount * sizeof(capture::IndexEntry) + sizeof(capture::StreamEntry));
+    auto header = get<capture::RecordHeader>(data, stream.offset);
+    header.payloadSize = UINT64_MAX / 2;
+    put(data, stream.offset, header);
+    CaptureReader reader;
+    openCorrupt(data, reader);
+    EXPECT_TRUE(reader.indexRecovered());
+}
@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <vector>
+
+#include "ControlScheduler.hpp"
+
+namespace {
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+constexpr auto kInterval = milliseconds(33);
+
+CameraCommand lens(int position) {
+    CameraCommand command;
+    command.lensPosition = position;
+    return command;
+}
+
+CameraCommand exposure(int us, int iso) {
+    CameraCommand command;
+    command.exposureUs = us;
+    command.iso = iso;
+    return command;
+}
+
+CameraCommand streaming(CameraCommand::Streaming streaming) {
+    CameraCommand command;
+    command.streaming = streaming;
+    return command;
+}
+
+// Everything takeNext() hands out between `start` and `end`, polled every millisecond
+std::vector<CameraCommand> drain(ControlScheduler& scheduler, steady_clock::time_point start, steady_clock::time_point end) {
+    std::vector<CameraCommand> sent;
+    for(auto now = start; now < end; now += milliseconds(1)) {
+        CameraCommand command;
+        if(scheduler.takeNext(command, now)) sent.push_back(command);
+    }
+    return sent;
+}
+
+}  // namespace
+
+TEST(CameraCommand, LaterSettingsOverrideEarlier) {
+    CameraCommand command = lens(100);
+    command.merge(lens(120));
+    command.merge(exposure(10000, 400));
+    command.merge(exposure(20000, 800));
+    EXPECT_EQ(command.lensPosition, 120);
+    EXPECT_EQ(command.exposureUs, 20000);
+    EXPECT_EQ(command.iso, 800);
+
+    // Fields the newer command leaves unset are kept
+    CameraCommand wb;
+    wb.whiteBalanceK = 5000;
+    command.merge(wb);
+    EXPECT_EQ(command.lensPosition, 120);
+    EXPECT_EQ(command.exposureUs, 20000);
+    EXPECT_EQ(command.whiteBalanceK, 5000);
+}
+
+TEST(CameraCommand, ManualFocusAndAutofocusReplaceEachOther) {
+    CameraCommand command = lens(100);
+    CameraCommand af;
+    af.autoFocusMode = 1;
+    command.merge(af);
+    EXPECT_EQ(command.lensPosition, -1);
+    EXPECT_EQ(command.autoFocusMode, 1);
+
+    command.merge(lens(80));
+    EXPECT_EQ(command.lensPosition, 80);
+    EXPECT_EQ(command.autoFocusMode, -1);
+
+    CameraCommand trigger;
+    trigger.autoFocusTrigger = true;
+    command.merge(trigger);
+    EXPECT_EQ(command.lensPosition, -1);
+    EXPECT_TRUE(command.autoFocusTrigger);
+
+    command.merge(lens(60));
+    EXPECT_EQ(command.lensPosition, 60);
+    EXPECT_FALSE(command.autoFocusTrigger);
+}
+
+TEST(ControlScheduler, BurstCoalescesIntoOneCommandPerInterval) {
+    ControlScheduler scheduler(kInterval);
+    auto start = steady_clock::now();
+    CameraCommand command;
+
+    // A focus sweep plus exposure and white balance changes within one interval
+    for(int position = 100; position <= 150; position += 5) scheduler.submit(lens(position));
+    scheduler.submit(exposure(8000, 200));
+    CameraCommand wb;
+    wb.whiteBalanceK = 4500;
+    scheduler.submit(wb);
+
+    auto sent = drain(scheduler, start, start + kInterval * 4);
+    ASSERT_EQ(sent.size(), 1u);
+    EXPECT_EQ(sent[0].lensPosition, 150);
+    EXPECT_EQ(sent[0].exposureUs, 8000);
+    EXPECT_EQ(sent[0].iso, 200);
+    EXPECT_EQ(sent[0].whiteBalanceK, 4500);
+    EXPECT_FALSE(scheduler.pending());
+
+    auto stats = scheduler.getStats();
+    EXPECT_EQ(stats.submitted, 13u);
+    EXPECT_EQ(stats.sent, 1u);
+    EXPECT_EQ(stats.merged, 12u);
+}
+
+TEST(ControlScheduler, RateLimitsToMinInterval) {
+    ControlScheduler scheduler(kInterval);
+    auto start = steady_clock::now();
+    CameraCommand command;
+
+    scheduler.submit(lens(10));
+    ASSERT_TRUE(scheduler.takeNext(command, start));
+    EXPECT_EQ(command.lensPosition, 10);
+
+    // Submissions during the interval wait and merge
+    scheduler.submit(lens(20));
+    scheduler.submit(lens(30));
+    EXPECT_FALSE(scheduler.takeNext(command, start + kInterval / 2));
+    EXPECT_EQ(scheduler.nextDue(start + kInterval / 2), kInterval - kInterval / 2);
+    ASSERT_TRUE(scheduler.takeNext(command, start + kInterval));
+    EXPECT_EQ(command.lensPosition, 30);
+
+    EXPECT_FALSE(scheduler.takeNext(command, start + kInterval * 3));
+    EXPECT_EQ(scheduler.nextDue(start + kInterval * 3), steady_clock::duration::max());
+}
+
+TEST(ControlScheduler, StreamingIsNotMergedOrReordered) {
+    ControlScheduler scheduler(kInterval);
+    auto start = steady_clock::now();
+
+    scheduler.submit(lens(10));
+    scheduler.submit(streaming(CameraCommand::Streaming::Stop));
+    scheduler.submit(streaming(CameraCommand::Streaming::Stop));
+    scheduler.submit(lens(20));
+    scheduler.submit(lens(30));
+    scheduler.submit(streaming(CameraCommand::Streaming::Start));
+
+    auto sent = drain(scheduler, start, start + kInterval * 10);
+    ASSERT_EQ(sent.size(), 4u);
+    EXPECT_EQ(sent[0].lensPosition, 10);
+    EXPECT_EQ(sent[0].streaming, CameraCommand::Streaming::None);
+    EXPECT_EQ(sent[1].streaming, CameraCommand::Streaming::Stop);
+    EXPECT_FALSE(sent[1].hasSettings());
+    EXPECT_EQ(sent[2].lensPosition, 30);
+    EXPECT_EQ(sent[3].streaming, CameraCommand::Streaming::Start);
+}
+
+TEST(ControlScheduler, MeasuresEffectLatency) {
+    ControlScheduler scheduler(kInterval, milliseconds(500));
+    auto start = steady_clock::now();
+    CameraCommand command;
+
+    scheduler.submit(lens(120));
+    ASSERT_TRUE(scheduler.takeNext(command, start));
+    // Frames captured before the send, or still at the old position, don't count
+    scheduler.onFrame(120, -1, start - milliseconds(5));
+    scheduler.onFrame(100, -1, start + milliseconds(33));
+    scheduler.onFrame(120, -1, start + milliseconds(66));
+
+    auto stats = scheduler.getStats();
+    EXPECT_EQ(stats.observed, 1u);
+    EXPECT_EQ(stats.unobserved, 0u);
+    EXPECT_EQ(stats.maxLatencyUs, 66000u);
+
+    // A position the device never reaches times out
+    scheduler.submit(lens(255));
+    ASSERT_TRUE(scheduler.takeNext(command, start + kInterval * 3));
+    scheduler.onFrame(250, -1, start + milliseconds(800));
+    stats = scheduler.getStats();
+    EXPECT_EQ(stats.observed, 1u);
+    EXPECT_EQ(stats.unobserved, 1u);
+}
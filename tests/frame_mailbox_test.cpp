@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "FrameMailbox.hpp"
+
+namespace {
+
+struct RunResult {
+    std::vector<uint64_t> received;
+    MailboxStats stats;
+};
+
+// Producer and consumer at mismatched rates: every `producerPause` items the producer sleeps
+// for a while, the consumer after every `consumerPause` items. The consumer drains what is
+// left once the producer is done.
+RunResult run(MailboxPolicy policy, size_t capacity, uint64_t items, int producerPause, int consumerPause) {
+    FrameMailbox<uint64_t> mailbox(capacity, policy);
+    RunResult result;
+    std::atomic<bool> done{false};
+    std::thread consumer([&] {
+        uint64_t value;
+        while(true) {
+            if(mailbox.waitPop(value, std::chrono::milliseconds(10))) {
+                result.received.push_back(value);
+                if(consumerPause && result.received.size() % consumerPause == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+            } else if(done && mailbox.size() == 0) {
+                break;
+            }
+        }
+    });
+    for(uint64_t i = 0; i < items; i++) {
+        EXPECT_TRUE(mailbox.push(i));
+        if(producerPause && i % producerPause == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    done = true;
+    consumer.join();
+    result.stats = mailbox.getStats();
+    return result;
+}
+
+void expectIncreasing(const std::vector<uint64_t>& values) {
+    for(size_t i = 1; i < values.size(); i++) {
+        ASSERT_LT(values[i - 1], values[i]) << "at " << i;
+    }
+}
+
+}  // namespace
+
+TEST(FrameMailbox, CapacityRoundsUpToPowerOfTwo) {
+    EXPECT_EQ(FrameMailbox<int>(1).capacity(), 2u);
+    EXPECT_EQ(FrameMailbox<int>(3).capacity(), 4u);
+    EXPECT_EQ(FrameMailbox<int>(8).capacity(), 8u);
+}
+
+TEST(FrameMailbox, LatestWinsKeepsNewest) {
+    FrameMailbox<int> mailbox(4, MailboxPolicy::LatestWins);
+    for(int i = 0; i < 10; i++) mailbox.push(i);
+    int value = -1;
+    ASSERT_TRUE(mailbox.tryPop(value));
+    EXPECT_EQ(value, 9);
+    EXPECT_FALSE(mailbox.tryPop(value));
+    auto stats = mailbox.getStats();
+    EXPECT_EQ(stats.pushed, 10u);
+    EXPECT_EQ(stats.popped, 1u);
+    EXPECT_EQ(stats.dropped, 9u);
+    EXPECT_EQ(stats.maxOccupancy, 4u);
+}
+
+TEST(FrameMailbox, DropOldestEvictsFromTheFront) {
+    FrameMailbox<int> mailbox(4, MailboxPolicy::DropOldest);
+    for(int i = 0; i < 6; i++) mailbox.push(i);
+    std::vector<int> values;
+    int value;
+    while(mailbox.tryPop(value)) values.push_back(value);
+    EXPECT_EQ(values, (std::vector<int>{2, 3, 4, 5}));
+    EXPECT_EQ(mailbox.getStats().dropped, 2u);
+}
+
+TEST(FrameMailbox, CloseRejectsPushesButDrains) {
+    FrameMailbox<int> mailbox(4, MailboxPolicy::Block);
+    mailbox.push(1);
+    mailbox.close();
+    EXPECT_FALSE(mailbox.push(2));
+    int value = 0;
+    EXPECT_TRUE(mailbox.waitPop(value, std::chrono::milliseconds(1)));
+    EXPECT_EQ(value, 1);
+    EXPECT_FALSE(mailbox.waitPop(value, std::chrono::milliseconds(1)));
+}
+
+// Slow consumer: the producer must wait, nothing is lost or reordered
+TEST(FrameMailboxStress, BlockSlowConsumer) {
+    const uint64_t items = 20000;
+    auto r = run(MailboxPolicy::Block, 8, items, 0, 50);
+    ASSERT_EQ(r.received.size(), items);
+    for(uint64_t i = 0; i < items; i++) ASSERT_EQ(r.received[i], i);
+    EXPECT_EQ(r.stats.dropped, 0u);
+    EXPECT_EQ(r.stats.popped, items);
+    EXPECT_LE(r.stats.maxOccupancy, 8u);
+}
+
+// Slow producer: the consumer mostly waits, still everything arrives in order
+TEST(FrameMailboxStress, BlockSlowProducer) {
+    const uint64_t items = 5000;
+    auto r = run(MailboxPolicy::Block, 8, items, 50, 0);
+    ASSERT_EQ(r.received.size(), items);
+    for(uint64_t i = 0; i < items; i++) ASSERT_EQ(r.received[i], i);
+}
+
+// Slow consumer: drops, but in order, with every item accounted for
+TEST(FrameMailboxStress, DropOldestSlowConsumer) {
+    const uint64_t items = 50000;
+    auto r = run(MailboxPolicy::DropOldest, 8, items, 0, 20);
+    expectIncreasing(r.received);
+    EXPECT_GT(r.stats.dropped, 0u);
+    EXPECT_EQ(r.stats.pushed, items);
+    EXPECT_EQ(r.stats.popped, r.received.size());
+    EXPECT_EQ(r.stats.popped + r.stats.dropped, items);
+    EXPECT_LE(r.stats.maxOccupancy, 8u);
+    EXPECT_EQ(r.received.back(), items - 1);
+}
+
+// The preview case: a depth-2 mailbox in front of a slow display always ends on the newest frame
+TEST(FrameMailboxStress, LatestWinsSlowConsumer) {
+    const uint64_t items = 50000;
+    auto r = run(MailboxPolicy::LatestWins, 2, items, 0, 20);
+    expectIncreasing(r.received);
+    EXPECT_GT(r.stats.dropped, 0u);
+    EXPECT_EQ(r.stats.popped + r.stats.dropped, items);
+    EXPECT_LE(r.stats.maxOccupancy, 2u);
+    EXPECT_EQ(r.received.back(), items - 1);
+}
+
+// Payloads are released when popped or dropped, not when their slot is reused
+TEST(FrameMailboxStress, PayloadsAreReleased) {
+    auto payload = std::make_shared<int>(0);
+    FrameMailbox<std::shared_ptr<int>> mailbox(4, MailboxPolicy::DropOldest);
+    std::thread producer([&] {
+        for(int i = 0; i < 10000; i++) mailbox.push(payload);
+    });
+    std::shared_ptr<int> value;
+    for(int i = 0; i < 1000; i++) mailbox.tryPop(value);
+    producer.join();
+    value.reset();
+    mailbox.clear();
+    EXPECT_EQ(payload.use_count(), 1);
+}
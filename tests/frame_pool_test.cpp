@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "FramePool.hpp"
+
+namespace {
+
+constexpr size_t kMinPooled = 100;
+
+// One byte per element, so the buffer size is `bytes`
+cv::UMatData* allocate(FramePool& pool, int bytes) {
+    size_t step[1];
+    return pool.allocate(1, &bytes, CV_8UC1, nullptr, step, cv::AccessFlag(), cv::UMatUsageFlags());
+}
+
+}  // namespace
+
+TEST(FramePool, ReusesBuffersOfTheSameSize) {
+    FramePool pool(1000, kMinPooled);
+    auto* a = allocate(pool, 300);
+    uint8_t* data = a->data;
+    pool.deallocate(a);
+    auto* b = allocate(pool, 300);
+    EXPECT_EQ(b->data, data);
+    pool.deallocate(b);
+
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.cachedBytes, 300u);
+}
+
+TEST(FramePool, NewSizeEvictsLeastRecentlyUsed) {
+    FramePool pool(1000, kMinPooled);
+    // The cache fills with two sizes; 200 is used after 300
+    std::vector<cv::UMatData*> old;
+    for(int i = 0; i < 2; i++) old.push_back(allocate(pool, 300));
+    for(auto* u : old) pool.deallocate(u);
+    auto* recent = allocate(pool, 200);
+    pool.deallocate(recent);
+    auto* recent2 = allocate(pool, 200);
+    pool.deallocate(recent2);
+    EXPECT_EQ(pool.getStats().cachedBytes, 800u);
+
+    // A crop change: the new size takes the place of the 300s first, then of the 200
+    auto* a = allocate(pool, 450);
+    auto* b = allocate(pool, 450);
+    pool.deallocate(a);
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.cachedBytes, 950u);
+    EXPECT_EQ(stats.evictions, 1u);
+    pool.deallocate(b);
+    stats = pool.getStats();
+    EXPECT_EQ(stats.cachedBytes, 900u);
+    EXPECT_EQ(stats.cachedBuffers, 2u);
+    EXPECT_EQ(stats.evictions, 3u);
+
+    // Both 450s come from the cache from now on
+    a = allocate(pool, 450);
+    b = allocate(pool, 450);
+    EXPECT_EQ(pool.getStats().hits, 3u);
+    pool.deallocate(a);
+    pool.deallocate(b);
+}
+
+TEST(FramePool, NeverExceedsCap) {
+    FramePool pool(1000, kMinPooled);
+    std::vector<cv::UMatData*> live;
+    for(int i = 0; i < 4; i++) live.push_back(allocate(pool, 400));
+    for(auto* u : live) pool.deallocate(u);
+    // Only one size: the buffers that don't fit are freed
+    auto stats = pool.getStats();
+    EXPECT_EQ(stats.cachedBytes, 800u);
+    EXPECT_EQ(stats.evictions, 2u);
+
+    // Larger than the whole cache: freed without evicting anything
+    pool.deallocate(allocate(pool, 2000));
+    stats = pool.getStats();
+    EXPECT_EQ(stats.cachedBytes, 800u);
+    EXPECT_EQ(stats.evictions, 3u);
+
+    // Below minPooledBytes: not pooled at all
+    pool.deallocate(allocate(pool, 50));
+    EXPECT_EQ(pool.getStats().cachedBytes, 800u);
+    EXPECT_EQ(pool.getStats().misses, 5u);
+}
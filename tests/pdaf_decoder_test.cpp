@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "PdafDecoder.hpp"
+
+namespace {
+
+constexpr int kWindowBytes = 5;
+constexpr int kWindowsPerRow = 16;
+constexpr int kFirstWindow = 10;  // header plus the invalid first window
+
+// The original decoder from rgb_video.cpp, byte by byte, as the reference
+void baselineWindow(const uint8_t* pdaf, int& conf, float& pd) {
+    conf = pdaf[0] << 3 | ((pdaf[1] >> 3) & 0x7);
+    int tmp = ((pdaf[1] & 0x3) << 8) | (pdaf[2] & 0xC0) | ((pdaf[2] & 0x0F) << 2) | (pdaf[3] >> 6);
+    if(pdaf[1] & (1 << 2)) tmp |= 0xFC00;  // sign, extended to 16 bit
+    pd = static_cast<int16_t>(tmp);
+    pd /= 16;
+}
+
+// Window with an 11-bit confidence and an 11-bit signed phase in 1/16 pixels; the bits that
+// belong to neither value are set, the decoder must ignore them
+void encodeWindow(uint8_t* p, int conf, int phase16) {
+    uint32_t raw = static_cast<uint32_t>(phase16) & 0x7FF;
+    p[0] = static_cast<uint8_t>(conf >> 3);
+    p[1] = static_cast<uint8_t>((conf & 0x7) << 3 | (raw >> 10) << 2 | ((raw >> 8) & 0x3) | 0xC0);
+    p[2] = static_cast<uint8_t>(((raw >> 6) & 0x3) << 6 | ((raw >> 2) & 0xF) | 0x30);
+    p[3] = static_cast<uint8_t>((raw & 0x3) << 6 | 0x15);
+    p[4] = 0x5A;
+}
+
+struct Window {
+    int conf;
+    int phase16;
+};
+
+// Packet with `windows(row, col)` at every valid position and junk everywhere else
+template <typename Windows>
+std::vector<uint8_t> buildPacket(PdafMode mode, uint8_t flexMask, Windows windows) {
+    int width = mode == PdafMode::Grid8x6 ? 8 : 16;
+    int height = mode == PdafMode::Grid8x6 ? 6 : 12;
+    std::vector<uint8_t> packet(pdafPayloadSize(mode), 0xEE);
+    packet[0] = flexMask;
+    for(int i = 0; i < height; i++) {
+        for(int j = 0; j < width; j++) {
+            Window w = windows(i, j);
+            encodeWindow(&packet[kFirstWindow + (i * kWindowsPerRow + j) * kWindowBytes], w.conf, w.phase16);
+        }
+    }
+    return packet;
+}
+
+}  // namespace
+
+TEST(PdafDecoder, PayloadSizes) {
+    EXPECT_EQ(pdafPayloadSize(PdafMode::Grid16x12), size_t(kFirstWindow + 12 * 16 * kWindowBytes));
+    EXPECT_EQ(pdafPayloadSize(PdafMode::Grid8x6), size_t(kFirstWindow + 6 * 16 * kWindowBytes));
+}
+
+TEST(PdafDecoder, RejectsShortPackets) {
+    std::vector<uint8_t> packet(pdafPayloadSize(PdafMode::Grid8x6) - 1);
+    PdafGrid grid;
+    EXPECT_FALSE(decodePdaf(packet.data(), packet.size(), PdafMode::Grid8x6, grid));
+    EXPECT_FALSE(decodePdaf(nullptr, 10000, PdafMode::Grid8x6, grid));
+    packet.resize(pdafPayloadSize(PdafMode::Grid8x6));
+    EXPECT_TRUE(decodePdaf(packet.data(), packet.size(), PdafMode::Grid8x6, grid));
+    EXPECT_FALSE(decodePdaf(packet.data(), packet.size(), PdafMode::Grid16x12, grid));
+}
+
+// Every window distinct, so a layout mistake (row pitch, 8 of 16 windows) shows up
+TEST(PdafDecoder, GridLayouts) {
+    for(PdafMode mode : {PdafMode::Grid16x12, PdafMode::Grid8x6}) {
+        auto packet = buildPacket(mode, 0x2C, [](int i, int j) { return Window{i * 100 + j, (i - 6) * 32 + j}; });
+        PdafGrid grid;
+        ASSERT_TRUE(decodePdaf(packet.data(), packet.size(), mode, grid));
+        EXPECT_EQ(grid.width, mode == PdafMode::Grid8x6 ? 8 : 16);
+        EXPECT_EQ(grid.height, mode == PdafMode::Grid8x6 ? 6 : 12);
+        EXPECT_EQ(grid.flexMask, 0x2C);
+        ASSERT_EQ(grid.confidence.size(), size_t(grid.width * grid.height));
+        for(int i = 0; i < grid.height; i++) {
+            for(int j = 0; j < grid.width; j++) {
+                EXPECT_EQ(grid.conf(i, j), i * 100 + j) << i << "," << j;
+                EXPECT_EQ(grid.pd(i, j), ((i - 6) * 32 + j) / 16.0f) << i << "," << j;
+            }
+        }
+    }
+}
+
+TEST(PdafDecoder, PhaseSignExtension) {
+    const int phases[] = {0, 1, -1, 15, -16, 1023, -1024, -513, 512};
+    auto packet = buildPacket(PdafMode::Grid16x12, 0, [&](int i, int j) { return Window{2047, phases[(i * 16 + j) % 9]}; });
+    PdafGrid grid;
+    ASSERT_TRUE(decodePdaf(packet.data(), packet.size(), PdafMode::Grid16x12, grid));
+    for(int k = 0; k < 16 * 12; k++) {
+        EXPECT_EQ(grid.confidence[k], 2047);
+        EXPECT_EQ(grid.phase[k], phases[k % 9] / 16.0f) << "raw " << phases[k % 9];
+    }
+    EXPECT_EQ(grid.pd(0, 6), -64.0f);
+    EXPECT_EQ(grid.pd(0, 5), 1023 / 16.0f);
+}
+
+// Random bytes everywhere: the decoder must agree with the byte-wise original bit for bit
+TEST(PdafDecoder, MatchesBaselineDecoder) {
+    std::mt19937 rng(7);
+    for(PdafMode mode : {PdafMode::Grid16x12, PdafMode::Grid8x6}) {
+        for(int round = 0; round < 20; round++) {
+            std::vector<uint8_t> packet(pdafPayloadSize(mode));
+            for(auto& b : packet) b = static_cast<uint8_t>(rng());
+            PdafGrid grid;
+            ASSERT_TRUE(decodePdaf(packet.data(), packet.size(), mode, grid));
+            int k = kFirstWindow;
+            for(int i = 0; i < grid.height; i++) {
+                for(int j = 0; j < kWindowsPerRow; j++, k += kWindowBytes) {
+                    if(j >= grid.width) continue;
+                    int conf;
+                    float pd;
+                    baselineWindow(&packet[k], conf, pd);
+                    ASSERT_EQ(grid.conf(i, j), conf) << i << "," << j;
+                    ASSERT_EQ(grid.pd(i, j), pd) << i << "," << j;
+                }
+            }
+        }
+    }
+}
+
+TEST(PdafFocusMetric, WeightedDefocusAndThreshold) {
+    // Left half confident at +2 px, right half below the threshold at -8 px
+    auto packet = buildPacket(PdafMode::Grid8x6, 0, [](int, int j) { return j < 4 ? Window{500, 32} : Window{10, -128}; });
+    PdafGrid grid;
+    ASSERT_TRUE(decodePdaf(packet.data(), packet.size(), PdafMode::Grid8x6, grid));
+    PdafFocusMetric metric(0.5f, 64);
+    ASSERT_TRUE(metric.update(grid));
+    EXPECT_FLOAT_EQ(metric.defocus(), 2.0f);
+    EXPECT_FLOAT_EQ(metric.confidence(), 500.0f);
+    EXPECT_FLOAT_EQ(metric.quality(), 1.0f / 3.0f);
+
+    // Only the low-confidence windows: nothing to go by
+    metric.setRoi(4, 0, 8, 6);
+    EXPECT_FALSE(metric.update(grid));
+    EXPECT_FLOAT_EQ(metric.defocus(), 2.0f);
+}
+
+TEST(PdafFocusMetric, EstimatesInFocusLens) {
+    PdafFocusMetric metric(0.2f, 64);
+    PdafGrid grid;
+    EXPECT_EQ(metric.estimateLensPosition(), -1);
+    // Phase crosses zero at lens 140
+    for(int lens = 60; lens <= 200; lens += 20) {
+        int phase16 = (lens - 140) * 16 / 10;
+        auto packet = buildPacket(PdafMode::Grid8x6, 0, [&](int, int) { return Window{400, phase16}; });
+        ASSERT_TRUE(decodePdaf(packet.data(), packet.size(), PdafMode::Grid8x6, grid));
+        ASSERT_TRUE(metric.update(grid, lens));
+    }
+    EXPECT_NEAR(metric.estimateLensPosition(), 140, 1);
+}
@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "PipelineCache.hpp"
+
+namespace {
+
+// EntryHeader: magic[8], keySize, reserved, payloadSize, payloadHash
+constexpr size_t kPayloadSizeOffset = 16;
+constexpr size_t kHeaderSize = 32;
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::vector<uint8_t> data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) return data;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    size_t n = fread(data.data(), 1, data.size(), f);
+    fclose(f);
+    data.resize(n);
+    return data;
+}
+
+void writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(data.data(), 1, data.size(), f);
+    fclose(f);
+}
+
+class PipelineCacheTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        dir = ::testing::TempDir() + "pipeline_cache_test_" + std::to_string(getpid());
+        for(int i = 0; i < 1000; i++) payload.push_back(static_cast<uint8_t>(i * 7));
+    }
+    void TearDown() override {
+        PipelineCache cache(dir);
+        std::remove(cache.pathFor(key).c_str());
+        rmdir(dir.c_str());
+    }
+
+    std::string dir;
+    std::string key = "depthai 2.x|1080p|30fps";
+    std::vector<uint8_t> payload;
+};
+
+}  // namespace
+
+TEST_F(PipelineCacheTest, StoresAndLoads) {
+    PipelineCache cache(dir);
+    std::vector<uint8_t> loaded;
+    EXPECT_FALSE(cache.load(key, loaded));
+    ASSERT_TRUE(cache.store(key, payload));
+    ASSERT_TRUE(cache.load(key, loaded));
+    EXPECT_EQ(loaded, payload);
+    EXPECT_FALSE(cache.load(key + "|other", loaded));
+    auto stats = cache.getStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.rejected, 0u);
+}
+
+TEST_F(PipelineCacheTest, RejectsTruncatedEntry) {
+    PipelineCache cache(dir);
+    ASSERT_TRUE(cache.store(key, payload));
+    auto file = readFile(cache.pathFor(key));
+    file.resize(file.size() - 1);
+    writeFile(cache.pathFor(key), file);
+    std::vector<uint8_t> loaded;
+    EXPECT_FALSE(cache.load(key, loaded));
+    EXPECT_TRUE(loaded.empty());
+    EXPECT_EQ(cache.getStats().rejected, 1u);
+}
+
+TEST_F(PipelineCacheTest, RejectsPayloadSizeBeyondFile) {
+    PipelineCache cache(dir);
+    ASSERT_TRUE(cache.store(key, payload));
+    auto file = readFile(cache.pathFor(key));
+    ASSERT_EQ(file.size(), kHeaderSize + key.size() + payload.size());
+    // Would be an allocation of exabytes if the header were trusted
+    uint64_t huge = ~uint64_t(0) >> 2;
+    std::memcpy(file.data() + kPayloadSizeOffset, &huge, sizeof(huge));
+    writeFile(cache.pathFor(key), file);
+    std::vector<uint8_t> loaded;
+    EXPECT_FALSE(cache.load(key, loaded));
+    EXPECT_TRUE(loaded.empty());
+    EXPECT_EQ(cache.getStats().rejected, 1u);
+}
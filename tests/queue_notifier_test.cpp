@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <thread>
+
+#include "QueueNotifier.hpp"
+
+TEST(QueueNotifier, SourceLimit) {
+    QueueNotifier notifier;
+    for(int i = 0; i < QueueNotifier::kMaxSources; i++) EXPECT_EQ(notifier.addSource(), i);
+    EXPECT_EQ(notifier.addSource(), -1);
+    EXPECT_EQ(notifier.addSource(), -1);
+}
+
+TEST(QueueNotifier, IgnoresSourcesOutOfRange) {
+    QueueNotifier notifier;
+    notifier.notify(-1);
+    notifier.notify(64);
+    notifier.notify(1000);
+    EXPECT_EQ(notifier.wait(std::chrono::milliseconds(0)), 0u);
+    notifier.notify(63);
+    notifier.notify(0);
+    EXPECT_EQ(notifier.wait(std::chrono::milliseconds(0)), (uint64_t(1) << 63) | 1u);
+}
+
+TEST(QueueNotifier, WakesSleepingWaiter) {
+    QueueNotifier notifier;
+    std::thread producer([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        notifier.notify(5);
+    });
+    auto t0 = std::chrono::steady_clock::now();
+    EXPECT_EQ(notifier.wait(std::chrono::seconds(5)), uint64_t(1) << 5);
+    EXPECT_LT(std::chrono::steady_clock::now() - t0, std::chrono::seconds(2));
+    producer.join();
+    EXPECT_EQ(notifier.wait(std::chrono::milliseconds(1)), 0u);
+}
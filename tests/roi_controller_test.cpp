@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include "RoiController.hpp"
+
+namespace {
+
+// 1080p sensor streamed at up to 720p
+constexpr int kSourceWidth = 1920, kSourceHeight = 1080;
+constexpr int kMaxOutWidth = 1280, kMaxOutHeight = 720;
+
+void expectInside(const Roi& roi) {
+    EXPECT_GE(roi.x, 0.0f);
+    EXPECT_GE(roi.y, 0.0f);
+    EXPECT_LE(roi.x + roi.width, 1.0f + 1e-6f);
+    EXPECT_LE(roi.y + roi.height, 1.0f + 1e-6f);
+    EXPECT_EQ(roi.outWidth % 16, 0);
+    EXPECT_EQ(roi.outHeight % 2, 0);
+    EXPECT_LE(roi.outWidth, 1280);
+    EXPECT_LE(roi.outHeight, 720);
+}
+
+}  // namespace
+
+TEST(RoiController, StartsWithFullFrame) {
+    RoiController controller(kSourceWidth, kSourceHeight, kMaxOutWidth, kMaxOutHeight);
+    auto roi = controller.current();
+    EXPECT_EQ(roi.x, 0.0f);
+    EXPECT_EQ(roi.y, 0.0f);
+    EXPECT_EQ(roi.width, 1.0f);
+    EXPECT_EQ(roi.height, 1.0f);
+    EXPECT_EQ(roi.outWidth, 1280);
+    EXPECT_EQ(roi.outHeight, 720);
+}
+
+TEST(RoiController, ClampsToFrameEdges) {
+    RoiController controller(kSourceWidth, kSourceHeight, kMaxOutWidth, kMaxOutHeight);
+
+    auto roi = controller.normalize(-0.3f, -0.1f, 0.5f, 0.5f, 0, 0);
+    EXPECT_FLOAT_EQ(roi.x, 0.0f);
+    EXPECT_FLOAT_EQ(roi.y, 0.0f);
+    EXPECT_FLOAT_EQ(roi.width, 0.5f);
+    EXPECT_FLOAT_EQ(roi.height, 0.5f);
+
+    // Past the right/bottom edge the crop is moved back in, not shrunk
+    roi = controller.normalize(0.8f, 0.9f, 0.5f, 0.25f, 0, 0);
+    EXPECT_FLOAT_EQ(roi.x, 0.5f);
+    EXPECT_FLOAT_EQ(roi.y, 0.75f);
+    EXPECT_FLOAT_EQ(roi.width, 0.5f);
+    EXPECT_FLOAT_EQ(roi.height, 0.25f);
+
+    // Larger than the source: the whole frame
+    roi = controller.normalize(0.2f, 0.2f, 3.0f, 1.5f, 0, 0);
+    EXPECT_FLOAT_EQ(roi.x, 0.0f);
+    EXPECT_FLOAT_EQ(roi.y, 0.0f);
+    EXPECT_FLOAT_EQ(roi.width, 1.0f);
+    EXPECT_FLOAT_EQ(roi.height, 1.0f);
+    expectInside(roi);
+}
+
+TEST(RoiController, PanStopsAtEdges) {
+    RoiController controller(kSourceWidth, kSourceHeight, kMaxOutWidth, kMaxOutHeight);
+    controller.zoom(4);
+    for(int i = 0; i < 20; i++) controller.pan(1, 1);
+    auto roi = controller.current();
+    EXPECT_FLOAT_EQ(roi.width, 0.25f);
+    EXPECT_FLOAT_EQ(roi.height, 0.25f);
+    EXPECT_FLOAT_EQ(roi.x + roi.width, 1.0f);
+    EXPECT_FLOAT_EQ(roi.y + roi.height, 1.0f);
+    expectInside(roi);
+
+    for(int i = 0; i < 20; i++) controller.pan(-1, -1);
+    roi = controller.current();
+    EXPECT_FLOAT_EQ(roi.x, 0.0f);
+    EXPECT_FLOAT_EQ(roi.y, 0.0f);
+    EXPECT_FLOAT_EQ(roi.width, 0.25f);
+}
+
+TEST(RoiController, ZoomLimits) {
+    RoiController controller(kSourceWidth, kSourceHeight, kMaxOutWidth, kMaxOutHeight);
+
+    // Zooming in stops at a 32x32 source pixel crop
+    for(int i = 0; i < 40; i++) controller.zoom(2);
+    auto roi = controller.current();
+    EXPECT_FLOAT_EQ(roi.width, 32.0f / 1920);
+    EXPECT_FLOAT_EQ(roi.height, 32.0f / 1080);
+    EXPECT_EQ(roi.outWidth, 32);
+    EXPECT_EQ(roi.outHeight, 32);
+    expectInside(roi);
+    // Around the center it started from
+    EXPECT_NEAR(roi.x + roi.width / 2, 0.5f, 1e-4f);
+    EXPECT_NEAR(roi.y + roi.height / 2, 0.5f, 1e-4f);
+
+    // Zooming out stops at the full frame
+    for(int i = 0; i < 40; i++) controller.zoom(0.5f);
+    roi = controller.current();
+    EXPECT_FLOAT_EQ(roi.x, 0.0f);
+    EXPECT_FLOAT_EQ(roi.y, 0.0f);
+    EXPECT_FLOAT_EQ(roi.width, 1.0f);
+    EXPECT_FLOAT_EQ(roi.height, 1.0f);
+    EXPECT_EQ(roi.outWidth, 1280);
+    EXPECT_EQ(roi.outHeight, 720);
+
+    // Non-positive factors are ignored
+    auto before = controller.getStats().requests;
+    controller.zoom(0);
+    controller.zoom(-2);
+    EXPECT_EQ(controller.getStats().requests, before);
+}
+
+TEST(RoiController, ZoomNearEdgeStaysInside) {
+    RoiController controller(kSourceWidth, kSourceHeight, kMaxOutWidth, kMaxOutHeight);
+    controller.setRoi(0.9f, 0.9f, 0.1f, 0.1f);
+    controller.zoom(0.25f);
+    auto roi = controller.current();
+    EXPECT_FLOAT_EQ(roi.width, 0.4f);
+    EXPECT_FLOAT_EQ(roi.height, 0.4f);
+    EXPECT_FLOAT_EQ(roi.x, 0.6f);
+    EXPECT_FLOAT_EQ(roi.y, 0.6f);
+    expectInside(roi);
+}
+
+TEST(RoiController, OutputSizeFollowsCrop) {
+    RoiController controller(kSourceWidth, kSourceHeight, kMaxOutWidth, kMaxOutHeight);
+
+    // A quarter of 1080p fits the output as is
+    auto roi = controller.normalize(0, 0, 0.25f, 0.25f, 0, 0);
+    EXPECT_EQ(roi.outWidth, 480);
+    EXPECT_EQ(roi.outHeight, 270);
+
+    // Three quarters is scaled down to fit, keeping the aspect
+    roi = controller.normalize(0, 0, 0.75f, 0.75f, 0, 0);
+    EXPECT_EQ(roi.outWidth, 1280);
+    EXPECT_EQ(roi.outHeight, 720);
+
+    // Explicit sizes are limited and rounded too
+    roi = controller.normalize(0, 0, 0.5f, 0.5f, 2000, 101);
+    EXPECT_EQ(roi.outWidth, 1280);
+    EXPECT_EQ(roi.outHeight, 64);
+    expectInside(roi);
+}
+
+TEST(RoiController, CoalescesRequestsPerFrame) {
+    RoiController controller(kSourceWidth, kSourceHeight, kMaxOutWidth, kMaxOutHeight);
+    Roi roi;
+    EXPECT_FALSE(controller.takePending(roi));
+
+    controller.zoom(2);
+    controller.pan(0.5f, 0);
+    controller.pan(0.5f, 0);
+    ASSERT_TRUE(controller.takePending(roi));
+    EXPECT_EQ(roi, controller.current());
+    EXPECT_FALSE(controller.takePending(roi));
+
+    // Back and forth between frames ends where it started and sends nothing
+    controller.pan(-0.5f, 0);
+    controller.pan(0.5f, 0);
+    EXPECT_FALSE(controller.takePending(roi));
+
+    auto stats = controller.getStats();
+    EXPECT_EQ(stats.requests, 5u);
+    EXPECT_EQ(stats.sent, 1u);
+    EXPECT_EQ(stats.coalesced, 4u);
+}
@@ -0,0 +1,212 @@
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SegmentedFile.hpp"
+
+namespace {
+
+constexpr size_t kHeaderBytes = 16;
+
+// Header: 8 bytes of magic, then the payload size
+void updateHeader(std::vector<uint8_t>& header, uint64_t dataBytes) {
+    std::memcpy(header.data() + 8, &dataBytes, sizeof(dataBytes));
+}
+
+std::vector<uint8_t> makeHeader() {
+    std::vector<uint8_t> header(kHeaderBytes, 0);
+    std::memcpy(header.data(), "TESTHDR1", 8);
+    return header;
+}
+
+uint8_t patternAt(uint64_t offset) {
+    return static_cast<uint8_t>(offset * 7 + offset / 251);
+}
+
+uint64_t fileSize(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+}
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::vector<uint8_t> data(fileSize(path));
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) return std::vector<uint8_t>();
+    size_t n = fread(data.data(), 1, data.size(), f);
+    fclose(f);
+    data.resize(n);
+    return data;
+}
+
+void writeText(const std::string& path, const std::string& text) {
+    FILE* f = fopen(path.c_str(), "wb");
+    ASSERT_NE(f, nullptr);
+    fwrite(text.data(), 1, text.size(), f);
+    fclose(f);
+}
+
+class SegmentedFileTest : public ::testing::Test {
+   protected:
+    void SetUp() override {
+        std::string pattern = ::testing::TempDir() + "segmented_file_XXXXXX";
+        std::vector<char> dir(pattern.begin(), pattern.end());
+        dir.push_back('\0');
+        ASSERT_NE(mkdtemp(dir.data()), nullptr);
+        _dir = dir.data();
+    }
+    void TearDown() override {
+        for(const auto& path : _files) std::remove(path.c_str());
+        SegmentIndex index;
+        for(const auto& base : _recordings) {
+            if(SegmentedFile::readIndex(base + ".index", index)) {
+                for(const auto& segment : index.segments) std::remove(segment.path.c_str());
+            }
+            std::remove((base + ".index").c_str());
+            std::remove((base + ".index.tmp").c_str());
+        }
+        ::rmdir(_dir.c_str());
+    }
+
+    std::string recording(const std::string& name) {
+        _recordings.push_back(_dir + "/" + name);
+        return _recordings.back();
+    }
+    std::string file(const std::string& name) {
+        _files.push_back(_dir + "/" + name);
+        return _files.back();
+    }
+
+    // Records `total` bytes of the pattern in writes of `writeBytes`, each split into three iovecs
+    void record(const std::string& path, const RecordingOptions& options, uint64_t total, size_t writeBytes) {
+        SegmentedFile out(path, "raw", options, makeHeader(), &updateHeader);
+        ASSERT_TRUE(out.open());
+        std::vector<uint8_t> data(writeBytes);
+        for(uint64_t offset = 0; offset < total; offset += writeBytes) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(writeBytes, total - offset));
+            for(size_t i = 0; i < n; i++) data[i] = patternAt(offset + i);
+            iovec iov[3] = {{data.data(), n / 3}, {data.data() + n / 3, 0}, {data.data() + n / 3, n - n / 3}};
+            ASSERT_TRUE(out.write(iov, 3));
+        }
+        out.close();
+        EXPECT_EQ(out.getStats().bytes, total);
+        EXPECT_EQ(out.getStats().errors, 0u);
+    }
+
+    // Every segment but the last holds exactly segmentBytes, and the segments join into the stream
+    void checkSegments(const std::string& path, uint64_t segmentBytes, uint64_t total) {
+        SegmentIndex index;
+        ASSERT_TRUE(SegmentedFile::readIndex(path + ".index", index));
+        EXPECT_EQ(index.format, "raw");
+        EXPECT_EQ(index.headerBytes, kHeaderBytes);
+        ASSERT_EQ(index.segments.size(), (total + segmentBytes - 1) / segmentBytes);
+        uint64_t offset = 0;
+        for(size_t i = 0; i < index.segments.size(); i++) {
+            const auto& segment = index.segments[i];
+            uint64_t expected = i + 1 < index.segments.size() ? segmentBytes : total - offset;
+            EXPECT_TRUE(segment.complete);
+            EXPECT_EQ(segment.dataBytes, expected) << "segment " << i;
+            EXPECT_EQ(fileSize(segment.path), kHeaderBytes + expected) << "segment " << i;
+
+            // Each segment is a complete file with its own header and the next part of the stream
+            auto data = readFile(segment.path);
+            ASSERT_EQ(data.size(), kHeaderBytes + expected);
+            uint64_t dataBytes = 0;
+            std::memcpy(&dataBytes, data.data() + 8, sizeof(dataBytes));
+            EXPECT_EQ(dataBytes, expected);
+            for(uint64_t j = 0; j < expected; j++) {
+                if(data[kHeaderBytes + j] != patternAt(offset + j)) {
+                    ADD_FAILURE() << "segment " << i << " differs at " << j;
+                    break;
+                }
+            }
+            offset += expected;
+        }
+        EXPECT_EQ(offset, total);
+
+        std::string joined = file("joined.bin");
+        ASSERT_TRUE(SegmentedFile::concatenate(path + ".index", joined, &updateHeader));
+        auto data = readFile(joined);
+        ASSERT_EQ(data.size(), kHeaderBytes + total);
+        uint64_t dataBytes = 0;
+        std::memcpy(&dataBytes, data.data() + 8, sizeof(dataBytes));
+        EXPECT_EQ(dataBytes, total);
+        for(uint64_t j = 0; j < total; j++) {
+            if(data[kHeaderBytes + j] != patternAt(j)) {
+                ADD_FAILURE() << "joined file differs at " << j;
+                break;
+            }
+        }
+    }
+
+    std::string _dir;
+    std::vector<std::string> _recordings;
+    std::vector<std::string> _files;
+};
+
+}  // namespace
+
+TEST_F(SegmentedFileTest, WritesLargerThanSegmentAreSplit) {
+    RecordingOptions options;
+    options.segmentBytes = 100000;
+    options.checkpointMs = 0;
+    std::string path = recording("large.bin");
+    record(path, options, 1000000, 150000);
+    checkSegments(path, options.segmentBytes, 1000000);
+}
+
+TEST_F(SegmentedFileTest, SegmentsAreExactWithUnalignedWrites) {
+    RecordingOptions options;
+    options.segmentBytes = 65536;
+    options.checkpointMs = 0;
+    std::string path = recording("unaligned.bin");
+    record(path, options, 500000, 9973);
+    checkSegments(path, options.segmentBytes, 500000);
+}
+
+TEST_F(SegmentedFileTest, SegmentsAreExactWithDirectWrites) {
+    RecordingOptions options;
+    options.segmentBytes = 3 << 20;
+    options.checkpointMs = 0;
+    options.direct = true;  // falls back to the page cache where O_DIRECT is not supported
+    std::string path = recording("direct.bin");
+    record(path, options, 10 << 20, 1500000);
+    checkSegments(path, options.segmentBytes, 10 << 20);
+}
+
+TEST_F(SegmentedFileTest, WriteEndingOnBoundaryOpensNoEmptySegment) {
+    RecordingOptions options;
+    options.segmentBytes = 100000;
+    options.checkpointMs = 0;
+    std::string path = recording("boundary.bin");
+    record(path, options, 300000, 50000);
+    checkSegments(path, options.segmentBytes, 300000);
+}
+
+TEST_F(SegmentedFileTest, RejectsBadIndexFiles) {
+    SegmentIndex index;
+    EXPECT_FALSE(SegmentedFile::readIndex(_dir + "/missing.index", index));
+
+    std::string empty = file("empty.index");
+    writeText(empty, "");
+    EXPECT_FALSE(SegmentedFile::readIndex(empty, index));
+
+    std::string truncated = file("truncated.index");
+    writeText(truncated, "oak-segm");
+    EXPECT_FALSE(SegmentedFile::readIndex(truncated, index));
+
+    std::string foreign = file("foreign.index");
+    writeText(foreign, "RIFF\x24\x08\x00\x00WAVEfmt ");
+    EXPECT_FALSE(SegmentedFile::readIndex(foreign, index));
+
+    std::string version = file("version.index");
+    writeText(version, "oak-segments 2 raw 16\n");
+    EXPECT_FALSE(SegmentedFile::readIndex(version, index));
+
+    EXPECT_FALSE(SegmentedFile::concatenate(empty, file("out.bin"), &updateHeader));
+}
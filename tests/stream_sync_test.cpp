@@ -0,0 +1,267 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "StreamSync.hpp"
+
+namespace {
+
+constexpr int kVideo = 0, kTof = 1, kPdaf = 2;
+constexpr int64_t kFrameNs = 33333333;
+constexpr int64_t kMs = 1000000;
+
+using Sync = StreamSync<int>;
+
+std::vector<Sync::Bundle> drain(Sync& sync) {
+    std::vector<Sync::Bundle> bundles;
+    Sync::Bundle bundle;
+    while(sync.tryPop(bundle)) bundles.push_back(bundle);
+    return bundles;
+}
+
+// Waits out maxWait so the last references are emitted with whatever they have
+std::vector<Sync::Bundle> flush(Sync& sync, std::chrono::milliseconds maxWait) {
+    std::this_thread::sleep_for(maxWait + std::chrono::milliseconds(5));
+    return drain(sync);
+}
+
+}  // namespace
+
+// 30 fps video; ToF 2 ms late and PDAF 1 ms early, both with +-1 ms jitter; about 10% of the
+// ToF and 5% of the PDAF messages lost. Items are the frame index, so every match can be checked.
+TEST(StreamSync, JitterAndDrops) {
+    const int frames = 600;
+    const auto maxWait = std::chrono::milliseconds(20);
+    Sync sync(3, std::chrono::nanoseconds(10 * kMs), kVideo, 64, maxWait);
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int64_t> jitter(-kMs, kMs);
+    std::vector<bool> tofSent(frames), pdafSent(frames);
+    std::vector<Sync::Bundle> bundles;
+    for(int i = 0; i < frames; i++) {
+        int64_t t = 1000 * kMs + i * kFrameNs;
+        pdafSent[i] = rng() % 20 != 0;
+        tofSent[i] = rng() % 10 != 0;
+        if(pdafSent[i]) sync.push(kPdaf, t - kMs + jitter(rng), i);
+        sync.push(kVideo, t, i);
+        if(tofSent[i]) sync.push(kTof, t + 2 * kMs + jitter(rng), i);
+        auto ready = drain(sync);
+        bundles.insert(bundles.end(), ready.begin(), ready.end());
+    }
+    auto rest = flush(sync, maxWait);
+    bundles.insert(bundles.end(), rest.begin(), rest.end());
+
+    ASSERT_EQ(bundles.size(), size_t(frames));
+    int tofMatched = 0, pdafMatched = 0, complete = 0;
+    for(int i = 0; i < frames; i++) {
+        const auto& b = bundles[i];
+        ASSERT_EQ(b.items[kVideo], i);
+        EXPECT_EQ(b.timestampNs, 1000 * kMs + i * kFrameNs);
+        ASSERT_EQ(b.has(kTof), tofSent[i]) << "frame " << i;
+        ASSERT_EQ(b.has(kPdaf), pdafSent[i]) << "frame " << i;
+        if(b.has(kTof)) {
+            EXPECT_EQ(b.items[kTof], i);
+        }
+        if(b.has(kPdaf)) {
+            EXPECT_EQ(b.items[kPdaf], i);
+        }
+        tofMatched += b.has(kTof);
+        pdafMatched += b.has(kPdaf);
+        complete += b.has(kTof) && b.has(kPdaf);
+    }
+
+    auto stats = sync.getStats();
+    EXPECT_EQ(stats.bundles, uint64_t(frames));
+    EXPECT_EQ(stats.complete, uint64_t(complete));
+    EXPECT_EQ(stats.matched[kVideo], uint64_t(frames));
+    EXPECT_EQ(stats.matched[kTof], uint64_t(tofMatched));
+    EXPECT_EQ(stats.matched[kPdaf], uint64_t(pdafMatched));
+    EXPECT_DOUBLE_EQ(stats.matchRate(kVideo), 1.0);
+    EXPECT_DOUBLE_EQ(stats.matchRate(kTof), double(tofMatched) / frames);
+    EXPECT_LT(stats.matchRate(kTof), 1.0);
+    EXPECT_GT(stats.matchRate(kTof), 0.8);
+    EXPECT_EQ(stats.evicted, 0u);
+    EXPECT_EQ(stats.overflow, 0u);
+    // A lost ToF message is settled by the next one; only the last reference, with nothing
+    // after it, waited out maxWait
+    EXPECT_GE(stats.maxLatencyUs, uint64_t(std::chrono::microseconds(maxWait).count()));
+    EXPECT_LT(stats.meanLatencyUs(), stats.maxLatencyUs);
+}
+
+// A message outside the tolerance of every reference is emitted alone, not matched to the wrong frame
+TEST(StreamSync, EvictsStaleMessages) {
+    Sync sync(2, std::chrono::nanoseconds(5 * kMs), kVideo, 16, std::chrono::milliseconds(1000));
+    std::vector<Sync::Bundle> bundles;
+    for(int i = 0; i < 50; i++) {
+        int64_t t = i * kFrameNs;
+        sync.push(kVideo, t, i);
+        sync.push(kTof, t + kMs, i);
+        // Halfway to the next frame, too far from both references
+        sync.push(kTof, t + kFrameNs / 2, -1);
+        auto ready = drain(sync);
+        bundles.insert(bundles.end(), ready.begin(), ready.end());
+    }
+    // The last reference is settled, the last stray message isn't evicted yet; each stray
+    // comes out on its own before the next frame's bundle
+    ASSERT_EQ(bundles.size(), 99u);
+    for(int i = 0; i < 50; i++) {
+        const auto& b = bundles[i == 0 ? 0 : 2 * i];
+        ASSERT_TRUE(b.has(kVideo));
+        EXPECT_EQ(b.items[kVideo], i);
+        ASSERT_TRUE(b.has(kTof));
+        EXPECT_EQ(b.items[kTof], i);
+        if(i > 0) {
+            const auto& stray = bundles[2 * i - 1];
+            EXPECT_TRUE(stray.single());
+            ASSERT_TRUE(stray.has(kTof));
+            EXPECT_EQ(stray.items[kTof], -1);
+            EXPECT_EQ(stray.timestampNs, (i - 1) * kFrameNs + kFrameNs / 2);
+        }
+    }
+    auto stats = sync.getStats();
+    EXPECT_EQ(stats.evicted, 49u);
+    EXPECT_EQ(stats.bundles, 50u);
+    EXPECT_DOUBLE_EQ(stats.matchRate(kTof), 1.0);
+}
+
+// Of several candidates within tolerance the closest wins, the ones before it come out alone
+TEST(StreamSync, PicksClosestWithinTolerance) {
+    Sync sync(2, std::chrono::nanoseconds(10 * kMs), kVideo);
+    sync.push(kVideo, 100 * kMs, 0);
+    sync.push(kTof, 92 * kMs, 1);
+    sync.push(kTof, 97 * kMs, 2);
+    sync.push(kTof, 104 * kMs, 3);
+    auto bundles = drain(sync);
+    ASSERT_EQ(bundles.size(), 2u);
+    EXPECT_TRUE(bundles[0].single());
+    EXPECT_EQ(bundles[0].items[kTof], 1);
+    EXPECT_FALSE(bundles[1].single());
+    EXPECT_EQ(bundles[1].items[kTof], 2);
+    EXPECT_EQ(sync.getStats().evicted, 1u);
+}
+
+// Streams that aren't synced and run at other rates: every message comes out exactly once,
+// in a bundle when it matched and alone otherwise
+TEST(StreamSync, UnsyncedStreamsLoseNothing) {
+    const auto maxWait = std::chrono::milliseconds(20);
+    Sync sync(3, std::chrono::nanoseconds(5 * kMs), kVideo, 16, maxWait);
+    const int64_t tofNs = 50000000, pdafNs = 16666667;  // 20 and 60 fps
+    std::vector<int> seen[3];
+    std::vector<Sync::Bundle> bundles;
+    int64_t videoT = 0, tofT = 7 * kMs, pdafT = 3 * kMs;
+    int video = 0, tof = 0, pdaf = 0;
+    for(int64_t t = 0; t < 10 * 1000 * kMs; t += kMs) {
+        if(t >= videoT) {
+            sync.push(kVideo, videoT, video++);
+            videoT += kFrameNs;
+        }
+        if(t >= tofT) {
+            sync.push(kTof, tofT, tof++);
+            tofT += tofNs;
+        }
+        if(t >= pdafT) {
+            sync.push(kPdaf, pdafT, pdaf++);
+            pdafT += pdafNs;
+        }
+        auto ready = drain(sync);
+        bundles.insert(bundles.end(), ready.begin(), ready.end());
+    }
+    auto rest = flush(sync, maxWait);
+    bundles.insert(bundles.end(), rest.begin(), rest.end());
+
+    for(const auto& b : bundles) {
+        for(int s = 0; s < 3; s++) {
+            if(b.has(s)) seen[s].push_back(b.items[s]);
+        }
+        // Matches lie within the tolerance of the reference
+        if(!b.single()) {
+            ASSERT_TRUE(b.has(kVideo));
+            if(b.has(kTof)) {
+                EXPECT_LE(std::abs(7 * kMs + b.items[kTof] * tofNs - b.timestampNs), 5 * kMs);
+            }
+            if(b.has(kPdaf)) {
+                EXPECT_LE(std::abs(3 * kMs + b.items[kPdaf] * pdafNs - b.timestampNs), 5 * kMs);
+            }
+        }
+    }
+    const int sent[3] = {video, tof, pdaf};
+    for(int s = 0; s < 3; s++) {
+        ASSERT_EQ(seen[s].size(), size_t(sent[s])) << "stream " << s;
+        // In order, each exactly once
+        for(int i = 0; i < sent[s]; i++) EXPECT_EQ(seen[s][i], i) << "stream " << s;
+    }
+    auto stats = sync.getStats();
+    EXPECT_EQ(stats.bundles, uint64_t(video));
+    EXPECT_EQ(stats.overflow, 0u);
+    EXPECT_EQ(stats.evicted, uint64_t(tof + pdaf) - stats.matched[kTof] - stats.matched[kPdaf]);
+    EXPECT_GT(stats.matchRate(kPdaf), 0.5);
+    EXPECT_LT(stats.matchRate(kTof), 0.5);
+}
+
+// Without reference messages, other streams wait at most maxWait
+TEST(StreamSync, NoReferenceReleasesAfterMaxWait) {
+    const auto maxWait = std::chrono::milliseconds(10);
+    Sync sync(2, std::chrono::nanoseconds(5 * kMs), kVideo, 16, maxWait);
+    sync.push(kTof, 0, 1);
+    sync.push(kTof, kFrameNs, 2);
+    Sync::Bundle bundle;
+    EXPECT_FALSE(sync.tryPop(bundle));
+    auto bundles = flush(sync, maxWait);
+    ASSERT_EQ(bundles.size(), 2u);
+    EXPECT_TRUE(bundles[0].single());
+    EXPECT_EQ(bundles[0].items[kTof], 1);
+    EXPECT_EQ(bundles[1].items[kTof], 2);
+    EXPECT_EQ(sync.getStats().bundles, 0u);
+    EXPECT_EQ(sync.getStats().evicted, 2u);
+}
+
+// A silent stream doesn't hold the reference back longer than maxWait
+TEST(StreamSync, MaxWaitExpiry) {
+    const auto maxWait = std::chrono::milliseconds(10);
+    Sync sync(2, std::chrono::nanoseconds(5 * kMs), kVideo, 16, maxWait);
+    sync.push(kVideo, 0, 7);
+    Sync::Bundle bundle;
+    EXPECT_FALSE(sync.tryPop(bundle));
+    std::this_thread::sleep_for(maxWait + std::chrono::milliseconds(2));
+    ASSERT_TRUE(sync.tryPop(bundle));
+    EXPECT_EQ(bundle.items[kVideo], 7);
+    EXPECT_FALSE(bundle.has(kTof));
+    auto stats = sync.getStats();
+    EXPECT_EQ(stats.bundles, 1u);
+    EXPECT_EQ(stats.complete, 0u);
+    EXPECT_DOUBLE_EQ(stats.matchRate(kTof), 0.0);
+    EXPECT_GE(stats.maxLatencyUs, uint64_t(std::chrono::microseconds(maxWait).count()));
+}
+
+TEST(StreamSync, BoundedBuffers) {
+    Sync sync(2, std::chrono::nanoseconds(kMs), kVideo, 4, std::chrono::milliseconds(1000));
+    std::vector<Sync::Bundle> bundles;
+    for(int i = 0; i < 10; i++) {
+        sync.push(kTof, i * kMs, i);
+        auto ready = drain(sync);
+        bundles.insert(bundles.end(), ready.begin(), ready.end());
+    }
+    // The six oldest were pushed out of the stream buffer and came out alone
+    ASSERT_EQ(bundles.size(), 6u);
+    for(int i = 0; i < 6; i++) {
+        EXPECT_TRUE(bundles[i].single());
+        EXPECT_EQ(bundles[i].items[kTof], i);
+    }
+    EXPECT_EQ(sync.getStats().evicted, 6u);
+    EXPECT_EQ(sync.getStats().overflow, 0u);
+    // So the reference at 5 ms gets the one at 6 ms
+    sync.push(kVideo, 5 * kMs, 0);
+    bundles = drain(sync);
+    ASSERT_EQ(bundles.size(), 1u);
+    ASSERT_TRUE(bundles[0].has(kTof));
+    EXPECT_EQ(bundles[0].items[kTof], 6);
+
+    // Only a full output drops anything: nine more are pushed out, four of them fit
+    for(int i = 10; i < 20; i++) sync.push(kTof, i * kMs, i);
+    EXPECT_EQ(sync.getStats().evicted, 15u);
+    EXPECT_EQ(sync.getStats().overflow, 5u);
+}
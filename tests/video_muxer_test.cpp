@@ -0,0 +1,323 @@
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "VideoMuxer.hpp"
+
+namespace {
+
+constexpr int64_t kFrameNs = 40000000;  // 25 fps
+constexpr int kGop = 25;                // a keyframe per second
+constexpr int kFrames = 4 * kGop;
+constexpr int64_t kStartNs = 123456789000;
+
+using Bytes = std::vector<uint8_t>;
+
+// ---- canned access units ----
+
+struct CannedStream {
+    VideoCodec codec;
+    Bytes vps, sps, pps;
+    std::vector<Bytes> frames;  // Annex B access units
+    std::vector<std::vector<Bytes>> nals;  // NAL units of each frame, without start codes
+};
+
+void appendNal(Bytes& au, std::vector<Bytes>& nals, const Bytes& nal, bool longStartCode) {
+    if(longStartCode) au.push_back(0);
+    au.insert(au.end(), {0, 0, 1});
+    au.insert(au.end(), nal.begin(), nal.end());
+    nals.push_back(nal);
+}
+
+// Slice payload with bytes that look like start codes once escaped, and no trailing zero
+Bytes slice(Bytes header, int frame) {
+    for(int i = 0; i < 200 + frame * 13; i++) header.push_back(static_cast<uint8_t>(i % 7 == 0 ? 0 : i * 31 + frame));
+    header.insert(header.end(), {0, 0, 3, 1, 0x80});
+    return header;
+}
+
+CannedStream cannedStream(VideoCodec codec) {
+    CannedStream s;
+    s.codec = codec;
+    if(codec == VideoCodec::H264) {
+        s.sps = {0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40, 0x78, 0x02, 0x27, 0xE5, 0xC0};
+        s.pps = {0x68, 0xEB, 0xE3, 0xCB, 0x22, 0xC0};
+    } else {
+        s.vps = {0x40, 0x01, 0x0C, 0x01, 0xFF, 0xFF, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x95, 0x98, 0x09};
+        // 2-byte header, then vps id / sub layers and the profile-tier-level with an emulation prevention byte
+        s.sps = {0x42, 0x01, 0x01, 0x01, 0x60, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0x00, 0x99, 0xA0, 0x01, 0xE0};
+        s.pps = {0x44, 0x01, 0xC1, 0x72, 0xB4, 0x62, 0x40};
+    }
+    for(int i = -1; i < kFrames; i++) {
+        Bytes au;
+        std::vector<Bytes> nals;
+        bool key = i >= 0 && i % kGop == 0;
+        if(key) {
+            if(codec == VideoCodec::H265) appendNal(au, nals, s.vps, true);
+            appendNal(au, nals, s.sps, true);
+            appendNal(au, nals, s.pps, false);
+        }
+        // Frame -1: a P-frame before the first keyframe, which the muxer must skip
+        Bytes header = codec == VideoCodec::H264 ? (key ? Bytes{0x65, 0x88} : Bytes{0x41, 0x9A}) : (key ? Bytes{0x26, 0x01} : Bytes{0x02, 0x01});
+        appendNal(au, nals, slice(header, i), key);
+        // trailing_zero_8bits after the last NAL unit
+        au.insert(au.end(), {0, 0});
+        s.frames.push_back(au);
+        s.nals.push_back(nals);
+    }
+    return s;
+}
+
+// ---- EBML reader ----
+
+struct Element {
+    uint32_t id = 0;
+    size_t offset = 0;      // of the id
+    size_t dataOffset = 0;  // of the body
+    uint64_t size = 0;
+    bool unknownSize = false;
+
+    size_t end() const {
+        return dataOffset + static_cast<size_t>(size);
+    }
+};
+
+int vintLength(uint8_t first) {
+    for(int len = 1; len <= 8; len++) {
+        if(first & (0x80 >> (len - 1))) return len;
+    }
+    return 0;
+}
+
+bool readElement(const Bytes& file, size_t offset, size_t limit, Element& e) {
+    if(offset >= limit) return false;
+    int idLen = vintLength(file[offset]);
+    if(idLen < 1 || idLen > 4 || offset + idLen >= limit) return false;
+    e.offset = offset;
+    e.id = 0;
+    for(int i = 0; i < idLen; i++) e.id = e.id << 8 | file[offset + i];
+    size_t p = offset + idLen;
+    int sizeLen = vintLength(file[p]);
+    if(sizeLen < 1 || p + sizeLen > limit) return false;
+    uint64_t size = file[p] & (0xFF >> sizeLen);
+    bool allOnes = size == uint64_t(0xFF >> sizeLen);
+    for(int i = 1; i < sizeLen; i++) {
+        size = size << 8 | file[p + i];
+        allOnes = allOnes && file[p + i] == 0xFF;
+    }
+    e.dataOffset = p + sizeLen;
+    e.unknownSize = allOnes;
+    e.size = allOnes ? limit - e.dataOffset : size;
+    return e.dataOffset + e.size <= limit;
+}
+
+// Children of [begin, end); fails the test on a malformed element
+std::vector<Element> children(const Bytes& file, size_t begin, size_t end) {
+    std::vector<Element> out;
+    for(size_t p = begin; p < end;) {
+        Element e;
+        if(!readElement(file, p, end, e)) {
+            ADD_FAILURE() << "malformed element at " << p;
+            break;
+        }
+        out.push_back(e);
+        p = e.end();
+    }
+    return out;
+}
+std::vector<Element> children(const Bytes& file, const Element& parent) {
+    return children(file, parent.dataOffset, parent.end());
+}
+
+const Element* find(const std::vector<Element>& elements, uint32_t id) {
+    for(const auto& e : elements) {
+        if(e.id == id) return &e;
+    }
+    return nullptr;
+}
+
+uint64_t readUInt(const Bytes& file, const Element& e) {
+    uint64_t v = 0;
+    for(size_t i = 0; i < e.size; i++) v = v << 8 | file[e.dataOffset + i];
+    return v;
+}
+
+std::string readString(const Bytes& file, const Element& e) {
+    return std::string(file.begin() + e.dataOffset, file.begin() + e.end());
+}
+
+Bytes readBinary(const Bytes& file, const Element& e) {
+    return Bytes(file.begin() + e.dataOffset, file.begin() + e.end());
+}
+
+Bytes readFile(const std::string& path) {
+    Bytes data;
+    FILE* f = fopen(path.c_str(), "rb");
+    if(!f) return data;
+    fseek(f, 0, SEEK_END);
+    data.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    size_t n = fread(data.data(), 1, data.size(), f);
+    fclose(f);
+    data.resize(n);
+    return data;
+}
+
+Bytes expectedCodecPrivate(const CannedStream& s) {
+    Bytes out;
+    if(s.codec == VideoCodec::H264) {
+        out = {1, s.sps[1], s.sps[2], s.sps[3], 0xFF, 0xE1, 0, static_cast<uint8_t>(s.sps.size())};
+        out.insert(out.end(), s.sps.begin(), s.sps.end());
+        out.insert(out.end(), {1, 0, static_cast<uint8_t>(s.pps.size())});
+        out.insert(out.end(), s.pps.begin(), s.pps.end());
+        return out;
+    }
+    // Profile space/tier/idc, 4 compatibility bytes, 6 constraint bytes and the level, from
+    // the SPS with its emulation prevention byte removed
+    out = {1, 0x01, 0x60, 0x00, 0x00, 0x00, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x99};
+    out.insert(out.end(), {0xF0, 0x00, 0xFC, 0xFD, 0xF8, 0xF8, 0x00, 0x00, 0x0F, 3});
+    const std::pair<uint8_t, const Bytes*> arrays[] = {{32, &s.vps}, {33, &s.sps}, {34, &s.pps}};
+    for(const auto& a : arrays) {
+        out.insert(out.end(), {static_cast<uint8_t>(0x80 | a.first), 0, 1, 0, static_cast<uint8_t>(a.second->size())});
+        out.insert(out.end(), a.second->begin(), a.second->end());
+    }
+    return out;
+}
+
+void checkRoundTrip(VideoCodec codec) {
+    SCOPED_TRACE(videoCodecName(codec));
+    auto stream = cannedStream(codec);
+    std::string path = ::testing::TempDir() + "video_muxer_test_" + std::to_string(getpid()) + ".mkv";
+    {
+        VideoMuxer muxer;
+        ASSERT_TRUE(muxer.open(path, codec, 1920, 1080, 25));
+        for(size_t i = 0; i < stream.frames.size(); i++) {
+            auto owner = std::make_shared<Bytes>(stream.frames[i]);
+            // Frame -1 comes first, one frame period before the first keyframe
+            int64_t ts = kStartNs + (static_cast<int64_t>(i) - 1) * kFrameNs;
+            ASSERT_TRUE(muxer.write(owner, owner->data(), owner->size(), ts));
+        }
+        muxer.close();
+        auto stats = muxer.getStats();
+        EXPECT_EQ(stats.packets, uint64_t(kFrames));
+        EXPECT_EQ(stats.skipped, 1u);
+        EXPECT_EQ(stats.writeErrors, 0u);
+    }
+    Bytes file = readFile(path);
+    std::remove(path.c_str());
+    ASSERT_FALSE(file.empty());
+
+    auto top = children(file, 0, file.size());
+    ASSERT_EQ(top.size(), 2u);
+
+    // EBML header
+    ASSERT_EQ(top[0].id, 0x1A45DFA3u);
+    auto header = children(file, top[0]);
+    ASSERT_TRUE(find(header, 0x4282));
+    EXPECT_EQ(readString(file, *find(header, 0x4282)), "matroska");
+
+    // The segment's size is known and covers the rest of the file
+    const Element& segment = top[1];
+    ASSERT_EQ(segment.id, 0x18538067u);
+    EXPECT_FALSE(segment.unknownSize);
+    EXPECT_EQ(segment.end(), file.size());
+    auto level1 = children(file, segment);
+
+    // Tracks: codec id, CodecPrivate built from the first keyframe's parameter sets, size
+    const Element* tracks = find(level1, 0x1654AE6B);
+    ASSERT_TRUE(tracks);
+    auto entries = children(file, *tracks);
+    ASSERT_EQ(entries.size(), 1u);
+    auto track = children(file, entries[0]);
+    ASSERT_TRUE(find(track, 0x86));
+    EXPECT_EQ(readString(file, *find(track, 0x86)), codec == VideoCodec::H264 ? "V_MPEG4/ISO/AVC" : "V_MPEGH/ISO/HEVC");
+    ASSERT_TRUE(find(track, 0x63A2));
+    EXPECT_EQ(readBinary(file, *find(track, 0x63A2)), expectedCodecPrivate(stream));
+    ASSERT_TRUE(find(track, 0xE0));
+    auto video = children(file, *find(track, 0xE0));
+    EXPECT_EQ(readUInt(file, *find(video, 0xB0)), 1920u);
+    EXPECT_EQ(readUInt(file, *find(video, 0xBA)), 1080u);
+
+    // Clusters: one per keyframe (a second apart), known sizes, every frame once with its
+    // timestamp, keyframe flag and the NAL units length-prefixed
+    std::vector<const Element*> clusters;
+    for(const auto& e : level1) {
+        if(e.id == 0x1F43B675) clusters.push_back(&e);
+    }
+    ASSERT_EQ(clusters.size(), size_t(kFrames / kGop));
+    int frame = 0;
+    for(size_t c = 0; c < clusters.size(); c++) {
+        EXPECT_FALSE(clusters[c]->unknownSize);
+        auto blocks = children(file, *clusters[c]);
+        ASSERT_FALSE(blocks.empty());
+        ASSERT_EQ(blocks[0].id, 0xE7u);
+        int64_t clusterMs = static_cast<int64_t>(readUInt(file, blocks[0]));
+        EXPECT_EQ(clusterMs, int64_t(c) * 1000);
+        for(size_t b = 1; b < blocks.size(); b++, frame++) {
+            ASSERT_EQ(blocks[b].id, 0xA3u);
+            ASSERT_LT(frame, kFrames);
+            const uint8_t* p = file.data() + blocks[b].dataOffset;
+            EXPECT_EQ(p[0], 0x81);  // track 1
+            int16_t relative = static_cast<int16_t>(p[1] << 8 | p[2]);
+            EXPECT_EQ(clusterMs + relative, frame * kFrameNs / 1000000) << "frame " << frame;
+            EXPECT_EQ((p[3] & 0x80) != 0, frame % kGop == 0) << "frame " << frame;
+            EXPECT_EQ(b == 1, frame % kGop == 0) << "clusters start on keyframes";
+
+            Bytes payload(file.begin() + blocks[b].dataOffset + 4, file.begin() + blocks[b].end());
+            Bytes expected;
+            for(const auto& nal : stream.nals[frame + 1]) {
+                uint32_t n = static_cast<uint32_t>(nal.size());
+                expected.insert(expected.end(), {uint8_t(n >> 24), uint8_t(n >> 16), uint8_t(n >> 8), uint8_t(n)});
+                expected.insert(expected.end(), nal.begin(), nal.end());
+            }
+            EXPECT_EQ(payload, expected) << "frame " << frame;
+        }
+    }
+    EXPECT_EQ(frame, kFrames);
+
+    // Cues: a point per cluster with its time and segment-relative position
+    const Element* cues = find(level1, 0x1C53BB6B);
+    ASSERT_TRUE(cues);
+    auto points = children(file, *cues);
+    ASSERT_EQ(points.size(), clusters.size());
+    for(size_t c = 0; c < points.size(); c++) {
+        auto point = children(file, points[c]);
+        ASSERT_TRUE(find(point, 0xB3));
+        EXPECT_EQ(readUInt(file, *find(point, 0xB3)), c * 1000);
+        ASSERT_TRUE(find(point, 0xB7));
+        auto positions = children(file, *find(point, 0xB7));
+        ASSERT_TRUE(find(positions, 0xF1));
+        EXPECT_EQ(readUInt(file, *find(positions, 0xF1)), clusters[c]->offset - segment.dataOffset);
+    }
+
+    // The SeekHead written on close points at the cues
+    const Element* seekHead = find(level1, 0x114D9B74);
+    ASSERT_TRUE(seekHead);
+    auto seeks = children(file, *seekHead);
+    ASSERT_EQ(seeks.size(), 1u);
+    auto seek = children(file, seeks[0]);
+    ASSERT_TRUE(find(seek, 0x53AC));
+    EXPECT_EQ(readUInt(file, *find(seek, 0x53AC)), cues->offset - segment.dataOffset);
+}
+
+}  // namespace
+
+TEST(VideoMuxer, H264RoundTrip) {
+    checkRoundTrip(VideoCodec::H264);
+}
+
+TEST(VideoMuxer, H265RoundTrip) {
+    checkRoundTrip(VideoCodec::H265);
+}
+
+TEST(VideoMuxer, OpenFailsOnBadPath) {
+    VideoMuxer muxer;
+    EXPECT_FALSE(muxer.open("/nonexistent-dir/out.mkv", VideoCodec::H264, 1920, 1080, 30));
+    EXPECT_FALSE(muxer.write(nullptr, "x", 1, 0));
+}
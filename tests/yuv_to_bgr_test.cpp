@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "YuvToBgr.hpp"
+
+namespace {
+
+// Smooth NV12 content, like a camera frame: gradients with a little noise
+std::vector<uint8_t> smoothNv12(int width, int height) {
+    std::vector<uint8_t> data(size_t(width) * height * 3 / 2);
+    std::mt19937 rng(1);
+    for(int r = 0; r < height; r++) {
+        for(int c = 0; c < width; c++) data[size_t(r) * width + c] = static_cast<uint8_t>(16 + (r + c) * 200 / (width + height) + rng() % 4);
+    }
+    uint8_t* uv = data.data() + size_t(width) * height;
+    for(int r = 0; r < height / 2; r++) {
+        for(int c = 0; c < width / 2; c++) {
+            uv[size_t(r) * width + 2 * c] = static_cast<uint8_t>(64 + c * 128 / (width / 2));
+            uv[size_t(r) * width + 2 * c + 1] = static_cast<uint8_t>(192 - r * 128 / (height / 2));
+        }
+    }
+    return data;
+}
+
+std::vector<uint8_t> flatNv12(int width, int height, uint8_t y, uint8_t u, uint8_t v) {
+    std::vector<uint8_t> data(size_t(width) * height * 3 / 2, y);
+    uint8_t* uv = data.data() + size_t(width) * height;
+    for(size_t i = 0; i < size_t(width) * height / 2; i += 2) {
+        uv[i] = u;
+        uv[i + 1] = v;
+    }
+    return data;
+}
+
+}  // namespace
+
+TEST(YuvToBgr, KernelsMatchScalar) {
+    const int width = 322, height = 242;
+    std::vector<uint8_t> nv12(size_t(width) * height * 3 / 2);
+    std::mt19937 rng(2);
+    for(auto& b : nv12) b = static_cast<uint8_t>(rng());
+    Yuv420Image src = Yuv420Image::nv12(nv12.data(), width, height);
+    std::vector<uint8_t> expected(size_t(width) * height * 3), actual(expected.size());
+    yuv420ToBgr(src, expected.data(), width * 3, ColorKernel::Scalar);
+    yuv420ToBgr(src, actual.data(), width * 3, bestColorKernel());
+    EXPECT_EQ(expected, actual) << colorKernelName(bestColorKernel());
+}
+
+TEST(YuvToBgr, FullResolutionMatchesOpenCV) {
+    const int width = 640, height = 480;
+    auto nv12 = smoothNv12(width, height);
+    cv::Mat src(height * 3 / 2, width, CV_8UC1, nv12.data()), expected;
+    cv::cvtColor(src, expected, cv::COLOR_YUV2BGR_NV12);
+    cv::Mat actual(height, width, CV_8UC3);
+    yuv420ToBgr(Yuv420Image::nv12(nv12.data(), width, height), actual.data, actual.step);
+    EXPECT_EQ(cv::norm(expected, actual, cv::NORM_INF), 0);
+}
+
+// Box areas of hundreds of pixels: a box of 255s must average to 255, not wrap around to 0
+TEST(YuvToBgr, LargeDownscaleKeepsExtremes) {
+    const int width = 1920, height = 1080;
+    for(uint8_t y : {uint8_t(0), uint8_t(255)}) {
+        auto nv12 = flatNv12(width, height, y, 128, 128);
+        Yuv420Image src = Yuv420Image::nv12(nv12.data(), width, height);
+        for(int dstWidth : {480, 64, 16}) {
+            int dstHeight = dstWidth * 9 / 16;
+            std::vector<uint8_t> bgr(size_t(dstWidth) * dstHeight * 3);
+            yuv420ToBgrResized(src, bgr.data(), dstWidth * 3, dstWidth, dstHeight);
+            for(size_t i = 0; i < bgr.size(); i++) ASSERT_EQ(bgr[i], y) << dstWidth << "x" << dstHeight << " at " << i;
+        }
+    }
+}
+
+// The fused path averages Y, U and V before converting, OpenCV converts and then averages, and
+// chroma boxes are rounded out to whole chroma samples: close on camera-like content, not exact
+TEST(YuvToBgr, ResizedMatchesOpenCVAreaResize) {
+    struct Case {
+        int width, height, dstWidth, dstHeight;
+    };
+    for(const Case& c : {Case{3840, 2160, 1280, 720}, Case{1920, 1080, 960, 540}, Case{1920, 1080, 640, 360}}) {
+        auto nv12 = smoothNv12(c.width, c.height);
+        cv::Mat src(c.height * 3 / 2, c.width, CV_8UC1, nv12.data()), full, expected;
+        cv::cvtColor(src, full, cv::COLOR_YUV2BGR_NV12);
+        cv::resize(full, expected, cv::Size(c.dstWidth, c.dstHeight), 0, 0, cv::INTER_AREA);
+        cv::Mat actual(c.dstHeight, c.dstWidth, CV_8UC3);
+        yuv420ToBgrResized(Yuv420Image::nv12(nv12.data(), c.width, c.height), actual.data, actual.step, c.dstWidth, c.dstHeight);
+
+        cv::Mat diff;
+        cv::absdiff(expected, actual, diff);
+        double maxDiff = cv::norm(diff, cv::NORM_INF);
+        double meanDiff = cv::mean(diff.reshape(1))[0];
+        EXPECT_LE(maxDiff, 6) << c.width << "x" << c.height << " -> " << c.dstWidth << "x" << c.dstHeight;
+        EXPECT_LE(meanDiff, 1.0) << c.width << "x" << c.height << " -> " << c.dstWidth << "x" << c.dstHeight;
+    }
+}